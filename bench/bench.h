@@ -0,0 +1,29 @@
+#ifndef XND_BENCH_H
+#define XND_BENCH_H 1
+
+#include <stddef.h>
+#include <time.h>
+
+/** Monotonic clock in nanoseconds. */
+static inline unsigned long long
+xnd_bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long) ts.tv_sec * 1000000000ULL
+	     + (unsigned long long) ts.tv_nsec;
+}
+
+/** Write callback discarding the response body. */
+static inline size_t
+xnd_bench_discard(char *ptr, size_t size, size_t nmemb, void *data)
+{
+	(void) ptr;
+	(void) data;
+
+	return size * nmemb;
+}
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * Offline throughput of the webhook receiver: producer threads submit
+ * invoice and disbursement callbacks, with their token, as a server thread
+ * would hand them over, and a no-op handler runs them on the workers. It
+ * reports the callbacks accepted per second, so the cost of the token check,
+ * the binding and the queue shows without any network in the way.
+ *
+ * Usage: callbacks [EVENTS] [THREADS]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "xendit.h"
+
+#define INVOICE \
+	"{\"id\":\"579c8d61f23fa4ca35e52da4\",\"external_id\":\"inv-1\"," \
+	"\"user_id\":\"5781d19b2e2385880609791c\",\"is_high\":true," \
+	"\"payment_method\":\"BANK_TRANSFER\",\"status\":\"PAID\"," \
+	"\"merchant_name\":\"Xendit\",\"amount\":50000," \
+	"\"paid_amount\":50000,\"bank_code\":\"PERMATA\"," \
+	"\"paid_at\":\"2016-10-12T08:15:03.404Z\"," \
+	"\"payer_email\":\"a@b.c\",\"description\":\"Invoice\"," \
+	"\"currency\":\"IDR\",\"payment_channel\":\"PERMATA\"}"
+
+#define DISBURSEMENT \
+	"{\"id\":\"57e214ba82b034c325e84d6e\",\"user_id\":\"u\"," \
+	"\"external_id\":\"d-1\",\"amount\":150000,\"bank_code\":\"BCA\"," \
+	"\"account_holder_name\":\"MICHAEL CHEN\"," \
+	"\"disbursement_description\":\"Refund\",\"status\":\"COMPLETED\"," \
+	"\"is_instant\":false}"
+
+/** Callbacks per thread. */
+static unsigned long events = 200000UL;
+
+/** Discards events. */
+static void
+discard_event(const xnd_event_t *event, void *data)
+{
+	(void) event;
+	(void) data;
+}
+
+static void *
+run(void *arg)
+{
+	xnd_webhook_t *w = arg;
+	size_t sizes[2] = { sizeof(INVOICE) - 1UL, sizeof(DISBURSEMENT) - 1UL };
+	const char *bodies[2] = { INVOICE, DISBURSEMENT };
+
+	for (unsigned long i = 0UL; i < events; ++i)
+		if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "token",
+		                       bodies[i % 2UL], sizes[i % 2UL]) !=
+		    XND_WEBHOOK_ACCEPTED)
+			return w;
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	xnd_webhook_options_t options = { 4U, 1024U, 1000L };
+	unsigned long threads = 4UL;
+	unsigned long long wall;
+	xnd_webhook_stats_t stats;
+	xnd_webhook_t *w;
+	pthread_t *ids;
+	void *failed = NULL;
+
+	if (argc > 1)
+		events = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		threads = strtoul(argv[2], NULL, 10);
+	if (events == 0UL || threads == 0UL)
+		return EXIT_FAILURE;
+
+	w = xnd_webhook_new(&options);
+	ids = calloc(threads, sizeof(pthread_t));
+	if (w == NULL || ids == NULL ||
+	    xnd_webhook_token(w, "previous") == -1 ||
+	    xnd_webhook_token(w, "token") == -1 ||
+	    xnd_webhook_handler(w, XND_EVENT_INVOICE, discard_event,
+	                        NULL) == -1 ||
+	    xnd_webhook_handler(w, XND_EVENT_DISBURSEMENT, discard_event,
+	                        NULL) == -1)
+		return EXIT_FAILURE;
+
+	wall = xnd_bench_now();
+
+	for (unsigned long i = 0UL; i < threads; ++i)
+		if (pthread_create(&ids[i], NULL, run, w) != 0)
+			return EXIT_FAILURE;
+	for (unsigned long i = 0UL; i < threads; ++i) {
+		void *res;
+
+		pthread_join(ids[i], &res);
+		if (res != NULL)
+			failed = res;
+	}
+
+	/** Handled once the queue is drained */
+	xnd_webhook_stats(w, &stats);
+	xnd_webhook_destroy(w);
+
+	wall = xnd_bench_now() - wall;
+
+	if (failed != NULL)
+		return EXIT_FAILURE;
+
+	printf("threads       %lu\n", threads);
+	printf("events        %lu\n", events * threads);
+	printf("busy          %lu\n", stats.busy);
+	printf("events/s      %.0f\n",
+	       (double) (events * threads) * 1e9 / (double) wall);
+	printf("wall/event    %.0f ns\n",
+	       (double) wall / (double) (events * threads));
+
+	free(ids);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Builds the libraries with link-time and profile-guided optimization: an
+# instrumented build runs the workload and replay benchmarks against local
+# stubs as training, then the same build directory is rebuilt with the
+# collected profiles. Profiles are named after object paths, so both steps
+# must use the same build directory.
+#
+# Usage: pgo.sh [BUILD_DIRECTORY] [CALLS]
+
+set -e
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+DIR=${1:-"$SRC/_pgo_build"}
+CALLS=${2:-20000}
+PROFILES="$DIR/pgo"
+
+rm -rf "$PROFILES"
+
+cmake -S "$SRC" -B "$DIR" -DCMAKE_BUILD_TYPE=Release \
+	-DXND_BUILD_BENCHMARKS=ON -DXND_LTO=ON \
+	-DXND_PGO=generate -DXND_PGO_DIR="$PROFILES"
+cmake --build "$DIR" -j"$(nproc)"
+
+"$DIR/bench/workload" "$CALLS"
+"$DIR/bench/replay" "$((CALLS * 10))"
+
+cmake -S "$SRC" -B "$DIR" -DXND_PGO=use
+cmake --build "$DIR" -j"$(nproc)" --clean-first
+ctest --test-dir "$DIR" --output-on-failure
+"$DIR/bench/workload" "$CALLS"
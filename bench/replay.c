@@ -0,0 +1,108 @@
+/**
+ * Per-call CPU time and allocations of the SDK itself, with every balance
+ * call served by the in-memory replay transport, so neither the network nor
+ * libcurl is measured. Allocations made by json-c are not counted.
+ *
+ * Usage: replay [CALLS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "xendit.h"
+
+static unsigned long allocations;
+
+static void *
+count_malloc(size_t size)
+{
+	++allocations;
+	return malloc(size);
+}
+
+static void *
+count_realloc(void *ptr, size_t size)
+{
+	++allocations;
+	return realloc(ptr, size);
+}
+
+static void *
+count_calloc(size_t nmemb, size_t size)
+{
+	++allocations;
+	return calloc(nmemb, size);
+}
+
+static unsigned long long
+cpu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return (unsigned long long) ts.tv_sec * 1000000000ULL
+	     + (unsigned long long) ts.tv_nsec;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *capture =
+	    "> GET " XND_BASEURL "/balance?account_type=CASH\n"
+	    "< 200 16\n"
+	    "{\"balance\":1000}\n";
+	const xnd_allocator_t allocator = {
+		count_malloc, free, count_realloc, count_calloc, NULL
+	};
+	char path[] = "/tmp/xnd-bench-replay-XXXXXX";
+	unsigned long calls = 100000UL;
+	unsigned long long wall, cpu;
+	unsigned long before;
+	xnd_balance_t balance;
+	xnd_client_t *x;
+	int fd;
+
+	if (argc > 1)
+		calls = strtoul(argv[1], NULL, 10);
+
+	fd = mkstemp(path);
+	if (fd == -1 ||
+	    write(fd, capture, strlen(capture)) != (ssize_t) strlen(capture))
+		return EXIT_FAILURE;
+	close(fd);
+
+	if (calls == 0UL || xnd_sdk_init_with_allocator(&allocator) == -1)
+		return EXIT_FAILURE;
+
+	x = xnd_client_new("secret");
+	if (x == NULL || xnd_client_replay(x, path) == -1)
+		return EXIT_FAILURE;
+	unlink(path);
+
+	before = allocations;
+	wall = xnd_bench_now();
+	cpu = cpu_now();
+
+	for (unsigned long i = 0UL; i < calls; ++i)
+		if (xnd_balance(x, NULL, "CASH", NULL, &balance) == -1)
+			return EXIT_FAILURE;
+
+	cpu = cpu_now() - cpu;
+	wall = xnd_bench_now() - wall;
+
+	printf("calls         %lu\n", calls);
+	printf("cpu/call      %.0f ns\n", (double) cpu / (double) calls);
+	printf("wall/call     %.0f ns\n", (double) wall / (double) calls);
+	printf("allocs/call   %.2f\n",
+	       (double) (allocations - before) / (double) calls);
+
+	xnd_client_destroy(x);
+	xnd_sdk_cleanup();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/**
+ * Scalability of one client shared by threads: balance calls per second from
+ * 1 to N threads, each pinned to a core of its own on Linux, against
+ * in-process stubs over loopback which the endpoint set of the client spreads
+ * the calls over. Throughput should grow with the threads until the cores, or
+ * the stubs, run out; the stubs take cores too, so the host is best given
+ * about twice the threads measured.
+ *
+ * Usage: scaling [CALLS] [THREADS]
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "xendit.h"
+#include "support/stub_server.h"
+
+/** Calls per thread and run. */
+static unsigned long calls = 20000UL;
+
+/** Thread of a run. */
+typedef struct worker_t {
+	const xnd_client_t *x;
+	pthread_barrier_t  *start;
+	unsigned long       cpu;
+	int                 failed;
+} worker_t;
+
+static void *
+run(void *arg)
+{
+	worker_t *w = arg;
+	xnd_balance_t balance;
+
+#ifdef __linux__
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+
+	pthread_barrier_wait(w->start);
+
+	for (unsigned long i = 0UL; i < calls; ++i) {
+		if (xnd_balance(w->x, NULL, "CASH", NULL, &balance) == -1) {
+			w->failed = 1;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/** Runs the calls on a number of threads, returns the wall time in ns. */
+static unsigned long long
+measure(const xnd_client_t *x, unsigned long threads, unsigned long cpus)
+{
+	pthread_barrier_t start;
+	unsigned long long wall;
+	pthread_t *ids;
+	worker_t *workers;
+	int failed = 0;
+
+	ids = calloc(threads, sizeof(pthread_t));
+	workers = calloc(threads, sizeof(worker_t));
+	if (ids == NULL || workers == NULL ||
+	    pthread_barrier_init(&start, NULL, (unsigned int) threads + 1U))
+		return 0ULL;
+
+	for (unsigned long i = 0UL; i < threads; ++i) {
+		workers[i].x = x;
+		workers[i].start = &start;
+		workers[i].cpu = i % cpus;
+		if (pthread_create(&ids[i], NULL, run, &workers[i]) != 0)
+			return 0ULL;
+	}
+
+	pthread_barrier_wait(&start);
+	wall = xnd_bench_now();
+
+	for (unsigned long i = 0UL; i < threads; ++i) {
+		pthread_join(ids[i], NULL);
+		failed |= workers[i].failed;
+	}
+
+	wall = xnd_bench_now() - wall;
+
+	pthread_barrier_destroy(&start);
+	free(workers);
+	free(ids);
+
+	return failed ? 0ULL : wall;
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *urls[XND_ENDPOINTS_MAX];
+	xnd_stub_t *stubs[XND_ENDPOINTS_MAX];
+	unsigned long threads, cpus, nstubs;
+	unsigned long long wall;
+	double rate, base = 0.0;
+	xnd_context_t *ctx;
+	xnd_client_t *x;
+
+	cpus = (unsigned long) sysconf(_SC_NPROCESSORS_ONLN);
+	threads = cpus;
+	if (argc > 1)
+		calls = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		threads = strtoul(argv[2], NULL, 10);
+	if (calls == 0UL || threads == 0UL || cpus == 0UL)
+		return EXIT_FAILURE;
+
+	xnd_sdk_init();
+
+	nstubs = threads < XND_ENDPOINTS_MAX ? threads : XND_ENDPOINTS_MAX;
+	for (unsigned long i = 0UL; i < nstubs; ++i) {
+		stubs[i] = xnd_stub_new(200, "{\"balance\":1234.5}");
+		if (stubs[i] == NULL)
+			return EXIT_FAILURE;
+		urls[i] = xnd_stub_url(stubs[i]);
+	}
+
+	/** Every thread keeps its connections to the stubs. */
+	ctx = xnd_context_new();
+	x = xnd_client_new_in(ctx, "secret");
+	if (ctx == NULL || x == NULL ||
+	    xnd_context_connections(ctx, (unsigned int) (threads * 2UL)) ||
+	    xnd_client_endpoints(x, urls, (unsigned int) nstubs, NULL) == -1)
+		return EXIT_FAILURE;
+
+	/** Connections, and curl instances, are paid before measuring. */
+	if (measure(x, threads, cpus) == 0ULL)
+		return EXIT_FAILURE;
+
+	printf("calls/thread  %lu\n", calls);
+	printf("cores         %lu\n", cpus);
+	printf("stubs         %lu\n", nstubs);
+	printf("%7s  %10s  %7s  %10s\n", "threads", "calls/s", "speedup",
+	       "efficiency");
+
+	for (unsigned long n = 1UL; n <= threads; ++n) {
+		wall = measure(x, n, cpus);
+		if (wall == 0ULL) {
+			fprintf(stderr, "calls failed\n");
+			return EXIT_FAILURE;
+		}
+
+		rate = (double) (calls * n) * 1e9 / (double) wall;
+		if (n == 1UL)
+			base = rate;
+		printf("%7lu  %10.0f  %6.2fx  %9.0f%%\n", n, rate, rate / base,
+		       rate / base / (double) n * 100.0);
+	}
+
+	xnd_client_destroy(x);
+	xnd_context_destroy(ctx);
+	for (unsigned long i = 0UL; i < nstubs; ++i)
+		xnd_stub_destroy(stubs[i]);
+	xnd_sdk_cleanup();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+/**
+ * Per-request CPU time of the calling thread, with requests sent over TLS
+ * directly and through a local sidecar terminating TLS, on kept-alive
+ * connections. See sidecar.sh for a local stub sidecar.
+ *
+ * Usage: sidecar HTTPS_URL CAFILE SIDECAR [REQUESTS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench.h"
+#include "http_request.h"
+
+static unsigned long long
+thread_cpu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (unsigned long long) ts.tv_sec * 1000000000ULL
+	     + (unsigned long long) ts.tv_nsec;
+}
+
+static int
+measure(const char *url, const char *cafile, const char *sidecar,
+        unsigned long requests, double *cpu, double *wall)
+{
+	xnd_http_pool_t *pool;
+	xnd_http_request_t *req;
+	unsigned long long cpu0, wall0;
+	int res = 0;
+
+	pool = xnd_http_pool_new();
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, url);
+	if (pool == NULL || req == NULL)
+		return -1;
+
+	xnd_http_pool_cainfo(pool, cafile);
+	if (xnd_http_pool_sidecar(pool, sidecar) == -1)
+		return -1;
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_callback(req, xnd_bench_discard);
+
+	/** The connection, and the handshake, are paid before measuring. */
+	if (xnd_http_request_send_with_data(req, NULL) == -1)
+		return -1;
+
+	cpu0 = thread_cpu_now();
+	wall0 = xnd_bench_now();
+
+	for (unsigned long i = 0UL; i < requests && res == 0; ++i)
+		res = xnd_http_request_send_with_data(req, NULL);
+
+	*cpu = (double) (thread_cpu_now() - cpu0) / (double) requests;
+	*wall = (double) (xnd_bench_now() - wall0) / (double) requests;
+
+	xnd_http_request_destroy(req);
+	xnd_http_pool_destroy(pool);
+
+	return res;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long requests = 10000UL;
+	double cpu[2], wall[2];
+
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s HTTPS_URL CAFILE SIDECAR "
+		        "[REQUESTS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 4)
+		requests = strtoul(argv[4], NULL, 10);
+	if (requests == 0UL)
+		return EXIT_FAILURE;
+
+	xnd_http_request_init();
+
+	if (measure(argv[1], argv[2], NULL, requests, &cpu[0], &wall[0]) ||
+	    measure(argv[1], argv[2], argv[3], requests, &cpu[1], &wall[1])) {
+		fprintf(stderr, "request failed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("requests      %lu\n", requests);
+	printf("%-12s  %8s  %8s\n", "", "cpu/req", "wall/req");
+	printf("%-12s  %5.0f ns  %5.0f ns\n", "direct tls", cpu[0], wall[0]);
+	printf("%-12s  %5.0f ns  %5.0f ns\n", "sidecar", cpu[1], wall[1]);
+
+	xnd_http_request_cleanup();
+
+	return EXIT_SUCCESS;
+}
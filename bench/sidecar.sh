@@ -0,0 +1,60 @@
+#!/bin/sh
+# Runs the sidecar benchmark against a local keep-alive stub serving HTTPS on
+# loopback, as Xendit would, and plain HTTP on a Unix domain socket, as a
+# TLS-terminating sidecar would, with a throwaway self-signed certificate.
+#
+# Usage: sidecar.sh PATH_TO_SIDECAR_BINARY [REQUESTS] [PORT]
+
+set -e
+
+BIN=${1:?usage: $0 PATH_TO_SIDECAR_BINARY [REQUESTS] [PORT]}
+REQUESTS=${2:-10000}
+PORT=${3:-18444}
+DIR=$(mktemp -d)
+
+trap 'kill $PID 2>/dev/null; rm -rf "$DIR"' EXIT INT TERM
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 \
+	-subj "/CN=localhost" -addext "subjectAltName=DNS:localhost" \
+	-keyout "$DIR/key.pem" -out "$DIR/cert.pem" 2>/dev/null
+
+python3 - "$PORT" "$DIR" <<'PY' &
+import http.server, socketserver, ssl, sys, threading
+
+class Stub(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        body = b'{"balance":1000}'
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+class TcpStub(Stub):
+    disable_nagle_algorithm = True
+
+class Unix(socketserver.ThreadingMixIn, socketserver.UnixStreamServer):
+    daemon_threads = True
+
+class Tcp(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+port, dir = int(sys.argv[1]), sys.argv[2]
+ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+ctx.load_cert_chain(dir + "/cert.pem", dir + "/key.pem")
+tls = Tcp(("127.0.0.1", port), TcpStub)
+tls.socket = ctx.wrap_socket(tls.socket, server_side=True)
+threading.Thread(target=Unix(dir + "/sidecar.sock", Stub).serve_forever,
+                 daemon=True).start()
+tls.serve_forever()
+PY
+PID=$!
+sleep 1
+
+"$BIN" "https://localhost:$PORT/balance" "$DIR/cert.pem" \
+	"unix:$DIR/sidecar.sock" "$REQUESTS"
@@ -0,0 +1,131 @@
+/**
+ * First-request latency with a cold and a warm persistent TLS session cache.
+ * Each measurement runs in a fresh process, so nothing but the cache file is
+ * carried over, see tls_session.sh for a local TLS stub.
+ *
+ * Usage: tls_session URL CAFILE CACHEFILE [ROUNDS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "http_request.h"
+
+static int
+first_request(const char *url, const char *cafile, const char *cache,
+              unsigned long long *elapsed, int *resumed)
+{
+	xnd_http_pool_t *pool;
+	xnd_http_request_t *req;
+	unsigned long long start;
+	int res;
+
+	xnd_http_request_init();
+
+	pool = xnd_http_pool_new();
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, url);
+	if (pool == NULL || req == NULL)
+		return -1;
+
+	xnd_http_pool_cainfo(pool, cafile);
+	*resumed = xnd_http_pool_tls_cache(pool, cache, 0L);
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_callback(req, xnd_bench_discard);
+
+	start = xnd_bench_now();
+	res = xnd_http_request_send_with_data(req, NULL);
+	*elapsed = xnd_bench_now() - start;
+
+	xnd_http_request_destroy(req);
+	xnd_http_pool_destroy(pool);
+	xnd_http_request_cleanup();
+
+	return res;
+}
+
+static int
+measure(const char *url, const char *cafile, const char *cache,
+        unsigned long long *elapsed, int *resumed)
+{
+	int fds[2], status, result[2];
+	pid_t pid;
+
+	if (pipe(fds) == -1)
+		return -1;
+
+	pid = fork();
+	if (pid == 0) {
+		unsigned long long ns = 0ULL;
+		int n = 0;
+
+		close(fds[0]);
+		if (first_request(url, cafile, cache, &ns, &n) != 0)
+			_exit(EXIT_FAILURE);
+		if (write(fds[1], &ns, sizeof(ns)) != sizeof(ns) ||
+		    write(fds[1], &n, sizeof(n)) != sizeof(n))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+	result[0] = read(fds[0], elapsed, sizeof(*elapsed)) == sizeof(*elapsed);
+	result[1] = read(fds[0], resumed, sizeof(*resumed)) == sizeof(*resumed);
+	close(fds[0]);
+
+	if (pid == -1 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS || !result[0] || !result[1])
+		return -1;
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long long cold = 0ULL, warm = 0ULL, ns;
+	int rounds, resumed;
+
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s URL CAFILE CACHEFILE [ROUNDS]\n",
+		        argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	rounds = (argc > 4) ? atoi(argv[4]) : 20;
+	if (rounds <= 0)
+		rounds = 1;
+
+	for (int i = 0; i < rounds; ++i) {
+		unlink(argv[3]);
+
+		if (measure(argv[1], argv[2], argv[3], &ns, &resumed) != 0)
+			goto fail;
+		if (resumed < 0) {
+			fprintf(stderr, "TLS session cache unavailable, it needs "
+			        "libcurl built with SSL session export\n");
+			exit(EXIT_FAILURE);
+		}
+		cold += ns;
+
+		if (measure(argv[1], argv[2], argv[3], &ns, &resumed) != 0)
+			goto fail;
+		if (resumed <= 0) {
+			fprintf(stderr, "no session resumed from the cache\n");
+			exit(EXIT_FAILURE);
+		}
+		warm += ns;
+	}
+
+	printf("rounds:              %d\n", rounds);
+	printf("cold cache, mean us: %.1f\n", (double) cold / rounds / 1e3);
+	printf("warm cache, mean us: %.1f\n", (double) warm / rounds / 1e3);
+
+	exit(EXIT_SUCCESS);
+
+fail:
+	fprintf(stderr, "request to %s failed\n", argv[1]);
+	exit(EXIT_FAILURE);
+}
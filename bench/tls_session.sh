@@ -0,0 +1,25 @@
+#!/bin/sh
+# Runs the TLS session cache benchmark against a local `openssl s_server`
+# stub with a throwaway self-signed certificate.
+#
+# Usage: tls_session.sh PATH_TO_TLS_SESSION_BINARY [ROUNDS] [PORT]
+
+set -e
+
+BIN=${1:?usage: $0 PATH_TO_TLS_SESSION_BINARY [ROUNDS] [PORT]}
+ROUNDS=${2:-20}
+PORT=${3:-18443}
+DIR=$(mktemp -d)
+
+trap 'kill $PID 2>/dev/null; rm -rf "$DIR"' EXIT INT TERM
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 \
+	-subj "/CN=localhost" -addext "subjectAltName=DNS:localhost" \
+	-keyout "$DIR/key.pem" -out "$DIR/cert.pem" 2>/dev/null
+
+openssl s_server -quiet -www -accept "$PORT" \
+	-cert "$DIR/cert.pem" -key "$DIR/key.pem" >/dev/null 2>&1 &
+PID=$!
+sleep 1
+
+"$BIN" "https://localhost:$PORT/" "$DIR/cert.pem" "$DIR/tls.cache" "$ROUNDS"
@@ -0,0 +1,171 @@
+/**
+ * Per-request system calls, CPU time and wall time of the calling thread,
+ * with requests sent to a local stub sidecar over loopback by libcurl and by
+ * the io_uring transport, on kept-alive connections. System calls are
+ * counted with the raw_syscalls:sys_enter tracepoint, which needs tracefs
+ * mounted and perf events allowed; they read n/a otherwise, `strace -c`
+ * then tells them.
+ *
+ * Usage: uring [REQUESTS]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "bench.h"
+#include "http_request.h"
+#include "support/stub_server.h"
+
+/** Counter of the system calls of the calling thread, -1 if unavailable. */
+static int
+syscalls_open(void)
+{
+	static const char *const paths[] = {
+		"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+		"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+	};
+	struct perf_event_attr attr;
+	unsigned long long id = 0ULL;
+	FILE *fp;
+
+	for (size_t i = 0UL; i < 2UL && id == 0ULL; ++i) {
+		fp = fopen(paths[i], "r");
+		if (fp == NULL)
+			continue;
+		if (fscanf(fp, "%llu", &id) != 1)
+			id = 0ULL;
+		fclose(fp);
+	}
+	if (id == 0ULL)
+		return -1;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.size = sizeof(attr);
+	attr.config = id;
+	attr.disabled = 1;
+
+	return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0UL);
+}
+
+static unsigned long long
+thread_cpu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (unsigned long long) ts.tv_sec * 1000000000ULL
+	     + (unsigned long long) ts.tv_nsec;
+}
+
+static int
+measure(const char *sidecar, const xnd_http_transport_t *t,
+        unsigned long requests, double *calls, double *cpu, double *wall)
+{
+	xnd_http_pool_t *pool;
+	xnd_http_request_t *req;
+	unsigned long long cpu0, wall0, count = 0ULL;
+	int res = 0, fd;
+
+	pool = xnd_http_pool_new();
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET,
+	                           "https://api.xendit.co/balance");
+	if (pool == NULL || req == NULL ||
+	    xnd_http_pool_sidecar(pool, sidecar) == -1)
+		return -1;
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_transport(req, t);
+	xnd_http_request_basic_auth(req, "secret", NULL);
+	xnd_http_request_callback(req, xnd_bench_discard);
+
+	/** The connection is opened before measuring. */
+	if (xnd_http_request_send_with_data(req, NULL) == -1)
+		return -1;
+
+	fd = syscalls_open();
+	if (fd != -1)
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	cpu0 = thread_cpu_now();
+	wall0 = xnd_bench_now();
+
+	for (unsigned long i = 0UL; i < requests && res == 0; ++i)
+		res = xnd_http_request_send_with_data(req, NULL);
+
+	*cpu = (double) (thread_cpu_now() - cpu0) / (double) requests;
+	*wall = (double) (xnd_bench_now() - wall0) / (double) requests;
+	*calls = -1.0;
+	if (fd != -1) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &count, sizeof(count)) == (ssize_t) sizeof(count))
+			*calls = (double) count / (double) requests;
+		close(fd);
+	}
+
+	xnd_http_request_destroy(req);
+	xnd_http_pool_destroy(pool);
+
+	return res;
+}
+
+static void
+report(const char *name, double calls, double cpu, double wall)
+{
+	if (calls < 0.0)
+		printf("%-12s  %9s  %5.0f ns  %5.0f ns\n", name, "n/a", cpu,
+		       wall);
+	else
+		printf("%-12s  %9.1f  %5.0f ns  %5.0f ns\n", name, calls, cpu,
+		       wall);
+}
+
+int
+main(int argc, char **argv)
+{
+	unsigned long requests = 20000UL;
+	double calls[2], cpu[2], wall[2];
+	xnd_http_transport_t *uring;
+	xnd_stub_t *stub;
+
+	if (argc > 1)
+		requests = strtoul(argv[1], NULL, 10);
+	if (requests == 0UL)
+		return EXIT_FAILURE;
+
+	xnd_http_request_init();
+
+	stub = xnd_stub_new(200, "{\"balance\":1234.5}");
+	uring = xnd_http_transport_uring_new();
+	if (stub == NULL || uring == NULL) {
+		fprintf(stderr, "io_uring unavailable\n");
+		return EXIT_FAILURE;
+	}
+
+	if (measure(xnd_stub_url(stub), NULL, requests, &calls[0], &cpu[0],
+	            &wall[0]) ||
+	    measure(xnd_stub_url(stub), uring, requests, &calls[1], &cpu[1],
+	            &wall[1])) {
+		fprintf(stderr, "request failed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("requests      %lu\n", requests);
+	printf("%-12s  %9s  %8s  %8s\n", "", "calls/req", "cpu/req",
+	       "wall/req");
+	report("curl", calls[0], cpu[0], wall[0]);
+	report("io_uring", calls[1], cpu[1], wall[1]);
+	printf("req/s         %.0f curl, %.0f io_uring\n", 1e9 / wall[0],
+	       1e9 / wall[1]);
+
+	xnd_http_transport_destroy(uring);
+	xnd_stub_destroy(stub);
+	xnd_http_request_cleanup();
+
+	return EXIT_SUCCESS;
+}
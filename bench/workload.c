@@ -0,0 +1,127 @@
+/**
+ * Representative workload of the SDK against an in-process stub over
+ * loopback: balance calls of the master and sub-accounts, with and without
+ * filters, and small downloads, from several threads sharing one client with
+ * its limiter, breakers and retries on. It is the training run of PGO builds,
+ * see pgo.sh, and reports the throughput of the client.
+ *
+ * Usage: workload [CALLS] [THREADS]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "xendit.h"
+#include "support/stub_server.h"
+
+/** Calls per thread. */
+static unsigned long calls = 20000UL;
+
+/** Discards downloaded chunks. */
+static int
+discard_chunk(const char *chunk, size_t size, void *data)
+{
+	(void) chunk;
+	(void) size;
+	(void) data;
+
+	return 0;
+}
+
+static void *
+run(void *arg)
+{
+	static const char *const types[] = { "CASH", "HOLDING", "TAX" };
+	xnd_client_t *x = arg;
+	xnd_balance_t balance;
+	xnd_sink_t *sink;
+	char user[32];
+
+	for (unsigned long i = 0UL; i < calls; ++i) {
+		if (i % 16UL == 15UL) {
+			sink = xnd_sink_callback(discard_chunk, NULL, 1UL << 20);
+			if (sink == NULL ||
+			    xnd_client_download(x, XND_BASEURL "/reports/1",
+			                        sink) == -1)
+				return x;
+			xnd_sink_destroy(sink);
+			continue;
+		}
+
+		snprintf(user, sizeof(user), "5f%022lu", i % 16UL);
+		if (xnd_balance(x, i % 4UL == 0UL ? user : NULL,
+		                types[i % 3UL], i % 2UL ? "IDR" : NULL,
+		                &balance) == -1)
+			return x;
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	xnd_concurrency_options_t concurrency = { 8U, 1U, 64U, 4.0, 1000L,
+	                                          { 0U, 0U }, 0.0 };
+	xnd_breaker_options_t breaker = { 5U, 1000L, 1U };
+	xnd_timeouts_t timeouts = { 1000L, 5000L, 0L, 0L, 2U };
+	unsigned long threads = 4UL;
+	unsigned long long wall;
+	pthread_t *ids;
+	xnd_stub_t *stub;
+	xnd_client_t *x;
+	void *failed = NULL;
+
+	if (argc > 1)
+		calls = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		threads = strtoul(argv[2], NULL, 10);
+	if (calls == 0UL || threads == 0UL)
+		return EXIT_FAILURE;
+
+	xnd_sdk_init();
+
+	stub = xnd_stub_new(200, "{\"balance\":1234.5}");
+	x = xnd_client_new("secret");
+	ids = calloc(threads, sizeof(pthread_t));
+	if (stub == NULL || x == NULL || ids == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) == -1 ||
+	    xnd_client_concurrency(x, &concurrency) == -1 ||
+	    xnd_client_breaker(x, &breaker) == -1 ||
+	    xnd_client_timeouts(x, &timeouts) == -1)
+		return EXIT_FAILURE;
+
+	wall = xnd_bench_now();
+
+	for (unsigned long i = 0UL; i < threads; ++i)
+		if (pthread_create(&ids[i], NULL, run, x) != 0)
+			return EXIT_FAILURE;
+	for (unsigned long i = 0UL; i < threads; ++i) {
+		void *res;
+
+		pthread_join(ids[i], &res);
+		if (res != NULL)
+			failed = res;
+	}
+
+	wall = xnd_bench_now() - wall;
+
+	if (failed != NULL)
+		return EXIT_FAILURE;
+
+	printf("threads       %lu\n", threads);
+	printf("calls         %lu\n", calls * threads);
+	printf("calls/s       %.0f\n",
+	       (double) (calls * threads) * 1e9 / (double) wall);
+	printf("wall/call     %.0f ns\n",
+	       (double) wall / (double) (calls * threads));
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+	xnd_sdk_cleanup();
+	free(ids);
+
+	return EXIT_SUCCESS;
+}
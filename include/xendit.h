@@ -11,33 +11,110 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+#include <stdint.h>
+
+/** The public API is exported from the shared library, built with hidden
+    visibility, and nothing else. */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
 #define XND_BASEURL "https://api.xendit.co"
 
 /**
  * \brief Xendit client opaque object.
+ *
+ * \details A client is set up first, then shared: functions taking a
+ * `const xnd_client_t *`, i.e. API calls and statistics, may be called from
+ * any number of threads at once on one client. Functions taking a
+ * `xnd_client_t *` change its settings, and must not overlap with any other
+ * function on the same client, nor with calls in flight. The same goes for
+ * the clients of a context and the functions setting the context up.
+ *
+ * Calls take no SDK-wide lock: each thread keeps a few curl instances of
+ * its own, reset between calls and handed over to another thread once it
+ * exits. Connections, DNS entries and TLS sessions are shared by the pool
+ * of the context under its own locks, as are the limiter, the breakers and
+ * the balance cache when set. `xnd_sdk_cleanup()` must come after every
+ * thread is done with the SDK.
  */
 typedef struct xnd_client_t xnd_client_t;
 
 /**
- * \brief Sets up the environment for Xendit SDK.
+ * \brief Xendit client context opaque object.
+ */
+typedef struct xnd_context_t xnd_context_t;
+
+/**
+ * \brief Sets up the environment for Xendit SDK. It is thread-safe and may be
+ * called more than once, each call balanced by `xnd_sdk_cleanup()`. Calling
+ * it is optional, the first client sets the environment up otherwise.
+ *
+ * \details The SDK is fork-safe: in a child process, connections inherited
+ * from the parent are closed on the child side only and calls in flight in
+ * the parent are forgotten, as are the DNS entries and TLS sessions libcurl
+ * keeps in memory. Settings, pinned addresses, and the balance and TLS
+ * session cache files are kept. A pre-fork server may thus set its clients
+ * up in the parent.
  */
 extern void
 xnd_sdk_init(void);
 
 /**
- * \brief Cleans up the Xendit SDK environment.
+ * \brief User-supplied allocator, with the semantics of their C library
+ * counterparts.
+ */
+typedef struct xnd_allocator_t {
+	void *(*malloc_fn)  (size_t size);                /** Required. */
+	void  (*free_fn)    (void *ptr);                  /** Required. */
+	void *(*realloc_fn) (void *ptr, size_t size);     /** Required. */
+	void *(*calloc_fn)  (size_t nmemb, size_t size);  /** Optional. */
+	char *(*strdup_fn)  (const char *str);            /** Optional. */
+} xnd_allocator_t;
+
+/**
+ * \brief Sets up the environment for Xendit SDK with a user-supplied
+ * allocator. Every SDK allocation, and every libcurl allocation, goes through
+ * it until `xnd_sdk_cleanup()`. json-c has no allocator hooks, so JSON
+ * documents are still allocated by the C library. It must be called before
+ * any other SDK function, and instead of the first `xnd_sdk_init()`.
+ * \param allocator The allocator.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_sdk_init_with_allocator(const xnd_allocator_t *allocator);
+
+/**
+ * \brief Cleans up the Xendit SDK environment, once every initialization
+ * has been cleaned up. Clients and contexts still alive keep it set up until
+ * the last of them is destroyed, extra calls do nothing.
  */
 extern void
 xnd_sdk_cleanup(void);
 
 /**
- * \brief Creates new Xendit client.
+ * \brief Creates new Xendit client, with a context of its own.
  * \param key The secret API key.
  * \return NULL on failure.
  */
 extern xnd_client_t *
 xnd_client_new(const char *key);
 
+/**
+ * \brief Creates new Xendit client borrowing a shared context. It holds
+ * nothing but its API key and prebuilt Authorization header, so that many
+ * API keys, e.g. of every merchant of a platform, share one connection pool
+ * and its DNS and TLS caches, one concurrency limiter and one set of circuit
+ * breakers. The pool, limiter and breakers are then set on the context, the
+ * client functions setting them fail.
+ * \param ctx The client context.
+ * \param key The secret API key.
+ * \return NULL on failure.
+ */
+extern xnd_client_t *
+xnd_client_new_in(xnd_context_t *ctx, const char *key);
+
 /**
  * \brief Destroys Xendit client.
  * \param x The Xendit client to destroy.
@@ -45,6 +122,469 @@ xnd_client_new(const char *key);
 extern void
 xnd_client_destroy(xnd_client_t *x);
 
+/**
+ * \brief Options of connection warm-up.
+ */
+typedef struct xnd_warmup_options_t {
+	unsigned int connections;    /** Connections to open ahead of time. */
+	long         keepalive_idle; /** TCP keepalive idle in seconds, 0 keeps
+	                                 the system default. */
+	int          pin_dns;        /** Non-zero resolves the API host once and
+	                                 pins its addresses. */
+} xnd_warmup_options_t;
+
+/** Number of priority lanes. */
+#define XND_PRIORITIES (2)
+
+/**
+ * \brief Priority of the calls of a client, the lane they wait in for a slot
+ * of the concurrency limiter.
+ */
+typedef enum xnd_priority_t {
+	XND_PRIORITY_INTERACTIVE = 0, /** Latency-bound, e.g. checkout. */
+	XND_PRIORITY_BULK        = 1  /** Batch, e.g. reconciliation. */
+} xnd_priority_t;
+
+/**
+ * \brief Statistics of a priority lane of the concurrency limiter.
+ */
+typedef struct xnd_lane_stats_t {
+	unsigned int  queued;       /** Calls waiting for a slot. */
+	unsigned int  in_flight;    /** Calls in flight. */
+	unsigned long admitted;     /** Calls given a slot. */
+	unsigned long rejected;     /** Calls rejected over the limit. */
+	double        wait_mean_ms; /** Mean wait for a slot. */
+	double        wait_p99_ms;  /** 99th percentile of the wait, rounded up
+	                                to a power of two microseconds. */
+	double        wait_max_ms;  /** Longest wait for a slot. */
+} xnd_lane_stats_t;
+
+/**
+ * \brief Xendit client statistics.
+ */
+typedef struct xnd_client_stats_t {
+	unsigned long warm_requests;     /** Requests on reused connections. */
+	unsigned long cold_requests;     /** Requests opening a connection. */
+	unsigned int  concurrency_limit; /** Current limit, 0 if unlimited. */
+	unsigned int  in_flight;         /** Calls in flight, if limited. */
+	unsigned long limited_requests;  /** Calls rejected over the limit. */
+	unsigned long broken_requests;   /** Calls failed fast by a breaker. */
+	xnd_lane_stats_t lanes[XND_PRIORITIES]; /** Lanes, if limited. */
+} xnd_client_stats_t;
+
+/**
+ * \brief Adaptive concurrency limiter options.
+ */
+typedef struct xnd_concurrency_options_t {
+	unsigned int initial;   /** Initial limit of calls in flight. */
+	unsigned int min;       /** Lower bound of the limit, at least 1. */
+	unsigned int max;       /** Upper bound of the limit. */
+	double       tolerance; /** Latency over its baseline seen as
+	                            congestion, e.g. 2.0. */
+	long         wait_ms;   /** Maximum wait for a slot, 0 rejects calls
+	                            over the limit right away. */
+	unsigned int weights[XND_PRIORITIES]; /** Share of slots given to the
+	                                          waiting calls of each lane,
+	                                          zeroes for 4:1. */
+	double       reserved;  /** Share of the limit bulk calls never take,
+	                            from 0 to 1 excluded. */
+} xnd_concurrency_options_t;
+
+/**
+ * \brief Circuit breaker options.
+ */
+typedef struct xnd_breaker_options_t {
+	unsigned int failures;    /** Consecutive failures opening a breaker. */
+	long         cooldown_ms; /** Time open before probing again. */
+	unsigned int probes;      /** Probe calls at once when half-open. */
+} xnd_breaker_options_t;
+
+/**
+ * \brief State of the circuit breaker of an endpoint.
+ */
+typedef enum xnd_circuit_state_t {
+	XND_CIRCUIT_CLOSED    = 0, /** Calls go through. */
+	XND_CIRCUIT_OPEN      = 1, /** Calls fail fast. */
+	XND_CIRCUIT_HALF_OPEN = 2  /** Probe calls go through. */
+} xnd_circuit_state_t;
+
+/**
+ * \brief Warms up the client, so that the first calls do not pay for DNS, TCP
+ * and TLS setup. It is opt-in and may be called again, e.g. to re-pin the
+ * addresses of the API host.
+ * \param x The Xendit client.
+ * \param options The warm-up options.
+ * \return The number of connections opened, -1 on failure.
+ */
+extern int
+xnd_client_warmup(xnd_client_t *x, const xnd_warmup_options_t *options);
+
+/**
+ * \brief Probes the health of the API host through the client connections,
+ * which also keeps an idle pooled connection alive.
+ * \param x The Xendit client.
+ * \return 0 if the API host is reachable, -1 otherwise.
+ */
+extern int
+xnd_client_probe(const xnd_client_t *x);
+
+/**
+ * \brief Enables a persistent TLS session cache on the client. Sessions are
+ * kept in a memory-mapped file keyed by host, so restarted processes or other
+ * processes using the same file resume sessions with an abbreviated
+ * handshake. It requires libcurl 8.12.0 or later, built with SSL session
+ * export.
+ * \param x The Xendit client.
+ * \param path The path of the cache file, NULL disables the cache.
+ * \param max_age The maximum age of stored sessions in seconds, 0 keeps the
+ * lifetime given by the server.
+ * \return The number of sessions resumed from the file, -1 on failure.
+ */
+extern int
+xnd_client_tls_cache(xnd_client_t *x, const char *path, long max_age);
+
+/**
+ * \brief Sends the requests of the client through a local sidecar proxy that
+ * terminates TLS, over a Unix domain socket or plain HTTP on loopback,
+ * instead of paying for TLS in-process. Requests keep the Xendit host and
+ * path, only the hop to the sidecar is plain HTTP.
+ * \param x The Xendit client.
+ * \param endpoint The sidecar, "unix:/path/to/socket" or "http://host:port",
+ * NULL connects to Xendit directly. The host is one of 127.0.0.0/8, "[::1]"
+ * or "localhost", the API key is sent in cleartext to the sidecar.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_sidecar(xnd_client_t *x, const char *endpoint);
+
+/** The number of base URLs of a client at most. */
+#define XND_ENDPOINTS_MAX (16U)
+
+/**
+ * \brief Options of the base URLs of a client.
+ */
+typedef struct xnd_endpoint_options_t {
+	long   check_ms; /** Interval of health checks, 0 disables them. */
+	double alpha;    /** Weight of a latency sample in the moving average
+	                     of an endpoint, 0 for 0.2. */
+} xnd_endpoint_options_t;
+
+/**
+ * \brief Statistics of a base URL of a client.
+ */
+typedef struct xnd_endpoint_stats_t {
+	const char    *url;        /** Base URL. */
+	int            healthy;    /** Whether it was last reachable. */
+	double         latency_ms; /** Moving average of its latency. */
+	unsigned int   in_flight;  /** Calls in flight. */
+	unsigned long  requests;   /** Calls sent to it. */
+	unsigned long  failures;   /** Calls which could not reach it. */
+} xnd_endpoint_stats_t;
+
+/**
+ * \brief Spreads the calls of the client over several base URLs in place of
+ * `XND_BASEURL`, e.g. regional egress proxies. Each call goes to the better
+ * of two random endpoints, by their moving average of latency and calls in
+ * flight. A call which cannot connect is sent again to another endpoint, and
+ * the unreachable one is left alone until a health check or a later call
+ * finds it back.
+ * \param x The Xendit client.
+ * \param urls The base URLs, e.g. "https://egress-sg.example.com".
+ * \param n The number of base URLs, 0 sends calls to `XND_BASEURL` again.
+ * \param options The options, NULL for defaults.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_endpoints(xnd_client_t *x, const char *const *urls, unsigned int n,
+                     const xnd_endpoint_options_t *options);
+
+/**
+ * \brief Gets the statistics of a base URL of the client.
+ * \param x The Xendit client.
+ * \param i The index of the base URL.
+ * \param stats The statistics.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_endpoint_stats(const xnd_client_t *x, unsigned int i,
+                          xnd_endpoint_stats_t *stats);
+
+/**
+ * \brief Time limits of the calls of a client, zeroed members are not
+ * enforced.
+ */
+typedef struct xnd_timeouts_t {
+	long         connect_ms;      /** Timeout of opening a connection. */
+	long         total_ms;        /** Deadline of a call, with retries. */
+	long         low_speed_limit; /** Aborts below this many bytes/second */
+	long         low_speed_time;  /** for this many seconds. */
+	unsigned int retries;         /** Retries of transient failures. */
+} xnd_timeouts_t;
+
+/**
+ * \brief Sets the time limits of the calls of the client. Retries happen
+ * only for idempotent calls, i.e. neither POST nor PATCH ones, on connection
+ * failures and 429, 502, 503 or 504 responses, with a jittered exponential
+ * backoff, and never past the deadline of the call. Clients start with a 10
+ * seconds connect timeout, a 60 seconds deadline and no retry.
+ * \param x The Xendit client.
+ * \param timeouts The time limits, copied.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_timeouts(xnd_client_t *x, const xnd_timeouts_t *timeouts);
+
+/**
+ * \brief Cancellation token opaque object.
+ */
+typedef struct xnd_cancel_t xnd_cancel_t;
+
+/**
+ * \brief Creates new cancellation token.
+ * \return NULL on failure.
+ */
+extern xnd_cancel_t *
+xnd_cancel_new(void);
+
+/**
+ * \brief Destroys cancellation token.
+ * \param token The cancellation token to destroy.
+ */
+extern void
+xnd_cancel_destroy(xnd_cancel_t *token);
+
+/**
+ * \brief Cancels the calls of every client using the token, from any thread.
+ * In-flight calls fail shortly after, and following calls fail right away
+ * until the token is reset.
+ * \param token The cancellation token.
+ */
+extern void
+xnd_cancel(xnd_cancel_t *token);
+
+/**
+ * \brief Resets a cancellation token, so that calls go through again.
+ * \param token The cancellation token.
+ */
+extern void
+xnd_cancel_reset(xnd_cancel_t *token);
+
+/**
+ * \brief Attaches a cancellation token to the client.
+ * \param x The Xendit client.
+ * \param token The cancellation token, must outlive the client or be
+ * detached first. NULL detaches the token.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_cancel_token(xnd_client_t *x, xnd_cancel_t *token);
+
+/**
+ * \brief Limits the calls in flight of the client adaptively, AIMD on their
+ * latency: the limit grows while latency stays within a tolerance of its
+ * baseline and shrinks on slower calls, timeouts and overload responses, so
+ * that callers do not pile up behind a degraded path. Calls over the limit
+ * wait in the lane of their priority, see `xnd_client_priority()`, then
+ * fail with -1. It must be set before the client is shared.
+ * \param x The Xendit client.
+ * \param options The limiter options, NULL disables the limiter.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_concurrency(xnd_client_t *x,
+                       const xnd_concurrency_options_t *options);
+
+/**
+ * \brief Sets the priority of the calls of the client. Waiting calls of both
+ * lanes are given slots of the limiter by weighted fair queueing, and bulk
+ * calls never take the reserved share of the limit, so that a flood of bulk
+ * calls does not hold interactive ones up. Clients of a shared context may
+ * each have their own. Clients start interactive.
+ * \param x The Xendit client.
+ * \param priority The priority of its calls.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_priority(xnd_client_t *x, xnd_priority_t priority);
+
+/**
+ * \brief Guards every endpoint of the client with a circuit breaker, which
+ * fails calls fast while the endpoint keeps failing, then lets probe calls
+ * through after a cooldown. Transport failures, 5xx and 429 responses count
+ * as failures. It must be set before the client is shared.
+ * \param x The Xendit client.
+ * \param options The breaker options, NULL disables the breakers.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_breaker(xnd_client_t *x, const xnd_breaker_options_t *options);
+
+/**
+ * \brief Retrieves the state of the circuit breaker of an endpoint.
+ * \param x The Xendit client.
+ * \param endpoint The endpoint, e.g. `XND_ENDPOINT_BALANCE`.
+ * \return The state, closed without breakers.
+ */
+extern xnd_circuit_state_t
+xnd_client_circuit(const xnd_client_t *x, const char *endpoint);
+
+/**
+ * \brief Enables a balance cache shared across processes. Balances are kept
+ * in a memory-mapped file, so that every process using the same file, e.g.
+ * the workers of a server, is served by one call per TTL, and is not stalled
+ * by the others. Balances of other API keys in the file are never served.
+ * \param x The Xendit client.
+ * \param path The path of the cache file, NULL disables the cache.
+ * \param ttl_ms The lifetime of cached balances in milliseconds.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_balance_cache(xnd_client_t *x, const char *path, long ttl_ms);
+
+/**
+ * \brief Retrieves the statistics of the client, those of its connections,
+ * limiter and breakers are shared by every client of its context.
+ * \param x The Xendit client.
+ * \param stats The retrieved statistics.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_stats(const xnd_client_t *x, xnd_client_stats_t *stats);
+
+/**
+ * \brief Records every exchange of the client into a capture file, secret
+ * API key excluded, so it can later be replayed offline.
+ * \param x The Xendit client.
+ * \param path The path of the capture file, NULL stops recording.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_record(xnd_client_t *x, const char *path);
+
+/**
+ * \brief Serves the calls of the client from a capture file recorded by
+ * `xnd_client_record()`, without any network access. Calls not found in the
+ * capture fail.
+ * \param x The Xendit client.
+ * \param path The path of the capture file, NULL goes back to the network.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_replay(xnd_client_t *x, const char *path);
+
+/**
+ * \brief Sends the calls of the client over io_uring with a minimal HTTP/1.1
+ * keep-alive client instead of libcurl, which saves most system calls of
+ * each call. It only speaks plain HTTP, for the hop to a sidecar set with
+ * `xnd_client_sidecar()`; calls without a sidecar still go through libcurl.
+ * Like recording and replaying, it replaces the transport of the client.
+ * \param x The Xendit client.
+ * \param enable Non-zero to use io_uring, 0 to go back to libcurl.
+ * \return 0 on success, -1 otherwise, e.g. where io_uring is unavailable.
+ */
+extern int
+xnd_client_uring(xnd_client_t *x, int enable);
+
+/**
+ * \brief Creates new client context, to be shared by clients created with
+ * `xnd_client_new_in()`.
+ * \return NULL on failure.
+ */
+extern xnd_context_t *
+xnd_context_new(void);
+
+/**
+ * \brief Destroys client context. Its clients keep it alive, it is freed
+ * once the last of them is destroyed.
+ * \param ctx The client context to destroy.
+ */
+extern void
+xnd_context_destroy(xnd_context_t *ctx);
+
+/**
+ * \brief Warms up the connections of the context, see
+ * `xnd_client_warmup()`.
+ * \param ctx The client context.
+ * \param options The warm-up options.
+ * \return The number of connections opened, -1 on failure.
+ */
+extern int
+xnd_context_warmup(xnd_context_t *ctx, const xnd_warmup_options_t *options);
+
+/**
+ * \brief Caps the idle connections kept by the context, the oldest are
+ * closed beyond it. Along with a concurrency limit, the connections stay few
+ * and fixed however many clients share the context.
+ * \param ctx The client context.
+ * \param max The maximum number of connections, 0 restores the default.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_context_connections(xnd_context_t *ctx, unsigned int max);
+
+/**
+ * \brief Enables a persistent TLS session cache on the context, see
+ * `xnd_client_tls_cache()`.
+ * \param ctx The client context.
+ * \param path The path of the cache file, NULL disables the cache.
+ * \param max_age The maximum age of stored sessions in seconds, 0 keeps the
+ * lifetime given by the server.
+ * \return The number of sessions resumed from the file, -1 on failure.
+ */
+extern int
+xnd_context_tls_cache(xnd_context_t *ctx, const char *path, long max_age);
+
+/**
+ * \brief Routes every call of the context through a local sidecar, see
+ * `xnd_client_sidecar()`.
+ * \param ctx The client context.
+ * \param endpoint The sidecar, NULL connects directly again.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_context_sidecar(xnd_context_t *ctx, const char *endpoint);
+
+/**
+ * \brief Limits the calls in flight of every client of the context, see
+ * `xnd_client_concurrency()`. It must be set before the context is shared.
+ * \param ctx The client context.
+ * \param options The limiter options, NULL disables the limiter.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_context_concurrency(xnd_context_t *ctx,
+                        const xnd_concurrency_options_t *options);
+
+/**
+ * \brief Guards every endpoint of the context with a circuit breaker, see
+ * `xnd_client_breaker()`. It must be set before the context is shared.
+ * \param ctx The client context.
+ * \param options The breaker options, NULL disables the breakers.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_context_breaker(xnd_context_t *ctx, const xnd_breaker_options_t *options);
+
+/**
+ * \brief Dumps the flight recorder, which always keeps the last 128 requests
+ * of every thread: method, path, status, transport error, attempts, timings
+ * and sizes, one line per request. It is async-signal-safe.
+ * \param fd The file descriptor to write to.
+ * \return The number of requests dumped, -1 on failure.
+ */
+extern int
+xnd_flight_dump(int fd);
+
+/**
+ * \brief Dumps the flight recorder whenever a signal is received, e.g.
+ * `SIGUSR1`.
+ * \param signo The signal.
+ * \param fd The file descriptor to write to.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_flight_dump_on_signal(int signo, int fd);
+
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  * Balances
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
@@ -72,6 +612,673 @@ xnd_balance(const xnd_client_t *x, const char *for_user_id,
             const char *account_type, const char *currency,
             xnd_balance_t *response);
 
+/** Columnar balances are in hundredths of the currency unit. */
+#define XND_BALANCE_SCALE (100)
+
+/**
+ * \brief Balance to fetch in bulk, see `xnd_balance()`.
+ */
+typedef struct xnd_balance_query_t {
+	const char *for_user_id;  /** Sub-account ID or NULL. */
+	const char *account_type; /** Balance type or NULL. */
+	const char *currency;     /** Currency filter or NULL. */
+} xnd_balance_query_t;
+
+/**
+ * \brief Columnar balances opaque object, one array per member rather than
+ * one object per balance.
+ */
+typedef struct xnd_balance_columns_t xnd_balance_columns_t;
+
+/**
+ * \brief View of columnar balances, one entry per row in each array. Strings
+ * are dictionary-encoded, code 0 standing for none. It is valid until the
+ * columns are fetched into, cleared or destroyed.
+ */
+typedef struct xnd_balance_columns_view_t {
+	size_t              rows;           /** Number of rows. */
+	const int64_t      *amounts;        /** Balances, in hundredths. */
+	const uint16_t     *currencies;     /** Codes of the currencies. */
+	const uint16_t     *types;          /** Codes of the balance types. */
+	const uint8_t      *valid;          /** 1 if fetched, 0 if failed. */
+	const uint32_t     *id_offsets;     /** Offsets of the sub-account IDs
+	                                        in `ids`, `rows + 1` of them. */
+	const char         *ids;            /** Sub-account IDs, back to back,
+	                                        each NUL-terminated, empty for
+	                                        the master account. */
+	const char *const  *currency_names; /** Currencies by code. */
+	size_t              ncurrencies;    /** Number of currency codes. */
+	const char *const  *type_names;     /** Balance types by code. */
+	size_t              ntypes;         /** Number of type codes. */
+} xnd_balance_columns_view_t;
+
+/**
+ * \brief Creates new, empty columnar balances.
+ * \return NULL on failure.
+ */
+extern xnd_balance_columns_t *
+xnd_balance_columns_new(void);
+
+/**
+ * \brief Destroys columnar balances.
+ * \param c The columnar balances to destroy.
+ */
+extern void
+xnd_balance_columns_destroy(xnd_balance_columns_t *c);
+
+/**
+ * \brief Removes every row, keeping the buffers and dictionaries for reuse.
+ * \param c The columnar balances.
+ */
+extern void
+xnd_balance_columns_clear(xnd_balance_columns_t *c);
+
+/**
+ * \brief Fetches balances in bulk, e.g. those of many sub-accounts, decoding
+ * each response straight into one row appended to the columns. Calls go
+ * through the limiter and breakers of the client, not its balance cache.
+ * \param x The Xendit client.
+ * \param c The columnar balances.
+ * \param queries The balances to fetch, one row each, in order.
+ * \param n The number of balances.
+ * \param threads The number of calls in flight at once.
+ * \return 0 if every balance was fetched, -1 otherwise, failed rows being
+ * appended all the same with `valid` at 0.
+ */
+extern int
+xnd_balance_columns_fetch(const xnd_client_t *x, xnd_balance_columns_t *c,
+                          const xnd_balance_query_t *queries, size_t n,
+                          unsigned int threads);
+
+/**
+ * \brief Retrieves a view of the columns.
+ * \param c The columnar balances.
+ * \param view The retrieved view.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_balance_columns_view(const xnd_balance_columns_t *c,
+                         xnd_balance_columns_view_t *view);
+
+/**
+ * \brief Balance watcher opaque object, one scheduler polling every watched
+ * balance of a client on behalf of its subscribers.
+ */
+typedef struct xnd_watcher_t xnd_watcher_t;
+
+/**
+ * \brief Balance watcher options.
+ */
+typedef struct xnd_watcher_options_t {
+	long         min_interval_ms; /** Poll interval of a balance which just
+	                                  changed. */
+	long         max_interval_ms; /** Poll interval of a balance which has
+	                                  not changed for long. */
+	unsigned int fanout;          /** Polls of a batch sent concurrently. */
+} xnd_watcher_options_t;
+
+/**
+ * \brief Balance watcher statistics.
+ */
+typedef struct xnd_watcher_stats_t {
+	unsigned long polls;         /** Balance calls sent. */
+	unsigned long batches;       /** Batches of due polls sent. */
+	unsigned long notifications; /** Callbacks called. */
+} xnd_watcher_stats_t;
+
+/**
+ * \brief Function called with a watched balance, on the watcher thread.
+ * \param for_user_id The sub-account ID, may be NULL.
+ * \param account_type The balance type, may be NULL.
+ * \param currency The currency filter, may be NULL.
+ * \param balance The balance.
+ * \param data The user-defined data of the subscription.
+ */
+typedef void (*xnd_watch_cb_t) (const char *, const char *, const char *,
+                                double, void *);
+
+/**
+ * \brief Creates new balance watcher, with a thread of its own. Balances are
+ * kept on a timer wheel, and polled again after a quarter of the time since
+ * they last changed, within the minimum and maximum intervals, so that
+ * changing balances are polled often and dormant ones rarely. Polls falling
+ * due together are sent as one batch. Every balance is polled once however
+ * many subscribers watch it. The watcher must be destroyed before the
+ * client, and is not inherited by children after `fork()`.
+ * \param x The Xendit client.
+ * \param options The watcher options.
+ * \return NULL on failure.
+ */
+extern xnd_watcher_t *
+xnd_watcher_new(const xnd_client_t *x, const xnd_watcher_options_t *options);
+
+/**
+ * \brief Destroys balance watcher, once calls and callbacks in flight are
+ * done. In a child after `fork()`, only its memory is freed.
+ * \param w The balance watcher to destroy.
+ */
+extern void
+xnd_watcher_destroy(xnd_watcher_t *w);
+
+/**
+ * \brief Subscribes to a balance, see `xnd_balance()`. The callback is called
+ * with the first balance polled for the subscription, then only when the
+ * balance changes. Failed polls are retried silently.
+ * \param w The balance watcher.
+ * \param for_user_id The XenPlatform sub-account ID, may be NULL.
+ * \param account_type The balance type, may be NULL.
+ * \param currency The currency filter, may be NULL.
+ * \param cb The callback.
+ * \param data The user-defined data passed to the callback.
+ * \return The subscription ID, -1 on failure.
+ */
+extern int
+xnd_watch(xnd_watcher_t *w, const char *for_user_id,
+          const char *account_type, const char *currency, xnd_watch_cb_t cb,
+          void *data);
+
+/**
+ * \brief Unsubscribes from a balance. Once it returns, the callback of the
+ * subscription is not called anymore. It may be called from a callback.
+ * \param w The balance watcher.
+ * \param id The subscription ID.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_unwatch(xnd_watcher_t *w, int id);
+
+/**
+ * \brief Retrieves the statistics of the balance watcher.
+ * \param w The balance watcher.
+ * \param stats The retrieved statistics.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_watcher_stats(const xnd_watcher_t *w, xnd_watcher_stats_t *stats);
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Downloads
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/**
+ * \brief Destination of a downloaded body, opaque object. Bodies are passed
+ * through a bounded buffer, so that downloads of any size take constant
+ * memory.
+ */
+typedef struct xnd_sink_t xnd_sink_t;
+
+/**
+ * \brief Callback for each chunk of a downloaded body.
+ *
+ * \details Parameters:
+ * 1. (const char *) The chunk.
+ * 2. (size_t) The size of the chunk.
+ * 3. (void *) The pointer to user-defined data.
+ *
+ * Return 0 to go on, -1 to abort the download.
+ */
+typedef int (*xnd_sink_cb_t) (const char *, size_t, void *);
+
+/**
+ * \brief Creates a sink writing to a file descriptor, e.g. a file or a pipe.
+ * \param fd The file descriptor, not closed by the sink.
+ * \param max_body The maximum size of the body, 0 for unlimited. Larger
+ * bodies abort the download as soon as they go past it.
+ * \return NULL on failure.
+ */
+extern xnd_sink_t *
+xnd_sink_fd(int fd, size_t max_body);
+
+/**
+ * \brief Creates a sink writing to a file through a sliding memory mapping,
+ * which saves a copy into the kernel for every chunk. The file is created or
+ * truncated, and trimmed to the size of the body once complete.
+ * \param path The path of the file.
+ * \param max_body The maximum size of the body, 0 for unlimited.
+ * \return NULL on failure.
+ */
+extern xnd_sink_t *
+xnd_sink_mmap(const char *path, size_t max_body);
+
+/**
+ * \brief Creates a sink passing the body to a callback, in chunks of up to
+ * 64 KiB.
+ * \param cb The callback function.
+ * \param data The user-defined data to be passed to the callback.
+ * \param max_body The maximum size of the body, 0 for unlimited.
+ * \return NULL on failure.
+ */
+extern xnd_sink_t *
+xnd_sink_callback(xnd_sink_cb_t cb, void *data, size_t max_body);
+
+/**
+ * \brief Retrieves the size of the body written to a sink so far.
+ * \param sink The sink.
+ * \return The size in bytes.
+ */
+extern size_t
+xnd_sink_size(const xnd_sink_t *sink);
+
+/**
+ * \brief Destroys a sink, flushing what it still buffers.
+ * \param sink The sink to destroy.
+ */
+extern void
+xnd_sink_destroy(xnd_sink_t *sink);
+
+/**
+ * \brief Downloads a file of the Xendit API, e.g. a report, into a sink.
+ * Only the body of a successful response reaches the sink. The API key is
+ * only sent to URLs under `XND_BASEURL` or an endpoint of the client, files
+ * elsewhere, e.g. at a signed URL, are downloaded without credentials.
+ * \param x The Xendit client.
+ * \param url The URL of the file.
+ * \param sink The sink, written to from its current size on.
+ * \return 0 on success, -1 otherwise, including a body over the maximum
+ * size of the sink or a sink failing to write.
+ */
+extern int
+xnd_client_download(const xnd_client_t *x, const char *url,
+                    xnd_sink_t *sink);
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Batch disbursements
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define XND_ENDPOINT_BATCH_DISBURSEMENTS (XND_BASEURL "/batch_disbursements")
+
+/**
+ * \brief Format of a batch disbursement file, one disbursement per row.
+ */
+typedef enum xnd_batch_format_t {
+	XND_BATCH_CSV    = 0, /** CSV with a header row naming the columns. */
+	XND_BATCH_NDJSON = 1  /** One JSON object per line. */
+} xnd_batch_format_t;
+
+/**
+ * \brief Function called with an invalid row of a batch file.
+ * \param line The line of the row, starting at 1.
+ * \param field The invalid field, NULL for the row as a whole.
+ * \param reason Why the row is invalid.
+ * \param data The user-defined data.
+ */
+typedef void (*xnd_batch_error_cb_t) (size_t, const char *, const char *,
+                                      void *);
+
+/**
+ * \brief Function called as a batch is uploaded.
+ * \param rows The rows sent so far.
+ * \param total The rows of the batch.
+ * \param data The user-defined data.
+ * \return 0 to go on, non-zero aborts the upload.
+ */
+typedef int (*xnd_batch_progress_cb_t) (size_t, size_t, void *);
+
+/**
+ * \brief Batch disbursement options.
+ */
+typedef struct xnd_batch_options_t {
+	const char              *reference; /** Reference of the batch. */
+	xnd_batch_format_t       format;    /** Format of the file. */
+	xnd_batch_error_cb_t     on_error;  /** Invalid rows or NULL. */
+	xnd_batch_progress_cb_t  on_progress; /** Upload progress or NULL. */
+	void                    *data;      /** User-defined data of both. */
+} xnd_batch_options_t;
+
+/**
+ * \brief Xendit batch disbursement object.
+ */
+typedef struct xnd_batch_disbursement_t {
+	char   id[64];     /** ID of the batch, empty if not sent. */
+	char   status[32]; /** Status of the batch, empty if not sent. */
+	size_t rows;       /** Valid rows of the file. */
+	size_t invalid;    /** Invalid rows of the file. */
+} xnd_batch_disbursement_t;
+
+/**
+ * \brief Creates a batch disbursement from a file of any size, e.g. tens of
+ * thousands of rows. The file is memory-mapped and read twice: every row is
+ * validated first, each invalid one reported, and nothing is sent if any is
+ * invalid; then rows are converted to JSON one at a time as the body is
+ * uploaded, so that the body is never held in memory.
+ *
+ * \details Every row has the fields `amount`, `bank_code`,
+ * `bank_account_name`, `bank_account_number` and `description`, and may have
+ * an `external_id`. Amounts are positive numbers, bank codes are uppercase
+ * letters, digits and underscores, and account numbers are digits. Other CSV
+ * columns and JSON members are ignored, and so are blank lines.
+ * \param x The Xendit client.
+ * \param path The path of the file.
+ * \param options The batch options.
+ * \param response The created batch disbursement, and the rows counted.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_batch_disbursement(const xnd_client_t *x, const char *path,
+                       const xnd_batch_options_t *options,
+                       xnd_batch_disbursement_t *response);
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Webhooks
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/**
+ * \brief Webhook receiver opaque object.
+ */
+typedef struct xnd_webhook_t xnd_webhook_t;
+
+/**
+ * \brief Type of a callback event.
+ */
+typedef enum xnd_event_type_t {
+	XND_EVENT_UNKNOWN      = 0, /** Any other callback. */
+	XND_EVENT_INVOICE      = 1, /** Invoice paid or expired. */
+	XND_EVENT_DISBURSEMENT = 2  /** Disbursement completed or failed. */
+} xnd_event_type_t;
+
+/** Number of event types. */
+#define XND_EVENT_TYPES (3)
+
+/**
+ * \brief Span of a callback payload, not NUL-terminated. Strings are as they
+ * appear in the JSON payload, escapes included.
+ */
+typedef struct xnd_span_t {
+	const char *data; /** First byte, NULL if missing. */
+	size_t      size; /** Size in bytes. */
+} xnd_span_t;
+
+/**
+ * \brief Members of invoice callbacks.
+ */
+typedef struct xnd_invoice_event_t {
+	double     paid_amount;     /** Amount paid. */
+	xnd_span_t payment_method;  /** e.g. BANK_TRANSFER. */
+	xnd_span_t payment_channel; /** e.g. BCA. */
+	xnd_span_t paid_at;         /** Time of payment, ISO 8601. */
+	xnd_span_t payer_email;     /** Email of the payer. */
+} xnd_invoice_event_t;
+
+/**
+ * \brief Members of disbursement callbacks.
+ */
+typedef struct xnd_disbursement_event_t {
+	xnd_span_t account_holder_name; /** Name of the account holder. */
+	xnd_span_t failure_code;        /** Why it failed, if it did. */
+	int        is_instant;          /** Whether it was instant. */
+} xnd_disbursement_event_t;
+
+/**
+ * \brief Callback event, bound without copying from its payload. It is only
+ * valid during the call of its handler.
+ */
+typedef struct xnd_event_t {
+	xnd_event_type_t         type;         /** Type of the event. */
+	xnd_span_t               id;           /** ID of the object. */
+	xnd_span_t               external_id;  /** Merchant ID of the object. */
+	xnd_span_t               user_id;      /** Account of the object. */
+	xnd_span_t               status;       /** e.g. PAID or COMPLETED. */
+	xnd_span_t               currency;     /** e.g. IDR. */
+	xnd_span_t               bank_code;    /** e.g. BCA. */
+	xnd_span_t               description;  /** Description. */
+	double                   amount;       /** Amount. */
+	xnd_invoice_event_t      invoice;      /** Invoice members. */
+	xnd_disbursement_event_t disbursement; /** Disbursement members. */
+	xnd_span_t               payload;      /** Whole JSON payload. */
+} xnd_event_t;
+
+/**
+ * \brief Function handling callback events, on a worker thread.
+ * \param event The event.
+ * \param data The user-defined data of the handler.
+ */
+typedef void (*xnd_event_cb_t) (const xnd_event_t *, void *);
+
+/**
+ * \brief Webhook receiver options.
+ */
+typedef struct xnd_webhook_options_t {
+	unsigned int threads;  /** Worker threads running the handlers. */
+	unsigned int capacity; /** Events queued at most. */
+	long         wait_ms;  /** Wait for room in a full queue, 0 turns
+	                           events down right away. */
+} xnd_webhook_options_t;
+
+/**
+ * \brief Outcome of a submitted callback, and the HTTP status to answer.
+ */
+typedef enum xnd_webhook_status_t {
+	XND_WEBHOOK_ACCEPTED  = 0, /** Queued, answer 200. */
+	XND_WEBHOOK_FORBIDDEN = 1, /** Token not accepted, answer 403. */
+	XND_WEBHOOK_INVALID   = 2, /** Not a callback event, answer 400. */
+	XND_WEBHOOK_BUSY      = 3  /** Queue full, answer 503 to be retried. */
+} xnd_webhook_status_t;
+
+/**
+ * \brief Webhook receiver statistics.
+ */
+typedef struct xnd_webhook_stats_t {
+	unsigned long accepted;  /** Events queued. */
+	unsigned long forbidden; /** Callbacks with a wrong token. */
+	unsigned long invalid;   /** Callbacks not parsed. */
+	unsigned long busy;      /** Callbacks turned down on a full queue. */
+	unsigned long handled;   /** Events passed to a handler. */
+	unsigned long unhandled; /** Events without a handler. */
+	unsigned int  queued;    /** Events waiting now. */
+} xnd_webhook_stats_t;
+
+/**
+ * \brief Creates new webhook receiver, with worker threads of its own. It
+ * takes callbacks from any HTTP server: their token is checked and their
+ * payload bound where they are submitted, so that the server can answer
+ * right away, then events wait in a bounded queue for the handlers. Queued
+ * payloads are copied once into buffers reused by the queue. The receiver is
+ * not inherited by children after `fork()`, where it may only be destroyed.
+ * \param options The receiver options.
+ * \return NULL on failure.
+ */
+extern xnd_webhook_t *
+xnd_webhook_new(const xnd_webhook_options_t *options);
+
+/**
+ * \brief Destroys webhook receiver, once queued events are handled. In a
+ * child after `fork()`, only its memory is freed.
+ * \param w The webhook receiver to destroy.
+ */
+extern void
+xnd_webhook_destroy(xnd_webhook_t *w);
+
+/**
+ * \brief Accepts a callback token, as set on the Xendit dashboard. Several
+ * may be accepted at once, e.g. while a token is rotated. It must be called
+ * before callbacks are submitted.
+ * \param w The webhook receiver.
+ * \param token The callback token, copied.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_webhook_token(xnd_webhook_t *w, const char *token);
+
+/**
+ * \brief Sets the handler of a type of events. It must be called before
+ * callbacks are submitted.
+ * \param w The webhook receiver.
+ * \param type The event type.
+ * \param cb The handler, NULL drops the events.
+ * \param data The user-defined data passed to the handler.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_webhook_handler(xnd_webhook_t *w, xnd_event_type_t type,
+                    xnd_event_cb_t cb, void *data);
+
+/**
+ * \brief Submits a callback. The token is compared in constant time with
+ * every accepted one. The type of the event is told by its members when not
+ * given, e.g. by the URL the callback was sent to.
+ * \param w The webhook receiver.
+ * \param type The event type, `XND_EVENT_UNKNOWN` to tell it from the
+ * payload.
+ * \param token The value of the `x-callback-token` header, may be NULL.
+ * \param body The JSON payload, not NUL-terminated.
+ * \param size The size of the payload.
+ * \return The outcome.
+ */
+extern xnd_webhook_status_t
+xnd_webhook_submit(xnd_webhook_t *w, xnd_event_type_t type,
+                   const char *token, const char *body, size_t size);
+
+/**
+ * \brief Submits a callback as raw HTTP/1.1 request bytes, headers and body,
+ * e.g. read off a socket, see `xnd_webhook_submit()`.
+ * \param w The webhook receiver.
+ * \param type The event type, `XND_EVENT_UNKNOWN` to tell it from the
+ * payload.
+ * \param request The request bytes.
+ * \param size The size of the request.
+ * \return The outcome.
+ */
+extern xnd_webhook_status_t
+xnd_webhook_submit_http(xnd_webhook_t *w, xnd_event_type_t type,
+                        const char *request, size_t size);
+
+/**
+ * \brief Retrieves the statistics of the webhook receiver.
+ * \param w The webhook receiver.
+ * \param stats The retrieved statistics.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_webhook_stats(xnd_webhook_t *w, xnd_webhook_stats_t *stats);
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Outbound queue
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/**
+ * \brief Persistent outbound queue opaque object.
+ */
+typedef struct xnd_outbox_t xnd_outbox_t;
+
+/**
+ * \brief Function called once a queued request is done, on a sender thread.
+ * \param key The idempotency key of the request.
+ * \param status The HTTP status of the response.
+ * \param body The body of the response.
+ * \param data The user-defined data.
+ */
+typedef void (*xnd_outbox_cb_t) (const char *, long, const char *, void *);
+
+/**
+ * \brief Outbound queue options.
+ */
+typedef struct xnd_outbox_options_t {
+	unsigned int     senders;      /** Threads sending the requests. */
+	double           rate;         /** Requests sent per second at most, 0
+	                                   for no limit. */
+	unsigned int     high_water;   /** Requests pending at most. */
+	long             wait_ms;      /** Wait for room past the high-water
+	                                   mark, 0 turns requests down right
+	                                   away. */
+	size_t           segment_size; /** Size of a log file, 0 for 4 MiB. */
+	int              sync;         /** Whether requests reach the disk
+	                                   before they are queued, to survive
+	                                   power loss and not only crashes. */
+	xnd_outbox_cb_t  on_done;      /** Completion callback or NULL. */
+	void            *data;         /** User-defined data of it. */
+} xnd_outbox_options_t;
+
+/**
+ * \brief Outcome of an enqueued request.
+ */
+typedef enum xnd_outbox_status_t {
+	XND_OUTBOX_QUEUED    = 0, /** Queued, sent in the background. */
+	XND_OUTBOX_DUPLICATE = 1, /** Key already queued or done, dropped. */
+	XND_OUTBOX_BUSY      = 2, /** Still past the high-water mark. */
+	XND_OUTBOX_FAILED    = 3  /** Invalid, or not written to the log. */
+} xnd_outbox_status_t;
+
+/**
+ * \brief Outbound queue statistics.
+ */
+typedef struct xnd_outbox_stats_t {
+	unsigned long queued;     /** Requests queued. */
+	unsigned long duplicates; /** Requests with a key seen already. */
+	unsigned long busy;       /** Requests turned down past the mark. */
+	unsigned long sent;       /** Requests done. */
+	unsigned long retries;    /** Failed sends tried again. */
+	size_t        replayed;   /** Requests left pending by the last run. */
+	size_t        pending;    /** Requests not done yet. */
+	size_t        segments;   /** Log files in use. */
+} xnd_outbox_stats_t;
+
+/**
+ * \brief Opens a persistent outbound queue of a client, which smooths bursts
+ * of requests out to the pace Xendit accepts. Requests are appended to a log
+ * of memory-mapped files in a directory, so that those pending when the
+ * process dies are sent on the next open. Each carries an idempotency key,
+ * sent as `X-IDEMPOTENCY-KEY`, and is marked done in the log once answered,
+ * so that a replay never sends it twice on our side, nor has it applied
+ * twice on Xendit's. Requests failing on the network, with a server error
+ * or with 429 are sent again after a growing backoff, any other answer
+ * completes them. Log files are deleted once all of their requests are done.
+ * The queue is not inherited by children after `fork()`, where it may only be
+ * closed.
+ * \param x The Xendit client, which must outlive the queue.
+ * \param dir The directory of the log, created if needed, used by one queue
+ * at a time.
+ * \param options The queue options.
+ * \return NULL on failure.
+ */
+extern xnd_outbox_t *
+xnd_outbox_open(const xnd_client_t *x, const char *dir,
+                const xnd_outbox_options_t *options);
+
+/**
+ * \brief Closes an outbound queue once the requests being sent are done.
+ * Other pending requests stay in the log for the next open. In a child after
+ * `fork()`, the log is only unmapped, and left to the parent.
+ * \param o The outbound queue to close.
+ */
+extern void
+xnd_outbox_close(xnd_outbox_t *o);
+
+/**
+ * \brief Queues a request. It returns as soon as the request is in the log,
+ * without waiting while fewer requests than the high-water mark are pending.
+ * \param o The outbound queue.
+ * \param method The HTTP method, e.g. "POST".
+ * \param path The path under `XND_BASEURL`, e.g. "/disbursements".
+ * \param key The idempotency key, at most 255 bytes.
+ * \param body The JSON body, NULL if none.
+ * \return The outcome.
+ */
+extern xnd_outbox_status_t
+xnd_outbox_enqueue(xnd_outbox_t *o, const char *method, const char *path,
+                   const char *key, const char *body);
+
+/**
+ * \brief Waits until no request is pending.
+ * \param o The outbound queue.
+ * \param timeout_ms The longest wait, 0 for no limit.
+ * \return 0 once no request is pending, -1 otherwise.
+ */
+extern int
+xnd_outbox_flush(xnd_outbox_t *o, long timeout_ms);
+
+/**
+ * \brief Retrieves the statistics of the outbound queue.
+ * \param o The outbound queue.
+ * \param stats The retrieved statistics.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_outbox_stats(xnd_outbox_t *o, xnd_outbox_stats_t *stats);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
 #ifdef __cplusplus
 }
 #endif
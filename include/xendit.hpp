@@ -1,12 +1,165 @@
 #ifndef XND_XENDIT_HPP
 #define XND_XENDIT_HPP 1
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <xendit/xendit.h>
 
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define XND_HAS_SPAN 1
+#endif
+
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#include <memory_resource>
+#define XND_HAS_MEMORY_RESOURCE 1
+#endif
+
 namespace xnd {
 
+#ifdef XND_HAS_SPAN
+template <typename T>
+using span = std::span<T>;
+#else
+/** Read-only view of a column, until `std::span` is available. */
+template <typename T>
+class span {
+private:
+
+	T *data_;
+	std::size_t size_;
+
+public:
+
+	constexpr span(void) noexcept : data_ { nullptr }, size_ { 0 } {}
+	constexpr span(T *data, std::size_t size) noexcept
+		: data_ { data }, size_ { size } {}
+
+	constexpr T *
+	data(void) const noexcept { return data_; }
+	constexpr std::size_t
+	size(void) const noexcept { return size_; }
+	constexpr bool
+	empty(void) const noexcept { return size_ == 0; }
+	constexpr T *
+	begin(void) const noexcept { return data_; }
+	constexpr T *
+	end(void) const noexcept { return data_ + size_; }
+	constexpr T &
+	operator[](std::size_t i) const noexcept { return data_[i]; }
+
+};
+#endif
+
+#ifdef XND_HAS_MEMORY_RESOURCE
+namespace detail {
+
+/** Memory resource of the SDK, C allocations do not carry their size, hence
+    each block is prefixed with it. */
+inline std::pmr::memory_resource *&
+resource(void)
+{
+	static std::pmr::memory_resource *r = nullptr;
+	return r;
+}
+
+constexpr std::size_t header = alignof(std::max_align_t);
+
+inline void *
+resource_malloc(std::size_t size)
+{
+	void *p;
+
+	try {
+		p = resource()->allocate(header + size, header);
+	} catch (...) {
+		return nullptr;
+	}
+
+	*static_cast<std::size_t *>(p) = size;
+
+	return static_cast<char *>(p) + header;
+}
+
+inline void
+resource_free(void *ptr)
+{
+	char *p;
+
+	if (ptr == nullptr)
+		return;
+
+	p = static_cast<char *>(ptr) - header;
+	resource()->deallocate(p, header + *reinterpret_cast<std::size_t *>(p),
+	                       header);
+}
+
+inline void *
+resource_realloc(void *ptr, std::size_t size)
+{
+	std::size_t old;
+	void *p;
+
+	if (ptr == nullptr)
+		return resource_malloc(size);
+
+	old = *reinterpret_cast<std::size_t *>(static_cast<char *>(ptr) - header);
+	if (size <= old)
+		return ptr;
+
+	p = resource_malloc(size);
+	if (p == nullptr)
+		return nullptr;
+
+	std::memcpy(p, ptr, old);
+	resource_free(ptr);
+
+	return p;
+}
+
+}
+
+/**
+ * \brief Sets up the environment for Xendit SDK with a polymorphic memory
+ * resource, see `xnd_sdk_init_with_allocator()`. The resource must outlive
+ * `xnd_sdk_cleanup()`.
+ * \param resource The memory resource.
+ * \return 0 on success, -1 otherwise.
+ */
+inline int
+sdk_init(std::pmr::memory_resource *resource)
+{
+	static const xnd_allocator_t allocator = {
+		detail::resource_malloc, detail::resource_free,
+		detail::resource_realloc, nullptr, nullptr
+	};
+
+	std::pmr::memory_resource *old = detail::resource();
+
+	if (resource == nullptr)
+		return -1;
+
+	/** Set first, the SDK may allocate while it is set up; a refused
+	    resource must not take over the memory of the one in use. */
+	detail::resource() = resource;
+	if (xnd_sdk_init_with_allocator(&allocator) == -1) {
+		detail::resource() = old;
+		return -1;
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * \brief Xendit client, see `xnd_client_new()`. It is shared by threads as a
+ * `xnd_client_t` is, through a reference, while moving it is not thread-safe.
+ * A moved-from client holds nothing.
+ */
 class client {
 private:
 
@@ -29,6 +182,9 @@ public:
 	bool
 	has_error(void) const;
 
+	xnd_client_t *
+	get(void) const;
+
 };
 
 inline
@@ -59,7 +215,9 @@ inline client::client(client &&other) noexcept
 inline client &
 client::operator=(client &&rhs) noexcept
 {
+	/** The client held so far is destroyed, not leaked. */
 	if (this != &rhs) {
+		xnd_client_destroy(client_);
 		error_ = std::exchange(rhs.error_, false);
 		client_ = std::exchange(rhs.client_, nullptr);
 	}
@@ -73,6 +231,187 @@ client::has_error(void) const
 	return error_;
 }
 
+inline xnd_client_t *
+client::get(void) const
+{
+	return client_;
+}
+
+/**
+ * \brief Balances bound as columns, see `xnd_balance_columns_fetch()`. The
+ * spans are valid until the next fetch, clear or move.
+ */
+class balance_columns {
+private:
+
+	xnd_balance_columns_t *columns_;
+	xnd_balance_columns_view_t view_;
+
+	void
+	refresh(void);
+
+public:
+
+	balance_columns();
+	~balance_columns();
+	balance_columns(const balance_columns &other) = delete;
+	balance_columns(balance_columns &&other) noexcept;
+
+	balance_columns &
+	operator=(const balance_columns &rhs) = delete;
+	balance_columns &
+	operator=(balance_columns &&rhs) noexcept;
+
+	bool
+	has_error(void) const;
+
+	int
+	fetch(const client &x, const xnd_balance_query_t *queries,
+	      std::size_t n, unsigned int threads = 1);
+
+	void
+	clear(void);
+
+	std::size_t
+	rows(void) const;
+
+	span<const std::int64_t>
+	amounts(void) const;
+
+	span<const std::uint16_t>
+	currencies(void) const;
+
+	span<const std::uint16_t>
+	types(void) const;
+
+	span<const std::uint8_t>
+	valid(void) const;
+
+	std::string_view
+	id(std::size_t row) const;
+
+	std::string_view
+	currency_name(std::uint16_t code) const;
+
+	std::string_view
+	type_name(std::uint16_t code) const;
+
+};
+
+inline
+balance_columns::balance_columns()
+	: columns_ { xnd_balance_columns_new() }
+	, view_ {}
+{
+	refresh();
+}
+
+inline
+balance_columns::~balance_columns()
+{
+	xnd_balance_columns_destroy(columns_);
+}
+
+inline
+balance_columns::balance_columns(balance_columns &&other) noexcept
+	: columns_ { std::exchange(other.columns_, nullptr) }
+	, view_ { std::exchange(other.view_, xnd_balance_columns_view_t {}) }
+{}
+
+inline balance_columns &
+balance_columns::operator=(balance_columns &&rhs) noexcept
+{
+	if (this != &rhs) {
+		xnd_balance_columns_destroy(columns_);
+		columns_ = std::exchange(rhs.columns_, nullptr);
+		view_ = std::exchange(rhs.view_, xnd_balance_columns_view_t {});
+	}
+
+	return *this;
+}
+
+inline void
+balance_columns::refresh(void)
+{
+	if (xnd_balance_columns_view(columns_, &view_) == -1)
+		view_ = xnd_balance_columns_view_t {};
+}
+
+inline bool
+balance_columns::has_error(void) const
+{
+	return columns_ == nullptr;
+}
+
+inline int
+balance_columns::fetch(const client &x, const xnd_balance_query_t *queries,
+                       std::size_t n, unsigned int threads)
+{
+	int status;
+
+	status = xnd_balance_columns_fetch(x.get(), columns_, queries, n,
+	                                   threads);
+	refresh();
+
+	return status;
+}
+
+inline void
+balance_columns::clear(void)
+{
+	xnd_balance_columns_clear(columns_);
+	refresh();
+}
+
+inline std::size_t
+balance_columns::rows(void) const
+{
+	return view_.rows;
+}
+
+inline span<const std::int64_t>
+balance_columns::amounts(void) const
+{
+	return { view_.amounts, view_.rows };
+}
+
+inline span<const std::uint16_t>
+balance_columns::currencies(void) const
+{
+	return { view_.currencies, view_.rows };
+}
+
+inline span<const std::uint16_t>
+balance_columns::types(void) const
+{
+	return { view_.types, view_.rows };
+}
+
+inline span<const std::uint8_t>
+balance_columns::valid(void) const
+{
+	return { view_.valid, view_.rows };
+}
+
+inline std::string_view
+balance_columns::id(std::size_t row) const
+{
+	return { view_.ids + view_.id_offsets[row],
+	         view_.id_offsets[row + 1] - view_.id_offsets[row] - 1 };
+}
+
+inline std::string_view
+balance_columns::currency_name(std::uint16_t code) const
+{
+	return code < view_.ncurrencies ? view_.currency_names[code] : "";
+}
+
+inline std::string_view
+balance_columns::type_name(std::uint16_t code) const
+{
+	return code < view_.ntypes ? view_.type_names[code] : "";
+}
+
 }
 
 #endif
@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+/** The C library allocator, the default one. */
+static const xnd_allocator_t xnd_alloc_libc = {
+	malloc, free, realloc, calloc, strdup
+};
+
+/** The current SDK allocator. */
+static xnd_allocator_t xnd_alloc = {
+	malloc, free, realloc, calloc, strdup
+};
+
+int
+xnd_alloc_set(const xnd_allocator_t *allocator)
+{
+	if (allocator == NULL) {
+		xnd_alloc = xnd_alloc_libc;
+		return 0;
+	}
+
+	if (allocator->malloc_fn == NULL || allocator->free_fn == NULL ||
+	    allocator->realloc_fn == NULL)
+		return -1;
+
+	xnd_alloc = *allocator;
+
+	return 0;
+}
+
+void *
+xnd_malloc(size_t size)
+{
+	return xnd_alloc.malloc_fn(size);
+}
+
+void *
+xnd_calloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (xnd_alloc.calloc_fn != NULL)
+		return xnd_alloc.calloc_fn(nmemb, size);
+
+	if (size != 0UL && nmemb > __SIZE_MAX__ / size)
+		return NULL; /** overflow */
+
+	ptr = xnd_alloc.malloc_fn(nmemb * size);
+	if (ptr != NULL)
+		memset(ptr, 0, nmemb * size);
+
+	return ptr;
+}
+
+void *
+xnd_realloc(void *ptr, size_t size)
+{
+	return xnd_alloc.realloc_fn(ptr, size);
+}
+
+void
+xnd_free(void *ptr)
+{
+	xnd_alloc.free_fn(ptr);
+}
+
+char *
+xnd_strdup(const char *str)
+{
+	char *dup;
+	size_t size;
+
+	if (xnd_alloc.strdup_fn != NULL)
+		return xnd_alloc.strdup_fn(str);
+
+	size = strlen(str) + 1UL;
+	dup = xnd_alloc.malloc_fn(size);
+	if (dup != NULL)
+		memcpy(dup, str, size);
+
+	return dup;
+}
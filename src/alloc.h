@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_ALLOC_H
+#define XND_ALLOC_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "xendit.h"
+
+/**
+ * \brief Sets the allocator of every SDK allocation. Missing `calloc_fn` and
+ * `strdup_fn` are emulated on top of `malloc_fn`.
+ * \param allocator The allocator, NULL restores the C library one.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_alloc_set(const xnd_allocator_t *allocator);
+
+/**
+ * \brief Allocates memory through the SDK allocator, see `malloc(3)`.
+ */
+extern void *
+xnd_malloc(size_t size);
+
+/**
+ * \brief Allocates zeroed memory through the SDK allocator, see `calloc(3)`.
+ */
+extern void *
+xnd_calloc(size_t nmemb, size_t size);
+
+/**
+ * \brief Resizes memory through the SDK allocator, see `realloc(3)`.
+ */
+extern void *
+xnd_realloc(void *ptr, size_t size);
+
+/**
+ * \brief Frees memory through the SDK allocator, see `free(3)`.
+ */
+extern void
+xnd_free(void *ptr);
+
+/**
+ * \brief Duplicates a string through the SDK allocator, see `strdup(3)`.
+ */
+extern char *
+xnd_strdup(const char *str);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
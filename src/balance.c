@@ -4,10 +4,14 @@
  * found in the LICENSE file or at https://opensource.org/licenses/MIT.
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include <stdio.h>
+
 #include <json-c/json.h>
 
+#include "balance.h"
 #include "strings.h"
 #include "http_request.h"
+#include "probes.h"
 #include "xendit_private.h"
 
 /** Binds JSON string response to Xendit balance object. */
@@ -19,24 +23,81 @@ xnd_balance(const xnd_client_t *x, const char *for_user_id,
             const char *account_type, const char *currency,
             xnd_balance_t *response)
 {
-	xnd_http_request_t *req;
 	xnd_string_t *res;
+	char key[XND_BALANCE_CACHE_KEY_MAX];
+	int cached = 0, hit;
+	int status = 0;
 
 	if (x == NULL)
 		return -1;
 
+	/** Shared cache, keyed by every parameter of the call */
+	if (x->balances != NULL) {
+		int size = snprintf(key, sizeof(key), "%s\x1f%s\x1f%s",
+		                    for_user_id ? for_user_id : "",
+		                    account_type ? account_type : "",
+		                    currency ? currency : "");
+
+		cached = size > 0 && (size_t) size < sizeof(key);
+		hit = cached &&
+		      xnd_balance_cache_get(x->balances, key,
+		                            &(response->balance)) == 0;
+
+		if (hit && XND_PROBE_ENABLED(cache__hit))
+			XND_PROBE(cache__hit, XND_ENDPOINT_BALANCE,
+			          for_user_id);
+		if (!hit && XND_PROBE_ENABLED(cache__miss))
+			XND_PROBE(cache__miss, XND_ENDPOINT_BALANCE,
+			          for_user_id);
+		if (hit)
+			return 0;
+	}
+
+	res = xnd_string_new(NULL);
+	if (res == NULL)
+		return -1;
+
+	status = xnd_balance_send(x, for_user_id, account_type, currency, &res);
+
+	/** Bind JSON response */
+	if (status == 0) {
+		if (XND_PROBE_ENABLED(bind__start))
+			XND_PROBE(bind__start, XND_ENDPOINT_BALANCE,
+			          for_user_id, res->size);
+
+		status = xnd_balance_bind(res->data, &response);
+
+		if (XND_PROBE_ENABLED(bind__done))
+			XND_PROBE(bind__done, XND_ENDPOINT_BALANCE,
+			          for_user_id, status);
+	}
+	if (status == 0 && cached)
+		xnd_balance_cache_put(x->balances, key, response->balance);
+
+	xnd_string_destroy(&res);
+
+	return status;
+}
+
+int
+xnd_balance_send(const xnd_client_t *x, const char *for_user_id,
+                 const char *account_type, const char *currency,
+                 xnd_string_t **res)
+{
+	xnd_http_request_t *req;
+	int status = 0;
+
 	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, XND_ENDPOINT_BALANCE);
 	if (req == NULL)
 		return -1;
 
-	res = xnd_string_new(NULL);
-	if (res == NULL) {
+	/** Client headers, credentials, pool and limits */
+	if (xnd_client_request(x, req) == -1) {
 		xnd_http_request_destroy(req);
 		return -1;
 	}
 
 	/** Headers */
-	xnd_http_request_header(req, "Content-Type", "application/json");
 	if (for_user_id != NULL && for_user_id[0])
 		xnd_http_request_header(req, "for-user-id", for_user_id);
 
@@ -49,19 +110,14 @@ xnd_balance(const xnd_client_t *x, const char *for_user_id,
 	/** Callback */
 	xnd_http_request_callback(req, xnd_http_request_default_callback);
 
-	/** Basic auth */
-	xnd_http_request_basic_auth(req, x->key->data, NULL);
-
 	/** Send request */
-	xnd_http_request_send_with_data(req, (void *) &res);
+	if (xnd_client_send(x, req, XND_ENDPOINT_BALANCE, (void *) res) == -1 ||
+	    req->status < 200L || req->status > 299L)
+		status = -1;
 
-	/** Bind JSON response */
-	xnd_balance_bind(res->data, &response);
-
-	xnd_string_destroy(&res);
 	xnd_http_request_destroy(req);
 
-	return 0;
+	return status;
 }
 
 static int
@@ -73,8 +129,13 @@ xnd_balance_bind(const char *jsonstr, xnd_balance_t **balance)
 	if (jsonstr == NULL || !jsonstr[0])
 		return -1;
 
+	/** Nothing is bound, nor cached, without a balance. */
 	root = json_tokener_parse(jsonstr);
-	json_object_object_get_ex(root, "balance", &balance_obj);
+	if (!json_object_object_get_ex(root, "balance", &balance_obj)) {
+		json_object_put(root);
+		return -1;
+	}
+
 	(*balance)->balance = json_object_get_double(balance_obj);
 	json_object_put(root);
 
@@ -0,0 +1,67 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_BALANCE_H
+#define XND_BALANCE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "strings.h"
+#include "xendit.h"
+
+/** Codes of a dictionary at most, code 0 included. */
+#define XND_BALANCE_CODES_MAX (65536UL)
+
+/**
+ * \brief Dictionary of the strings of a column, code 0 being none.
+ */
+typedef struct xnd_balance_dict_t {
+	char   **names; /** Names by code, "" first. */
+	size_t   n;     /** Number of codes. */
+	size_t   max;   /** Capacity of the names. */
+} xnd_balance_dict_t;
+
+struct xnd_balance_columns_t {
+	size_t              rows;       /** Number of rows. */
+	size_t              max;        /** Capacity of the columns in rows. */
+	int64_t            *amounts;    /** Balances, in hundredths. */
+	uint16_t           *currencies; /** Codes of the currencies. */
+	uint16_t           *types;      /** Codes of the balance types. */
+	uint8_t            *valid;      /** Whether each row was fetched. */
+	uint32_t           *id_offsets; /** Offsets of the IDs, `max + 1`. */
+	char               *ids;        /** Arena of the sub-account IDs. */
+	size_t              ids_size;   /** Bytes of the arena in use. */
+	size_t              ids_max;    /** Capacity of the arena. */
+	xnd_balance_dict_t  currency;   /** Dictionary of the currencies. */
+	xnd_balance_dict_t  type;       /** Dictionary of the balance types. */
+	pthread_mutex_t     lock;       /** Guards the currency dictionary
+	                                    while rows are fetched. */
+};
+
+/**
+ * \brief Sends a balance call of the client, see `xnd_balance()`.
+ * \param x The Xendit client.
+ * \param for_user_id The sub-account ID or NULL.
+ * \param account_type The balance type or NULL.
+ * \param currency The currency filter or NULL.
+ * \param res The body of the response.
+ * \return 0 on a successful response, -1 otherwise.
+ */
+extern int
+xnd_balance_send(const xnd_client_t *x, const char *for_user_id,
+                 const char *account_type, const char *currency,
+                 xnd_string_t **res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
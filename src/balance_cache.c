@@ -0,0 +1,237 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alloc.h"
+#include "balance_cache.h"
+
+/** Hashes a string, FNV-1a. */
+static uint64_t
+xnd_balance_cache_hash(const char *str);
+
+/** Reads the wall clock, shared by every process of the host, in ns. */
+static uint64_t
+xnd_balance_cache_now(void);
+
+/** Retrieves the slots of the cache file. */
+static xnd_balance_cache_slot_t *
+xnd_balance_cache_slots(xnd_balance_cache_t *c);
+
+xnd_balance_cache_t *
+xnd_balance_cache_open(const char *path, long ttl_ms, const char *owner)
+{
+	xnd_balance_cache_t *c;
+	xnd_balance_cache_header_t *header;
+	struct stat st;
+
+	if (path == NULL || !path[0] || ttl_ms <= 0L || owner == NULL)
+		return NULL;
+
+	c = xnd_malloc(sizeof(xnd_balance_cache_t));
+	if (c == NULL)
+		return NULL;
+
+	c->size = sizeof(xnd_balance_cache_header_t)
+	        + sizeof(xnd_balance_cache_slot_t) * XND_BALANCE_CACHE_SLOTS;
+	c->ttl = (uint64_t) ttl_ms * 1000000ULL;
+	c->owner = xnd_balance_cache_hash(owner);
+	c->map = MAP_FAILED;
+
+	c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (c->fd == -1) {
+		xnd_free(c);
+		return NULL;
+	}
+
+	/** Only opening is serialized, entries are guarded by seqlocks. */
+	if (flock(c->fd, LOCK_EX) == -1 || fstat(c->fd, &st) == -1)
+		goto fail;
+
+	if ((size_t) st.st_size != c->size && ftruncate(c->fd, 0) == -1)
+		goto fail;
+	if ((size_t) st.st_size != c->size &&
+	    ftruncate(c->fd, (off_t) c->size) == -1)
+		goto fail;
+
+	c->map = mmap(NULL, c->size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd,
+	              0);
+	if (c->map == MAP_FAILED)
+		goto fail;
+
+	header = c->map;
+	if (header->magic != XND_BALANCE_CACHE_MAGIC ||
+	    header->slots != XND_BALANCE_CACHE_SLOTS ||
+	    header->slot_size != sizeof(xnd_balance_cache_slot_t)) {
+		memset(c->map, 0, c->size);
+		header->magic = XND_BALANCE_CACHE_MAGIC;
+		header->slots = XND_BALANCE_CACHE_SLOTS;
+		header->slot_size = sizeof(xnd_balance_cache_slot_t);
+	}
+
+	flock(c->fd, LOCK_UN);
+
+	return c;
+
+fail:
+	if (c->map != MAP_FAILED)
+		munmap(c->map, c->size);
+	close(c->fd);
+	xnd_free(c);
+
+	return NULL;
+}
+
+void
+xnd_balance_cache_close(xnd_balance_cache_t *c)
+{
+	if (c == NULL)
+		return;
+
+	munmap(c->map, c->size);
+	close(c->fd);
+	xnd_free(c);
+}
+
+int
+xnd_balance_cache_get(xnd_balance_cache_t *c, const char *key,
+                      double *balance)
+{
+	xnd_balance_cache_slot_t *slots = xnd_balance_cache_slots(c);
+	uint32_t hash = (uint32_t) xnd_balance_cache_hash(key);
+	uint64_t now = xnd_balance_cache_now();
+
+	for (uint32_t i = 0U; i < XND_BALANCE_CACHE_PROBES; ++i) {
+		xnd_balance_cache_slot_t *slot;
+		uint32_t seq;
+		uint64_t expires, stored, owner;
+		double value;
+		int match;
+
+		slot = &(slots[(hash + i) & (XND_BALANCE_CACHE_SLOTS - 1U)]);
+
+		seq = atomic_load_explicit(&(slot->seq), memory_order_acquire);
+		if (seq & 1U)
+			continue; /** Being written, as good as a miss */
+
+		match = slot->hash == hash &&
+		        strncmp(slot->key, key, XND_BALANCE_CACHE_KEY_MAX) == 0;
+		owner = slot->owner;
+		stored = slot->stored;
+		expires = slot->expires;
+		value = slot->balance;
+
+		/** The copy only counts if no writer came by meanwhile. */
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&(slot->seq),
+		                         memory_order_relaxed) != seq)
+			continue;
+
+		if (match && owner == c->owner && stored <= now &&
+		    now < expires) {
+			*balance = value;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int
+xnd_balance_cache_put(xnd_balance_cache_t *c, const char *key,
+                      double balance)
+{
+	xnd_balance_cache_slot_t *slots = xnd_balance_cache_slots(c);
+	xnd_balance_cache_slot_t *slot = NULL;
+	uint32_t hash = (uint32_t) xnd_balance_cache_hash(key);
+	uint64_t now = xnd_balance_cache_now();
+	size_t size = strlen(key);
+	uint64_t claim;
+	uint32_t seq;
+
+	if (size >= XND_BALANCE_CACHE_KEY_MAX)
+		return -1;
+
+	/** The slot of the key, else the first expired one, else the one
+	    expiring soonest. Racy reads are fine, the claim below is not. */
+	for (uint32_t i = 0U; i < XND_BALANCE_CACHE_PROBES; ++i) {
+		xnd_balance_cache_slot_t *s;
+
+		s = &(slots[(hash + i) & (XND_BALANCE_CACHE_SLOTS - 1U)]);
+		if (s->hash == hash && s->owner == c->owner &&
+		    strncmp(s->key, key, XND_BALANCE_CACHE_KEY_MAX) == 0) {
+			slot = s;
+			break;
+		}
+		if (slot == NULL || (slot->expires > now &&
+		                     s->expires < slot->expires))
+			slot = s;
+	}
+
+	/** Claimed with the time of the claim, a busy slot is left alone
+	    unless its writer died holding it. */
+	claim = atomic_load_explicit(&(slot->claim), memory_order_relaxed);
+	if (claim != 0ULL && now >= claim &&
+	    now - claim < XND_BALANCE_CACHE_STALE_MS * 1000000ULL)
+		return -1;
+	if (!atomic_compare_exchange_strong_explicit(&(slot->claim), &claim,
+	                                             now | 1ULL,
+	                                             memory_order_acquire,
+	                                             memory_order_relaxed))
+		return -1;
+
+	/** Odd already if the previous writer died while writing. */
+	seq = atomic_load_explicit(&(slot->seq), memory_order_relaxed) | 1U;
+	atomic_store_explicit(&(slot->seq), seq, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->hash = hash;
+	slot->owner = c->owner;
+	slot->stored = now;
+	slot->expires = now + c->ttl;
+	slot->balance = balance;
+	memcpy(slot->key, key, size + 1UL);
+
+	atomic_store_explicit(&(slot->seq), seq + 1U, memory_order_release);
+	atomic_store_explicit(&(slot->claim), 0ULL, memory_order_release);
+
+	return 0;
+}
+
+static uint64_t
+xnd_balance_cache_hash(const char *str)
+{
+	uint64_t hash = 14695981039346656037ULL;
+
+	for (const char *p = str; *p; ++p)
+		hash = (hash ^ (unsigned char) *p) * 1099511628211ULL;
+
+	return hash;
+}
+
+static uint64_t
+xnd_balance_cache_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static xnd_balance_cache_slot_t *
+xnd_balance_cache_slots(xnd_balance_cache_t *c)
+{
+	return (xnd_balance_cache_slot_t *)
+	       ((char *) c->map + sizeof(xnd_balance_cache_header_t));
+}
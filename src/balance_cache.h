@@ -0,0 +1,121 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_BALANCE_CACHE_H
+#define XND_BALANCE_CACHE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The number of entries kept in a cache segment, a power of two. */
+#define XND_BALANCE_CACHE_SLOTS (4096U)
+
+/** The number of slots probed for an entry. */
+#define XND_BALANCE_CACHE_PROBES (8U)
+
+/** The maximum size of an entry key, including NTB. */
+#define XND_BALANCE_CACHE_KEY_MAX (112U)
+
+/** Time after which a claimed entry is taken from its writer, which can only
+    have died while writing it. */
+#define XND_BALANCE_CACHE_STALE_MS (1000ULL)
+
+/** The magic number of cache files, "XNDBAL01". */
+#define XND_BALANCE_CACHE_MAGIC (0x31304c4142444e58ULL)
+
+/**
+ * \brief Header of a cache file.
+ */
+typedef struct xnd_balance_cache_header_t {
+	uint64_t magic;     /** The magic number. */
+	uint32_t slots;     /** The number of slots. */
+	uint32_t slot_size; /** The size of each slot. */
+} xnd_balance_cache_header_t;
+
+/**
+ * \brief Slot of a cache file, holding one balance. Writers claim it, then
+ * make `seq` odd while they update the rest; readers retry or give up when it
+ * moved.
+ */
+typedef struct xnd_balance_cache_slot_t {
+	_Atomic uint32_t seq;     /** Sequence number, odd while written. */
+	uint32_t         hash;    /** Hash of the key. */
+	_Atomic uint64_t claim;   /** Claim time of the writer, ns since the
+	                              epoch with the low bit set, 0 if none. */
+	uint64_t         owner;   /** Hash of the owning API key. */
+	uint64_t         stored;  /** Storage time, ns since the epoch. */
+	uint64_t         expires; /** Expiry, ns since the epoch, 0 if empty. */
+	double           balance; /** The balance. */
+	char             key[XND_BALANCE_CACHE_KEY_MAX];
+} xnd_balance_cache_slot_t;
+
+/**
+ * \brief Shared-memory balance cache. Entries live in a fixed-size,
+ * open-addressed hash table in a memory-mapped file, so that every process
+ * mapping the same file, e.g. pre-forked workers, is served by one fetch per
+ * TTL. Entries are guarded by seqlocks: readers never block nor write, and a
+ * writer only skips an entry another writer holds, unless that writer died
+ * with it claimed.
+ */
+typedef struct xnd_balance_cache_t {
+	int      fd;    /** File descriptor of the cache file. */
+	void    *map;   /** Memory mapping of the cache file. */
+	size_t   size;  /** Size of the memory mapping. */
+	uint64_t ttl;   /** Lifetime of stored entries in ns. */
+	uint64_t owner; /** Hash of the API key owning the entries. */
+} xnd_balance_cache_t;
+
+/**
+ * \brief Opens a balance cache file, creating it if needed.
+ * \param path The path of the cache file.
+ * \param ttl_ms The lifetime of stored entries in milliseconds.
+ * \param owner The secret API key, hashed to keep the balances of different
+ * accounts apart in a shared file.
+ * \return NULL on failure.
+ */
+extern xnd_balance_cache_t *
+xnd_balance_cache_open(const char *path, long ttl_ms, const char *owner);
+
+/**
+ * \brief Closes a balance cache, the file is kept.
+ * \param c The balance cache to close.
+ */
+extern void
+xnd_balance_cache_close(xnd_balance_cache_t *c);
+
+/**
+ * \brief Looks up an unexpired balance.
+ * \param c The balance cache.
+ * \param key The key of the balance.
+ * \param balance The balance found.
+ * \return 0 on hit, -1 on miss.
+ */
+extern int
+xnd_balance_cache_get(xnd_balance_cache_t *c, const char *key,
+                      double *balance);
+
+/**
+ * \brief Stores a balance for the TTL of the cache.
+ * \param c The balance cache.
+ * \param key The key of the balance.
+ * \param balance The balance.
+ * \return 0 on success, -1 if the key is too long or every probed entry is
+ * being written by another process.
+ */
+extern int
+xnd_balance_cache_put(xnd_balance_cache_t *c, const char *key,
+                      double balance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,375 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include <json-c/json.h>
+
+#include "alloc.h"
+#include "balance.h"
+
+/**
+ * \brief Balances fetched at once, shared by the threads sending them.
+ */
+typedef struct xnd_balance_job_t {
+	const xnd_client_t        *x;       /** Client of the calls. */
+	xnd_balance_columns_t     *c;       /** Columns bound to. */
+	const xnd_balance_query_t *queries; /** Balances to fetch. */
+	size_t                     first;   /** Row of the first balance. */
+	size_t                     n;       /** Number of balances. */
+	atomic_size_t              next;    /** Next balance to fetch. */
+} xnd_balance_job_t;
+
+/** Makes room for more rows and more bytes of IDs. */
+static int
+xnd_balance_columns_reserve(xnd_balance_columns_t *c, size_t rows,
+                            size_t ids);
+
+/** Sends the calls of a job until none is left. */
+static void *
+xnd_balance_columns_work(void *arg);
+
+/** Binds a JSON string response straight into a row. */
+static int
+xnd_balance_columns_bind(xnd_balance_columns_t *c, size_t row,
+                         const char *jsonstr);
+
+/** Encodes a string, adding it to the dictionary if needed. */
+static int
+xnd_balance_dict_code(xnd_balance_dict_t *d, const char *name,
+                      uint16_t *code);
+
+/** Sets up a dictionary holding the empty string only. */
+static int
+xnd_balance_dict_init(xnd_balance_dict_t *d);
+
+/** Frees the strings of a dictionary. */
+static void
+xnd_balance_dict_destroy(xnd_balance_dict_t *d);
+
+xnd_balance_columns_t *
+xnd_balance_columns_new(void)
+{
+	xnd_balance_columns_t *c;
+
+	c = xnd_calloc(1UL, sizeof(xnd_balance_columns_t));
+	if (c == NULL)
+		return NULL;
+
+	pthread_mutex_init(&(c->lock), NULL);
+
+	if (xnd_balance_dict_init(&(c->currency)) == -1 ||
+	    xnd_balance_dict_init(&(c->type)) == -1 ||
+	    xnd_balance_columns_reserve(c, 64UL, 1024UL) == -1) {
+		xnd_balance_columns_destroy(c);
+		return NULL;
+	}
+
+	c->id_offsets[0] = 0U;
+
+	return c;
+}
+
+void
+xnd_balance_columns_destroy(xnd_balance_columns_t *c)
+{
+	if (c == NULL)
+		return;
+
+	pthread_mutex_destroy(&(c->lock));
+	xnd_balance_dict_destroy(&(c->currency));
+	xnd_balance_dict_destroy(&(c->type));
+	xnd_free(c->amounts);
+	xnd_free(c->currencies);
+	xnd_free(c->types);
+	xnd_free(c->valid);
+	xnd_free(c->id_offsets);
+	xnd_free(c->ids);
+	xnd_free(c);
+}
+
+void
+xnd_balance_columns_clear(xnd_balance_columns_t *c)
+{
+	if (c == NULL)
+		return;
+
+	c->rows = 0UL;
+	c->ids_size = 0UL;
+}
+
+int
+xnd_balance_columns_fetch(const xnd_client_t *x, xnd_balance_columns_t *c,
+                          const xnd_balance_query_t *queries, size_t n,
+                          unsigned int threads)
+{
+	size_t ids = 0UL, size, row, failed = 0UL;
+	pthread_t *tids = NULL;
+	unsigned int started = 0U;
+	xnd_balance_job_t job;
+	const char *id;
+
+	if (x == NULL || c == NULL || (queries == NULL && n > 0UL))
+		return -1;
+	if (n == 0UL)
+		return 0;
+
+	for (size_t i = 0UL; i < n; ++i)
+		ids += (queries[i].for_user_id ?
+		        strlen(queries[i].for_user_id) : 0UL) + 1UL;
+	if (ids > UINT32_MAX - c->ids_size ||
+	    xnd_balance_columns_reserve(c, n, ids) == -1)
+		return -1;
+
+	/** Strings are encoded up front, so that the threads only write the
+	    amounts, and the currencies a response names. */
+	for (size_t i = 0UL; i < n; ++i) {
+		row = c->rows + i;
+		if (xnd_balance_dict_code(&(c->currency), queries[i].currency,
+		                          &(c->currencies[row])) == -1 ||
+		    xnd_balance_dict_code(&(c->type), queries[i].account_type,
+		                          &(c->types[row])) == -1) {
+			c->ids_size = c->id_offsets[c->rows];
+			return -1;
+		}
+
+		id = queries[i].for_user_id ? queries[i].for_user_id : "";
+		size = strlen(id) + 1UL;
+		memcpy(c->ids + c->ids_size, id, size);
+		c->ids_size += size;
+		c->id_offsets[row + 1UL] = (uint32_t) c->ids_size;
+		c->amounts[row] = 0;
+		c->valid[row] = 0U;
+	}
+
+	job.x = x;
+	job.c = c;
+	job.queries = queries;
+	job.first = c->rows;
+	job.n = n;
+	atomic_init(&(job.next), 0UL);
+	c->rows += n;
+
+	if (threads > n)
+		threads = (unsigned int) n;
+	if (threads > 1U)
+		tids = xnd_calloc(threads - 1U, sizeof(pthread_t));
+
+	/** The caller is one of the threads. */
+	for (; tids != NULL && started < threads - 1U; ++started)
+		if (pthread_create(&(tids[started]), NULL,
+		                   xnd_balance_columns_work, &job) != 0)
+			break;
+	xnd_balance_columns_work(&job);
+	for (unsigned int i = 0U; i < started; ++i)
+		pthread_join(tids[i], NULL);
+	xnd_free(tids);
+
+	for (size_t i = job.first; i < c->rows; ++i)
+		failed += c->valid[i] == 0U;
+
+	return failed > 0UL ? -1 : 0;
+}
+
+int
+xnd_balance_columns_view(const xnd_balance_columns_t *c,
+                         xnd_balance_columns_view_t *view)
+{
+	if (c == NULL || view == NULL)
+		return -1;
+
+	view->rows           = c->rows;
+	view->amounts        = c->amounts;
+	view->currencies     = c->currencies;
+	view->types          = c->types;
+	view->valid          = c->valid;
+	view->id_offsets     = c->id_offsets;
+	view->ids            = c->ids;
+	view->currency_names = (const char *const *) c->currency.names;
+	view->ncurrencies    = c->currency.n;
+	view->type_names     = (const char *const *) c->type.names;
+	view->ntypes         = c->type.n;
+
+	return 0;
+}
+
+static int
+xnd_balance_columns_reserve(xnd_balance_columns_t *c, size_t rows,
+                            size_t ids)
+{
+	size_t max = c->max;
+	void *p;
+
+	/** Each column is reallocated on its own, so the old capacity stays
+	    right until every one of them has grown. */
+	if (c->rows + rows > max) {
+		max = max * 2UL > c->rows + rows ? max * 2UL : c->rows + rows;
+
+		p = xnd_realloc(c->amounts, max * sizeof(int64_t));
+		if (p == NULL)
+			return -1;
+		c->amounts = p;
+		if ((p = xnd_realloc(c->currencies,
+		                     max * sizeof(uint16_t))) == NULL)
+			return -1;
+		c->currencies = p;
+		if ((p = xnd_realloc(c->types, max * sizeof(uint16_t))) == NULL)
+			return -1;
+		c->types = p;
+		if ((p = xnd_realloc(c->valid, max * sizeof(uint8_t))) == NULL)
+			return -1;
+		c->valid = p;
+		if ((p = xnd_realloc(c->id_offsets,
+		                     (max + 1UL) * sizeof(uint32_t))) == NULL)
+			return -1;
+		c->id_offsets = p;
+
+		c->max = max;
+	}
+
+	if (c->ids_size + ids > c->ids_max) {
+		max = c->ids_max * 2UL > c->ids_size + ids ?
+		      c->ids_max * 2UL : c->ids_size + ids;
+		if ((p = xnd_realloc(c->ids, max)) == NULL)
+			return -1;
+		c->ids = p;
+		c->ids_max = max;
+	}
+
+	return 0;
+}
+
+static void *
+xnd_balance_columns_work(void *arg)
+{
+	xnd_balance_job_t *job = arg;
+	const xnd_balance_query_t *q;
+	xnd_string_t *res;
+	size_t i;
+
+	res = xnd_string_new(NULL);
+	if (res == NULL)
+		return NULL;
+
+	while ((i = atomic_fetch_add(&(job->next), 1UL)) < job->n) {
+		q = &(job->queries[i]);
+		xnd_string_clear(&res);
+
+		if (xnd_balance_send(job->x, q->for_user_id, q->account_type,
+		                     q->currency, &res) == 0 &&
+		    xnd_balance_columns_bind(job->c, job->first + i,
+		                             res->data) == 0)
+			job->c->valid[job->first + i] = 1U;
+	}
+
+	xnd_string_destroy(&res);
+
+	return NULL;
+}
+
+static int
+xnd_balance_columns_bind(xnd_balance_columns_t *c, size_t row,
+                         const char *jsonstr)
+{
+	json_object *root;
+	json_object *balance_obj = NULL, *currency_obj = NULL;
+	const char *currency;
+	double balance;
+	int status = 0;
+
+	if (jsonstr == NULL || !jsonstr[0])
+		return -1;
+
+	root = json_tokener_parse(jsonstr);
+	if (!json_object_object_get_ex(root, "balance", &balance_obj)) {
+		json_object_put(root);
+		return -1;
+	}
+
+	/** Rounded to the nearest hundredth, away from zero on ties. */
+	balance = json_object_get_double(balance_obj) * XND_BALANCE_SCALE;
+	c->amounts[row] = (int64_t) (balance + (balance < 0.0 ? -0.5 : 0.5));
+
+	if (json_object_object_get_ex(root, "currency", &currency_obj) &&
+	    json_object_is_type(currency_obj, json_type_string)) {
+		currency = json_object_get_string(currency_obj);
+		pthread_mutex_lock(&(c->lock));
+		status = xnd_balance_dict_code(&(c->currency), currency,
+		                               &(c->currencies[row]));
+		pthread_mutex_unlock(&(c->lock));
+	}
+
+	json_object_put(root);
+
+	return status;
+}
+
+static int
+xnd_balance_dict_code(xnd_balance_dict_t *d, const char *name,
+                      uint16_t *code)
+{
+	char **names;
+	size_t max;
+
+	if (name == NULL || !name[0]) {
+		*code = 0U;
+		return 0;
+	}
+
+	/** Dictionaries are tiny, e.g. a few currencies. */
+	for (size_t i = 1UL; i < d->n; ++i) {
+		if (strcmp(d->names[i], name) == 0) {
+			*code = (uint16_t) i;
+			return 0;
+		}
+	}
+
+	if (d->n == XND_BALANCE_CODES_MAX)
+		return -1;
+
+	if (d->n == d->max) {
+		max = d->max * 2UL;
+		names = xnd_realloc(d->names, max * sizeof(char *));
+		if (names == NULL)
+			return -1;
+		d->names = names;
+		d->max = max;
+	}
+
+	d->names[d->n] = xnd_strdup(name);
+	if (d->names[d->n] == NULL)
+		return -1;
+
+	*code = (uint16_t) (d->n)++;
+
+	return 0;
+}
+
+static int
+xnd_balance_dict_init(xnd_balance_dict_t *d)
+{
+	d->names = xnd_calloc(8UL, sizeof(char *));
+	if (d->names == NULL)
+		return -1;
+
+	d->max = 8UL;
+	d->names[0] = xnd_strdup("");
+	if (d->names[0] == NULL)
+		return -1;
+
+	d->n = 1UL;
+
+	return 0;
+}
+
+static void
+xnd_balance_dict_destroy(xnd_balance_dict_t *d)
+{
+	for (size_t i = 0UL; i < d->n; ++i)
+		xnd_free(d->names[i]);
+	xnd_free(d->names);
+}
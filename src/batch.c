@@ -0,0 +1,764 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <json-c/json.h>
+
+#include "strings.h"
+#include "http_request.h"
+#include "xendit_private.h"
+
+/** Fields of a disbursement, in the order of its JSON object. */
+enum {
+	XND_BATCH_AMOUNT,
+	XND_BATCH_BANK_CODE,
+	XND_BATCH_ACCOUNT_NAME,
+	XND_BATCH_ACCOUNT_NUMBER,
+	XND_BATCH_DESCRIPTION,
+	XND_BATCH_EXTERNAL_ID,
+	XND_BATCH_FIELDS
+};
+
+/** Names of the fields, as CSV columns and JSON members. */
+static const char *const xnd_batch_names[XND_BATCH_FIELDS] = {
+	"amount", "bank_code", "bank_account_name", "bank_account_number",
+	"description", "external_id"
+};
+
+/** Parts of the body, in the order they are sent. */
+enum {
+	XND_BATCH_HEAD,
+	XND_BATCH_ROWS,
+	XND_BATCH_TAIL,
+	XND_BATCH_DONE
+};
+
+/** Kinds of field values. */
+enum {
+	XND_BATCH_TEXT,   /** Bytes as they are. */
+	XND_BATCH_QUOTED, /** Quoted CSV, doubled quotes are collapsed. */
+	XND_BATCH_NUMBER, /** JSON number. */
+	XND_BATCH_OTHER   /** JSON value of any other type. */
+};
+
+/** Value of a field, pointing into the file or a parsed JSON object. */
+typedef struct xnd_batch_value_t {
+	const char  *data;   /** First byte, NULL if missing. */
+	size_t       size;   /** Size in bytes. */
+	int          kind;   /** Kind of value. */
+	json_object *number; /** JSON number or NULL. */
+} xnd_batch_value_t;
+
+/** Batch file, read row by row from its mapping. */
+typedef struct xnd_batch_t {
+	const char                *map;     /** Mapping of the file. */
+	size_t                     size;    /** Size of the file. */
+	const xnd_batch_options_t *options; /** Batch options. */
+	long                       columns[XND_BATCH_FIELDS]; /** CSV column
+	                                        of each field, -1 if missing. */
+	size_t                     start;   /** Offset of the first row. */
+	size_t                     first;   /** Line of the first row. */
+	size_t                     offset;  /** Offset of the next row. */
+	size_t                     line;    /** Line of the next row. */
+	json_tokener              *tok;     /** NDJSON parser. */
+	json_object               *obj;     /** Last NDJSON row parsed. */
+	xnd_string_t              *head;    /** Opening of the body. */
+	xnd_string_t              *row;     /** JSON of the last row. */
+	size_t                     count;   /** Rows converted in this pass. */
+	int                        stage;   /** Part of the body being sent. */
+	const char                *piece;   /** Bytes being sent. */
+	size_t                     left;    /** Bytes of the piece left. */
+	size_t                     rows;    /** Valid rows of the file. */
+} xnd_batch_t;
+
+/** Maps the file, parses the CSV header. */
+static int
+xnd_batch_open(xnd_batch_t *b, const char *path,
+               const xnd_batch_options_t *options);
+
+/** Unmaps the file. */
+static void
+xnd_batch_close(xnd_batch_t *b);
+
+/** Converts the next row to JSON, 1 if valid, 0 at the end, -1 if not. */
+static int
+xnd_batch_next(xnd_batch_t *b, int report);
+
+/** Reads a CSV field, 1 if more follow on the row, 0 if last, -1 if bad. */
+static int
+xnd_batch_csv_field(xnd_batch_t *b, xnd_batch_value_t *value);
+
+/** Reads the fields of the next CSV row. */
+static int
+xnd_batch_csv_row(xnd_batch_t *b, xnd_batch_value_t *values);
+
+/** Reads the fields of the next NDJSON row. */
+static int
+xnd_batch_ndjson_row(xnd_batch_t *b, xnd_batch_value_t *values);
+
+/** Validates the fields of a row, NULL if valid, the reason otherwise. */
+static const char *
+xnd_batch_check(const xnd_batch_value_t *values, double *amount, int *field);
+
+/** Appends a value as a JSON string. */
+static int
+xnd_batch_quote(xnd_string_t **s, const xnd_batch_value_t *value);
+
+/** Reports an invalid row. */
+static void
+xnd_batch_error(const xnd_batch_t *b, size_t line, int field,
+                const char *reason);
+
+/** Read callback of the body, converts rows as they are sent. */
+static size_t
+xnd_batch_read(char *buf, size_t size, void *data);
+
+/** Rewind callback of the body. */
+static int
+xnd_batch_rewind(void *data);
+
+/** Binds JSON string response to Xendit batch disbursement object. */
+static int
+xnd_batch_bind(const char *jsonstr, xnd_batch_disbursement_t *batch);
+
+int
+xnd_batch_disbursement(const xnd_client_t *x, const char *path,
+                       const xnd_batch_options_t *options,
+                       xnd_batch_disbursement_t *response)
+{
+	xnd_http_request_t *req;
+	xnd_http_body_t body;
+	xnd_string_t *res;
+	xnd_batch_t b;
+	int status = 0, r;
+
+	if (x == NULL || path == NULL || options == NULL ||
+	    options->reference == NULL || response == NULL)
+		return -1;
+
+	memset(response, 0, sizeof(xnd_batch_disbursement_t));
+
+	if (xnd_batch_open(&b, path, options) == -1)
+		return -1;
+
+	/** First pass, every row is validated and the body measured, so that
+	    nothing is sent unless the whole batch is valid */
+	body.size = b.head->size + 2UL;
+	while ((r = xnd_batch_next(&b, 1)) != 0) {
+		if (r == 1)
+			body.size += b.row->size;
+		else
+			++(response->invalid);
+	}
+	response->rows = b.rows = b.count;
+
+	if (response->invalid > 0UL || b.rows == 0UL) {
+		xnd_batch_close(&b);
+		return -1;
+	}
+
+	/** Second pass, rows are converted again as the body is sent */
+	body.read = xnd_batch_read;
+	body.rewind = xnd_batch_rewind;
+	body.data = &b;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_POST,
+	                           XND_ENDPOINT_BATCH_DISBURSEMENTS);
+	if (req == NULL) {
+		xnd_batch_close(&b);
+		return -1;
+	}
+
+	res = xnd_string_new(NULL);
+	if (res == NULL) {
+		xnd_http_request_destroy(req);
+		xnd_batch_close(&b);
+		return -1;
+	}
+
+	/** Client headers, credentials, pool and limits */
+	if (xnd_client_request(x, req) == -1 ||
+	    xnd_http_request_body(req, &body) == -1) {
+		xnd_string_destroy(&res);
+		xnd_http_request_destroy(req);
+		xnd_batch_close(&b);
+		return -1;
+	}
+
+	/** Callback */
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+
+	/** Send request */
+	if (xnd_client_send(x, req, XND_ENDPOINT_BATCH_DISBURSEMENTS,
+	                    (void *) &res) == -1 ||
+	    req->status < 200L || req->status > 299L)
+		status = -1;
+
+	/** Bind JSON response */
+	if (status == 0)
+		status = xnd_batch_bind(res->data, response);
+
+	xnd_string_destroy(&res);
+	xnd_http_request_destroy(req);
+	xnd_batch_close(&b);
+
+	return status;
+}
+
+static int
+xnd_batch_open(xnd_batch_t *b, const char *path,
+               const xnd_batch_options_t *options)
+{
+	xnd_batch_value_t value;
+	struct stat st;
+	long column = 0L;
+	int fd, r;
+
+	memset(b, 0, sizeof(xnd_batch_t));
+	b->options = options;
+	b->map = MAP_FAILED;
+	for (int i = 0; i < XND_BATCH_FIELDS; ++i)
+		b->columns[i] = -1L;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return -1;
+	}
+
+	/** Read front to back, twice, the kernel reads ahead */
+	b->size = (size_t) st.st_size;
+	if (b->size > 0UL)
+		b->map = mmap(NULL, b->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (b->map == MAP_FAILED)
+		return -1;
+	madvise((void *) b->map, b->size, MADV_SEQUENTIAL);
+
+	b->head = xnd_string_new("{\"reference\":");
+	b->row = xnd_string_new(NULL);
+	if (b->head == NULL || b->row == NULL) {
+		xnd_batch_close(b);
+		return -1;
+	}
+
+	value.data = options->reference;
+	value.size = strlen(options->reference);
+	value.kind = XND_BATCH_TEXT;
+	if (xnd_batch_quote(&(b->head), &value) == -1 ||
+	    xnd_string_sized_insert(&(b->head), ",\"disbursements\":[",
+	                            b->head->size, 19UL) == -1) {
+		xnd_batch_close(b);
+		return -1;
+	}
+
+	/** UTF-8 byte order mark */
+	if (b->size >= 3UL && memcmp(b->map, "\xef\xbb\xbf", 3UL) == 0)
+		b->offset = 3UL;
+	b->line = 1UL;
+
+	if (options->format == XND_BATCH_NDJSON) {
+		b->tok = json_tokener_new();
+		if (b->tok == NULL) {
+			xnd_batch_close(b);
+			return -1;
+		}
+	} else {
+		/** Header row, naming the column of every field */
+		do {
+			r = xnd_batch_csv_field(b, &value);
+			for (int i = 0; r != -1 && i < XND_BATCH_FIELDS; ++i)
+				if (value.size == strlen(xnd_batch_names[i]) &&
+				    memcmp(value.data, xnd_batch_names[i],
+				           value.size) == 0)
+					b->columns[i] = column;
+			++column;
+		} while (r == 1);
+
+		for (int i = 0; r != -1 && i < XND_BATCH_EXTERNAL_ID; ++i)
+			if (b->columns[i] == -1L) {
+				xnd_batch_error(b, 1UL, i, "missing column");
+				r = -1;
+			}
+		if (r == -1) {
+			xnd_batch_close(b);
+			return -1;
+		}
+	}
+
+	b->start = b->offset;
+	b->first = b->line;
+
+	return 0;
+}
+
+static void
+xnd_batch_close(xnd_batch_t *b)
+{
+	if (b->obj != NULL)
+		json_object_put(b->obj);
+	if (b->tok != NULL)
+		json_tokener_free(b->tok);
+	xnd_string_destroy(&(b->row));
+	xnd_string_destroy(&(b->head));
+	if (b->map != MAP_FAILED)
+		munmap((void *) b->map, b->size);
+}
+
+static int
+xnd_batch_next(xnd_batch_t *b, int report)
+{
+	xnd_batch_value_t values[XND_BATCH_FIELDS];
+	const char *reason;
+	char number[32];
+	double amount = 0.0;
+	size_t line;
+	int field = -1, r;
+
+	for (;;) {
+		line = b->line;
+		if (b->options->format == XND_BATCH_NDJSON)
+			r = xnd_batch_ndjson_row(b, values);
+		else
+			r = xnd_batch_csv_row(b, values);
+
+		/** Blank line */
+		if (r != 2)
+			break;
+	}
+
+	if (r == 0)
+		return 0;
+
+	if (r == -1)
+		reason = "malformed row";
+	else
+		reason = xnd_batch_check(values, &amount, &field);
+
+	if (reason != NULL) {
+		if (report)
+			xnd_batch_error(b, line, field, reason);
+		return -1;
+	}
+
+	/** Row as a JSON object, following a comma but for the first one */
+	xnd_string_clear(&(b->row));
+	snprintf(number, sizeof(number), "%.15g", amount);
+	if (b->count > 0UL)
+		xnd_string_append(&(b->row), ',');
+	xnd_string_sized_insert(&(b->row), "{\"amount\":", b->row->size, 10UL);
+	xnd_string_sized_insert(&(b->row), number, b->row->size,
+	                        strlen(number));
+	for (int i = XND_BATCH_BANK_CODE; i < XND_BATCH_FIELDS; ++i) {
+		if (values[i].data == NULL || values[i].size == 0UL)
+			continue;
+		xnd_string_sized_insert(&(b->row), ",\"", b->row->size, 2UL);
+		xnd_string_sized_insert(&(b->row), xnd_batch_names[i],
+		                        b->row->size,
+		                        strlen(xnd_batch_names[i]));
+		xnd_string_sized_insert(&(b->row), "\":", b->row->size, 2UL);
+		if (xnd_batch_quote(&(b->row), &(values[i])) == -1)
+			return -1;
+	}
+	if (xnd_string_append(&(b->row), '}') == -1)
+		return -1;
+
+	++(b->count);
+
+	return 1;
+}
+
+static int
+xnd_batch_csv_field(xnd_batch_t *b, xnd_batch_value_t *value)
+{
+	const char *p = b->map + b->offset, *end = b->map + b->size;
+
+	value->kind = XND_BATCH_TEXT;
+
+	if (p < end && *p == '"') {
+		/** Quoted, may hold commas, newlines and doubled quotes */
+		value->data = ++p;
+		value->kind = XND_BATCH_QUOTED;
+		for (;;) {
+			if (p == end) {
+				b->offset = b->size;
+				return -1;
+			}
+			if (*p == '"') {
+				if (p + 1 < end && p[1] == '"') {
+					p += 2;
+					continue;
+				}
+				break;
+			}
+			if (*p == '\n')
+				++(b->line);
+			++p;
+		}
+		value->size = (size_t) (p - value->data);
+		++p;
+	} else {
+		value->data = p;
+		while (p < end && *p != ',' && *p != '\n' && *p != '"')
+			++p;
+		if (p < end && *p == '"')
+			return -1;
+		value->size = (size_t) (p - value->data);
+		if (value->size > 0UL && (p == end || *p == '\n') &&
+		    value->data[value->size - 1UL] == '\r')
+			--(value->size);
+	}
+
+	if (p < end && *p == '\r' && p + 1 < end && p[1] == '\n')
+		++p;
+
+	b->offset = (size_t) (p - b->map);
+	if (p == end)
+		return 0;
+
+	++(b->offset);
+	if (*p == ',')
+		return 1;
+	if (*p == '\n') {
+		++(b->line);
+		return 0;
+	}
+
+	/** Closing quote followed by anything else */
+	return -1;
+}
+
+static int
+xnd_batch_csv_row(xnd_batch_t *b, xnd_batch_value_t *values)
+{
+	const char *p = b->map + b->offset;
+	xnd_batch_value_t value;
+	long column = 0L;
+	int r, bad = 0;
+
+	if (b->offset >= b->size)
+		return 0;
+
+	for (int i = 0; i < XND_BATCH_FIELDS; ++i)
+		values[i].data = NULL;
+
+	if (*p == '\n' || (*p == '\r' && b->offset + 1UL < b->size &&
+	                   p[1] == '\n')) {
+		b->offset += *p == '\n' ? 1UL : 2UL;
+		++(b->line);
+		return 2;
+	}
+
+	do {
+		r = xnd_batch_csv_field(b, &value);
+		if (r == -1) {
+			/** Skip what is left of the line */
+			bad = 1;
+			while (b->offset < b->size &&
+			       b->map[b->offset++] != '\n')
+				;
+			++(b->line);
+			break;
+		}
+		for (int i = 0; i < XND_BATCH_FIELDS; ++i)
+			if (b->columns[i] == column)
+				values[i] = value;
+		++column;
+	} while (r == 1);
+
+	return bad ? -1 : 1;
+}
+
+static int
+xnd_batch_ndjson_row(xnd_batch_t *b, xnd_batch_value_t *values)
+{
+	const char *p = b->map + b->offset, *eol, *q;
+	json_object *member;
+	size_t size, parsed;
+
+	if (b->offset >= b->size)
+		return 0;
+
+	eol = memchr(p, '\n', b->size - b->offset);
+	size = eol != NULL ? (size_t) (eol - p) : b->size - b->offset;
+	b->offset += size + (eol != NULL ? 1UL : 0UL);
+	++(b->line);
+
+	for (q = p; q < p + size && strchr(" \t\r", *q) != NULL; ++q)
+		;
+	if (q == p + size)
+		return 2;
+
+	for (int i = 0; i < XND_BATCH_FIELDS; ++i)
+		values[i].data = NULL;
+
+	if (b->obj != NULL) {
+		json_object_put(b->obj);
+		b->obj = NULL;
+	}
+
+	if (size > (size_t) __INT_MAX__)
+		return -1;
+
+	json_tokener_reset(b->tok);
+	b->obj = json_tokener_parse_ex(b->tok, p, (int) size);
+	if (b->obj == NULL ||
+	    json_tokener_get_error(b->tok) != json_tokener_success ||
+	    !json_object_is_type(b->obj, json_type_object))
+		return -1;
+
+	/** Trailing bytes */
+	parsed = json_tokener_get_parse_end(b->tok);
+	for (q = p + parsed; q < p + size; ++q)
+		if (strchr(" \t\r", *q) == NULL)
+			return -1;
+
+	for (int i = 0; i < XND_BATCH_FIELDS; ++i) {
+		if (!json_object_object_get_ex(b->obj, xnd_batch_names[i],
+		                               &member) || member == NULL)
+			continue;
+
+		values[i].data = "";
+		values[i].size = 0UL;
+		values[i].kind = XND_BATCH_OTHER;
+		values[i].number = NULL;
+
+		if (json_object_is_type(member, json_type_int) ||
+		    json_object_is_type(member, json_type_double)) {
+			values[i].kind = XND_BATCH_NUMBER;
+			values[i].number = member;
+		} else if (i != XND_BATCH_AMOUNT &&
+		           json_object_is_type(member, json_type_string)) {
+			values[i].data = json_object_get_string(member);
+			values[i].size = (size_t)
+			                 json_object_get_string_len(member);
+			values[i].kind = XND_BATCH_TEXT;
+		}
+	}
+
+	return 1;
+}
+
+static const char *
+xnd_batch_check(const xnd_batch_value_t *values, double *amount, int *field)
+{
+	const xnd_batch_value_t *value;
+	char number[64], *end;
+
+	for (int i = 0; i < XND_BATCH_FIELDS; ++i) {
+		*field = i;
+		value = &(values[i]);
+
+		if (value->data == NULL) {
+			if (i == XND_BATCH_EXTERNAL_ID)
+				continue;
+			return "missing";
+		}
+		if (i == XND_BATCH_AMOUNT) {
+			if (value->kind == XND_BATCH_NUMBER) {
+				*amount = json_object_get_double(value->number);
+			} else if (value->kind == XND_BATCH_OTHER) {
+				return "not a number";
+			} else {
+				if (value->size == 0UL ||
+				    value->size >= sizeof(number))
+					return "not a number";
+				memcpy(number, value->data, value->size);
+				number[value->size] = '\0';
+				*amount = strtod(number, &end);
+				if (*end != '\0')
+					return "not a number";
+			}
+			if (!isfinite(*amount) || *amount <= 0.0)
+				return "not positive";
+			continue;
+		}
+
+		if (value->kind != XND_BATCH_TEXT &&
+		    value->kind != XND_BATCH_QUOTED)
+			return "not a string";
+		if (value->size == 0UL && i != XND_BATCH_EXTERNAL_ID)
+			return "empty";
+
+		for (size_t j = 0UL; j < value->size; ++j) {
+			char c = value->data[j];
+			int digit = c >= '0' && c <= '9';
+
+			if (i == XND_BATCH_BANK_CODE && !digit && c != '_' &&
+			    !(c >= 'A' && c <= 'Z'))
+				return "not a bank code";
+			if (i == XND_BATCH_ACCOUNT_NUMBER && !digit)
+				return "not digits";
+		}
+	}
+
+	*field = -1;
+
+	return NULL;
+}
+
+static int
+xnd_batch_quote(xnd_string_t **s, const xnd_batch_value_t *value)
+{
+	char escape[8];
+	size_t from = 0UL;
+
+	if (xnd_string_append(s, '"') == -1)
+		return -1;
+
+	/** Runs of plain bytes are copied at once */
+	for (size_t i = 0UL; i <= value->size; ++i) {
+		unsigned char c = i < value->size ?
+		                  (unsigned char) value->data[i] : '\0';
+		int skip = value->kind == XND_BATCH_QUOTED && c == '"';
+
+		if (i < value->size && c != '"' && c != '\\' && c >= 0x20)
+			continue;
+
+		if (i > from && xnd_string_sized_insert(s, value->data + from,
+		                                        (*s)->size,
+		                                        i - from) == -1)
+			return -1;
+		if (i == value->size)
+			break;
+
+		/** Doubled quotes of CSV */
+		if (skip)
+			++i;
+		from = i + 1UL;
+
+		if (c == '"' || c == '\\')
+			snprintf(escape, sizeof(escape), "\\%c", c);
+		else if (c == '\n' || c == '\r' || c == '\t')
+			snprintf(escape, sizeof(escape), "\\%c",
+			         c == '\n' ? 'n' : c == '\r' ? 'r' : 't');
+		else
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+		if (xnd_string_sized_insert(s, escape, (*s)->size,
+		                            strlen(escape)) == -1)
+			return -1;
+	}
+
+	return xnd_string_append(s, '"');
+}
+
+static void
+xnd_batch_error(const xnd_batch_t *b, size_t line, int field,
+                const char *reason)
+{
+	if (b->options->on_error == NULL)
+		return;
+
+	b->options->on_error(line, field >= 0 ? xnd_batch_names[field] : NULL,
+	                     reason, b->options->data);
+}
+
+static size_t
+xnd_batch_read(char *buf, size_t size, void *data)
+{
+	xnd_batch_t *b = data;
+	const xnd_batch_options_t *options = b->options;
+	size_t n = 0UL, chunk;
+
+	while (n < size && b->stage != XND_BATCH_DONE) {
+		if (b->left == 0UL) {
+			/** Next piece of the body */
+			switch (b->stage) {
+			case XND_BATCH_HEAD:
+				if (b->piece == NULL) {
+					b->piece = b->head->data;
+					b->left = b->head->size;
+					continue;
+				}
+				b->stage = XND_BATCH_ROWS;
+				b->piece = NULL;
+				continue;
+			case XND_BATCH_ROWS:
+				/** The row just sent */
+				if (b->piece != NULL && options->on_progress &&
+				    options->on_progress(b->count, b->rows,
+				                         options->data) != 0)
+					return XND_HTTP_BODY_ABORT;
+
+				switch (xnd_batch_next(b, 0)) {
+				case 1:
+					b->piece = b->row->data;
+					b->left = b->row->size;
+					continue;
+				case 0:
+					b->stage = XND_BATCH_TAIL;
+					b->piece = "]}";
+					b->left = 2UL;
+					continue;
+				default:
+					/** The file changed since checked */
+					return XND_HTTP_BODY_ABORT;
+				}
+			default:
+				b->stage = XND_BATCH_DONE;
+				continue;
+			}
+		}
+
+		chunk = b->left < size - n ? b->left : size - n;
+		memcpy(buf + n, b->piece, chunk);
+		b->piece += chunk;
+		b->left -= chunk;
+		n += chunk;
+	}
+
+	return n;
+}
+
+static int
+xnd_batch_rewind(void *data)
+{
+	xnd_batch_t *b = data;
+
+	b->offset = b->start;
+	b->line = b->first;
+	b->count = 0UL;
+	b->stage = XND_BATCH_HEAD;
+	b->piece = NULL;
+	b->left = 0UL;
+
+	return 0;
+}
+
+static int
+xnd_batch_bind(const char *jsonstr, xnd_batch_disbursement_t *batch)
+{
+	json_object *root;
+	json_object *id_obj = NULL;
+	json_object *status_obj = NULL;
+	const char *id, *status;
+
+	if (jsonstr == NULL || !jsonstr[0])
+		return -1;
+
+	root = json_tokener_parse(jsonstr);
+	json_object_object_get_ex(root, "id", &id_obj);
+	json_object_object_get_ex(root, "status", &status_obj);
+	id = json_object_get_string(id_obj);
+	status = json_object_get_string(status_obj);
+	snprintf(batch->id, sizeof(batch->id), "%s", id ? id : "");
+	snprintf(batch->status, sizeof(batch->status), "%s",
+	         status ? status : "");
+	json_object_put(root);
+
+	return 0;
+}
@@ -0,0 +1,199 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "alloc.h"
+#include "breaker.h"
+#include "http_request.h"
+
+/** Finds the breaker of an endpoint, creating it if asked to. */
+static xnd_breaker_t *
+xnd_breakers_find(xnd_breakers_t *b, const char *endpoint, int create);
+
+xnd_breakers_t *
+xnd_breakers_new(unsigned int threshold, long cooldown_ms,
+                 unsigned int probes)
+{
+	xnd_breakers_t *b;
+
+	if (threshold == 0U || cooldown_ms < 0L || probes == 0U)
+		return NULL;
+
+	b = xnd_malloc(sizeof(xnd_breakers_t));
+	if (b == NULL)
+		return NULL;
+
+	pthread_mutex_init(&(b->lock), NULL);
+	b->list      = NULL;
+	b->threshold = threshold;
+	b->cooldown  = (unsigned long long) cooldown_ms * 1000000ULL;
+	b->probes    = probes;
+	atomic_init(&(b->rejected), 0UL);
+
+	return b;
+}
+
+void
+xnd_breakers_destroy(xnd_breakers_t *b)
+{
+	xnd_breaker_t *next;
+
+	if (b == NULL)
+		return;
+
+	for (xnd_breaker_t *i = b->list; i != NULL; i = next) {
+		next = i->next;
+		xnd_free(i->endpoint);
+		xnd_free(i);
+	}
+
+	pthread_mutex_destroy(&(b->lock));
+	xnd_free(b);
+}
+
+int
+xnd_breakers_allow(xnd_breakers_t *b, const char *endpoint)
+{
+	xnd_breaker_t *breaker;
+	int res = 0;
+
+	pthread_mutex_lock(&(b->lock));
+
+	/** Without memory for a breaker, calls are simply let through. */
+	breaker = xnd_breakers_find(b, endpoint, 1);
+
+	if (breaker != NULL && breaker->state == XND_CIRCUIT_OPEN &&
+	    xnd_http_request_now() - breaker->opened >= b->cooldown) {
+		breaker->state = XND_CIRCUIT_HALF_OPEN;
+		breaker->probes = 0U;
+	}
+
+	if (breaker == NULL || breaker->state == XND_CIRCUIT_CLOSED) {
+		res = 0;
+	} else if (breaker->state == XND_CIRCUIT_HALF_OPEN &&
+	           breaker->probes < b->probes) {
+		++(breaker->probes);
+		res = 1;
+	} else {
+		res = -1;
+	}
+
+	pthread_mutex_unlock(&(b->lock));
+
+	if (res == -1)
+		atomic_fetch_add_explicit(&(b->rejected), 1UL,
+		                          memory_order_relaxed);
+
+	return res;
+}
+
+void
+xnd_breakers_record(xnd_breakers_t *b, const char *endpoint, int probe,
+                    xnd_breaker_outcome_t outcome)
+{
+	xnd_breaker_t *breaker;
+
+	pthread_mutex_lock(&(b->lock));
+
+	breaker = xnd_breakers_find(b, endpoint, 0);
+	if (breaker == NULL) {
+		pthread_mutex_unlock(&(b->lock));
+		return;
+	}
+
+	if (probe) {
+		if (breaker->probes > 0U)
+			--(breaker->probes);
+
+		/** Only the probes decide while half-open. */
+		if (breaker->state == XND_CIRCUIT_HALF_OPEN &&
+		    outcome == XND_BREAKER_SUCCESS) {
+			breaker->state = XND_CIRCUIT_CLOSED;
+			breaker->failures = 0U;
+		} else if (breaker->state == XND_CIRCUIT_HALF_OPEN &&
+		           outcome == XND_BREAKER_FAILURE) {
+			breaker->state = XND_CIRCUIT_OPEN;
+			breaker->opened = xnd_http_request_now();
+		}
+	} else if (breaker->state == XND_CIRCUIT_CLOSED) {
+		if (outcome == XND_BREAKER_SUCCESS) {
+			breaker->failures = 0U;
+		} else if (outcome == XND_BREAKER_FAILURE &&
+		           ++(breaker->failures) >= b->threshold) {
+			breaker->state = XND_CIRCUIT_OPEN;
+			breaker->opened = xnd_http_request_now();
+		}
+	}
+
+	pthread_mutex_unlock(&(b->lock));
+}
+
+xnd_circuit_state_t
+xnd_breakers_state(xnd_breakers_t *b, const char *endpoint)
+{
+	xnd_breaker_t *breaker;
+	xnd_circuit_state_t state = XND_CIRCUIT_CLOSED;
+
+	pthread_mutex_lock(&(b->lock));
+
+	breaker = xnd_breakers_find(b, endpoint, 0);
+	if (breaker != NULL) {
+		state = breaker->state;
+
+		/** Reported as it would be seen by the next call. */
+		if (state == XND_CIRCUIT_OPEN &&
+		    xnd_http_request_now() - breaker->opened >= b->cooldown)
+			state = XND_CIRCUIT_HALF_OPEN;
+	}
+
+	pthread_mutex_unlock(&(b->lock));
+
+	return state;
+}
+
+void
+xnd_breakers_forked(xnd_breakers_t *b)
+{
+	if (b == NULL)
+		return;
+
+	for (xnd_breaker_t *i = b->list; i != NULL; i = i->next)
+		i->probes = 0U;
+	pthread_mutex_unlock(&(b->lock));
+}
+
+static xnd_breaker_t *
+xnd_breakers_find(xnd_breakers_t *b, const char *endpoint, int create)
+{
+	xnd_breaker_t *breaker;
+
+	for (breaker = b->list; breaker != NULL; breaker = breaker->next)
+		if (strcmp(breaker->endpoint, endpoint) == 0)
+			return breaker;
+
+	if (!create)
+		return NULL;
+
+	breaker = xnd_malloc(sizeof(xnd_breaker_t));
+	if (breaker == NULL)
+		return NULL;
+
+	breaker->endpoint = xnd_strdup(endpoint);
+	if (breaker->endpoint == NULL) {
+		xnd_free(breaker);
+		return NULL;
+	}
+
+	breaker->state    = XND_CIRCUIT_CLOSED;
+	breaker->failures = 0U;
+	breaker->probes   = 0U;
+	breaker->opened   = 0ULL;
+	breaker->next     = b->list;
+	b->list = breaker;
+
+	return breaker;
+}
@@ -0,0 +1,116 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_BREAKER_H
+#define XND_BREAKER_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "xendit.h"
+
+/**
+ * \brief Outcome of a call let through a circuit breaker.
+ */
+typedef enum xnd_breaker_outcome_t {
+	XND_BREAKER_SUCCESS = 0, /** Answered, the endpoint is healthy. */
+	XND_BREAKER_FAILURE = 1, /** Failed or answered with a server error. */
+	XND_BREAKER_ABORTED = 2  /** Not sent or cancelled, tells nothing. */
+} xnd_breaker_outcome_t;
+
+/**
+ * \brief Circuit breaker of an endpoint.
+ */
+typedef struct xnd_breaker_t {
+	char                  *endpoint; /** Name of the endpoint. */
+	xnd_circuit_state_t    state;    /** Current state. */
+	unsigned int           failures; /** Consecutive failures, closed. */
+	unsigned int           probes;   /** Probes in flight when half-open. */
+	unsigned long long     opened;   /** Monotonic ns when last opened. */
+	struct xnd_breaker_t  *next;     /** Next breaker. */
+} xnd_breaker_t;
+
+/**
+ * \brief Circuit breakers, one per endpoint. A breaker opens after a number
+ * of consecutive failures and then fails calls fast. Once a cooldown has
+ * passed it is half-open and lets a few probe calls through, closing again
+ * on a successful probe and reopening on a failed one.
+ */
+typedef struct xnd_breakers_t {
+	pthread_mutex_t     lock;      /** Guards the breakers. */
+	xnd_breaker_t      *list;      /** Breakers, created on first use. */
+	unsigned int        threshold; /** Failures opening a breaker. */
+	unsigned long long  cooldown;  /** Time open before probing, in ns. */
+	unsigned int        probes;    /** Probes in flight when half-open. */
+	atomic_ulong        rejected;  /** Calls failed fast. */
+} xnd_breakers_t;
+
+/**
+ * \brief Creates new set of circuit breakers.
+ * \param threshold The number of consecutive failures opening a breaker.
+ * \param cooldown_ms The time a breaker stays open before probing.
+ * \param probes The number of probe calls let through at once when half-open.
+ * \return NULL on failure.
+ */
+extern xnd_breakers_t *
+xnd_breakers_new(unsigned int threshold, long cooldown_ms,
+                 unsigned int probes);
+
+/**
+ * \brief Destroys set of circuit breakers.
+ * \param b The set of circuit breakers to destroy.
+ */
+extern void
+xnd_breakers_destroy(xnd_breakers_t *b);
+
+/**
+ * \brief Asks the breaker of an endpoint to let a call through.
+ * \param b The set of circuit breakers.
+ * \param endpoint The name of the endpoint.
+ * \return 1 if the call is a probe, 0 if it is let through, -1 if it must
+ * fail fast.
+ */
+extern int
+xnd_breakers_allow(xnd_breakers_t *b, const char *endpoint);
+
+/**
+ * \brief Records the outcome of a call let through.
+ * \param b The set of circuit breakers.
+ * \param endpoint The name of the endpoint.
+ * \param probe Whether the call was a probe.
+ * \param outcome The outcome of the call.
+ */
+extern void
+xnd_breakers_record(xnd_breakers_t *b, const char *endpoint, int probe,
+                    xnd_breaker_outcome_t outcome);
+
+/**
+ * \brief Retrieves the state of the breaker of an endpoint.
+ * \param b The set of circuit breakers.
+ * \param endpoint The name of the endpoint.
+ * \return The state, closed for endpoints never called.
+ */
+extern xnd_circuit_state_t
+xnd_breakers_state(xnd_breakers_t *b, const char *endpoint);
+
+/**
+ * \brief Resets the breakers in a child process after `fork()`, held by the
+ * forking thread. Probes in flight in the parent are dropped, their threads
+ * do not exist in the child.
+ * \param b The set of circuit breakers.
+ */
+extern void
+xnd_breakers_forked(xnd_breakers_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
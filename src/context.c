@@ -0,0 +1,168 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <string.h>
+
+#include "alloc.h"
+#include "xendit_private.h"
+
+xnd_context_t *
+xnd_context_new(void)
+{
+	xnd_context_t *ctx;
+
+	ctx = xnd_malloc(sizeof(xnd_context_t));
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->headers = NULL;
+	ctx->pool = NULL;
+	ctx->limiter = NULL;
+	ctx->breakers = NULL;
+	atomic_init(&(ctx->refs), 1U);
+
+	/** The SDK is set up before the pool creates its curl objects. */
+	xnd_sdk_attach(ctx);
+
+	/** Built once, merged into every request of every client. */
+	ctx->headers = xnd_http_headers_new();
+	if (ctx->headers == NULL ||
+	    xnd_http_headers_set(ctx->headers, "Content-Type",
+	                         "application/json") == -1)
+		goto fail;
+
+	ctx->pool = xnd_http_pool_new();
+	if (ctx->pool == NULL)
+		goto fail;
+
+	return ctx;
+
+fail:
+	xnd_sdk_detach(ctx);
+	xnd_http_headers_destroy(ctx->headers);
+	xnd_free(ctx);
+
+	return NULL;
+}
+
+void
+xnd_context_destroy(xnd_context_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	/** The last of the creator and the clients frees it. */
+	if (atomic_fetch_sub(&(ctx->refs), 1U) != 1U)
+		return;
+
+	xnd_sdk_detach(ctx);
+
+	xnd_breakers_destroy(ctx->breakers);
+	xnd_limiter_destroy(ctx->limiter);
+	xnd_http_pool_destroy(ctx->pool);
+	xnd_http_headers_destroy(ctx->headers);
+	xnd_free(ctx);
+}
+
+int
+xnd_context_warmup(xnd_context_t *ctx, const xnd_warmup_options_t *options)
+{
+	if (ctx == NULL || options == NULL)
+		return -1;
+
+	if (xnd_http_pool_keepalive(ctx->pool, options->keepalive_idle) == -1)
+		return -1;
+
+	if (options->pin_dns &&
+	    xnd_http_pool_resolve(ctx->pool, XND_BASEURL) == -1)
+		return -1;
+
+	return xnd_http_pool_warmup(ctx->pool, XND_BASEURL,
+	                            options->connections);
+}
+
+int
+xnd_context_connections(xnd_context_t *ctx, unsigned int max)
+{
+	if (ctx == NULL)
+		return -1;
+
+	return xnd_http_pool_connections(ctx->pool, (long) max);
+}
+
+int
+xnd_context_tls_cache(xnd_context_t *ctx, const char *path, long max_age)
+{
+	if (ctx == NULL)
+		return -1;
+
+	return xnd_http_pool_tls_cache(ctx->pool, path, max_age);
+}
+
+int
+xnd_context_sidecar(xnd_context_t *ctx, const char *endpoint)
+{
+	if (ctx == NULL)
+		return -1;
+
+	return xnd_http_pool_sidecar(ctx->pool, endpoint);
+}
+
+int
+xnd_context_concurrency(xnd_context_t *ctx,
+                        const xnd_concurrency_options_t *options)
+{
+	xnd_limiter_t *limiter = NULL;
+
+	if (ctx == NULL)
+		return -1;
+
+	if (options != NULL) {
+		unsigned int weights[XND_PRIORITIES] = { 4U, 1U };
+
+		limiter = xnd_limiter_new(options->initial, options->min,
+		                          options->max, options->tolerance,
+		                          options->wait_ms);
+		if (limiter == NULL)
+			return -1;
+
+		/** Zeroed weights keep the defaults */
+		if (options->weights[0] != 0U || options->weights[1] != 0U)
+			memcpy(weights, options->weights, sizeof(weights));
+		if (xnd_limiter_lanes(limiter, weights,
+		                      options->reserved) == -1) {
+			xnd_limiter_destroy(limiter);
+			return -1;
+		}
+	}
+
+	xnd_limiter_destroy(ctx->limiter);
+	ctx->limiter = limiter;
+
+	return 0;
+}
+
+int
+xnd_context_breaker(xnd_context_t *ctx, const xnd_breaker_options_t *options)
+{
+	xnd_breakers_t *breakers = NULL;
+
+	if (ctx == NULL)
+		return -1;
+
+	if (options != NULL) {
+		breakers = xnd_breakers_new(options->failures,
+		                            options->cooldown_ms,
+		                            options->probes);
+		if (breakers == NULL)
+			return -1;
+	}
+
+	xnd_breakers_destroy(ctx->breakers);
+	ctx->breakers = breakers;
+
+	return 0;
+}
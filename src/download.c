@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "http_request.h"
+#include "sink.h"
+#include "xendit_private.h"
+
+/** Transfer of a download, the response status decides on the sink. */
+typedef struct xnd_download_t {
+	xnd_http_request_t *req;  /** The HTTP request. */
+	xnd_sink_t         *sink; /** The sink of the body. */
+} xnd_download_t;
+
+/** Write callback of downloads, error bodies are dropped. */
+static size_t
+xnd_download_cb(char *ptr, size_t size, size_t nmemb, void *data);
+
+int
+xnd_client_download(const xnd_client_t *x, const char *url,
+                    xnd_sink_t *sink)
+{
+	xnd_http_request_t *req;
+	xnd_download_t download;
+	int status = 0;
+
+	if (x == NULL || url == NULL || sink == NULL || sink->failed)
+		return -1;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, url);
+	if (req == NULL)
+		return -1;
+
+	/** Client headers, credentials, pool and limits */
+	if (xnd_client_request(x, req) == -1) {
+		xnd_http_request_destroy(req);
+		return -1;
+	}
+
+	/** Callback */
+	download.req = req;
+	download.sink = sink;
+	xnd_http_request_callback(req, xnd_download_cb);
+
+	/** Send request, one breaker for every file, a sink refusing a chunk
+	    aborts the transfer */
+	if (xnd_client_send(x, req, "download", &download) == -1 ||
+	    req->status < 200L || req->status > 299L)
+		status = -1;
+
+	if (xnd_sink_flush(sink) == -1)
+		status = -1;
+
+	xnd_http_request_destroy(req);
+
+	return status;
+}
+
+static size_t
+xnd_download_cb(char *ptr, size_t size, size_t nmemb, void *data)
+{
+	xnd_download_t *download = data;
+	size_t realsize = size * nmemb;
+
+	if (download->req->status < 200L || download->req->status > 299L)
+		return realsize;
+
+	if (xnd_sink_write(download->sink, ptr, realsize) == -1)
+		return 0UL;
+
+	return realsize;
+}
@@ -0,0 +1,369 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "endpoints.h"
+#include "http_request.h"
+#include "xendit_private.h"
+
+/** Sets up the checker, and starts it if health checks are asked for. */
+static int
+xnd_endpoints_start(xnd_endpoints_t *e);
+
+/** Starts the health checks over in a forked child, once. */
+static void
+xnd_endpoints_forked(xnd_endpoints_t *e, unsigned int forks);
+
+/** Checks the health of the endpoints every interval. */
+static void *
+xnd_endpoints_run(void *arg);
+
+/** Sends a HEAD request to an endpoint, bounded by the check interval. */
+static int
+xnd_endpoints_check(xnd_endpoints_t *e, xnd_endpoint_t *ep);
+
+/** Feeds a latency sample into the moving average of an endpoint. */
+static void
+xnd_endpoints_sample(xnd_endpoints_t *e, xnd_endpoint_t *ep,
+                     unsigned long long latency);
+
+/** Copies a base URL, without its trailing '/'. */
+static int
+xnd_endpoints_copy(xnd_endpoint_t *ep, const char *url);
+
+/** Load of an endpoint, lower is better. */
+static unsigned long long
+xnd_endpoints_load(xnd_endpoint_t *ep);
+
+xnd_endpoints_t *
+xnd_endpoints_new(const char *const *urls, unsigned int n,
+                  const xnd_endpoint_options_t *options,
+                  xnd_http_pool_t *pool)
+{
+	xnd_endpoints_t *e;
+
+	if (urls == NULL || n == 0U || n > XND_ENDPOINTS_MAX || pool == NULL)
+		return NULL;
+
+	if (options != NULL &&
+	    (options->check_ms < 0L || options->alpha < 0.0 ||
+	     options->alpha > 1.0))
+		return NULL;
+
+	e = xnd_calloc(1UL, sizeof(xnd_endpoints_t));
+	if (e == NULL)
+		return NULL;
+
+	for (e->n = 0U; e->n < n; ++(e->n)) {
+		if (xnd_endpoints_copy(&(e->endpoints[e->n]), urls[e->n]) == -1)
+			goto fail;
+		/** Healthy until proven otherwise. */
+		atomic_init(&(e->endpoints[e->n].healthy), 1);
+	}
+
+	e->alpha = XND_ENDPOINTS_ALPHA;
+	if (options != NULL && options->alpha > 0.0)
+		e->alpha = options->alpha;
+	e->check_ms = options != NULL ? options->check_ms : 0L;
+	e->pool = pool;
+	atomic_init(&(e->forks), xnd_sdk_forks());
+
+	if (xnd_endpoints_start(e) == -1)
+		goto fail;
+
+	return e;
+
+fail:
+	for (unsigned int i = 0U; i < e->n; ++i)
+		xnd_free(e->endpoints[i].url);
+	xnd_free(e);
+
+	return NULL;
+}
+
+void
+xnd_endpoints_destroy(xnd_endpoints_t *e)
+{
+	if (e == NULL)
+		return;
+
+	/** In a child which never picked, the checker and its lock, maybe held
+	    at fork(), are the parent's: not joined, not destroyed. */
+	if (atomic_load(&(e->forks)) == xnd_sdk_forks()) {
+		if (e->running) {
+			pthread_mutex_lock(&(e->lock));
+			e->stopping = 1;
+			pthread_cond_signal(&(e->wake));
+			pthread_mutex_unlock(&(e->lock));
+			pthread_join(e->thread, NULL);
+		}
+
+		pthread_cond_destroy(&(e->wake));
+		pthread_mutex_destroy(&(e->lock));
+	}
+
+	for (unsigned int i = 0U; i < e->n; ++i)
+		xnd_free(e->endpoints[i].url);
+	xnd_free(e);
+}
+
+int
+xnd_endpoints_pick(xnd_endpoints_t *e, unsigned int tried)
+{
+	static _Thread_local unsigned int seed;
+	unsigned long long now = xnd_http_request_now();
+	unsigned int up[XND_ENDPOINTS_MAX], left[XND_ENDPOINTS_MAX];
+	unsigned int nup = 0U, nleft = 0U, *from, n, a, b;
+	unsigned int forks = xnd_sdk_forks();
+	xnd_endpoint_t *ep;
+
+	if (atomic_load_explicit(&(e->forks), memory_order_relaxed) != forks)
+		xnd_endpoints_forked(e, forks);
+
+	for (unsigned int i = 0U; i < e->n; ++i) {
+		if (tried & (1U << i))
+			continue;
+		ep = &(e->endpoints[i]);
+		left[nleft++] = i;
+		if (atomic_load(&(ep->healthy)) ||
+		    now >= atomic_load(&(ep->retry_at)))
+			up[nup++] = i;
+	}
+
+	/** Unreachable endpoints are still better than none. */
+	from = nup > 0U ? up : left;
+	n = nup > 0U ? nup : nleft;
+	if (n == 0U)
+		return -1;
+
+	if (seed == 0U)
+		seed = (unsigned int) now | 1U;
+
+	/** Two distinct endpoints at random, the less loaded one wins. */
+	a = from[(unsigned int) rand_r(&seed) % n];
+	if (n > 1U) {
+		b = from[(unsigned int) rand_r(&seed) % (n - 1U)];
+		if (b == a)
+			b = from[n - 1U];
+		if (xnd_endpoints_load(&(e->endpoints[b])) <
+		    xnd_endpoints_load(&(e->endpoints[a])))
+			a = b;
+	}
+
+	atomic_fetch_add(&(e->endpoints[a].inflight), 1U);
+	atomic_fetch_add(&(e->endpoints[a].requests), 1UL);
+
+	return (int) a;
+}
+
+void
+xnd_endpoints_record(xnd_endpoints_t *e, int i, unsigned long long latency,
+                     int unreachable)
+{
+	xnd_endpoint_t *ep = &(e->endpoints[i]);
+
+	atomic_fetch_sub(&(ep->inflight), 1U);
+
+	if (unreachable) {
+		atomic_fetch_add(&(ep->failures), 1UL);
+		atomic_store(&(ep->healthy), 0);
+		atomic_store(&(ep->retry_at), xnd_http_request_now() +
+		             (unsigned long long) XND_ENDPOINTS_RETRY_MS *
+		             1000000ULL);
+		return;
+	}
+
+	atomic_store(&(ep->healthy), 1);
+	if (latency > 0ULL)
+		xnd_endpoints_sample(e, ep, latency);
+}
+
+int
+xnd_endpoints_rebase(const xnd_endpoints_t *e, int i, xnd_string_t **url,
+                     size_t *base)
+{
+	const xnd_endpoint_t *ep = &(e->endpoints[i]);
+	size_t size = (*url)->size - *base + ep->size;
+
+	if (xnd_string_reserve(url, size) == -1)
+		return -1;
+
+	memmove((*url)->data + ep->size, (*url)->data + *base,
+	        (*url)->size - *base + 1UL);
+	memcpy((*url)->data, ep->url, ep->size);
+	(*url)->size = size;
+	*base = ep->size;
+
+	return 0;
+}
+
+static int
+xnd_endpoints_start(xnd_endpoints_t *e)
+{
+	pthread_condattr_t attr;
+
+	pthread_mutex_init(&(e->lock), NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(e->wake), &attr);
+	pthread_condattr_destroy(&attr);
+
+	e->stopping = 0;
+	e->running = 0;
+	if (e->check_ms > 0L) {
+		if (pthread_create(&(e->thread), NULL, xnd_endpoints_run,
+		                   e) != 0) {
+			pthread_cond_destroy(&(e->wake));
+			pthread_mutex_destroy(&(e->lock));
+			return -1;
+		}
+		e->running = 1;
+	}
+
+	return 0;
+}
+
+static void
+xnd_endpoints_forked(xnd_endpoints_t *e, unsigned int forks)
+{
+	unsigned int seen = atomic_load(&(e->forks));
+
+	/** Only the first thread of the child to pick gets to restart it. */
+	if (seen == forks ||
+	    !atomic_compare_exchange_strong(&(e->forks), &seen, forks))
+		return;
+
+	/** Without a checker the endpoints are only judged by the calls. */
+	if (xnd_endpoints_start(e) == -1) {
+		pthread_mutex_init(&(e->lock), NULL);
+		pthread_cond_init(&(e->wake), NULL);
+	}
+}
+
+static void *
+xnd_endpoints_run(void *arg)
+{
+	xnd_endpoints_t *e = arg;
+	unsigned long long start, due;
+	struct timespec ts;
+	xnd_endpoint_t *ep;
+
+	pthread_mutex_lock(&(e->lock));
+
+	while (!e->stopping) {
+		pthread_mutex_unlock(&(e->lock));
+
+		due = xnd_http_request_now() +
+		      (unsigned long long) e->check_ms * 1000000ULL;
+
+		for (unsigned int i = 0U; i < e->n; ++i) {
+			ep = &(e->endpoints[i]);
+			start = xnd_http_request_now();
+			if (xnd_endpoints_check(e, ep) == -1) {
+				atomic_store(&(ep->healthy), 0);
+				atomic_store(&(ep->retry_at), due);
+				continue;
+			}
+
+			/** Idle endpoints keep a fresh latency, so that a
+			    recovered one wins calls back. */
+			xnd_endpoints_sample(e, ep,
+			                     xnd_http_request_now() - start);
+			atomic_store(&(ep->retry_at), 0ULL);
+			atomic_store(&(ep->healthy), 1);
+		}
+
+		ts.tv_sec = (time_t) (due / 1000000000ULL);
+		ts.tv_nsec = (long) (due % 1000000000ULL);
+
+		pthread_mutex_lock(&(e->lock));
+		while (!e->stopping && xnd_http_request_now() < due)
+			pthread_cond_timedwait(&(e->wake), &(e->lock), &ts);
+	}
+
+	pthread_mutex_unlock(&(e->lock));
+
+	return NULL;
+}
+
+static int
+xnd_endpoints_check(xnd_endpoints_t *e, xnd_endpoint_t *ep)
+{
+	CURL *curl;
+	CURLcode res;
+
+	curl = curl_easy_init();
+	if (curl == NULL)
+		return -1;
+
+	xnd_http_pool_apply(e->pool, curl);
+	xnd_http_pool_url(e->pool, curl, ep->url);
+	curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, e->check_ms);
+	res = curl_easy_perform(curl);
+	curl_easy_cleanup(curl);
+
+	if (res != CURLE_OK)
+		return -1;
+
+	return 0;
+}
+
+static void
+xnd_endpoints_sample(xnd_endpoints_t *e, xnd_endpoint_t *ep,
+                     unsigned long long latency)
+{
+	unsigned long long old, avg;
+
+	old = atomic_load(&(ep->ewma));
+	do {
+		if (old == 0ULL)
+			avg = latency;
+		else
+			avg = (unsigned long long) ((double) old + e->alpha *
+			      ((double) latency - (double) old));
+		if (avg == 0ULL)
+			avg = 1ULL;
+	} while (!atomic_compare_exchange_weak(&(ep->ewma), &old, avg));
+}
+
+static int
+xnd_endpoints_copy(xnd_endpoint_t *ep, const char *url)
+{
+	size_t size;
+
+	if (url == NULL ||
+	    (strncmp(url, "http://", 7UL) != 0 &&
+	     strncmp(url, "https://", 8UL) != 0))
+		return -1;
+
+	size = strlen(url);
+	while (size > 0UL && url[size - 1UL] == '/')
+		--size;
+
+	ep->url = xnd_malloc(size + 1UL);
+	if (ep->url == NULL)
+		return -1;
+
+	memcpy(ep->url, url, size);
+	ep->url[size] = '\0';
+	ep->size = size;
+
+	return 0;
+}
+
+static unsigned long long
+xnd_endpoints_load(xnd_endpoint_t *ep)
+{
+	/** Endpoints not measured yet are tried first. */
+	return atomic_load(&(ep->ewma)) *
+	       (atomic_load(&(ep->inflight)) + 1ULL);
+}
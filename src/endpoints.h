@@ -0,0 +1,124 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_ENDPOINTS_H
+#define XND_ENDPOINTS_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "http_pool.h"
+#include "strings.h"
+#include "xendit.h"
+
+/** Default weight of a latency sample in the moving average. */
+#define XND_ENDPOINTS_ALPHA (0.2)
+
+/** Time an unreachable endpoint is left alone without health checks. */
+#define XND_ENDPOINTS_RETRY_MS (5000L)
+
+/**
+ * \brief Base URL a client sends its calls to.
+ */
+typedef struct xnd_endpoint_t {
+	char               *url;      /** Base URL, without a trailing '/'. */
+	size_t              size;     /** Size of the base URL. */
+	atomic_ullong       ewma;     /** Latency moving average in ns, 0 when
+	                                  not measured yet. */
+	atomic_uint         inflight; /** Calls in flight. */
+	atomic_int          healthy;  /** Whether it was last reachable. */
+	atomic_ullong       retry_at; /** When an unreachable endpoint is
+	                                  tried again, in ns. */
+	atomic_ulong        requests; /** Calls sent to it. */
+	atomic_ulong        failures; /** Calls which could not reach it. */
+} xnd_endpoint_t;
+
+/**
+ * \brief Set of interchangeable base URLs, e.g. regional egress proxies.
+ */
+typedef struct xnd_endpoints_t {
+	xnd_endpoint_t      endpoints[XND_ENDPOINTS_MAX]; /** Endpoints. */
+	unsigned int        n;        /** Number of endpoints. */
+	double              alpha;    /** Weight of a latency sample. */
+	long                check_ms; /** Interval of health checks, 0 if
+	                                  none. */
+	xnd_http_pool_t    *pool;     /** Pool of the health checks. */
+	pthread_mutex_t     lock;     /** Guards the checker. */
+	pthread_cond_t      wake;     /** Wakes the checker up. */
+	pthread_t           thread;   /** Health checker. */
+	int                 running;  /** Whether the checker was started. */
+	int                 stopping; /** Set once destroyed. */
+	atomic_uint         forks;    /** Fork generation of the checker, see
+	                                  `xnd_sdk_forks()`. */
+} xnd_endpoints_t;
+
+/**
+ * \brief Creates a set of endpoints, and starts checking their health in the
+ * background if asked to.
+ * \param urls The base URLs.
+ * \param n The number of base URLs, at most `XND_ENDPOINTS_MAX`.
+ * \param options The options, NULL for defaults.
+ * \param pool The connection pool of the health checks.
+ * \return NULL on failure.
+ */
+extern xnd_endpoints_t *
+xnd_endpoints_new(const char *const *urls, unsigned int n,
+                  const xnd_endpoint_options_t *options,
+                  xnd_http_pool_t *pool);
+
+/**
+ * \brief Stops the health checks and destroys a set of endpoints. The checker
+ * of a parent is left alone in a forked child, it does not exist there.
+ * \param e The set of endpoints.
+ */
+extern void
+xnd_endpoints_destroy(xnd_endpoints_t *e);
+
+/**
+ * \brief Picks the better of two random endpoints, by their latency and calls
+ * in flight, among those not tried yet. Unreachable endpoints are only picked
+ * when nothing else is left. The call is counted in flight until recorded.
+ * In a forked child, the first pick starts the health checks over.
+ * \param e The set of endpoints.
+ * \param tried The endpoints tried already, as a bit mask.
+ * \return The index of the endpoint, -1 if every endpoint was tried.
+ */
+extern int
+xnd_endpoints_pick(xnd_endpoints_t *e, unsigned int tried);
+
+/**
+ * \brief Records the outcome of a call sent to an endpoint.
+ * \param e The set of endpoints.
+ * \param i The index of the endpoint.
+ * \param latency The latency of the call in ns, 0 if it failed.
+ * \param unreachable Whether the call could not reach the endpoint, which is
+ * then skipped for a while.
+ */
+extern void
+xnd_endpoints_record(xnd_endpoints_t *e, int i, unsigned long long latency,
+                     int unreachable);
+
+/**
+ * \brief Moves a URL onto the base URL of an endpoint.
+ * \param e The set of endpoints.
+ * \param i The index of the endpoint.
+ * \param url The URL.
+ * \param base The size of the current base URL of the URL, updated.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_endpoints_rebase(const xnd_endpoints_t *e, int i, xnd_string_t **url,
+                     size_t *base);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,270 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flight.h"
+#include "xendit.h"
+
+/** The size of a dumped line, longer lines are truncated. */
+#define XND_FLIGHT_LINE (256U)
+
+/** Line being formatted by a dump. */
+typedef struct xnd_flight_line_t {
+	char   data[XND_FLIGHT_LINE]; /** Formatted bytes. */
+	size_t size;                  /** Bytes used. */
+} xnd_flight_line_t;
+
+/** Rings of every thread so far, outliving the SDK to be dumped. */
+static xnd_registry_t xnd_flight_rings = XND_REGISTRY_INIT(xnd_flight_ring_t);
+
+/** Ring of the calling thread, claimed on its first request. */
+static _Thread_local xnd_flight_ring_t *xnd_flight_ring = NULL;
+
+/** File descriptor dumped to on signal. */
+static volatile sig_atomic_t xnd_flight_signal_fd = 2;
+
+/** Reads a clock in ns. */
+static uint64_t
+xnd_flight_now(clockid_t clock);
+
+/** Appends a string to a line, async-signal-safe. */
+static void
+xnd_flight_str(xnd_flight_line_t *line, const char *str);
+
+/** Appends a number to a line, async-signal-safe. */
+static void
+xnd_flight_num(xnd_flight_line_t *line, long long num, int width);
+
+/** Dumps on signal. */
+static void
+xnd_flight_handler(int signo);
+
+void
+xnd_flight_request(const xnd_http_request_t *req, unsigned long long start,
+                   unsigned int attempts, int res)
+{
+	xnd_flight_ring_t *ring = xnd_flight_ring;
+	xnd_flight_record_t *r;
+	curl_off_t connect = 0, first = 0, received = 0;
+	unsigned int n;
+	uint32_t seq;
+	uint64_t total;
+	const char *path;
+	size_t size;
+
+	if (ring == NULL) {
+		ring = (xnd_flight_ring_t *)
+		       xnd_registry_claim(&xnd_flight_rings);
+		if (ring == NULL)
+			return;
+		xnd_flight_ring = ring;
+	}
+
+	total = xnd_flight_now(CLOCK_MONOTONIC) - start;
+
+	/** Timings of the last attempt, when it went through curl. */
+	if (req->curl != NULL) {
+		curl_easy_getinfo(req->curl, CURLINFO_CONNECT_TIME_T, &connect);
+		curl_easy_getinfo(req->curl, CURLINFO_STARTTRANSFER_TIME_T,
+		                  &first);
+		curl_easy_getinfo(req->curl, CURLINFO_SIZE_DOWNLOAD_T,
+		                  &received);
+	}
+
+	path = strstr(req->url->data, "://");
+	path = path != NULL ? strchr(path + 3, '/') : req->url->data;
+	if (path == NULL)
+		path = "/";
+
+	n = atomic_load_explicit(&(ring->next), memory_order_relaxed);
+	r = &(ring->records[n & (XND_FLIGHT_RECORDS - 1U)]);
+
+	/** Only this thread writes, the sequence is made odd meanwhile. */
+	seq = atomic_load_explicit(&(r->seq), memory_order_relaxed);
+	atomic_store_explicit(&(r->seq), seq + 1U, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	r->status     = (int32_t) req->status;
+	r->error      = req->error != 0 ? req->error : (res == -1 ? -1 : 0);
+	r->attempts   = attempts;
+	r->start      = xnd_flight_now(CLOCK_REALTIME) - total;
+	r->connect_us = (uint32_t) connect;
+	r->first_us   = (uint32_t) first;
+	r->total_us   = (uint32_t) (total / 1000ULL);
+	r->sent       = req->payload != NULL ? strlen(req->payload) :
+	                req->body != NULL ? req->body->size : 0U;
+	r->received   = (uint64_t) received;
+
+	size = strlen(req->method);
+	if (size > sizeof(r->method))
+		size = sizeof(r->method);
+	memset(r->method, 0, sizeof(r->method));
+	memcpy(r->method, req->method, size);
+
+	size = strcspn(path, "?");
+	if (size >= sizeof(r->endpoint))
+		size = sizeof(r->endpoint) - 1UL;
+	memcpy(r->endpoint, path, size);
+	r->endpoint[size] = '\0';
+
+	atomic_store_explicit(&(r->seq), seq + 2U, memory_order_release);
+	atomic_store_explicit(&(ring->next), n + 1U, memory_order_release);
+}
+
+int
+xnd_flight_dump(int fd)
+{
+	xnd_flight_record_t copy;
+	xnd_flight_line_t line;
+	int dumped = 0;
+
+	if (fd < 0)
+		return -1;
+
+	for (xnd_registry_entry_t *e = atomic_load(&(xnd_flight_rings.head));
+	     e != NULL; e = e->link) {
+		xnd_flight_ring_t *ring = (xnd_flight_ring_t *) e;
+		unsigned int next, n;
+
+		next = atomic_load_explicit(&(ring->next),
+		                            memory_order_acquire);
+		n = next < XND_FLIGHT_RECORDS ? next : XND_FLIGHT_RECORDS;
+
+		/** Oldest first, records rewritten meanwhile are skipped. */
+		for (unsigned int i = next - n; i != next; ++i) {
+			xnd_flight_record_t *r;
+			uint32_t seq;
+
+			r = &(ring->records[i & (XND_FLIGHT_RECORDS - 1U)]);
+			seq = atomic_load_explicit(&(r->seq),
+			                           memory_order_acquire);
+			if (seq & 1U)
+				continue;
+			memcpy(&copy, r, sizeof(copy));
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&(r->seq),
+			                         memory_order_relaxed) != seq)
+				continue;
+
+			copy.method[sizeof(copy.method) - 1UL] = '\0';
+			copy.endpoint[sizeof(copy.endpoint) - 1UL] = '\0';
+
+			line.size = 0UL;
+			xnd_flight_str(&line, "xnd-flight ring=");
+			xnd_flight_num(&line, (long long) ring->entry.id, 0);
+			xnd_flight_str(&line, " start=");
+			xnd_flight_num(&line, (long long) (copy.start /
+			                                   1000000000ULL), 0);
+			xnd_flight_str(&line, ".");
+			xnd_flight_num(&line, (long long) (copy.start %
+			                                   1000000000ULL), 9);
+			xnd_flight_str(&line, " ");
+			xnd_flight_str(&line, copy.method);
+			xnd_flight_str(&line, " ");
+			xnd_flight_str(&line, copy.endpoint);
+			xnd_flight_str(&line, " status=");
+			xnd_flight_num(&line, copy.status, 0);
+			xnd_flight_str(&line, " error=");
+			xnd_flight_num(&line, copy.error, 0);
+			xnd_flight_str(&line, " attempts=");
+			xnd_flight_num(&line, copy.attempts, 0);
+			xnd_flight_str(&line, " connect_us=");
+			xnd_flight_num(&line, copy.connect_us, 0);
+			xnd_flight_str(&line, " first_us=");
+			xnd_flight_num(&line, copy.first_us, 0);
+			xnd_flight_str(&line, " total_us=");
+			xnd_flight_num(&line, copy.total_us, 0);
+			xnd_flight_str(&line, " sent=");
+			xnd_flight_num(&line, copy.sent, 0);
+			xnd_flight_str(&line, " received=");
+			xnd_flight_num(&line, (long long) copy.received, 0);
+			xnd_flight_str(&line, "\n");
+			line.data[line.size - 1UL] = '\n';
+
+			if (write(fd, line.data, line.size) !=
+			    (ssize_t) line.size)
+				return -1;
+			++dumped;
+		}
+	}
+
+	return dumped;
+}
+
+int
+xnd_flight_dump_on_signal(int signo, int fd)
+{
+	struct sigaction sa;
+
+	if (fd < 0)
+		return -1;
+
+	xnd_flight_signal_fd = fd;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = xnd_flight_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&(sa.sa_mask));
+
+	return sigaction(signo, &sa, NULL) == 0 ? 0 : -1;
+}
+
+static uint64_t
+xnd_flight_now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void
+xnd_flight_str(xnd_flight_line_t *line, const char *str)
+{
+	while (*str && line->size < sizeof(line->data))
+		line->data[line->size++] = *str++;
+}
+
+static void
+xnd_flight_num(xnd_flight_line_t *line, long long num, int width)
+{
+	char digits[24];
+	unsigned long long u;
+	int n = 0;
+
+	if (num < 0LL && line->size < sizeof(line->data))
+		line->data[line->size++] = '-';
+	u = num < 0LL ? 0ULL - (unsigned long long) num
+	              : (unsigned long long) num;
+
+	do {
+		digits[n++] = (char) ('0' + u % 10ULL);
+		u /= 10ULL;
+	} while (u > 0ULL);
+	while (n < width)
+		digits[n++] = '0';
+
+	while (n > 0 && line->size < sizeof(line->data))
+		line->data[line->size++] = digits[--n];
+}
+
+static void
+xnd_flight_handler(int signo)
+{
+	int saved = errno;
+
+	(void) signo;
+
+	xnd_flight_dump(xnd_flight_signal_fd);
+	errno = saved;
+}
@@ -0,0 +1,71 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_FLIGHT_H
+#define XND_FLIGHT_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "http_request.h"
+#include "registry.h"
+
+/** The number of records kept per thread, a power of two. */
+#define XND_FLIGHT_RECORDS (128U)
+
+/** The maximum size of a recorded endpoint path, including NTB. */
+#define XND_FLIGHT_ENDPOINT_MAX (48U)
+
+/**
+ * \brief Compact record of a finished request.
+ */
+typedef struct xnd_flight_record_t {
+	_Atomic uint32_t seq;         /** Sequence number, odd while written. */
+	int32_t          status;      /** HTTP status, 0 without response. */
+	int32_t          error;       /** Transport error, -1 if unknown. */
+	uint32_t         attempts;    /** Attempts, retries included. */
+	uint64_t         start;       /** Start, ns since the epoch. */
+	uint32_t         connect_us;  /** Time to connect, 0 if reused. */
+	uint32_t         first_us;    /** Time to the first byte. */
+	uint32_t         total_us;    /** Time until done. */
+	uint32_t         sent;        /** Bytes of payload sent. */
+	uint64_t         received;    /** Bytes of body received. */
+	char             method[8];   /** HTTP method, NTB if it fits. */
+	char             endpoint[XND_FLIGHT_ENDPOINT_MAX]; /** URL path. */
+} xnd_flight_record_t;
+
+/**
+ * \brief Ring of the last records of a thread. Only its thread writes to it,
+ * without locks, dumps read it through the seqlocks of the records. Rings of
+ * exited threads are kept and handed over to new threads.
+ */
+typedef struct xnd_flight_ring_t {
+	xnd_registry_entry_t entry; /** Entry of the registry of rings, its ID
+	                                numbering the ring in dumps. */
+	atomic_uint          next;  /** Records written so far. */
+	xnd_flight_record_t  records[XND_FLIGHT_RECORDS];
+} xnd_flight_ring_t;
+
+/**
+ * \brief Records a finished request in the ring of the calling thread.
+ * \param req The HTTP request, its URL without the query string yet.
+ * \param start The start of the request on the monotonic clock in ns.
+ * \param attempts The number of attempts made.
+ * \param res The result of the request, 0 if a response was received.
+ */
+extern void
+xnd_flight_request(const xnd_http_request_t *req, unsigned long long start,
+                   unsigned int attempts, int res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
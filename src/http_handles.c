@@ -0,0 +1,94 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "http_handles.h"
+
+/** Caches of every thread so far. */
+static xnd_registry_t xnd_http_handles_all =
+	XND_REGISTRY_INIT(xnd_http_handles_t);
+
+/** Cache of the calling thread, claimed on its first request. */
+static _Thread_local xnd_http_handles_t *xnd_http_handles_own = NULL;
+
+/** Claims a released cache or creates a new one. */
+static xnd_http_handles_t *
+xnd_http_handles_claim(void);
+
+CURL *
+xnd_http_handles_get(void)
+{
+	xnd_http_handles_t *h = xnd_http_handles_own;
+	CURL *curl;
+
+	/** A new thread may claim the warm instances of one gone. */
+	if (h == NULL)
+		h = xnd_http_handles_own = xnd_http_handles_claim();
+
+	if (h != NULL && h->n > 0U)
+		return h->curl[--(h->n)];
+
+	curl = curl_easy_init();
+	if (curl == NULL)
+		return NULL;
+
+	/** Timeouts must not rely on signals in threaded callers. */
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+	return curl;
+}
+
+void
+xnd_http_handles_put(CURL *curl)
+{
+	xnd_http_handles_t *h = xnd_http_handles_own;
+
+	if (curl == NULL)
+		return;
+
+	if (h == NULL)
+		h = xnd_http_handles_own = xnd_http_handles_claim();
+
+	if (h == NULL || h->n == XND_HTTP_HANDLES_MAX) {
+		curl_easy_cleanup(curl);
+		return;
+	}
+
+	/** Connections are kept by the share of the pool, not the instance,
+	    which is detached so that the pool may go before it. */
+	curl_easy_setopt(curl, CURLOPT_SHARE, NULL);
+	curl_easy_reset(curl);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+	h->curl[(h->n)++] = curl;
+}
+
+void
+xnd_http_handles_flush(void)
+{
+	xnd_registry_entry_t *e;
+	xnd_http_handles_t *h;
+
+	/** Every thread is done with the SDK by then, see xendit.h, and no
+	    instance may outlive the allocator it was built with. */
+	for (e = atomic_load(&(xnd_http_handles_all.head)); e != NULL;
+	     e = e->link) {
+		h = (xnd_http_handles_t *) e;
+		while (h->n > 0U)
+			curl_easy_cleanup(h->curl[--(h->n)]);
+	}
+}
+
+void
+xnd_http_handles_forked(void)
+{
+	xnd_registry_forked(&xnd_http_handles_all);
+}
+
+static xnd_http_handles_t *
+xnd_http_handles_claim(void)
+{
+	return (xnd_http_handles_t *) xnd_registry_claim(&xnd_http_handles_all);
+}
@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_HTTP_HANDLES_H
+#define XND_HTTP_HANDLES_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <curl/curl.h>
+
+#include "registry.h"
+
+/** The number of curl instances cached per thread at most. */
+#define XND_HTTP_HANDLES_MAX (4U)
+
+/**
+ * \brief Curl instances of a thread, reset and ready to be reused. Only the
+ * owning thread touches it, so that taking and giving back an instance takes
+ * no lock. It is handed over to another thread once its owner exits.
+ */
+typedef struct xnd_http_handles_t {
+	xnd_registry_entry_t entry; /** Entry of the registry of caches. */
+	CURL                *curl[XND_HTTP_HANDLES_MAX]; /** Instances. */
+	unsigned int         n;     /** Number of instances. */
+} xnd_http_handles_t;
+
+/**
+ * \brief Takes a curl instance from the cache of the calling thread, or
+ * creates one.
+ * \return NULL on failure.
+ */
+extern CURL *
+xnd_http_handles_get(void);
+
+/**
+ * \brief Gives a curl instance back to the cache of the calling thread. It is
+ * detached from its connection pool and reset, or cleaned up if the cache is
+ * full. Only instances used through a pool are given back, others would keep
+ * connections of their own.
+ * \param curl The curl instance, may be NULL.
+ */
+extern void
+xnd_http_handles_put(CURL *curl);
+
+/**
+ * \brief Cleans up the cached instances of every thread, live or exited,
+ * before the global cleanup of libcurl. No thread may be using the SDK.
+ */
+extern void
+xnd_http_handles_flush(void);
+
+/**
+ * \brief Hands the caches of the threads of the parent over in a child
+ * process after `fork()`, but the one of the calling thread.
+ */
+extern void
+xnd_http_handles_forked(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
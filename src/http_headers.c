@@ -0,0 +1,263 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "http_headers.h"
+
+/** The initial number of header records of a set. */
+#define XND_HTTP_HEADERS_INITIAL_CAPACITY (8UL)
+
+/** Finds the index of the header record with the given key. */
+static int
+xnd_http_headers_find(const xnd_http_headers_t *h, const char *key,
+                      size_t keylen, size_t *index);
+
+/** Adds or replaces a header record given the exact key and value sizes. */
+static int
+xnd_http_headers_sized_set(xnd_http_headers_t *h, const char *key,
+                           size_t keylen, const char *value, size_t valuelen);
+
+/** Makes sure the set can hold at least `capacity` header records. */
+static int
+xnd_http_headers_reserve(xnd_http_headers_t *h, size_t capacity);
+
+xnd_http_headers_t *
+xnd_http_headers_new(void)
+{
+	xnd_http_headers_t *h;
+
+	h = xnd_malloc(sizeof(xnd_http_headers_t));
+	if (h == NULL)
+		return NULL;
+
+	h->block = xnd_string_new(NULL);
+	if (h->block == NULL) {
+		xnd_free(h);
+		return NULL;
+	}
+
+	h->lines    = NULL;
+	h->list     = NULL;
+	h->count    = 0UL;
+	h->capacity = 0UL;
+	h->dirty    = 0;
+
+	return h;
+}
+
+void
+xnd_http_headers_destroy(xnd_http_headers_t *h)
+{
+	if (h == NULL)
+		return;
+
+	xnd_string_destroy(&(h->block));
+	xnd_free(h->lines);
+	xnd_free(h->list);
+	xnd_free(h);
+}
+
+int
+xnd_http_headers_set(xnd_http_headers_t *h, const char *key,
+                     const char *value)
+{
+	if (h == NULL || key == NULL || !key[0] || value == NULL || !value[0])
+		return -1;
+
+	return xnd_http_headers_sized_set(h, key, strlen(key), value,
+	                                  strlen(value));
+}
+
+const char *
+xnd_http_headers_get(const xnd_http_headers_t *h, const char *key)
+{
+	size_t index, keylen;
+
+	if (h == NULL || key == NULL || !key[0])
+		return NULL;
+
+	keylen = strlen(key);
+	if (xnd_http_headers_find(h, key, keylen, &index) == -1)
+		return NULL;
+
+	return h->block->data + h->lines[index] + keylen + 2UL;
+}
+
+int
+xnd_http_headers_merge(xnd_http_headers_t *dst, const xnd_http_headers_t *src)
+{
+	if (dst == NULL || src == NULL || dst == src)
+		return -1;
+
+	if (dst->count == 0UL) {
+		/** Bulk copy, the common case of seeding per-call headers
+		    with the static ones. */
+		if (xnd_string_reserve(&(dst->block),
+		                       src->block->size) == -1)
+			return -1;
+		if (xnd_http_headers_reserve(dst, src->count) == -1)
+			return -1;
+
+		memcpy(dst->block->data, src->block->data,
+		       src->block->size + 1UL);
+		memcpy(dst->lines, src->lines, sizeof(size_t) * src->count);
+		dst->block->size = src->block->size;
+		dst->count = src->count;
+		dst->dirty = 1;
+
+		return 0;
+	}
+
+	for (size_t i = 0UL; i < src->count; ++i) {
+		const char *line = src->block->data + src->lines[i];
+		size_t keylen = (size_t) (strchr(line, ':') - line);
+		const char *value = line + keylen + 2UL;
+
+		if (xnd_http_headers_sized_set(dst, line, keylen, value,
+		                               strlen(value)) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+int
+xnd_http_headers_clear(xnd_http_headers_t *h)
+{
+	if (h == NULL)
+		return -1;
+
+	xnd_string_clear(&(h->block));
+	h->count = 0UL;
+	h->dirty = 1;
+
+	return 0;
+}
+
+struct curl_slist *
+xnd_http_headers_slist(xnd_http_headers_t *h)
+{
+	if (h == NULL || h->count == 0UL)
+		return NULL;
+
+	if (h->dirty) {
+		for (size_t i = 0UL; i < h->count; ++i) {
+			h->list[i].data = h->block->data + h->lines[i];
+			h->list[i].next = &(h->list[i + 1UL]);
+		}
+		h->list[h->count - 1UL].next = NULL;
+		h->dirty = 0;
+	}
+
+	return h->list;
+}
+
+static int
+xnd_http_headers_find(const xnd_http_headers_t *h, const char *key,
+                      size_t keylen, size_t *index)
+{
+	for (size_t i = 0UL; i < h->count; ++i) {
+		const char *line = h->block->data + h->lines[i];
+		size_t j;
+
+		for (j = 0UL; j < keylen; ++j)
+			if (tolower((unsigned char) line[j]) !=
+			    tolower((unsigned char) key[j]))
+				break;
+
+		if (j == keylen && line[keylen] == ':') {
+			*index = i;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int
+xnd_http_headers_sized_set(xnd_http_headers_t *h, const char *key,
+                           size_t keylen, const char *value, size_t valuelen)
+{
+	size_t index, offset, oldlen, linelen = keylen + 2UL + valuelen;
+	char *line;
+
+	if (xnd_http_headers_find(h, key, keylen, &index) == 0) {
+		/** Replace in place, shifting the following lines if needed. */
+		offset = h->lines[index];
+		oldlen = strlen(h->block->data + offset);
+
+		if (linelen > oldlen &&
+		    xnd_string_reserve(&(h->block),
+		                       h->block->size + linelen - oldlen) == -1)
+			return -1;
+
+		memmove(
+			h->block->data + offset + linelen + 1UL,
+			h->block->data + offset + oldlen + 1UL,
+			h->block->size - (offset + oldlen + 1UL)
+		);
+
+		for (size_t i = index + 1UL; i < h->count; ++i)
+			h->lines[i] = h->lines[i] + linelen - oldlen;
+
+		h->block->size = h->block->size + linelen - oldlen;
+		line = h->block->data + offset; /** keeps the key casing */
+	} else {
+		if (h->count == h->capacity &&
+		    xnd_http_headers_reserve(h, h->capacity * 2UL) == -1)
+			return -1;
+
+		if (xnd_string_reserve(&(h->block),
+		                       h->block->size + linelen + 1UL) == -1)
+			return -1;
+
+		offset = h->block->size;
+		h->lines[h->count++] = offset;
+		h->block->size += linelen + 1UL;
+
+		line = h->block->data + offset;
+		memcpy(line, key, keylen);
+	}
+
+	memcpy(line + keylen, ": ", 2UL);
+	memcpy(line + keylen + 2UL, value, valuelen);
+	line[linelen] = '\0';
+	h->block->data[h->block->size] = '\0';
+	h->dirty = 1;
+
+	return 0;
+}
+
+static int
+xnd_http_headers_reserve(xnd_http_headers_t *h, size_t capacity)
+{
+	size_t *lines;
+	struct curl_slist *list;
+
+	if (capacity < XND_HTTP_HEADERS_INITIAL_CAPACITY)
+		capacity = XND_HTTP_HEADERS_INITIAL_CAPACITY;
+
+	if (capacity <= h->capacity)
+		return 0; /** No resizing needed */
+
+	lines = xnd_realloc(h->lines, sizeof(size_t) * capacity);
+	if (lines == NULL)
+		return -1;
+	h->lines = lines;
+
+	list = xnd_realloc(h->list, sizeof(struct curl_slist) * capacity);
+	if (list == NULL)
+		return -1;
+	h->list = list;
+
+	h->capacity = capacity;
+	h->dirty = 1;
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_HTTP_HEADERS_H
+#define XND_HTTP_HEADERS_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <curl/curl.h>
+
+#include "strings.h"
+
+/**
+ * \brief Set of HTTP header records. All records are stored as "Key: value"
+ * lines in one contiguous block, each line terminated by NTB, and the list
+ * handed to curl is built on top of that block without any allocation.
+ */
+typedef struct xnd_http_headers_t {
+	xnd_string_t      *block;    /** Header lines, each terminated by NTB. */
+	size_t            *lines;    /** Offset of each line in the block. */
+	struct curl_slist *list;     /** Cached curl list, one node per line. */
+	size_t             count;    /** Number of header lines. */
+	size_t             capacity; /** Capacity of `lines` and `list`. */
+	int                dirty;    /** Whether `list` needs to be relinked. */
+} xnd_http_headers_t;
+
+/**
+ * \brief Creates new empty set of HTTP headers.
+ * \return NULL on failure.
+ */
+extern xnd_http_headers_t *
+xnd_http_headers_new(void);
+
+/**
+ * \brief Destroys set of HTTP headers.
+ * \param h The set of HTTP headers to destroy.
+ */
+extern void
+xnd_http_headers_destroy(xnd_http_headers_t *h);
+
+/**
+ * \brief Adds a header record, or replaces the value in place if a record
+ * with the same key, compared case-insensitively, already exists.
+ * \param h The set of HTTP headers.
+ * \param key The key of the header record.
+ * \param value The value of the header record.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_headers_set(xnd_http_headers_t *h, const char *key,
+                     const char *value);
+
+/**
+ * \brief Retrieves the value of a header record.
+ * \param h The set of HTTP headers.
+ * \param key The key of the header record, compared case-insensitively.
+ * \return NULL if there is no such record.
+ */
+extern const char *
+xnd_http_headers_get(const xnd_http_headers_t *h, const char *key);
+
+/**
+ * \brief Merges header records of `src` into `dst`, records of `src` replace
+ * the ones with the same key in `dst`. Merging into an empty set copies the
+ * whole block at once.
+ * \param dst The set of HTTP headers to merge into.
+ * \param src The set of HTTP headers to merge from.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_headers_merge(xnd_http_headers_t *dst, const xnd_http_headers_t *src);
+
+/**
+ * \brief Removes all header records while keeping the allocated memory for
+ * reuse.
+ * \param h The set of HTTP headers to clear.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_headers_clear(xnd_http_headers_t *h);
+
+/**
+ * \brief Retrieves the curl list of the header records. The list is owned by
+ * the set, stays valid until the set is modified and is only relinked, never
+ * reallocated, when it is stale.
+ * \param h The set of HTTP headers.
+ * \return NULL if the set is empty.
+ */
+extern struct curl_slist *
+xnd_http_headers_slist(xnd_http_headers_t *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,712 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "alloc.h"
+#include "http_pool.h"
+#include "strings.h"
+
+/** Idle connections kept by default, as libcurl does. */
+#define XND_HTTP_POOL_CONNECTIONS (5L)
+
+/** Locks shared data of the curl share instance. */
+static void
+xnd_http_pool_lock(CURL *curl, curl_lock_data data, curl_lock_access access,
+                   void *userptr);
+
+/** Unlocks shared data of the curl share instance. */
+static void
+xnd_http_pool_unlock(CURL *curl, curl_lock_data data, void *userptr);
+
+/** Opens a socket of a pooled connection, tracking it. */
+static curl_socket_t
+xnd_http_pool_open(void *userptr, curlsocktype purpose,
+                   struct curl_sockaddr *address);
+
+/** Closes a socket of a pooled connection. */
+static int
+xnd_http_pool_close(void *userptr, curl_socket_t fd);
+
+/** Creates the curl share instance of a pool. */
+static CURLSH *
+xnd_http_pool_share(xnd_http_pool_t *pool);
+
+/** Releases the locks taken by `xnd_http_pool_prepare()`. */
+static void
+xnd_http_pool_release(xnd_http_pool_t *pool);
+
+/** Whether the host of a sidecar is on loopback. */
+static int
+xnd_http_pool_loopback(const char *host, size_t size);
+
+/** URLs up to this size are downgraded on the stack. */
+#define XND_HTTP_POOL_URL_SIZE (1024)
+
+/** Builds "host:port:address[,address]..." entry of a URL. */
+static xnd_string_t *
+xnd_http_pool_resolve_entry(const char *url, size_t *prefix);
+
+xnd_http_pool_t *
+xnd_http_pool_new(void)
+{
+	xnd_http_pool_t *pool;
+
+	pool = xnd_malloc(sizeof(xnd_http_pool_t));
+	if (pool == NULL)
+		return NULL;
+
+	/** The share locks through them from its creation. */
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+		pthread_mutex_init(&(pool->locks[i]), NULL);
+	pthread_mutex_init(&(pool->sockets_lock), NULL);
+
+	pool->share = xnd_http_pool_share(pool);
+	if (pool->share == NULL) {
+		for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+			pthread_mutex_destroy(&(pool->locks[i]));
+		pthread_mutex_destroy(&(pool->sockets_lock));
+		xnd_free(pool);
+		return NULL;
+	}
+
+	pool->resolve   = NULL;
+	pool->keepalive = 0L;
+	pool->connections = XND_HTTP_POOL_CONNECTIONS;
+	pool->cainfo    = NULL;
+	pool->tls       = NULL;
+	pool->sidecar   = NULL;
+	pool->connect_to = NULL;
+	pool->sockets   = NULL;
+	pool->nsockets  = 0UL;
+	pool->sockets_max = 0UL;
+	atomic_init(&(pool->warm), 0UL);
+	atomic_init(&(pool->cold), 0UL);
+
+	return pool;
+}
+
+void
+xnd_http_pool_destroy(xnd_http_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	curl_share_cleanup(pool->share);
+	curl_slist_free_all(pool->resolve);
+	curl_slist_free_all(pool->connect_to);
+	xnd_tls_cache_close(pool->tls);
+	xnd_free(pool->sidecar);
+	xnd_free(pool->cainfo);
+
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+		pthread_mutex_destroy(&(pool->locks[i]));
+	pthread_mutex_destroy(&(pool->sockets_lock));
+
+	xnd_free(pool->sockets);
+	xnd_free(pool);
+}
+
+int
+xnd_http_pool_resolve(xnd_http_pool_t *pool, const char *url)
+{
+	xnd_string_t *entry;
+	struct curl_slist *resolve = NULL, *tmp;
+	size_t prefix = 0UL;
+
+	if (pool == NULL || url == NULL || !url[0])
+		return -1;
+
+	entry = xnd_http_pool_resolve_entry(url, &prefix);
+	if (entry == NULL)
+		return -1;
+
+	/** Keep the entries of other hosts, replace the one of this host. */
+	for (struct curl_slist *i = pool->resolve; i != NULL; i = i->next) {
+		if (strncmp(i->data, entry->data, prefix) == 0)
+			continue;
+
+		tmp = curl_slist_append(resolve, i->data);
+		if (tmp == NULL)
+			goto fail;
+		resolve = tmp;
+	}
+
+	tmp = curl_slist_append(resolve, entry->data);
+	if (tmp == NULL)
+		goto fail;
+	resolve = tmp;
+
+	xnd_string_destroy(&entry);
+	curl_slist_free_all(pool->resolve);
+	pool->resolve = resolve;
+
+	return 0;
+
+fail:
+	xnd_string_destroy(&entry);
+	curl_slist_free_all(resolve);
+
+	return -1;
+}
+
+int
+xnd_http_pool_keepalive(xnd_http_pool_t *pool, long idle)
+{
+	if (pool == NULL || idle < 0L)
+		return -1;
+
+	pool->keepalive = idle;
+
+	return 0;
+}
+
+int
+xnd_http_pool_connections(xnd_http_pool_t *pool, long max)
+{
+	if (pool == NULL || max < 0L)
+		return -1;
+
+	pool->connections = max ? max : XND_HTTP_POOL_CONNECTIONS;
+
+	return 0;
+}
+
+int
+xnd_http_pool_cainfo(xnd_http_pool_t *pool, const char *path)
+{
+	char *cainfo = NULL;
+
+	if (pool == NULL)
+		return -1;
+
+	if (path != NULL) {
+		cainfo = xnd_strdup(path);
+		if (cainfo == NULL)
+			return -1;
+	}
+
+	xnd_free(pool->cainfo);
+	pool->cainfo = cainfo;
+
+	return 0;
+}
+
+int
+xnd_http_pool_tls_cache(xnd_http_pool_t *pool, const char *path,
+                        long max_age)
+{
+	CURL *curl;
+	int n;
+
+	if (pool == NULL)
+		return -1;
+
+	xnd_tls_cache_close(pool->tls);
+	pool->tls = NULL;
+
+	if (path == NULL)
+		return 0;
+
+	if (! XND_TLS_CACHE_SUPPORTED)
+		return -1;
+
+	pool->tls = xnd_tls_cache_open(path, max_age);
+	if (pool->tls == NULL)
+		return -1;
+
+	/** Sessions are imported into the share through a scratch handle. */
+	curl = curl_easy_init();
+	if (curl == NULL) {
+		xnd_tls_cache_close(pool->tls);
+		pool->tls = NULL;
+		return -1;
+	}
+
+	/** Saving right away also tells whether libcurl was built with session
+	    export, which is an optional feature. */
+	curl_easy_setopt(curl, CURLOPT_SHARE, pool->share);
+	n = xnd_tls_cache_load(pool->tls, curl);
+	if (n == -1 || xnd_tls_cache_save(pool->tls, curl) == -1) {
+		xnd_tls_cache_close(pool->tls);
+		pool->tls = NULL;
+		n = -1;
+	}
+	curl_easy_cleanup(curl);
+
+	return n;
+}
+
+int
+xnd_http_pool_sidecar(xnd_http_pool_t *pool, const char *endpoint)
+{
+	char *sidecar = NULL, *end;
+	struct curl_slist *connect_to = NULL;
+	xnd_string_t *entry;
+	const char *port;
+	size_t size;
+
+	if (pool == NULL)
+		return -1;
+
+	if (endpoint == NULL) {
+		/** Direct connections */
+	} else if (strncmp(endpoint, "unix:", 5UL) == 0 && endpoint[5]) {
+		sidecar = xnd_strdup(endpoint + 5);
+		if (sidecar == NULL)
+			return -1;
+	} else if (strncmp(endpoint, "http://", 7UL) == 0) {
+		/** "host:port", trailing slash aside, the port is mandatory. */
+		endpoint += 7;
+		size = strcspn(endpoint, "/");
+		for (port = endpoint + size; port > endpoint; --port)
+			if (port[-1] == ':')
+				break;
+		if (port <= endpoint + 1 || strtoul(port, &end, 10) == 0UL ||
+		    end != endpoint + size)
+			return -1;
+
+		/** The API key crosses this hop in cleartext. */
+		if (!xnd_http_pool_loopback(endpoint,
+		                            (size_t) (port - endpoint) - 1UL))
+			return -1;
+
+		entry = xnd_string_new("::");
+		if (entry == NULL ||
+		    xnd_string_sized_insert(&entry, endpoint, 2UL, size) == -1) {
+			xnd_string_destroy(&entry);
+			return -1;
+		}
+		connect_to = curl_slist_append(NULL, entry->data);
+		xnd_string_destroy(&entry);
+		if (connect_to == NULL)
+			return -1;
+	} else {
+		return -1;
+	}
+
+	xnd_free(pool->sidecar);
+	curl_slist_free_all(pool->connect_to);
+	pool->sidecar = sidecar;
+	pool->connect_to = connect_to;
+
+	return 0;
+}
+
+int
+xnd_http_pool_warmup(xnd_http_pool_t *pool, const char *url, unsigned int n)
+{
+	CURLM *multi;
+	CURL **handles;
+	CURLMsg *msg;
+	int running, left, opened = 0;
+
+	if (pool == NULL || url == NULL || !url[0])
+		return -1;
+
+	if (n == 0U)
+		return 0;
+
+	multi = curl_multi_init();
+	if (multi == NULL)
+		return -1;
+
+	handles = xnd_calloc(n, sizeof(CURL *));
+	if (handles == NULL) {
+		curl_multi_cleanup(multi);
+		return -1;
+	}
+
+	for (unsigned int i = 0U; i < n; ++i) {
+		handles[i] = curl_easy_init();
+		if (handles[i] == NULL)
+			break;
+
+		xnd_http_pool_apply(pool, handles[i]);
+		xnd_http_pool_url(pool, handles[i], url);
+		curl_easy_setopt(handles[i], CURLOPT_NOBODY, 1L);
+		curl_multi_add_handle(multi, handles[i]);
+	}
+
+	do {
+		if (curl_multi_perform(multi, &running) != CURLM_OK)
+			break;
+		if (running &&
+		    curl_multi_poll(multi, NULL, 0, 1000, NULL) != CURLM_OK)
+			break;
+	} while (running);
+
+	while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+		if (msg->msg == CURLMSG_DONE && msg->data.result == CURLE_OK)
+			++opened;
+
+	if (pool->tls != NULL && handles[0] != NULL)
+		xnd_tls_cache_save(pool->tls, handles[0]);
+
+	/** The connections outlive the handles, they are kept in the share. */
+	for (unsigned int i = 0U; i < n && handles[i] != NULL; ++i) {
+		curl_multi_remove_handle(multi, handles[i]);
+		curl_easy_cleanup(handles[i]);
+	}
+
+	xnd_free(handles);
+	curl_multi_cleanup(multi);
+
+	return opened;
+}
+
+int
+xnd_http_pool_probe(xnd_http_pool_t *pool, const char *url)
+{
+	CURL *curl;
+	CURLcode res;
+
+	if (pool == NULL || url == NULL || !url[0])
+		return -1;
+
+	curl = curl_easy_init();
+	if (curl == NULL)
+		return -1;
+
+	xnd_http_pool_apply(pool, curl);
+	xnd_http_pool_url(pool, curl, url);
+	curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+	res = curl_easy_perform(curl);
+	curl_easy_cleanup(curl);
+
+	if (res != CURLE_OK)
+		return -1;
+
+	return 0;
+}
+
+void
+xnd_http_pool_prepare(xnd_http_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	/** libcurl takes the DNS and TLS session locks with the connection
+	    one held, and sockets are closed with it held too. */
+	for (int i = CURL_LOCK_DATA_LAST - 1; i >= 0; --i)
+		pthread_mutex_lock(&(pool->locks[i]));
+	pthread_mutex_lock(&(pool->sockets_lock));
+}
+
+void
+xnd_http_pool_parent(xnd_http_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	xnd_http_pool_release(pool);
+}
+
+void
+xnd_http_pool_forked(xnd_http_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	/** The parent keeps its own descriptors of these connections. */
+	for (size_t i = 0UL; i < pool->nsockets; ++i)
+		close(pool->sockets[i]);
+	pool->nsockets = 0UL;
+
+	xnd_http_pool_release(pool);
+	pool->share = xnd_http_pool_share(pool);
+
+	/** flock(2) locks belong to the open file, shared with the parent. */
+	if (pool->tls != NULL && xnd_tls_cache_reopen(pool->tls) == -1) {
+		xnd_tls_cache_close(pool->tls);
+		pool->tls = NULL;
+	}
+}
+
+void
+xnd_http_pool_apply(xnd_http_pool_t *pool, CURL *curl)
+{
+	if (pool == NULL || curl == NULL)
+		return;
+
+	curl_easy_setopt(curl, CURLOPT_SHARE, pool->share);
+	curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, xnd_http_pool_open);
+	curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, pool);
+	curl_easy_setopt(curl, CURLOPT_CLOSESOCKETFUNCTION,
+	                 xnd_http_pool_close);
+	curl_easy_setopt(curl, CURLOPT_CLOSESOCKETDATA, pool);
+
+	if (pool->resolve != NULL)
+		curl_easy_setopt(curl, CURLOPT_RESOLVE, pool->resolve);
+
+	if (pool->cainfo != NULL)
+		curl_easy_setopt(curl, CURLOPT_CAINFO, pool->cainfo);
+
+	/** Set either way, so a reused curl instance follows the pool. */
+	curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, pool->sidecar);
+	curl_easy_setopt(curl, CURLOPT_CONNECT_TO, pool->connect_to);
+	curl_easy_setopt(curl, CURLOPT_MAXCONNECTS, pool->connections);
+
+	if (pool->keepalive > 0L) {
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, pool->keepalive);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, pool->keepalive);
+	}
+}
+
+int
+xnd_http_pool_url(xnd_http_pool_t *pool, CURL *curl, const char *url)
+{
+	char buf[XND_HTTP_POOL_URL_SIZE], *downgraded = buf;
+	size_t size;
+	CURLcode res;
+
+	if (curl == NULL || url == NULL)
+		return -1;
+
+	/** The sidecar terminates TLS, "https://host/path" is sent to it as
+	    "http://host/path" so that the logical host and path are kept. */
+	if (pool == NULL ||
+	    (pool->sidecar == NULL && pool->connect_to == NULL) ||
+	    strncmp(url, "https://", 8UL) != 0) {
+		res = curl_easy_setopt(curl, CURLOPT_URL, url);
+		return res == CURLE_OK ? 0 : -1;
+	}
+
+	size = strlen(url);
+	if (size > sizeof(buf)) {
+		downgraded = xnd_malloc(size);
+		if (downgraded == NULL)
+			return -1;
+	}
+
+	memcpy(downgraded, "http", 4UL);
+	memcpy(downgraded + 4, url + 5, size - 4UL); /** NTB included */
+
+	res = curl_easy_setopt(curl, CURLOPT_URL, downgraded); /** copied */
+
+	if (downgraded != buf)
+		xnd_free(downgraded);
+
+	return res == CURLE_OK ? 0 : -1;
+}
+
+void
+xnd_http_pool_account(xnd_http_pool_t *pool, CURL *curl)
+{
+	long connects = 0L;
+
+	if (pool == NULL || curl == NULL)
+		return;
+
+	if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS,
+	                      &connects) != CURLE_OK)
+		return;
+
+	if (connects == 0L) {
+		atomic_fetch_add_explicit(&(pool->warm), 1UL,
+		                          memory_order_relaxed);
+	} else {
+		atomic_fetch_add_explicit(&(pool->cold), 1UL,
+		                          memory_order_relaxed);
+
+		/** A new connection may have brought a new TLS session. */
+		if (pool->tls != NULL)
+			xnd_tls_cache_save(pool->tls, curl);
+	}
+}
+
+static void
+xnd_http_pool_lock(CURL *curl, curl_lock_data data, curl_lock_access access,
+                   void *userptr)
+{
+	xnd_http_pool_t *pool = userptr;
+
+	(void) curl;
+	(void) access;
+
+	pthread_mutex_lock(&(pool->locks[data]));
+}
+
+static void
+xnd_http_pool_unlock(CURL *curl, curl_lock_data data, void *userptr)
+{
+	xnd_http_pool_t *pool = userptr;
+
+	(void) curl;
+
+	pthread_mutex_unlock(&(pool->locks[data]));
+}
+
+static xnd_string_t *
+xnd_http_pool_resolve_entry(const char *url, size_t *prefix)
+{
+	CURLU *u;
+	char *host = NULL, *port = NULL;
+	char addr[INET6_ADDRSTRLEN];
+	struct addrinfo hints, *res = NULL;
+	xnd_string_t *entry = NULL;
+	int n = 0;
+
+	u = curl_url();
+	if (u == NULL)
+		return NULL;
+
+	if (curl_url_set(u, CURLUPART_URL, url, 0) != CURLUE_OK ||
+	    curl_url_get(u, CURLUPART_HOST, &host, 0) != CURLUE_OK ||
+	    curl_url_get(u, CURLUPART_PORT, &port,
+	                 CURLU_DEFAULT_PORT) != CURLUE_OK)
+		goto out;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		goto out;
+
+	entry = xnd_string_new(host);
+	if (entry == NULL)
+		goto out;
+
+	xnd_string_append(&entry, ':');
+	xnd_string_insert(&entry, port, entry->size);
+	xnd_string_append(&entry, ':');
+	*prefix = entry->size;
+
+	for (struct addrinfo *i = res; i != NULL; i = i->ai_next) {
+		const void *src;
+
+		if (i->ai_family == AF_INET)
+			src = &(((struct sockaddr_in *) i->ai_addr)->sin_addr);
+		else if (i->ai_family == AF_INET6)
+			src = &(((struct sockaddr_in6 *) i->ai_addr)->sin6_addr);
+		else
+			continue;
+
+		if (inet_ntop(i->ai_family, src, addr, sizeof(addr)) == NULL)
+			continue;
+
+		if (n++ > 0)
+			xnd_string_append(&entry, ',');
+		if (i->ai_family == AF_INET6)
+			xnd_string_append(&entry, '[');
+		xnd_string_insert(&entry, addr, entry->size);
+		if (i->ai_family == AF_INET6)
+			xnd_string_append(&entry, ']');
+	}
+
+	if (n == 0)
+		xnd_string_destroy(&entry);
+
+out:
+	if (res != NULL)
+		freeaddrinfo(res);
+	curl_free(host);
+	curl_free(port);
+	curl_url_cleanup(u);
+
+	return entry;
+}
+
+static curl_socket_t
+xnd_http_pool_open(void *userptr, curlsocktype purpose,
+                   struct curl_sockaddr *address)
+{
+	xnd_http_pool_t *pool = userptr;
+	curl_socket_t fd;
+	int *sockets;
+
+	(void) purpose;
+
+	fd = socket(address->family, address->socktype | SOCK_CLOEXEC,
+	            address->protocol);
+	if (fd == CURL_SOCKET_BAD)
+		return fd;
+
+	/** An untracked socket only outlives a fork, it still works. */
+	pthread_mutex_lock(&(pool->sockets_lock));
+	if (pool->nsockets == pool->sockets_max) {
+		sockets = xnd_realloc(pool->sockets, sizeof(int) *
+		                      (pool->sockets_max * 2UL + 4UL));
+		if (sockets != NULL) {
+			pool->sockets = sockets;
+			pool->sockets_max = pool->sockets_max * 2UL + 4UL;
+		}
+	}
+	if (pool->nsockets < pool->sockets_max)
+		pool->sockets[pool->nsockets++] = fd;
+	pthread_mutex_unlock(&(pool->sockets_lock));
+
+	return fd;
+}
+
+static int
+xnd_http_pool_close(void *userptr, curl_socket_t fd)
+{
+	xnd_http_pool_t *pool = userptr;
+
+	pthread_mutex_lock(&(pool->sockets_lock));
+	for (size_t i = 0UL; i < pool->nsockets; ++i) {
+		if (pool->sockets[i] == fd) {
+			pool->sockets[i] = pool->sockets[--pool->nsockets];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&(pool->sockets_lock));
+
+	return close(fd);
+}
+
+static void
+xnd_http_pool_release(xnd_http_pool_t *pool)
+{
+	pthread_mutex_unlock(&(pool->sockets_lock));
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+		pthread_mutex_unlock(&(pool->locks[i]));
+}
+
+static int
+xnd_http_pool_loopback(const char *host, size_t size)
+{
+	char addr[INET_ADDRSTRLEN];
+	struct in_addr in;
+
+	if ((size == 9UL && strncmp(host, "localhost", size) == 0) ||
+	    (size == 5UL && strncmp(host, "[::1]", size) == 0))
+		return 1;
+
+	if (size >= sizeof(addr))
+		return 0;
+	memcpy(addr, host, size);
+	addr[size] = '\0';
+
+	/** 127.0.0.0/8 */
+	return inet_pton(AF_INET, addr, &in) == 1 &&
+	       (ntohl(in.s_addr) >> 24) == 127U;
+}
+
+static CURLSH *
+xnd_http_pool_share(xnd_http_pool_t *pool)
+{
+	CURLSH *share = curl_share_init();
+
+	if (share == NULL)
+		return NULL;
+
+	curl_share_setopt(share, CURLSHOPT_LOCKFUNC, xnd_http_pool_lock);
+	curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, xnd_http_pool_unlock);
+	curl_share_setopt(share, CURLSHOPT_USERDATA, pool);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+	return share;
+}
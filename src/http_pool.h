@@ -0,0 +1,206 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_HTTP_POOL_H
+#define XND_HTTP_POOL_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <curl/curl.h>
+
+#include "tls_cache.h"
+
+/**
+ * \brief Connection pool shared by the HTTP requests of a client. It owns a
+ * curl share handle for connections, DNS entries and TLS sessions, and the
+ * addresses pinned at warm-up.
+ */
+typedef struct xnd_http_pool_t {
+	CURLSH            *share;      /** curl share instance. */
+	pthread_mutex_t    locks[CURL_LOCK_DATA_LAST]; /** Share locks. */
+	struct curl_slist *resolve;    /** Pinned "host:port:address" list. */
+	long               keepalive;  /** TCP keepalive idle in seconds. */
+	long               connections; /** Idle connections kept at most. */
+	char              *cainfo;     /** CA bundle path, may be NULL. */
+	xnd_tls_cache_t   *tls;        /** Persistent TLS sessions or NULL. */
+	char              *sidecar;    /** Sidecar Unix socket, may be NULL. */
+	struct curl_slist *connect_to; /** Loopback sidecar, "::host:port". */
+	pthread_mutex_t    sockets_lock; /** Guards the sockets below. */
+	int               *sockets;    /** Sockets of pooled connections. */
+	size_t             nsockets;   /** Number of sockets. */
+	size_t             sockets_max; /** Capacity of the sockets. */
+	atomic_ulong       warm;       /** Requests on reused connections. */
+	atomic_ulong       cold;       /** Requests on new connections. */
+} xnd_http_pool_t;
+
+/**
+ * \brief Creates new connection pool.
+ * \return NULL on failure.
+ */
+extern xnd_http_pool_t *
+xnd_http_pool_new(void);
+
+/**
+ * \brief Destroys connection pool, closing every pooled connection.
+ * \param pool The connection pool to destroy.
+ */
+extern void
+xnd_http_pool_destroy(xnd_http_pool_t *pool);
+
+/**
+ * \brief Resolves the host of a URL and pins its addresses, in the manner of
+ * `CURLOPT_RESOLVE`, for every following request. Calling it again re-pins
+ * the host with freshly resolved addresses.
+ * \param pool The connection pool.
+ * \param url The URL whose host to resolve.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_pool_resolve(xnd_http_pool_t *pool, const char *url);
+
+/**
+ * \brief Sets the TCP keepalive of pooled connections.
+ * \param pool The connection pool.
+ * \param idle The idle time in seconds before keepalive probes are sent, 0
+ * disables TCP keepalive.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_pool_keepalive(xnd_http_pool_t *pool, long idle);
+
+/**
+ * \brief Caps the idle connections kept by the pool, shared by every curl
+ * instance using it, the oldest are closed beyond it.
+ * \param pool The connection pool.
+ * \param max The maximum number of connections, 0 restores the default.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_pool_connections(xnd_http_pool_t *pool, long max);
+
+/**
+ * \brief Sets the CA bundle used to verify peers, e.g. a self-signed
+ * certificate of a local stub.
+ * \param pool The connection pool.
+ * \param path The path of the CA bundle, NULL restores the default.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_pool_cainfo(xnd_http_pool_t *pool, const char *path);
+
+/**
+ * \brief Attaches a persistent TLS session cache to the pool. Unexpired
+ * sessions stored by earlier processes are imported right away, so that the
+ * first handshakes are abbreviated, and sessions are stored back whenever a
+ * transfer opens a new connection.
+ * \param pool The connection pool.
+ * \param path The path of the cache file, NULL detaches the cache.
+ * \param max_age The maximum age of stored sessions in seconds, 0 keeps the
+ * lifetime given by the server.
+ * \return The number of sessions imported, -1 on failure or if libcurl was
+ * built without SSL session export.
+ */
+extern int
+xnd_http_pool_tls_cache(xnd_http_pool_t *pool, const char *path,
+                        long max_age);
+
+/**
+ * \brief Routes every request through a local sidecar proxy terminating TLS,
+ * over a Unix domain socket or plain HTTP on loopback. The URLs of requests
+ * keep their host and path, only "https" is downgraded to "http" on the wire
+ * to the sidecar.
+ * \param pool The connection pool.
+ * \param endpoint The sidecar, "unix:/path/to/socket" or "http://host:port",
+ * NULL connects directly again. The host is one of 127.0.0.0/8, "[::1]" or
+ * "localhost".
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_pool_sidecar(xnd_http_pool_t *pool, const char *endpoint);
+
+/**
+ * \brief Opens connections ahead of time by sending concurrent HEAD requests
+ * to a URL, the connections are then kept in the pool.
+ * \param pool The connection pool.
+ * \param url The URL to connect to.
+ * \param n The number of connections to open.
+ * \return The number of connections opened, -1 on failure.
+ */
+extern int
+xnd_http_pool_warmup(xnd_http_pool_t *pool, const char *url, unsigned int n);
+
+/**
+ * \brief Sends a HEAD request to a URL through the pool, which also keeps a
+ * pooled connection alive.
+ * \param pool The connection pool.
+ * \param url The URL to probe.
+ * \return 0 if the URL is reachable, -1 otherwise.
+ */
+extern int
+xnd_http_pool_probe(xnd_http_pool_t *pool, const char *url);
+
+/**
+ * \brief Takes the locks of the pool before `fork()`, so that neither the
+ * share nor the list of sockets is left half updated in the child.
+ * \param pool The connection pool.
+ */
+extern void
+xnd_http_pool_prepare(xnd_http_pool_t *pool);
+
+/**
+ * \brief Releases the locks of the pool in the parent after `fork()`.
+ * \param pool The connection pool.
+ */
+extern void
+xnd_http_pool_parent(xnd_http_pool_t *pool);
+
+/**
+ * \brief Rebuilds the pool in a child process after `fork()`, releasing its
+ * locks. Connections inherited from the parent are closed in the child only,
+ * without a word on the wire, and the share holding them is abandoned rather
+ * than cleaned up, which would shut their TLS sessions down on behalf of the
+ * parent. Its DNS entries and TLS sessions go with it, pinned addresses,
+ * settings and the persistent TLS session cache are kept.
+ * \param pool The connection pool.
+ */
+extern void
+xnd_http_pool_forked(xnd_http_pool_t *pool);
+
+/**
+ * \brief Applies the pool to a curl instance before a transfer.
+ * \param pool The connection pool.
+ * \param curl The curl instance.
+ */
+extern void
+xnd_http_pool_apply(xnd_http_pool_t *pool, CURL *curl);
+
+/**
+ * \brief Sets the URL of a curl instance, as seen through the pool.
+ * \param pool The connection pool, may be NULL.
+ * \param curl The curl instance.
+ * \param url The URL of the transfer.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_pool_url(xnd_http_pool_t *pool, CURL *curl, const char *url);
+
+/**
+ * \brief Accounts a finished transfer as served on a warm or cold connection.
+ * \param pool The connection pool.
+ * \param curl The curl instance of the finished transfer.
+ */
+extern void
+xnd_http_pool_account(xnd_http_pool_t *pool, CURL *curl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
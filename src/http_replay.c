@@ -0,0 +1,561 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "http_request.h"
+#include "http_transport.h"
+#include "probes.h"
+
+/** Recorded response. */
+typedef struct xnd_http_replay_record_t {
+	long        status; /** HTTP status. */
+	const char *body;   /** Body, points into the capture buffer. */
+	size_t      size;   /** Size of the body. */
+	size_t      group;  /** Index of the group of the record. */
+} xnd_http_replay_record_t;
+
+/** Recorded responses of the same request, served in turn. */
+typedef struct xnd_http_replay_group_t {
+	const char    *method;   /** HTTP request method. */
+	const char    *url;      /** Full URL. */
+	const char    *headers;  /** Header keys and values, see below. */
+	size_t         nheaders; /** Number of headers. */
+	size_t         first;    /** Index of the first record in `order`. */
+	size_t         count;    /** Number of records. */
+	atomic_size_t  cursor;   /** Number of times the group was served. */
+	uint32_t       hash;     /** Hash of the method and URL. */
+} xnd_http_replay_group_t;
+
+/** In-memory replay transport. Header lines of the capture buffer are split
+    in place into "key\0 value\0", each line still prefixed with "> ". */
+typedef struct xnd_http_replay_t {
+	char                     *buf;      /** Capture file contents. */
+	xnd_http_replay_record_t *records;  /** Recorded responses. */
+	size_t                    nrecords; /** Number of records. */
+	xnd_http_replay_group_t  *groups;   /** Recorded requests. */
+	size_t                    ngroups;  /** Number of groups. */
+	size_t                   *order;    /** Record indexes, by group. */
+	size_t                   *table;    /** Group indexes + 1, by hash. */
+	size_t                    mask;     /** Size of `table` - 1. */
+} xnd_http_replay_t;
+
+/** Recording transport. */
+typedef struct xnd_http_recorder_t {
+	FILE                       *fp;    /** Capture file. */
+	pthread_mutex_t             lock;  /** Serializes records. */
+	const xnd_http_transport_t *inner; /** Transport sending requests. */
+} xnd_http_recorder_t;
+
+/** Response being recorded. */
+typedef struct xnd_http_capture_t {
+	xnd_http_request_cb_t  cb;   /** Write callback of the request. */
+	void                  *data; /** User-defined data of the callback. */
+	xnd_string_t          *body; /** Received body. */
+} xnd_http_capture_t;
+
+/** Hashes the method and URL of a request, FNV-1a. */
+static uint32_t
+xnd_http_replay_hash(const char *method, const char *url);
+
+/** Steps to the next split header of a group. */
+static const char *
+xnd_http_replay_next(const char *header);
+
+/** Parses the capture buffer. */
+static int
+xnd_http_replay_parse(xnd_http_replay_t *r);
+
+/** Indexes the parsed groups by hash and their records by group. */
+static int
+xnd_http_replay_index(xnd_http_replay_t *r);
+
+/** Finds or adds the group of a parsed request. */
+static int
+xnd_http_replay_group(xnd_http_replay_t *r, const char *method,
+                      const char *url, const char *headers, size_t nheaders,
+                      size_t *index);
+
+static int
+xnd_http_replay_send(void *ctx, xnd_http_request_t *req, void *data);
+
+static void
+xnd_http_replay_destroy(void *ctx);
+
+static int
+xnd_http_record_send(void *ctx, xnd_http_request_t *req, void *data);
+
+static void
+xnd_http_record_destroy(void *ctx);
+
+static size_t
+xnd_http_record_cb(char *ptr, size_t size, size_t nmemb, void *data);
+
+xnd_http_transport_t *
+xnd_http_transport_replay_new(const char *path)
+{
+	xnd_http_transport_t *t;
+	xnd_http_replay_t *r;
+	FILE *fp;
+	long size;
+
+	if (path == NULL || !path[0])
+		return NULL;
+
+	t = xnd_malloc(sizeof(xnd_http_transport_t));
+	r = xnd_calloc(1UL, sizeof(xnd_http_replay_t));
+	if (t == NULL || r == NULL)
+		goto fail;
+
+	fp = fopen(path, "rb");
+	if (fp == NULL)
+		goto fail;
+
+	if (fseek(fp, 0L, SEEK_END) == -1 || (size = ftell(fp)) < 0L ||
+	    fseek(fp, 0L, SEEK_SET) == -1 ||
+	    (r->buf = xnd_malloc((size_t) size + 1UL)) == NULL ||
+	    fread(r->buf, 1UL, (size_t) size, fp) != (size_t) size) {
+		fclose(fp);
+		goto fail;
+	}
+
+	fclose(fp);
+	r->buf[size] = '\0';
+
+	if (xnd_http_replay_parse(r) == -1 || xnd_http_replay_index(r) == -1)
+		goto fail;
+
+	t->name    = "replay";
+	t->send    = xnd_http_replay_send;
+	t->destroy = xnd_http_replay_destroy;
+	t->ctx     = r;
+
+	return t;
+
+fail:
+	if (r != NULL)
+		xnd_http_replay_destroy(r);
+	xnd_free(t);
+
+	return NULL;
+}
+
+xnd_http_transport_t *
+xnd_http_transport_record_new(const char *path,
+                              const xnd_http_transport_t *inner)
+{
+	xnd_http_transport_t *t;
+	xnd_http_recorder_t *rec;
+
+	if (path == NULL || !path[0])
+		return NULL;
+
+	t = xnd_malloc(sizeof(xnd_http_transport_t));
+	rec = xnd_malloc(sizeof(xnd_http_recorder_t));
+	if (t == NULL || rec == NULL)
+		goto fail;
+
+	rec->fp = fopen(path, "ab");
+	if (rec->fp == NULL)
+		goto fail;
+
+	pthread_mutex_init(&(rec->lock), NULL);
+	rec->inner = (inner != NULL) ? inner : &xnd_http_transport_curl;
+
+	t->name    = "record";
+	t->send    = xnd_http_record_send;
+	t->destroy = xnd_http_record_destroy;
+	t->ctx     = rec;
+
+	return t;
+
+fail:
+	xnd_free(rec);
+	xnd_free(t);
+
+	return NULL;
+}
+
+static uint32_t
+xnd_http_replay_hash(const char *method, const char *url)
+{
+	uint32_t hash = 2166136261U;
+
+	for (const char *p = method; *p; ++p)
+		hash = (hash ^ (unsigned char) *p) * 16777619U;
+
+	hash = (hash ^ (unsigned char) ' ') * 16777619U;
+
+	for (const char *p = url; *p; ++p)
+		hash = (hash ^ (unsigned char) *p) * 16777619U;
+
+	return hash;
+}
+
+static const char *
+xnd_http_replay_next(const char *header)
+{
+	header += strlen(header) + 2UL;  /** key, NTB and space */
+	return header + strlen(header) + 3UL; /** value, NTB and "> " */
+}
+
+static int
+xnd_http_replay_parse(xnd_http_replay_t *r)
+{
+	size_t capacity = 0UL;
+	char *p = r->buf;
+
+	while (*p) {
+		char *eol, *method, *url, *headers = NULL, *end;
+		size_t nheaders = 0UL, group;
+		long status;
+		unsigned long size;
+
+		eol = strchr(p, '\n');
+		if (eol == NULL)
+			eol = p + strlen(p);
+
+		if (*p == '\n' || *p == '#' || (*p == '\r' && p[1] == '\n')) {
+			p = *eol ? eol + 1 : eol; /** blank or comment */
+			continue;
+		}
+
+		/** "> METHOD URL" */
+		if (strncmp(p, "> ", 2UL) != 0 || *eol != '\n')
+			return -1;
+		method = p + 2;
+		url = memchr(method, ' ', (size_t) (eol - method));
+		if (url == NULL)
+			return -1;
+		*url++ = '\0';
+		*eol = '\0';
+		if (eol[-1] == '\r')
+			eol[-1] = '\0';
+		p = eol + 1;
+
+		/** "> Key: value" */
+		while (strncmp(p, "> ", 2UL) == 0) {
+			char *colon;
+
+			eol = strchr(p, '\n');
+			colon = strstr(p, ": ");
+			if (eol == NULL || colon == NULL || colon > eol)
+				return -1;
+			*colon = '\0';
+			*eol = '\0';
+			if (eol[-1] == '\r')
+				eol[-1] = '\0';
+			if (headers == NULL)
+				headers = p + 2;
+			++nheaders;
+			p = eol + 1;
+		}
+
+		/** "< STATUS SIZE" then the body */
+		if (strncmp(p, "< ", 2UL) != 0)
+			return -1;
+		status = strtol(p + 2, &end, 10);
+		size = strtoul(end, &end, 10);
+		eol = strchr(end, '\n');
+		if (eol == NULL || size > strlen(eol + 1))
+			return -1;
+		p = eol + 1;
+
+		if (xnd_http_replay_group(r, method, url, headers, nheaders,
+		                          &group) == -1)
+			return -1;
+
+		if (r->nrecords == capacity) {
+			xnd_http_replay_record_t *tmp;
+
+			capacity = capacity ? capacity * 2UL : 16UL;
+			tmp = xnd_realloc(r->records, capacity *
+			                  sizeof(xnd_http_replay_record_t));
+			if (tmp == NULL)
+				return -1;
+			r->records = tmp;
+		}
+
+		r->records[r->nrecords].status = status;
+		r->records[r->nrecords].body   = p;
+		r->records[r->nrecords].size   = size;
+		r->records[r->nrecords].group  = group;
+		++(r->nrecords);
+		++(r->groups[group].count);
+
+		p += size;
+		if (*p == '\r' && p[1] == '\n')
+			*p++ = '\0';
+		if (*p == '\n')
+			*p++ = '\0';
+	}
+
+	return 0;
+}
+
+static int
+xnd_http_replay_group(xnd_http_replay_t *r, const char *method,
+                      const char *url, const char *headers, size_t nheaders,
+                      size_t *index)
+{
+	xnd_http_replay_group_t *g;
+	size_t n = r->ngroups;
+
+	for (size_t i = 0UL; i < r->ngroups; ++i) {
+		const char *a = r->groups[i].headers, *b = headers;
+		size_t j;
+
+		g = &(r->groups[i]);
+		if (g->nheaders != nheaders || strcmp(g->method, method) != 0 ||
+		    strcmp(g->url, url) != 0)
+			continue;
+
+		for (j = 0UL; j < nheaders; ++j) {
+			if (strcmp(a, b) != 0 ||
+			    strcmp(a + strlen(a) + 2, b + strlen(b) + 2) != 0)
+				break;
+			a = xnd_http_replay_next(a);
+			b = xnd_http_replay_next(b);
+		}
+
+		if (j == nheaders) {
+			*index = i;
+			return 0;
+		}
+	}
+
+	/** Groups grow in powers of two, from 16. */
+	if (n == 0UL || (n >= 16UL && (n & (n - 1UL)) == 0UL)) {
+		xnd_http_replay_group_t *tmp;
+
+		tmp = xnd_realloc(r->groups, (n ? n * 2UL : 16UL) *
+		                  sizeof(xnd_http_replay_group_t));
+		if (tmp == NULL)
+			return -1;
+		r->groups = tmp;
+	}
+
+	g = &(r->groups[r->ngroups]);
+	g->method   = method;
+	g->url      = url;
+	g->headers  = headers;
+	g->nheaders = nheaders;
+	g->first    = 0UL;
+	g->count    = 0UL;
+	g->hash     = xnd_http_replay_hash(method, url);
+	atomic_init(&(g->cursor), 0UL);
+
+	*index = r->ngroups++;
+
+	return 0;
+}
+
+static int
+xnd_http_replay_index(xnd_http_replay_t *r)
+{
+	size_t size = 16UL, *fill;
+
+	if (r->nrecords == 0UL)
+		return -1; /** Nothing to replay */
+
+	r->order = xnd_malloc(sizeof(size_t) * r->nrecords);
+	fill = xnd_calloc(r->ngroups, sizeof(size_t));
+	if (r->order == NULL || fill == NULL) {
+		xnd_free(fill);
+		return -1;
+	}
+
+	/** Records of a group are laid out contiguously, in file order. */
+	for (size_t i = 0UL, first = 0UL; i < r->ngroups; ++i) {
+		r->groups[i].first = first;
+		first += r->groups[i].count;
+	}
+	for (size_t i = 0UL; i < r->nrecords; ++i) {
+		xnd_http_replay_group_t *g = &(r->groups[r->records[i].group]);
+
+		r->order[g->first + fill[r->records[i].group]++] = i;
+	}
+	xnd_free(fill);
+
+	while (size < r->ngroups * 2UL)
+		size *= 2UL;
+
+	r->table = xnd_calloc(size, sizeof(size_t));
+	if (r->table == NULL)
+		return -1;
+	r->mask = size - 1UL;
+
+	for (size_t i = 0UL; i < r->ngroups; ++i) {
+		size_t slot = r->groups[i].hash & r->mask;
+
+		while (r->table[slot] != 0UL)
+			slot = (slot + 1UL) & r->mask;
+		r->table[slot] = i + 1UL;
+	}
+
+	return 0;
+}
+
+static int
+xnd_http_replay_send(void *ctx, xnd_http_request_t *req, void *data)
+{
+	xnd_http_replay_t *r = ctx;
+	xnd_http_replay_group_t *match = NULL;
+	const xnd_http_replay_record_t *rec;
+	const char *url = req->url->data;
+	uint32_t hash = xnd_http_replay_hash(req->method, url);
+	size_t n;
+
+	if (xnd_http_request_remaining(req) == 0L)
+		return -1;
+
+	/** The group with the most recorded headers, all sent along, wins. */
+	for (size_t slot = hash & r->mask; r->table[slot] != 0UL;
+	     slot = (slot + 1UL) & r->mask) {
+		xnd_http_replay_group_t *g = &(r->groups[r->table[slot] - 1UL]);
+		const char *header = g->headers;
+		size_t i;
+
+		if (g->hash != hash || strcmp(g->method, req->method) != 0 ||
+		    strcmp(g->url, url) != 0 ||
+		    (match != NULL && match->nheaders >= g->nheaders))
+			continue;
+
+		for (i = 0UL; i < g->nheaders; ++i) {
+			const char *value;
+
+			value = xnd_http_headers_get(req->headers, header);
+			if (value == NULL ||
+			    strcmp(value, header + strlen(header) + 2) != 0)
+				break;
+			header = xnd_http_replay_next(header);
+		}
+
+		if (i == g->nheaders)
+			match = g;
+	}
+
+	if (match == NULL)
+		return -1; /** Not recorded, as if the host was unreachable */
+
+	n = atomic_fetch_add_explicit(&(match->cursor), 1UL,
+	                              memory_order_relaxed);
+	if (n >= match->count)
+		n = match->count - 1UL;
+
+	rec = &(r->records[r->order[match->first + n]]);
+	req->status = rec->status;
+
+	if (XND_PROBE_ENABLED(first__byte))
+		XND_PROBE(first__byte, req, req->status);
+
+	if (req->cb != NULL && rec->size > 0UL &&
+	    req->cb((char *) rec->body, 1UL, rec->size, data) != rec->size)
+		return -1;
+
+	return 0;
+}
+
+static void
+xnd_http_replay_destroy(void *ctx)
+{
+	xnd_http_replay_t *r = ctx;
+
+	xnd_free(r->table);
+	xnd_free(r->order);
+	xnd_free(r->groups);
+	xnd_free(r->records);
+	xnd_free(r->buf);
+	xnd_free(r);
+}
+
+static int
+xnd_http_record_send(void *ctx, xnd_http_request_t *req, void *data)
+{
+	xnd_http_recorder_t *rec = ctx;
+	xnd_http_capture_t capture;
+	struct curl_slist *list;
+	int res;
+
+	capture.cb = req->cb;
+	capture.data = data;
+	capture.body = xnd_string_new(NULL);
+	if (capture.body == NULL)
+		return -1;
+
+	req->cb = xnd_http_record_cb;
+	res = rec->inner->send(rec->inner->ctx, req, &capture);
+	req->cb = capture.cb;
+
+	if (res == 0) {
+		pthread_mutex_lock(&(rec->lock));
+
+		fprintf(rec->fp, "> %s %s\n", req->method, req->url->data);
+
+		list = xnd_http_headers_slist(req->headers);
+		for (struct curl_slist *i = list; i != NULL; i = i->next) {
+			const char *key = "authorization:", *line = i->data;
+			size_t j = 0UL;
+
+			while (key[j] &&
+			       tolower((unsigned char) line[j]) == key[j])
+				++j;
+			if (!key[j])
+				continue; /** Never record credentials */
+
+			fprintf(rec->fp, "> %s\n", i->data);
+		}
+
+		fprintf(rec->fp, "< %ld %zu\n", req->status,
+		        capture.body->size);
+		fwrite(capture.body->data, 1UL, capture.body->size, rec->fp);
+		fputc('\n', rec->fp);
+		fflush(rec->fp);
+
+		pthread_mutex_unlock(&(rec->lock));
+	}
+
+	xnd_string_destroy(&(capture.body));
+
+	return res;
+}
+
+static void
+xnd_http_record_destroy(void *ctx)
+{
+	xnd_http_recorder_t *rec = ctx;
+
+	fclose(rec->fp);
+	pthread_mutex_destroy(&(rec->lock));
+	xnd_free(rec);
+}
+
+static size_t
+xnd_http_record_cb(char *ptr, size_t size, size_t nmemb, void *data)
+{
+	xnd_http_capture_t *capture = data;
+	size_t realsize = size * nmemb;
+	xnd_string_t **body = &(capture->body);
+
+	if (xnd_string_reserve(body, (*body)->size + realsize) == -1)
+		return 0UL; /** Aborts the transfer */
+
+	memcpy((*body)->data + (*body)->size, ptr, realsize);
+	(*body)->size += realsize;
+	(*body)->data[(*body)->size] = '\0';
+
+	if (capture->cb != NULL)
+		return capture->cb(ptr, size, nmemb, capture->data);
+
+	return realsize;
+}
@@ -4,9 +4,43 @@
  * found in the LICENSE file or at https://opensource.org/licenses/MIT.
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "alloc.h"
+#include "flight.h"
+#include "http_handles.h"
 #include "http_request.h"
+#include "probes.h"
+
+/** Backoff before the first retry, doubled on every retry after. */
+#define XND_HTTP_REQUEST_BACKOFF_MS     (50L)
+#define XND_HTTP_REQUEST_BACKOFF_MAX_MS (2000L)
+
+/** Attempt of a request which may be retried. */
+typedef struct xnd_http_request_attempt_t {
+	xnd_http_request_t    *req;       /** The HTTP request. */
+	xnd_http_request_cb_t  cb;        /** Write callback of the request. */
+	void                  *data;      /** User-defined data of callback. */
+	size_t                 delivered; /** Bytes passed to the callback. */
+	int                    last;      /** No retry left. */
+} xnd_http_request_attempt_t;
+
+/** Write callback of an attempt, holding back retried responses. */
+static size_t
+xnd_http_request_attempt_cb(char *ptr, size_t size, size_t nmemb,
+                            void *data);
+
+/** Whether a response status is worth a retry. */
+static int
+xnd_http_request_transient(long status);
+
+/** Sleeps before a retry, -1 if it does not fit in the limits. */
+static int
+xnd_http_request_backoff(const xnd_http_request_t *req,
+                         unsigned int attempt);
 
 const char *const XND_HTTP_REQUEST_GET     = "GET";
 const char *const XND_HTTP_REQUEST_HEAD    = "HEAD";
@@ -20,12 +54,15 @@ const char *const XND_HTTP_REQUEST_PATCH   = "PATCH";
 void
 xnd_http_request_init(void)
 {
-	curl_global_init(CURL_GLOBAL_DEFAULT);
+	/** curl allocates through the SDK allocator as well. */
+	curl_global_init_mem(CURL_GLOBAL_DEFAULT, xnd_malloc, xnd_free,
+	                     xnd_realloc, xnd_strdup, xnd_calloc);
 }
 
 void
 xnd_http_request_cleanup(void)
 {
+	xnd_http_handles_flush();
 	curl_global_cleanup();
 }
 
@@ -37,28 +74,31 @@ xnd_http_request_new(const char *method, const char *baseurl)
 	if (baseurl == NULL || !baseurl[0])
 		return NULL;
 
-	req = malloc(sizeof(xnd_http_request_t));
+	req = xnd_malloc(sizeof(xnd_http_request_t));
 	if (req == NULL)
 		return NULL;
 
 	req->url = xnd_string_new(baseurl);
 	if (req->url == NULL) {
-		free(req);
+		xnd_free(req);
 		return NULL;
 	}
 
-	req->curl = curl_easy_init();
-	if (req->curl == NULL) {
-		xnd_string_destroy(&(req->url));
-		free(req);
-		return NULL;
-	}
-
-	curl_easy_setopt(req->curl, CURLOPT_CUSTOMREQUEST, method);
-	req->method  = method;
-	req->queries = NULL;
-	req->headers = NULL;
-	req->cb      = NULL;
+	req->method    = method;
+	req->queries   = NULL;
+	req->headers   = NULL;
+	req->payload   = NULL;
+	req->body      = NULL;
+	req->transport = NULL;
+	req->pool      = NULL;
+	req->curl      = NULL;
+	req->cb        = NULL;
+	req->status    = 0L;
+	req->error     = 0;
+	memset(&(req->limits), 0, sizeof(xnd_http_limits_t));
+
+	if (XND_PROBE_ENABLED(request__create))
+		XND_PROBE(request__create, req, method, baseurl);
 
 	return req;
 }
@@ -72,11 +112,17 @@ xnd_http_request_destroy(xnd_http_request_t *req)
 	if (req->queries != NULL)
 		xnd_string_destroy(&(req->queries));
 	if (req->headers != NULL)
-		curl_slist_free_all(req->headers);
+		xnd_http_headers_destroy(req->headers);
+
+	/** The connections of a pooled request are kept by the pool, its curl
+	    instance holds none and goes back to the cache of the thread. */
+	if (req->pool != NULL)
+		xnd_http_handles_put(req->curl);
+	else if (req->curl != NULL)
+		curl_easy_cleanup(req->curl);
 
-	curl_easy_cleanup(req->curl);
 	xnd_string_destroy(&(req->url));
-	free(req);
+	xnd_free(req);
 }
 
 int
@@ -88,15 +134,16 @@ xnd_http_request_path(xnd_http_request_t *req, const char *path)
 	if (req->url->data[req->url->size - 1] != '/')
 		xnd_string_append(&(req->url), '/');
 
-	xnd_string_insert(&(req->url), path + (path[0] == '/'), req->url->size);
-
-	return 0;
+	return xnd_string_encode(&(req->url), path + (path[0] == '/'),
+	                         XND_STRING_ENCODE_PATH);
 }
 
 int
 xnd_http_request_query(xnd_http_request_t *req, const char *key,
                        const char *value)
 {
+	size_t keysz, valuesz;
+
 	if (req == NULL || key == NULL || !key[0])
 		return -1;
 
@@ -104,15 +151,22 @@ xnd_http_request_query(xnd_http_request_t *req, const char *key,
 		req->queries = xnd_string_new(NULL);
 		if (req->queries == NULL)
 			return -1;
-
-		xnd_string_append(&(req->queries), '?');
-	} else {
-		xnd_string_append(&(req->queries), '&');
 	}
 
-	xnd_string_insert(&(req->queries), key, req->queries->size);
+	/** Measure first, so the whole `?key=value` is written with at most one
+	    resize of the buffer. */
+	keysz = xnd_string_encoded_size(key, __SIZE_MAX__,
+	                                XND_STRING_ENCODE_QUERY);
+	valuesz = xnd_string_encoded_size(value, __SIZE_MAX__,
+	                                  XND_STRING_ENCODE_QUERY);
+	if (xnd_string_reserve(&(req->queries),
+	                       req->queries->size + keysz + valuesz + 2UL) == -1)
+		return -1;
+
+	xnd_string_append(&(req->queries), req->queries->size ? '&' : '?');
+	xnd_string_encode(&(req->queries), key, XND_STRING_ENCODE_QUERY);
 	xnd_string_append(&(req->queries), '=');
-	xnd_string_insert(&(req->queries), value, req->queries->size);
+	xnd_string_encode(&(req->queries), value, XND_STRING_ENCODE_QUERY);
 
 	return 0;
 }
@@ -121,7 +175,8 @@ int
 xnd_http_request_basic_auth(xnd_http_request_t *req, const char *user,
                             const char *pass)
 {
-	xnd_string_t *cred;
+	xnd_string_t *cred, *value;
+	int res = -1;
 
 	if (req == NULL || user == NULL || !user[0])
 		return -1;
@@ -135,33 +190,51 @@ xnd_http_request_basic_auth(xnd_http_request_t *req, const char *user,
 	if (pass != NULL && pass[0])
 		xnd_string_insert(&cred, pass, cred->size);
 
-	curl_easy_setopt(req->curl, CURLOPT_USERPWD, cred->data);
+	/** Sent as a plain header, so that every transport handles it alike. */
+	value = xnd_string_new("Basic ");
+	if (value != NULL &&
+	    xnd_string_base64(&value, cred->data, cred->size) == 0)
+		res = xnd_http_request_header(req, "Authorization", value->data);
+
 	xnd_string_zeroize(&cred); /** Do not exposed in memory after it is no
 	                               longer needed. At least we do our part. */
 	xnd_string_destroy(&cred);
+	xnd_string_zeroize(&value);
+	xnd_string_destroy(&value);
 
-	return 0;
+	return res;
 }
 
 int
 xnd_http_request_header(xnd_http_request_t *req, const char *key,
                         const char *value)
 {
-	xnd_string_t *header;
-
 	if (req == NULL || key == NULL || !key[0] || value == NULL || !value[0])
 		return -1;
 
-	header = xnd_string_new(key);
-	if (header == NULL)
+	if (req->headers == NULL) {
+		req->headers = xnd_http_headers_new();
+		if (req->headers == NULL)
+			return -1;
+	}
+
+	return xnd_http_headers_set(req->headers, key, value);
+}
+
+int
+xnd_http_request_headers(xnd_http_request_t *req,
+                         const xnd_http_headers_t *headers)
+{
+	if (req == NULL || headers == NULL)
 		return -1;
 
-	xnd_string_insert(&header, ": ", header->size);
-	xnd_string_insert(&header, value, header->size);
-	req->headers = curl_slist_append(req->headers, header->data);
-	xnd_string_destroy(&header);
+	if (req->headers == NULL) {
+		req->headers = xnd_http_headers_new();
+		if (req->headers == NULL)
+			return -1;
+	}
 
-	return 0;
+	return xnd_http_headers_merge(req->headers, headers);
 }
 
 int
@@ -170,7 +243,41 @@ xnd_http_request_payload(xnd_http_request_t *req, const char *payload)
 	if (req == NULL || payload == NULL || !payload[0])
 		return -1;
 
-	curl_easy_setopt(req->curl, CURLOPT_POSTFIELDS, payload);
+	req->payload = payload;
+
+	return 0;
+}
+
+int
+xnd_http_request_body(xnd_http_request_t *req, const xnd_http_body_t *body)
+{
+	if (req == NULL || body == NULL || body->read == NULL)
+		return -1;
+
+	req->body = body;
+
+	return 0;
+}
+
+int
+xnd_http_request_transport(xnd_http_request_t *req,
+                           const xnd_http_transport_t *transport)
+{
+	if (req == NULL)
+		return -1;
+
+	req->transport = transport;
+
+	return 0;
+}
+
+int
+xnd_http_request_pool(xnd_http_request_t *req, xnd_http_pool_t *pool)
+{
+	if (req == NULL)
+		return -1;
+
+	req->pool = pool;
 
 	return 0;
 }
@@ -186,38 +293,195 @@ xnd_http_request_callback(xnd_http_request_t *req, xnd_http_request_cb_t cb)
 	return 0;
 }
 
+int
+xnd_http_request_limits(xnd_http_request_t *req,
+                        const xnd_http_limits_t *limits)
+{
+	if (req == NULL || limits == NULL || limits->connect_ms < 0L ||
+	    limits->low_speed_limit < 0L || limits->low_speed_time < 0L)
+		return -1;
+
+	req->limits = *limits;
+
+	return 0;
+}
+
+long
+xnd_http_request_remaining(const xnd_http_request_t *req)
+{
+	unsigned long long now, left;
+
+	if (req->limits.cancel != NULL && atomic_load(req->limits.cancel))
+		return 0L;
+
+	if (req->limits.deadline == 0ULL)
+		return LONG_MAX;
+
+	now = xnd_http_request_now();
+	if (now >= req->limits.deadline)
+		return 0L;
+
+	left = (req->limits.deadline - now + 999999ULL) / 1000000ULL;
+
+	return left < (unsigned long long) LONG_MAX ? (long) left : LONG_MAX;
+}
+
+unsigned long long
+xnd_http_request_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (unsigned long long) ts.tv_sec * 1000000000ULL
+	     + (unsigned long long) ts.tv_nsec;
+}
+
 int
 xnd_http_request_send_with_data(xnd_http_request_t *req, void *data)
 {
-	CURLcode res;
-	xnd_string_t *fullurl;
+	const xnd_http_transport_t *transport;
+	xnd_http_request_attempt_t attempt;
+	unsigned long long start = xnd_http_request_now();
+	unsigned int retries = 0U, attempts = 1U;
+	size_t urlsz;
+	int res;
 
 	if (req == NULL)
 		return -1;
 
-	fullurl = xnd_string_new(req->url->data);
-	if (fullurl == NULL)
-		return -1;
+	/** Traced by endpoint, before the queries. */
+	if (XND_PROBE_ENABLED(send__start))
+		XND_PROBE(send__start, req, req->method, req->url->data,
+		          xnd_http_headers_get(req->headers, "for-user-id"));
 
+	/** The queries are appended straight into the URL buffer for the
+	    transport and truncated back afterwards. */
+	urlsz = req->url->size;
 	if (req->queries != NULL)
-		xnd_string_insert(&fullurl, req->queries->data, fullurl->size);
+		if (xnd_string_insert(&(req->url), req->queries->data,
+		                      req->url->size) == -1)
+			return -1;
 
-	if (req->headers != NULL)
-		curl_easy_setopt(req->curl, CURLOPT_HTTPHEADER, req->headers);
+	transport = req->transport;
+	if (transport == NULL)
+		transport = &xnd_http_transport_curl;
 
-	if (req->cb != NULL) {
-		curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION, req->cb);
-		if (data != NULL)
-			curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, data);
+	/** Only requests safe to repeat are retried. */
+	if (strcmp(req->method, XND_HTTP_REQUEST_POST) != 0 &&
+	    strcmp(req->method, XND_HTTP_REQUEST_PATCH) != 0 &&
+	    strcmp(req->method, XND_HTTP_REQUEST_CONNECT) != 0)
+		retries = req->limits.retries;
+
+	if (retries == 0U) {
+		req->status = 0L;
+		req->error = 0;
+		res = transport->send(transport->ctx, req, data);
+	} else {
+		attempt.req = req;
+		attempt.cb = req->cb;
+		attempt.data = data;
+		req->cb = xnd_http_request_attempt_cb;
+
+		for (unsigned int i = 0U;; ++i) {
+			attempt.delivered = 0UL;
+			attempt.last = (i == retries);
+			attempts = i + 1U;
+
+			req->status = 0L;
+			req->error = 0;
+			res = transport->send(transport->ctx, req, &attempt);
+
+			/** Decided by the status, a transient one may come
+			    without a body to hold back. */
+			if (attempt.last || attempt.delivered > 0UL)
+				break;
+			if (res == 0 &&
+			    !xnd_http_request_transient(req->status))
+				break;
+
+			if (xnd_http_request_backoff(req, i) == -1) {
+				res = -1; /** The withheld one is dropped */
+				break;
+			}
+		}
+
+		req->cb = attempt.cb;
 	}
 
-	curl_easy_setopt(req->curl, CURLOPT_URL, fullurl->data);
-	res = curl_easy_perform(req->curl);
-	xnd_string_destroy(&fullurl);
+	req->url->data[urlsz] = '\0';
+	req->url->size = urlsz;
+
+	/** Always on, a few stores into the ring of this thread. */
+	xnd_flight_request(req, start, attempts, res);
+
+	if (XND_PROBE_ENABLED(send__done))
+		XND_PROBE(send__done, req, req->status, res,
+		          xnd_http_request_now() - start);
+
+	return res;
+}
+
+static size_t
+xnd_http_request_attempt_cb(char *ptr, size_t size, size_t nmemb,
+                            void *data)
+{
+	xnd_http_request_attempt_t *attempt = data;
+	size_t res;
+
+	if (!attempt->last && attempt->delivered == 0UL &&
+	    xnd_http_request_transient(attempt->req->status))
+		return size * nmemb;
+
+	if (attempt->cb == NULL)
+		return size * nmemb;
 
-	if (res != CURLE_OK)
+	res = attempt->cb(ptr, size, nmemb, attempt->data);
+	attempt->delivered += res;
+
+	return res;
+}
+
+static int
+xnd_http_request_transient(long status)
+{
+	return status == 429L || status == 502L || status == 503L ||
+	       status == 504L;
+}
+
+static int
+xnd_http_request_backoff(const xnd_http_request_t *req,
+                         unsigned int attempt)
+{
+	struct timespec ts;
+	long delay = XND_HTTP_REQUEST_BACKOFF_MS;
+	unsigned int seed = (unsigned int) xnd_http_request_now();
+
+	while (attempt-- > 0U && delay < XND_HTTP_REQUEST_BACKOFF_MAX_MS)
+		delay *= 2L;
+	if (delay > XND_HTTP_REQUEST_BACKOFF_MAX_MS)
+		delay = XND_HTTP_REQUEST_BACKOFF_MAX_MS;
+
+	/** Jittered in [delay / 2, delay], so retrying callers spread out. */
+	delay = delay / 2L + (long) (rand_r(&seed) % (int) (delay / 2L + 1L));
+
+	/** A retry needs time left after the backoff. */
+	if (xnd_http_request_remaining(req) <= delay)
 		return -1;
 
+	/** Slept in slices, so that cancellation is noticed meanwhile. */
+	while (delay > 0L) {
+		long slice = delay < 10L ? delay : 10L;
+
+		ts.tv_sec = 0;
+		ts.tv_nsec = slice * 1000000L;
+		nanosleep(&ts, NULL);
+		delay -= slice;
+
+		if (xnd_http_request_remaining(req) == 0L)
+			return -1;
+	}
+
 	return 0;
 }
 
@@ -233,30 +497,3 @@ xnd_http_request_default_callback(char *ptr, size_t size, size_t nmemb,
 
 	return realsize;
 }
-
-#ifdef DEBUG
-void
-xnd_http_request_dump(xnd_http_request_t *req, FILE *output)
-{
-	FILE *out;
-
-	if (req == NULL)
-		return;
-
-	if (output == NULL)
-		out = stdout;
-
-	fprintf(out, "\n\n%s ", req->method);
-	fprintf(out, "%s", req->url->data);
-
-	if (req->queries != NULL)
-		fprintf(out, "%s\n", req->queries->data);
-	else
-		fprintf(out, "\n");
-
-	fprintf(out, "Header\n");
-	if (req->headers != NULL)
-		for (struct curl_slist *i = req->headers; i != NULL; i = i->next)
-			fprintf(out, "    %s\n", i->data);
-}
-#endif
@@ -11,9 +11,13 @@
 extern "C" {
 #endif
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <curl/curl.h>
 
+#include "http_headers.h"
+#include "http_pool.h"
+#include "http_transport.h"
 #include "strings.h"
 
 extern const char *const XND_HTTP_REQUEST_GET;
@@ -41,16 +45,57 @@ extern const char *const XND_HTTP_REQUEST_PATCH;
  */
 typedef size_t (*xnd_http_request_cb_t) (char *, size_t, size_t, void *);
 
+/**
+ * \brief Time limits and cancellation of an HTTP request, zeroed members are
+ * not enforced. Retries of transient failures share the deadline.
+ */
+typedef struct xnd_http_limits_t {
+	unsigned long long  deadline;        /** Monotonic ns, see `_now()`. */
+	long                connect_ms;      /** Connect timeout per attempt. */
+	long                low_speed_limit; /** Bytes per second, ... */
+	long                low_speed_time;  /** ... for this many seconds. */
+	unsigned int        retries;         /** Retries of idempotent calls. */
+	const atomic_int   *cancel;          /** Aborts the request once set. */
+} xnd_http_limits_t;
+
+/** Returned by the reader of a streamed body to abort the request. */
+#define XND_HTTP_BODY_ABORT ((size_t) -1)
+
+/**
+ * \brief Body of an HTTP request streamed by the transport, rather than held
+ * in memory.
+ */
+typedef struct xnd_http_body_t {
+	size_t  (*read)   (char *, size_t, void *); /** Fills a buffer, returns
+	                                                the bytes filled, 0 at
+	                                                the end. */
+	int     (*rewind) (void *);                 /** Restarts the body for
+	                                                a resend, 0 on
+	                                                success. */
+	void     *data;                             /** User-defined data. */
+	size_t    size;                             /** Size of the body. */
+} xnd_http_body_t;
+
 /**
  * \brief HTTP request.
  */
 typedef struct xnd_http_request_t {
-	const char            *method;  /** HTTP request method. */
-	xnd_string_t          *url;     /** URL. */
-	xnd_string_t          *queries; /** Query parameters. */
-	struct curl_slist     *headers; /** List of HTTP header records. */
-	CURL                  *curl;    /** curl instance. */
-	xnd_http_request_cb_t  cb;      /** Write callback. */
+	const char                 *method;    /** HTTP request method. */
+	xnd_string_t               *url;       /** URL. */
+	xnd_string_t               *queries;   /** Query parameters. */
+	xnd_http_headers_t         *headers;   /** HTTP header records. */
+	const char                 *payload;   /** Payload, owned by caller. */
+	const xnd_http_body_t      *body;      /** Streamed body, owned by
+	                                           caller, or NULL. */
+	const xnd_http_transport_t *transport; /** Transport, NULL for curl. */
+	xnd_http_pool_t            *pool;      /** Connection pool or NULL. */
+	CURL                       *curl;      /** curl instance, created by
+	                                           curl transport on demand. */
+	xnd_http_request_cb_t       cb;        /** Write callback. */
+	xnd_http_limits_t           limits;    /** Deadline and cancellation. */
+	long                        status;    /** HTTP status of response. */
+	int                         error;     /** Transport error of the last
+	                                           attempt, e.g. a CURLcode. */
 } xnd_http_request_t;
 
 /**
@@ -83,14 +128,16 @@ xnd_http_request_destroy(xnd_http_request_t *req);
 /**
  * \brief Adds path to the existing URL of the HTTP request.
  * \param path The path to be concatenated to the existing request URL. Do need
- * to provide any '/' as it is managed inside.
+ * to provide any '/' as it is managed inside. Characters other than '/' and
+ * the unreserved ones are percent-encoded.
  * \return 0 on success, -1 otherwise.
  */
 extern int
 xnd_http_request_path(xnd_http_request_t *req, const char *path);
 
 /**
- * \brief Adds a query parameter to the URL of the HTTP request.
+ * \brief Adds a query parameter to the URL of the HTTP request. Both key and
+ * value are percent-encoded.
  * \param key The key of the query parameter to add.
  * \param value The value of the query parameter to add.
  * \return 0 on success, -1 otherwise.
@@ -121,15 +168,57 @@ extern int
 xnd_http_request_header(xnd_http_request_t *req, const char *key,
                         const char *value);
 
+/**
+ * \brief Merges a set of header records, typically the static ones built once
+ * per client, into the HTTP request headers.
+ * \param req The HTTP request.
+ * \param headers The set of HTTP headers to merge.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_request_headers(xnd_http_request_t *req,
+                         const xnd_http_headers_t *headers);
+
 /**
  * \brief Sets the payload of the HTTP request.
  * \param req The HTTP request.
- * \param payload The umm.. payload?
+ * \param payload The umm.. payload? It is not copied, so it must outlive the
+ * sending of the request.
  * \return 0 on success, -1 otherwise.
  */
 extern int
 xnd_http_request_payload(xnd_http_request_t *req, const char *payload);
 
+/**
+ * \brief Sets a body streamed by the transport, instead of a payload. It is
+ * not copied, so it must outlive the sending of the request.
+ * \param req The HTTP request.
+ * \param body The streamed body.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_request_body(xnd_http_request_t *req, const xnd_http_body_t *body);
+
+/**
+ * \brief Sets the transport sending the HTTP request.
+ * \param req The HTTP request.
+ * \param transport The transport, must outlive the request. NULL restores the
+ * default curl transport.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_request_transport(xnd_http_request_t *req,
+                           const xnd_http_transport_t *transport);
+
+/**
+ * \brief Sends the HTTP request through a connection pool.
+ * \param req The HTTP request.
+ * \param pool The connection pool, must outlive the request.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_request_pool(xnd_http_request_t *req, xnd_http_pool_t *pool);
+
 /**
  * \brief Sets the write callback for retrieved response.
  * \param req The HTTP request.
@@ -139,12 +228,43 @@ xnd_http_request_payload(xnd_http_request_t *req, const char *payload);
 extern int
 xnd_http_request_callback(xnd_http_request_t *req, xnd_http_request_cb_t cb);
 
+/**
+ * \brief Sets the time limits and cancellation of the HTTP request.
+ * \param req The HTTP request.
+ * \param limits The limits, copied. The cancellation flag must outlive the
+ * request.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_http_request_limits(xnd_http_request_t *req,
+                        const xnd_http_limits_t *limits);
+
+/**
+ * \brief Retrieves the time left before the deadline of the HTTP request,
+ * for transports to bound each attempt.
+ * \param req The HTTP request.
+ * \return The milliseconds left, rounded up, LONG_MAX without a deadline, 0
+ * once the deadline passed or the request was cancelled.
+ */
+extern long
+xnd_http_request_remaining(const xnd_http_request_t *req);
+
+/**
+ * \brief Reads the monotonic clock deadlines are expressed in.
+ * \return The time in nanoseconds.
+ */
+extern unsigned long long
+xnd_http_request_now(void);
+
 /**
  * \brief Sends HTTP request with user-defined data passed to write cb
- * function, if provided, though.
+ * function, if provided, though. The HTTP status of the response is stored
+ * in `req->status`. Idempotent requests are retried within their limits on
+ * transport failures before any data was received and on 429, 502, 503 and
+ * 504 responses, whose bodies are then never passed to the callback.
  * \param req The HTTP request.
  * \param data The user-defined data to be passed to the write cb function.
- * \return 0 on success, -1 otherwise.
+ * \return 0 if a response is received, -1 otherwise.
  */
 extern int
 xnd_http_request_send_with_data(xnd_http_request_t *req, void *data);
@@ -169,15 +289,6 @@ extern size_t
 xnd_http_request_default_callback(char *ptr, size_t size, size_t nmemb,
                                   void *data);
 
-#ifdef DEBUG
-/**
- * \brief Dumps the details of HTTP request for debugging purposes.
- * \param req The http request.
- */
-extern void
-xnd_http_request_dump(xnd_http_request_t *req, FILE *output);
-#endif
-
 #ifdef __cplusplus
 }
 #endif
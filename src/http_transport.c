@@ -0,0 +1,216 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <limits.h>
+
+#include "alloc.h"
+#include "http_handles.h"
+#include "http_request.h"
+#include "http_transport.h"
+#include "probes.h"
+
+/** Transfer of the curl transport. */
+typedef struct xnd_http_transport_curl_xfer_t {
+	xnd_http_request_t *req;  /** The HTTP request. */
+	void               *data; /** User-defined data of the callback. */
+} xnd_http_transport_curl_xfer_t;
+
+/** Sends HTTP request with libcurl. */
+static int
+xnd_http_transport_curl_send(void *ctx, xnd_http_request_t *req, void *data);
+
+/** Write callback of curl, sets the status before passing the body on. */
+static size_t
+xnd_http_transport_curl_write(char *ptr, size_t size, size_t nmemb,
+                              void *data);
+
+/** Read callback of curl, passes the streamed body on. */
+static size_t
+xnd_http_transport_curl_read(char *ptr, size_t size, size_t nitems,
+                             void *data);
+
+/** Seek callback of curl, rewinds the streamed body for a resend. */
+static int
+xnd_http_transport_curl_seek(void *data, curl_off_t offset, int origin);
+
+/** Progress callback of curl, aborts cancelled transfers. */
+static int
+xnd_http_transport_curl_progress(void *data, curl_off_t dltotal,
+                                 curl_off_t dlnow, curl_off_t ultotal,
+                                 curl_off_t ulnow);
+
+const xnd_http_transport_t xnd_http_transport_curl = {
+	"curl", xnd_http_transport_curl_send, NULL, NULL
+};
+
+void
+xnd_http_transport_destroy(xnd_http_transport_t *t)
+{
+	if (t == NULL)
+		return;
+
+	if (t->destroy != NULL)
+		t->destroy(t->ctx);
+
+	xnd_free(t);
+}
+
+static int
+xnd_http_transport_curl_send(void *ctx, xnd_http_request_t *req, void *data)
+{
+	xnd_http_transport_curl_xfer_t xfer;
+	long left, connect;
+	CURLcode res;
+
+	(void) ctx;
+
+	left = xnd_http_request_remaining(req);
+	if (left == 0L)
+		return -1;
+
+	/** The curl instance is only taken by this transport, from the cache
+	    of the thread, and kept with the request so that resending it
+	    reuses the instance. */
+	if (req->curl == NULL) {
+		req->curl = xnd_http_handles_get();
+		if (req->curl == NULL)
+			return -1;
+	}
+
+	curl_easy_setopt(req->curl, CURLOPT_CUSTOMREQUEST, req->method);
+	if (xnd_http_pool_url(req->pool, req->curl, req->url->data) == -1)
+		return -1;
+
+	if (req->headers != NULL)
+		curl_easy_setopt(req->curl, CURLOPT_HTTPHEADER,
+		                 xnd_http_headers_slist(req->headers));
+
+	if (req->payload != NULL)
+		curl_easy_setopt(req->curl, CURLOPT_POSTFIELDS, req->payload);
+
+	/** A streamed body starts over on every attempt. */
+	if (req->body != NULL) {
+		if (req->body->rewind != NULL &&
+		    req->body->rewind(req->body->data) == -1)
+			return -1;
+
+		curl_easy_setopt(req->curl, CURLOPT_POST, 1L);
+		curl_easy_setopt(req->curl, CURLOPT_POSTFIELDS, NULL);
+		curl_easy_setopt(req->curl, CURLOPT_POSTFIELDSIZE_LARGE,
+		                 (curl_off_t) req->body->size);
+		curl_easy_setopt(req->curl, CURLOPT_READFUNCTION,
+		                 xnd_http_transport_curl_read);
+		curl_easy_setopt(req->curl, CURLOPT_READDATA, req->body);
+		curl_easy_setopt(req->curl, CURLOPT_SEEKFUNCTION,
+		                 xnd_http_transport_curl_seek);
+		curl_easy_setopt(req->curl, CURLOPT_SEEKDATA, req->body);
+	}
+
+	if (req->cb != NULL) {
+		xfer.req = req;
+		xfer.data = data;
+		curl_easy_setopt(req->curl, CURLOPT_WRITEFUNCTION,
+		                 xnd_http_transport_curl_write);
+		curl_easy_setopt(req->curl, CURLOPT_WRITEDATA, &xfer);
+	}
+
+	/** Each attempt is bounded by what is left of the deadline. */
+	if (left == LONG_MAX)
+		left = 0L;
+	connect = req->limits.connect_ms;
+	if (connect == 0L || (left > 0L && connect > left))
+		connect = left;
+	curl_easy_setopt(req->curl, CURLOPT_TIMEOUT_MS, left);
+	curl_easy_setopt(req->curl, CURLOPT_CONNECTTIMEOUT_MS, connect);
+	curl_easy_setopt(req->curl, CURLOPT_LOW_SPEED_LIMIT,
+	                 req->limits.low_speed_limit);
+	curl_easy_setopt(req->curl, CURLOPT_LOW_SPEED_TIME,
+	                 req->limits.low_speed_time);
+
+	if (req->limits.cancel != NULL) {
+		curl_easy_setopt(req->curl, CURLOPT_XFERINFOFUNCTION,
+		                 xnd_http_transport_curl_progress);
+		curl_easy_setopt(req->curl, CURLOPT_XFERINFODATA,
+		                 req->limits.cancel);
+		curl_easy_setopt(req->curl, CURLOPT_NOPROGRESS, 0L);
+	} else {
+		curl_easy_setopt(req->curl, CURLOPT_NOPROGRESS, 1L);
+	}
+
+	if (req->pool != NULL)
+		xnd_http_pool_apply(req->pool, req->curl);
+
+	res = curl_easy_perform(req->curl);
+
+	if (res != CURLE_OK) {
+		req->error = (int) res;
+		return -1;
+	}
+
+	curl_easy_getinfo(req->curl, CURLINFO_RESPONSE_CODE, &(req->status));
+
+	if (req->pool != NULL)
+		xnd_http_pool_account(req->pool, req->curl);
+
+	return 0;
+}
+
+static size_t
+xnd_http_transport_curl_write(char *ptr, size_t size, size_t nmemb,
+                              void *data)
+{
+	xnd_http_transport_curl_xfer_t *xfer = data;
+
+	if (xfer->req->status == 0L) {
+		curl_easy_getinfo(xfer->req->curl, CURLINFO_RESPONSE_CODE,
+		                  &(xfer->req->status));
+
+		if (XND_PROBE_ENABLED(first__byte))
+			XND_PROBE(first__byte, xfer->req, xfer->req->status);
+	}
+
+	return xfer->req->cb(ptr, size, nmemb, xfer->data);
+}
+
+static size_t
+xnd_http_transport_curl_read(char *ptr, size_t size, size_t nitems,
+                             void *data)
+{
+	const xnd_http_body_t *body = data;
+	size_t n;
+
+	n = body->read(ptr, size * nitems, body->data);
+
+	return n == XND_HTTP_BODY_ABORT ? CURL_READFUNC_ABORT : n;
+}
+
+static int
+xnd_http_transport_curl_seek(void *data, curl_off_t offset, int origin)
+{
+	const xnd_http_body_t *body = data;
+
+	/** Only ever asked to start over, e.g. on a stale pooled connection. */
+	if (offset != 0 || origin != SEEK_SET || body->rewind == NULL ||
+	    body->rewind(body->data) == -1)
+		return CURL_SEEKFUNC_CANTSEEK;
+
+	return CURL_SEEKFUNC_OK;
+}
+
+static int
+xnd_http_transport_curl_progress(void *data, curl_off_t dltotal,
+                                 curl_off_t dlnow, curl_off_t ultotal,
+                                 curl_off_t ulnow)
+{
+	const atomic_int *cancel = data;
+
+	(void) dltotal;
+	(void) dlnow;
+	(void) ultotal;
+	(void) ulnow;
+
+	return atomic_load(cancel) ? 1 : 0;
+}
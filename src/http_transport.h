@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_HTTP_TRANSPORT_H
+#define XND_HTTP_TRANSPORT_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct xnd_http_request_t;
+
+/** Whether the io_uring transport is built, on Linux only. */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define XND_HTTP_URING_SUPPORTED 1
+#endif
+#endif
+#ifndef XND_HTTP_URING_SUPPORTED
+#define XND_HTTP_URING_SUPPORTED 0
+#endif
+
+/**
+ * \brief HTTP transport, the backend actually sending HTTP requests.
+ *
+ * \details A transport sends `req` to the full URL found in `req->url`, with
+ * the headers and payload of the request, sets `req->status` and then passes
+ * the response body to `req->cb` together with `data`, within the time left
+ * by `xnd_http_request_remaining()`. It returns 0 when a response is
+ * received, whatever its status, -1 otherwise.
+ */
+typedef struct xnd_http_transport_t {
+	const char *name; /** Name of the backend. */
+	int  (*send)    (void *ctx, struct xnd_http_request_t *req, void *data);
+	void (*destroy) (void *ctx);
+	void *ctx;        /** Backend state. */
+} xnd_http_transport_t;
+
+/**
+ * \brief The default transport, backed by libcurl.
+ */
+extern const xnd_http_transport_t xnd_http_transport_curl;
+
+/**
+ * \brief Creates new in-memory transport serving recorded responses from a
+ * capture file, see `xnd_http_transport_record_new()` for the format. A
+ * request is matched by method, full URL and the recorded headers, several
+ * records of the same request are served in turn and the last one keeps
+ * being served afterwards.
+ * \param path The path of the capture file.
+ * \return NULL on failure.
+ */
+extern xnd_http_transport_t *
+xnd_http_transport_replay_new(const char *path);
+
+/**
+ * \brief Creates new transport recording every exchange sent through another
+ * transport into a capture file. Each record is a request line, the request
+ * headers other than "Authorization", a response line and the response body:
+ *
+ *     > GET https://api.xendit.co/balance?account_type=CASH
+ *     > for-user-id: 5f2e0b7c
+ *     < 200 16
+ *     {"balance":1000}
+ *
+ * \param path The path of the capture file, records are appended.
+ * \param inner The transport actually sending requests, NULL for curl.
+ * \return NULL on failure.
+ */
+extern xnd_http_transport_t *
+xnd_http_transport_record_new(const char *path,
+                              const xnd_http_transport_t *inner);
+
+/**
+ * \brief Creates new transport speaking a minimal HTTP/1.1 client over
+ * io_uring, for the plain HTTP hop to a local sidecar, see
+ * `xnd_http_pool_sidecar()`. Connections are kept alive, each with a ring of
+ * its own and its response buffer registered with it, and the last write of
+ * a request is submitted together with the first read of its response, in
+ * one system call. HTTPS requests without a sidecar are sent with curl, low
+ * speed limits are not enforced and heads must fit in 16 KiB.
+ * \return NULL on failure, or if io_uring is unavailable, e.g. before Linux
+ * 5.11 or where it is disabled.
+ */
+extern xnd_http_transport_t *
+xnd_http_transport_uring_new(void);
+
+/**
+ * \brief Destroys a transport created by one of the constructors above.
+ * \param t The transport to destroy.
+ */
+extern void
+xnd_http_transport_destroy(xnd_http_transport_t *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
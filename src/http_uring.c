@@ -0,0 +1,1128 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "http_transport.h"
+
+#if XND_HTTP_URING_SUPPORTED
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "alloc.h"
+#include "http_request.h"
+#include "probes.h"
+
+/** Size of the request and response buffers of a connection, the head of a
+    request and the head of a response must fit in one. */
+#define XND_HTTP_URING_BUFFER (16384UL)
+
+/** Entries of the ring of a connection: a write, a read and their
+    cancellations at most. */
+#define XND_HTTP_URING_ENTRIES (4U)
+
+/** Idle connections kept by the transport, the others are closed. */
+#define XND_HTTP_URING_IDLE (16U)
+
+/** Maximum size of an endpoint, "unix:/path" or "host:port". */
+#define XND_HTTP_URING_PEER (128UL)
+
+/** Waits are sliced so that cancellation is noticed meanwhile. */
+#define XND_HTTP_URING_SLICE_MS (10L)
+
+/** Operations, also the user data of their completions. */
+enum {
+	XND_HTTP_URING_CONNECT,
+	XND_HTTP_URING_WRITE,
+	XND_HTTP_URING_READ,
+	XND_HTTP_URING_OPS
+};
+
+/** Keep-alive connection, with a ring of its own and its response buffer
+    registered with the ring, so that reads skip mapping its pages. */
+typedef struct xnd_http_uring_conn_t {
+	int                  ring;     /** io_uring instance. */
+	void                *map;      /** Mapped SQ and CQ rings. */
+	size_t               mapsz;    /** Size of the mapped rings. */
+	struct io_uring_sqe *sqes;     /** Mapped submission entries. */
+	size_t               sqesz;    /** Size of the mapped entries. */
+	unsigned int        *sq_tail;  /** Tail of the SQ ring. */
+	unsigned int        *sq_array; /** Entry indexes of the SQ ring. */
+	unsigned int         sq_mask;  /** Mask of the SQ ring. */
+	unsigned int         tail;     /** Tail, queued entries included. */
+	unsigned int         queued;   /** Entries not submitted yet. */
+	unsigned int        *cq_head;  /** Head of the CQ ring. */
+	unsigned int        *cq_tail;  /** Tail of the CQ ring. */
+	struct io_uring_cqe *cqes;     /** Completion entries. */
+	unsigned int         cq_mask;  /** Mask of the CQ ring. */
+	unsigned int         pending;  /** Operations in flight. */
+	unsigned int         done;     /** Completed operations, bitwise. */
+	int                  res[XND_HTTP_URING_OPS]; /** Their results. */
+	int                  sock;     /** Socket, -1 when not connected. */
+	char                 peer[XND_HTTP_URING_PEER]; /** Its endpoint. */
+	char                *out;      /** Request buffer. */
+	char                *in;       /** Registered response buffer. */
+	size_t               pos;      /** Response bytes consumed. */
+	size_t               fill;     /** Response bytes buffered. */
+	struct xnd_http_uring_conn_t *next; /** Next idle connection. */
+} xnd_http_uring_conn_t;
+
+/** io_uring transport. */
+typedef struct xnd_http_uring_t {
+	pthread_mutex_t        lock;  /** Guards the idle connections. */
+	xnd_http_uring_conn_t *idle;  /** Idle connections, last in first. */
+	unsigned int           nidle; /** Number of idle connections. */
+	unsigned int           forks; /** Forks seen by the connections. */
+} xnd_http_uring_t;
+
+/** Forks of the process, so that children leave the connections of their
+    parent alone without a getpid() system call on every request. */
+static atomic_uint xnd_http_uring_forks;
+
+/** Registers the fork handler once. */
+static pthread_once_t xnd_http_uring_once = PTHREAD_ONCE_INIT;
+
+/** Counts a fork, in the child. */
+static void
+xnd_http_uring_forked(void);
+
+/** Registers the fork handler. */
+static void
+xnd_http_uring_atfork(void);
+
+/** Sends HTTP request over io_uring. */
+static int
+xnd_http_uring_send(void *ctx, xnd_http_request_t *req, void *data);
+
+/** Destroys the transport state. */
+static void
+xnd_http_uring_destroy(void *ctx);
+
+/** Creates new connection, its ring set up, not connected yet. */
+static xnd_http_uring_conn_t *
+xnd_http_uring_conn_new(void);
+
+/** Destroys connection, `forked` leaves the socket to the parent. */
+static void
+xnd_http_uring_conn_destroy(xnd_http_uring_conn_t *c, int forked);
+
+/** Takes an idle connection, or creates one. */
+static xnd_http_uring_conn_t *
+xnd_http_uring_checkout(xnd_http_uring_t *u);
+
+/** Gives a connection back once a request is done. */
+static void
+xnd_http_uring_checkin(xnd_http_uring_t *u, xnd_http_uring_conn_t *c);
+
+/** Queues an operation on the socket of the connection. */
+static void
+xnd_http_uring_queue(xnd_http_uring_conn_t *c, unsigned char opcode,
+                     int op, void *addr, size_t len, unsigned long long off,
+                     unsigned char flags);
+
+/** Moves completions into the results of their operations. */
+static void
+xnd_http_uring_reap(xnd_http_uring_conn_t *c);
+
+/** Submits queued operations and waits for the ones in `ops`, bitwise,
+    within the time left by the request and before `until`, if set. */
+static int
+xnd_http_uring_wait(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                    unsigned int ops, unsigned long long until);
+
+/** Closes the socket of the connection, cancelling operations in flight
+    before their buffers may be reused. */
+static void
+xnd_http_uring_close(xnd_http_uring_conn_t *c);
+
+/** Finds the endpoint of a request and the host and target of its URL,
+    fails for requests left to curl. */
+static int
+xnd_http_uring_peer(const xnd_http_request_t *req, char *peer,
+                    const char **host, size_t *hostsz, const char **target);
+
+/** Connects the connection to an endpoint. */
+static int
+xnd_http_uring_connect(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                       const char *peer);
+
+/** Sends a request and receives its response on a connected connection,
+    returns 1 if the connection must be closed afterwards. */
+static int
+xnd_http_uring_exchange(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                        void *data, const char *host, size_t hostsz,
+                        const char *target);
+
+/** Writes the request, the first read of the response batched with the
+    last write. */
+static int
+xnd_http_uring_request(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                       const char *host, size_t hostsz, const char *target);
+
+/** Reads the response, passing its body to the write callback. */
+static int
+xnd_http_uring_response(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                        void *data);
+
+/** Reads more of the response, returns the bytes read, 0 at the end. */
+static long
+xnd_http_uring_more(xnd_http_uring_conn_t *c, xnd_http_request_t *req);
+
+/** Waits for a whole line at the read position, sets its size without the
+    CRLF. */
+static int
+xnd_http_uring_line(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                    size_t *size);
+
+/** Passes `size` bytes of body on to the write callback. */
+static int
+xnd_http_uring_body(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                    void *data, size_t size);
+
+/** Finds the value of a header line by key, compared case-insensitively. */
+static const char *
+xnd_http_uring_header(const char *line, size_t size, const char *key);
+
+/** Appends to the request buffer, fails once it is full. */
+static int
+xnd_http_uring_put(xnd_http_uring_conn_t *c, size_t *size, const char *src,
+                   size_t n);
+
+xnd_http_transport_t *
+xnd_http_transport_uring_new(void)
+{
+	xnd_http_transport_t *t;
+	xnd_http_uring_t *u;
+
+	t = xnd_malloc(sizeof(xnd_http_transport_t));
+	u = xnd_malloc(sizeof(xnd_http_uring_t));
+	if (t == NULL || u == NULL)
+		goto fail;
+
+	/** A first connection tells whether io_uring is usable at all, it may
+	    be missing or forbidden by a seccomp policy. */
+	u->idle = xnd_http_uring_conn_new();
+	if (u->idle == NULL)
+		goto fail;
+
+	pthread_mutex_init(&(u->lock), NULL);
+	u->nidle = 1U;
+	pthread_once(&xnd_http_uring_once, xnd_http_uring_atfork);
+	u->forks = atomic_load(&xnd_http_uring_forks);
+
+	t->name    = "uring";
+	t->send    = xnd_http_uring_send;
+	t->destroy = xnd_http_uring_destroy;
+	t->ctx     = u;
+
+	return t;
+
+fail:
+	xnd_free(u);
+	xnd_free(t);
+
+	return NULL;
+}
+
+static int
+xnd_http_uring_send(void *ctx, xnd_http_request_t *req, void *data)
+{
+	xnd_http_uring_t *u = ctx;
+	xnd_http_uring_conn_t *c;
+	char peer[XND_HTTP_URING_PEER];
+	const char *host, *target;
+	size_t hostsz;
+	int res = -1, reused;
+
+	/** Only plain HTTP is spoken, HTTPS without a sidecar goes to curl. */
+	if (xnd_http_uring_peer(req, peer, &host, &hostsz, &target) == -1)
+		return xnd_http_transport_curl.send(NULL, req, data);
+
+	if (xnd_http_request_remaining(req) == 0L)
+		return -1;
+
+	c = xnd_http_uring_checkout(u);
+	if (c == NULL) {
+		req->error = CURLE_OUT_OF_MEMORY;
+		return -1;
+	}
+
+	/** A pooled connection may have been closed by the peer meanwhile,
+	    the request is then sent once more on a new one, as curl does. */
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		if (req->body != NULL && req->body->rewind != NULL &&
+		    req->body->rewind(req->body->data) == -1) {
+			req->error = CURLE_SEND_FAIL_REWIND;
+			res = -1;
+			break;
+		}
+
+		reused = c->sock != -1 && strcmp(c->peer, peer) == 0;
+		if (!reused) {
+			xnd_http_uring_close(c);
+			if (xnd_http_uring_connect(c, req, peer) == -1) {
+				res = -1;
+				break;
+			}
+		}
+
+		if (req->pool != NULL)
+			atomic_fetch_add_explicit(reused ? &(req->pool->warm)
+			                                 : &(req->pool->cold),
+			                          1UL, memory_order_relaxed);
+
+		res = xnd_http_uring_exchange(c, req, data, host, hostsz,
+		                              target);
+		if (res != -1 || !reused || req->status != 0L ||
+		    (req->error != CURLE_SEND_ERROR &&
+		     req->error != CURLE_RECV_ERROR &&
+		     req->error != CURLE_GOT_NOTHING))
+			break;
+
+		xnd_http_uring_close(c);
+		req->error = 0;
+	}
+
+	/** The ring and its buffers are kept, even without the socket. */
+	if (res != 0)
+		xnd_http_uring_close(c);
+	xnd_http_uring_checkin(u, c);
+
+	return res == -1 ? -1 : 0;
+}
+
+static void
+xnd_http_uring_destroy(void *ctx)
+{
+	xnd_http_uring_t *u = ctx;
+	xnd_http_uring_conn_t *c;
+
+	while ((c = u->idle) != NULL) {
+		u->idle = c->next;
+		xnd_http_uring_conn_destroy(c, u->forks !=
+		                            atomic_load(&xnd_http_uring_forks));
+	}
+
+	pthread_mutex_destroy(&(u->lock));
+	xnd_free(u);
+}
+
+static void
+xnd_http_uring_forked(void)
+{
+	atomic_fetch_add(&xnd_http_uring_forks, 1U);
+}
+
+static void
+xnd_http_uring_atfork(void)
+{
+	pthread_atfork(NULL, NULL, xnd_http_uring_forked);
+}
+
+static xnd_http_uring_conn_t *
+xnd_http_uring_conn_new(void)
+{
+	struct io_uring_params p;
+	struct iovec iov;
+	xnd_http_uring_conn_t *c;
+	size_t cqsz;
+	char *map;
+
+	c = xnd_calloc(1UL, sizeof(xnd_http_uring_conn_t));
+	if (c == NULL)
+		return NULL;
+
+	c->ring = -1;
+	c->sock = -1;
+	c->map = MAP_FAILED;
+	c->sqes = MAP_FAILED;
+
+	c->out = xnd_malloc(2UL * XND_HTTP_URING_BUFFER);
+	if (c->out == NULL)
+		goto fail;
+	c->in = c->out + XND_HTTP_URING_BUFFER;
+
+	/** Timed waits on completions need IORING_FEAT_EXT_ARG, Linux 5.11. */
+	memset(&p, 0, sizeof(p));
+	c->ring = (int) syscall(__NR_io_uring_setup, XND_HTTP_URING_ENTRIES,
+	                        &p);
+	if (c->ring == -1 || !(p.features & IORING_FEAT_SINGLE_MMAP) ||
+	    !(p.features & IORING_FEAT_EXT_ARG))
+		goto fail;
+
+	c->mapsz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (cqsz > c->mapsz)
+		c->mapsz = cqsz;
+	c->sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	c->map = mmap(NULL, c->mapsz, PROT_READ | PROT_WRITE,
+	              MAP_SHARED | MAP_POPULATE, c->ring, IORING_OFF_SQ_RING);
+	c->sqes = mmap(NULL, c->sqesz, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_POPULATE, c->ring, IORING_OFF_SQES);
+	if (c->map == MAP_FAILED || c->sqes == MAP_FAILED)
+		goto fail;
+
+	map = c->map;
+	c->sq_tail  = (unsigned int *) (map + p.sq_off.tail);
+	c->sq_array = (unsigned int *) (map + p.sq_off.array);
+	c->sq_mask  = *(unsigned int *) (map + p.sq_off.ring_mask);
+	c->cq_head  = (unsigned int *) (map + p.cq_off.head);
+	c->cq_tail  = (unsigned int *) (map + p.cq_off.tail);
+	c->cqes     = (struct io_uring_cqe *) (map + p.cq_off.cqes);
+	c->cq_mask  = *(unsigned int *) (map + p.cq_off.ring_mask);
+	c->tail     = *(c->sq_tail);
+
+	iov.iov_base = c->in;
+	iov.iov_len  = XND_HTTP_URING_BUFFER;
+	if (syscall(__NR_io_uring_register, c->ring, IORING_REGISTER_BUFFERS,
+	            &iov, 1U) == -1)
+		goto fail;
+
+	return c;
+
+fail:
+	xnd_http_uring_conn_destroy(c, 0);
+
+	return NULL;
+}
+
+static void
+xnd_http_uring_conn_destroy(xnd_http_uring_conn_t *c, int forked)
+{
+	/** A shutdown in a child would cut the connection of the parent. */
+	if (forked && c->sock != -1)
+		close(c->sock);
+	else
+		xnd_http_uring_close(c);
+
+	if (c->sqes != MAP_FAILED)
+		munmap(c->sqes, c->sqesz);
+	if (c->map != MAP_FAILED)
+		munmap(c->map, c->mapsz);
+	if (c->ring != -1)
+		close(c->ring);
+
+	xnd_free(c->out);
+	xnd_free(c);
+}
+
+static xnd_http_uring_conn_t *
+xnd_http_uring_checkout(xnd_http_uring_t *u)
+{
+	xnd_http_uring_conn_t *c, *stale = NULL;
+
+	pthread_mutex_lock(&(u->lock));
+
+	/** Rings and sockets inherited across fork() belong to the parent. */
+	if (u->forks != atomic_load(&xnd_http_uring_forks)) {
+		stale = u->idle;
+		u->idle = NULL;
+		u->nidle = 0U;
+		u->forks = atomic_load(&xnd_http_uring_forks);
+	}
+
+	c = u->idle;
+	if (c != NULL) {
+		u->idle = c->next;
+		--(u->nidle);
+	}
+
+	pthread_mutex_unlock(&(u->lock));
+
+	while (stale != NULL) {
+		xnd_http_uring_conn_t *next = stale->next;
+
+		xnd_http_uring_conn_destroy(stale, 1);
+		stale = next;
+	}
+
+	return c != NULL ? c : xnd_http_uring_conn_new();
+}
+
+static void
+xnd_http_uring_checkin(xnd_http_uring_t *u, xnd_http_uring_conn_t *c)
+{
+	pthread_mutex_lock(&(u->lock));
+	if (u->nidle < XND_HTTP_URING_IDLE) {
+		c->next = u->idle;
+		u->idle = c;
+		++(u->nidle);
+		c = NULL;
+	}
+	pthread_mutex_unlock(&(u->lock));
+
+	if (c != NULL)
+		xnd_http_uring_conn_destroy(c, 0);
+}
+
+static void
+xnd_http_uring_queue(xnd_http_uring_conn_t *c, unsigned char opcode,
+                     int op, void *addr, size_t len, unsigned long long off,
+                     unsigned char flags)
+{
+	unsigned int index = c->tail & c->sq_mask;
+	struct io_uring_sqe *sqe = &(c->sqes[index]);
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode    = opcode;
+	sqe->flags     = flags;
+	sqe->fd        = opcode == IORING_OP_ASYNC_CANCEL ? -1 : c->sock;
+	sqe->addr      = (unsigned long long) (uintptr_t) addr;
+	sqe->len       = (unsigned int) len;
+	sqe->off       = off;
+	sqe->user_data = (unsigned long long) op;
+
+	/** A peer gone away must not raise SIGPIPE, as write(2) would, and a
+	    short send must break the link to the read. */
+	if (opcode == IORING_OP_SEND)
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+
+	c->sq_array[index] = index;
+	++(c->tail);
+	++(c->queued);
+	++(c->pending);
+
+	if (op < XND_HTTP_URING_OPS)
+		c->done &= ~(1U << op);
+}
+
+static void
+xnd_http_uring_reap(xnd_http_uring_conn_t *c)
+{
+	unsigned int head = *(c->cq_head);
+	unsigned int tail = __atomic_load_n(c->cq_tail, __ATOMIC_ACQUIRE);
+	const struct io_uring_cqe *cqe;
+
+	for (; head != tail; ++head) {
+		cqe = &(c->cqes[head & c->cq_mask]);
+		if (cqe->user_data < (unsigned long long) XND_HTTP_URING_OPS) {
+			c->res[cqe->user_data] = cqe->res;
+			c->done |= 1U << cqe->user_data;
+		}
+		--(c->pending);
+	}
+
+	__atomic_store_n(c->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static int
+xnd_http_uring_wait(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                    unsigned int ops, unsigned long long until)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned long long now;
+	unsigned int want;
+	long left, r;
+
+	for (;;) {
+		xnd_http_uring_reap(c);
+		if ((c->done & ops) == ops)
+			return 0;
+
+		left = xnd_http_request_remaining(req);
+		if (left == 0L) {
+			req->error = req->limits.cancel != NULL &&
+			             atomic_load(req->limits.cancel) ?
+			             CURLE_ABORTED_BY_CALLBACK :
+			             CURLE_OPERATION_TIMEDOUT;
+			return -1;
+		}
+		if (until != 0ULL) {
+			now = xnd_http_request_now();
+			if (now >= until) {
+				req->error = CURLE_OPERATION_TIMEDOUT;
+				return -1;
+			}
+			if ((until - now + 999999ULL) / 1000000ULL <
+			    (unsigned long long) left)
+				left = (long) ((until - now + 999999ULL) /
+				               1000000ULL);
+		}
+		if (req->limits.cancel != NULL &&
+		    left > XND_HTTP_URING_SLICE_MS)
+			left = XND_HTTP_URING_SLICE_MS;
+
+		memset(&arg, 0, sizeof(arg));
+		if (left != LONG_MAX) {
+			ts.tv_sec = left / 1000L;
+			ts.tv_nsec = (left % 1000L) * 1000000L;
+			arg.ts = (unsigned long long) (uintptr_t) &ts;
+		}
+
+		want = (unsigned int) __builtin_popcount(ops & ~c->done);
+		__atomic_store_n(c->sq_tail, c->tail, __ATOMIC_RELEASE);
+
+		/** The submission and the wait are one system call, the wait
+		    may time out with the operations left in flight. */
+		r = syscall(__NR_io_uring_enter, c->ring, c->queued, want,
+		            IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		            &arg, sizeof(arg));
+		if (r >= 0L) {
+			if ((unsigned long) r != c->queued) {
+				req->error = CURLE_SEND_ERROR;
+				return -1;
+			}
+			c->queued = 0U;
+		} else if (errno != ETIME && errno != EINTR) {
+			req->error = CURLE_RECV_ERROR;
+			return -1;
+		}
+	}
+}
+
+static void
+xnd_http_uring_close(xnd_http_uring_conn_t *c)
+{
+	if (c->sock == -1)
+		return;
+
+	/** Nothing may land in the registered buffers once they are reused,
+	    so operations in flight are cancelled and waited for. */
+	if (c->pending > 0U) {
+		shutdown(c->sock, SHUT_RDWR);
+		for (int op = 0; op < XND_HTTP_URING_OPS; ++op)
+			if (!(c->done & (1U << op)))
+				xnd_http_uring_queue(c, IORING_OP_ASYNC_CANCEL,
+				                     XND_HTTP_URING_OPS,
+				                     (void *) (uintptr_t) op,
+				                     0UL, 0ULL, 0);
+		__atomic_store_n(c->sq_tail, c->tail, __ATOMIC_RELEASE);
+
+		while (c->pending > 0U) {
+			if (syscall(__NR_io_uring_enter, c->ring, c->queued,
+			            1U, IORING_ENTER_GETEVENTS, NULL,
+			            0UL) >= 0L)
+				c->queued = 0U;
+			else if (errno != EINTR)
+				break;
+			xnd_http_uring_reap(c);
+		}
+	}
+
+	close(c->sock);
+	c->sock = -1;
+	c->peer[0] = '\0';
+	c->done = (1U << XND_HTTP_URING_OPS) - 1U;
+	c->pos = 0UL;
+	c->fill = 0UL;
+}
+
+static int
+xnd_http_uring_peer(const xnd_http_request_t *req, char *peer,
+                    const char **host, size_t *hostsz, const char **target)
+{
+	const char *url = req->url->data, *sep;
+	int n;
+
+	sep = strstr(url, "://");
+	if (sep == NULL)
+		return -1;
+
+	*host = sep + 3;
+	*hostsz = strcspn(*host, "/?#");
+	*target = *host + *hostsz;
+
+	if (req->pool != NULL && req->pool->sidecar != NULL) {
+		n = snprintf(peer, XND_HTTP_URING_PEER, "unix:%s",
+		             req->pool->sidecar);
+	} else if (req->pool != NULL && req->pool->connect_to != NULL) {
+		/** "::host:port", see `xnd_http_pool_sidecar()`. */
+		n = snprintf(peer, XND_HTTP_URING_PEER, "%s",
+		             req->pool->connect_to->data + 2);
+	} else if (strncmp(url, "http://", 7UL) == 0) {
+		/** The port defaults to 80, looked for past an IPv6 address. */
+		sep = memchr(*host, ']', *hostsz);
+		if (sep == NULL)
+			sep = *host;
+		sep = memchr(sep, ':', *hostsz - (size_t) (sep - *host));
+		n = snprintf(peer, XND_HTTP_URING_PEER, "%.*s%s",
+		             (int) *hostsz, *host, sep != NULL ? "" : ":80");
+	} else {
+		return -1;
+	}
+
+	return n > 0 && (size_t) n < XND_HTTP_URING_PEER ? 0 : -1;
+}
+
+static int
+xnd_http_uring_connect(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                       const char *peer)
+{
+	struct sockaddr_storage addr;
+	struct sockaddr_un *sun = (struct sockaddr_un *) &addr;
+	struct addrinfo hints, *res = NULL;
+	unsigned long long until = 0ULL;
+	char host[XND_HTTP_URING_PEER], *port;
+	socklen_t len;
+	int one = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	if (strncmp(peer, "unix:", 5UL) == 0) {
+		if (strlen(peer + 5) >= sizeof(sun->sun_path))
+			goto fail;
+		sun->sun_family = AF_UNIX;
+		strcpy(sun->sun_path, peer + 5);
+		len = (socklen_t) sizeof(struct sockaddr_un);
+	} else {
+		/** "host:port", the host possibly a bracketed IPv6 address. */
+		strcpy(host, peer);
+		port = strrchr(host, ':');
+		if (port == NULL)
+			goto fail;
+		*port++ = '\0';
+		if (host[0] == '[' && port[-2] == ']') {
+			port[-2] = '\0';
+			memmove(host, host + 1, strlen(host));
+		}
+
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		if (getaddrinfo(host, port, &hints, &res) != 0 ||
+		    res->ai_addrlen > sizeof(addr)) {
+			if (res != NULL)
+				freeaddrinfo(res);
+			req->error = CURLE_COULDNT_RESOLVE_HOST;
+			return -1;
+		}
+		memcpy(&addr, res->ai_addr, res->ai_addrlen);
+		len = res->ai_addrlen;
+		freeaddrinfo(res);
+	}
+
+	c->sock = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (c->sock == -1)
+		goto fail;
+	if (addr.ss_family != AF_UNIX)
+		setsockopt(c->sock, IPPROTO_TCP, TCP_NODELAY, &one,
+		           sizeof(one));
+
+	if (req->limits.connect_ms > 0L)
+		until = xnd_http_request_now() + 1000000ULL *
+		        (unsigned long long) req->limits.connect_ms;
+
+	xnd_http_uring_queue(c, IORING_OP_CONNECT, XND_HTTP_URING_CONNECT,
+	                     &addr, 0UL, (unsigned long long) len, 0);
+	if (xnd_http_uring_wait(c, req, 1U << XND_HTTP_URING_CONNECT,
+	                        until) == -1) {
+		xnd_http_uring_close(c);
+		return -1;
+	}
+	if (c->res[XND_HTTP_URING_CONNECT] < 0)
+		goto fail;
+
+	strcpy(c->peer, peer);
+
+	return 0;
+
+fail:
+	xnd_http_uring_close(c);
+	req->error = CURLE_COULDNT_CONNECT;
+
+	return -1;
+}
+
+static int
+xnd_http_uring_exchange(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                        void *data, const char *host, size_t hostsz,
+                        const char *target)
+{
+	c->pos = 0UL;
+	c->fill = 0UL;
+
+	if (xnd_http_uring_request(c, req, host, hostsz, target) == -1)
+		return -1;
+
+	return xnd_http_uring_response(c, req, data);
+}
+
+static int
+xnd_http_uring_request(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                       const char *host, size_t hostsz, const char *target)
+{
+	const xnd_http_headers_t *h = req->headers;
+	const unsigned int writing = 1U << XND_HTTP_URING_WRITE;
+	const unsigned int both = writing | (1U << XND_HTTP_URING_READ);
+	size_t size = 0UL, total = 0UL, sent = 0UL, n;
+	char length[64];
+	int last, res;
+
+	if (req->payload != NULL)
+		total = strlen(req->payload);
+	else if (req->body != NULL)
+		total = req->body->size;
+
+	/** "GET /path?query HTTP/1.1", in origin form as curl sends it. */
+	if (xnd_http_uring_put(c, &size, req->method, strlen(req->method)) ||
+	    xnd_http_uring_put(c, &size, " ", 1UL) ||
+	    (*target != '/' && xnd_http_uring_put(c, &size, "/", 1UL)) ||
+	    xnd_http_uring_put(c, &size, target, strcspn(target, "#")) ||
+	    xnd_http_uring_put(c, &size, " HTTP/1.1\r\nHost: ", 17UL) ||
+	    xnd_http_uring_put(c, &size, host, hostsz) ||
+	    xnd_http_uring_put(c, &size, "\r\n", 2UL))
+		goto fail;
+
+	for (size_t i = 0UL; h != NULL && i < h->count; ++i) {
+		const char *line = h->block->data + h->lines[i];
+
+		if (xnd_http_uring_put(c, &size, line, strlen(line)) ||
+		    xnd_http_uring_put(c, &size, "\r\n", 2UL))
+			goto fail;
+	}
+
+	if (req->payload != NULL || req->body != NULL) {
+		n = (size_t) snprintf(length, sizeof(length),
+		                      "Content-Length: %zu\r\n", total);
+		if (xnd_http_uring_put(c, &size, length, n))
+			goto fail;
+	}
+	if (xnd_http_uring_put(c, &size, "\r\n", 2UL))
+		goto fail;
+
+	for (;;) {
+		/** The rest of the buffer is filled with the body. */
+		while (sent < total && size < XND_HTTP_URING_BUFFER) {
+			n = XND_HTTP_URING_BUFFER - size;
+			if (n > total - sent)
+				n = total - sent;
+
+			if (req->payload != NULL) {
+				memcpy(c->out + size, req->payload + sent, n);
+			} else {
+				n = req->body->read(c->out + size, n,
+				                    req->body->data);
+				if (n == XND_HTTP_BODY_ABORT || n == 0UL) {
+					req->error = n == 0UL ?
+					             CURLE_READ_ERROR :
+					             CURLE_ABORTED_BY_CALLBACK;
+					return -1;
+				}
+			}
+
+			size += n;
+			sent += n;
+		}
+
+		/** The first read of the response goes in the same system call
+		    as the last write of the request, linked after it. */
+		last = sent == total;
+		xnd_http_uring_queue(c, IORING_OP_SEND,
+		                     XND_HTTP_URING_WRITE, c->out, size, 0ULL,
+		                     last ? IOSQE_IO_LINK : 0);
+		if (last)
+			xnd_http_uring_queue(c, IORING_OP_READ_FIXED,
+			                     XND_HTTP_URING_READ, c->in,
+			                     XND_HTTP_URING_BUFFER, 0ULL, 0);
+		if (xnd_http_uring_wait(c, req, last ? both : writing,
+		                        0ULL) == -1)
+			return -1;
+
+		res = c->res[XND_HTTP_URING_WRITE];
+		if (res <= 0) {
+			req->error = CURLE_SEND_ERROR;
+			return -1;
+		}
+		memmove(c->out, c->out + res, size - (size_t) res);
+		size -= (size_t) res;
+
+		if (!last)
+			continue;
+
+		/** A short write breaks the link, the read is then cancelled
+		    and queued again with the rest. */
+		res = c->res[XND_HTTP_URING_READ];
+		if (res == -ECANCELED && size > 0UL)
+			continue;
+		if (res < 0) {
+			req->error = CURLE_RECV_ERROR;
+			return -1;
+		}
+		if (res == 0) {
+			req->error = CURLE_GOT_NOTHING;
+			return -1;
+		}
+
+		c->fill = (size_t) res;
+
+		return 0;
+	}
+
+fail:
+	req->error = CURLE_SEND_ERROR;
+
+	return -1;
+}
+
+static int
+xnd_http_uring_response(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                        void *data)
+{
+	const char *line, *value;
+	size_t size, length = 0UL;
+	int chunked = 0, closing = 0, sized = 0;
+	long status = 0L;
+
+	/** Interim responses, e.g. "100 Continue", are skipped. */
+	do {
+		if (xnd_http_uring_line(c, req, &size) == -1)
+			return -1;
+
+		line = c->in + c->pos;
+		if (size < 12UL || strncmp(line, "HTTP/1.", 7UL) != 0 ||
+		    line[8] != ' ' || !isdigit((unsigned char) line[9]) ||
+		    !isdigit((unsigned char) line[10]) ||
+		    !isdigit((unsigned char) line[11])) {
+			req->error = CURLE_WEIRD_SERVER_REPLY;
+			return -1;
+		}
+		status = (line[9] - '0') * 100L + (line[10] - '0') * 10L +
+		         (line[11] - '0');
+		closing = line[7] == '0';
+		c->pos += size + 2UL;
+
+		for (;;) {
+			if (xnd_http_uring_line(c, req, &size) == -1)
+				return -1;
+
+			line = c->in + c->pos;
+			c->pos += size + 2UL;
+			if (size == 0UL)
+				break;
+
+			if ((value = xnd_http_uring_header(line, size,
+			                                   "content-length"))) {
+				length = strtoul(value, NULL, 10);
+				sized = 1;
+			} else if ((value = xnd_http_uring_header(
+			                line, size, "transfer-encoding"))) {
+				chunked = strncmp(value, "chunked", 7UL) == 0;
+			} else if ((value = xnd_http_uring_header(
+			                line, size, "connection"))) {
+				closing = strncmp(value, "close", 5UL) == 0;
+			}
+		}
+	} while (status < 200L);
+
+	req->status = status;
+
+	if (XND_PROBE_ENABLED(first__byte))
+		XND_PROBE(first__byte, req, req->status);
+
+	if (strcmp(req->method, XND_HTTP_REQUEST_HEAD) == 0 ||
+	    status == 204L || status == 304L)
+		return closing;
+
+	if (!chunked) {
+		if (!sized) {
+			/** Delimited by the end of the connection. */
+			while (xnd_http_uring_more(c, req) > 0L)
+				if (xnd_http_uring_body(c, req, data,
+				                        c->fill - c->pos) == -1)
+					return -1;
+			if (req->error != 0)
+				return -1;
+			return xnd_http_uring_body(c, req, data,
+			                           c->fill - c->pos) == -1 ?
+			       -1 : 1;
+		}
+
+		return xnd_http_uring_body(c, req, data, length) == -1 ?
+		       -1 : closing;
+	}
+
+	for (;;) {
+		if (xnd_http_uring_line(c, req, &size) == -1)
+			return -1;
+
+		line = c->in + c->pos;
+		length = 0UL;
+		for (size_t i = 0UL; i < size && isxdigit((unsigned char)
+		                                          line[i]); ++i) {
+			if (length >> 56)
+				break;
+			length = length * 16UL + (size_t) (isdigit(
+			         (unsigned char) line[i]) ? line[i] - '0' :
+			         (tolower((unsigned char) line[i]) - 'a' + 10));
+		}
+		if (size == 0UL || !isxdigit((unsigned char) line[0]) ||
+		    (length >> 56)) {
+			req->error = CURLE_RECV_ERROR;
+			return -1;
+		}
+		c->pos += size + 2UL;
+
+		if (length == 0UL)
+			break;
+
+		if (xnd_http_uring_body(c, req, data, length) == -1 ||
+		    xnd_http_uring_line(c, req, &size) == -1)
+			return -1;
+		if (size != 0UL) {
+			req->error = CURLE_RECV_ERROR;
+			return -1;
+		}
+		c->pos += 2UL;
+	}
+
+	/** Trailers are ignored up to the empty line. */
+	do {
+		if (xnd_http_uring_line(c, req, &size) == -1)
+			return -1;
+		c->pos += size + 2UL;
+	} while (size > 0UL);
+
+	return closing;
+}
+
+static long
+xnd_http_uring_more(xnd_http_uring_conn_t *c, xnd_http_request_t *req)
+{
+	int res;
+
+	if (c->pos > 0UL) {
+		memmove(c->in, c->in + c->pos, c->fill - c->pos);
+		c->fill -= c->pos;
+		c->pos = 0UL;
+	}
+
+	if (c->fill == XND_HTTP_URING_BUFFER) {
+		req->error = CURLE_RECV_ERROR;
+		return -1L;
+	}
+
+	xnd_http_uring_queue(c, IORING_OP_READ_FIXED, XND_HTTP_URING_READ,
+	                     c->in + c->fill, XND_HTTP_URING_BUFFER - c->fill,
+	                     0ULL, 0);
+	if (xnd_http_uring_wait(c, req, 1U << XND_HTTP_URING_READ,
+	                        0ULL) == -1)
+		return -1L;
+
+	res = c->res[XND_HTTP_URING_READ];
+	if (res < 0) {
+		req->error = CURLE_RECV_ERROR;
+		return -1L;
+	}
+	c->fill += (size_t) res;
+
+	return (long) res;
+}
+
+static int
+xnd_http_uring_line(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                    size_t *size)
+{
+	long n;
+
+	for (;;) {
+		for (size_t i = c->pos; i + 1UL < c->fill; ++i) {
+			if (c->in[i] == '\r' && c->in[i + 1UL] == '\n') {
+				*size = i - c->pos;
+				return 0;
+			}
+		}
+
+		n = xnd_http_uring_more(c, req);
+		if (n <= 0L) {
+			if (n == 0L)
+				req->error = req->status == 0L ?
+				             CURLE_GOT_NOTHING :
+				             CURLE_PARTIAL_FILE;
+			return -1;
+		}
+	}
+}
+
+static int
+xnd_http_uring_body(xnd_http_uring_conn_t *c, xnd_http_request_t *req,
+                    void *data, size_t size)
+{
+	size_t n;
+	long r;
+
+	while (size > 0UL) {
+		if (c->pos == c->fill) {
+			r = xnd_http_uring_more(c, req);
+			if (r <= 0L) {
+				if (r == 0L)
+					req->error = CURLE_PARTIAL_FILE;
+				return -1;
+			}
+		}
+
+		n = c->fill - c->pos;
+		if (n > size)
+			n = size;
+
+		if (req->cb != NULL &&
+		    req->cb(c->in + c->pos, 1UL, n, data) != n) {
+			req->error = CURLE_WRITE_ERROR;
+			return -1;
+		}
+
+		c->pos += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+static const char *
+xnd_http_uring_header(const char *line, size_t size, const char *key)
+{
+	size_t keysz = strlen(key), i;
+
+	if (size <= keysz || line[keysz] != ':')
+		return NULL;
+
+	for (i = 0UL; i < keysz; ++i)
+		if (tolower((unsigned char) line[i]) != key[i])
+			return NULL;
+
+	for (++i; i < size && (line[i] == ' ' || line[i] == '\t'); ++i)
+		;
+
+	return line + i;
+}
+
+static int
+xnd_http_uring_put(xnd_http_uring_conn_t *c, size_t *size, const char *src,
+                   size_t n)
+{
+	if (n > XND_HTTP_URING_BUFFER - *size)
+		return -1;
+
+	memcpy(c->out + *size, src, n);
+	*size += n;
+
+	return 0;
+}
+
+#else
+
+xnd_http_transport_t *
+xnd_http_transport_uring_new(void)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,337 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "http_request.h"
+#include "limiter.h"
+
+/** Weights of the lanes of new limiters. */
+static const unsigned int xnd_limiter_weights[XND_LIMITER_LANES] = { 4U, 1U };
+
+/** Initializes the conditions of a limiter. */
+static void
+xnd_limiter_conds(xnd_limiter_t *l);
+
+/** Whether a call of a lane fits in the limit. */
+static int
+xnd_limiter_fits(const xnd_limiter_t *l, unsigned int lane);
+
+/** Lane whose waiting calls are due for a slot, -1 if none fits. */
+static int
+xnd_limiter_turn(const xnd_limiter_t *l);
+
+/** Wakes a waiting call of the lane whose turn it is. */
+static void
+xnd_limiter_wake(xnd_limiter_t *l);
+
+xnd_limiter_t *
+xnd_limiter_new(unsigned int initial, unsigned int min, unsigned int max,
+                double tolerance, long wait_ms)
+{
+	xnd_limiter_t *l;
+
+	if (min == 0U || min > max || initial < min || initial > max ||
+	    tolerance <= 1.0 || wait_ms < 0L)
+		return NULL;
+
+	l = xnd_malloc(sizeof(xnd_limiter_t));
+	if (l == NULL)
+		return NULL;
+
+	pthread_mutex_init(&(l->lock), NULL);
+	xnd_limiter_conds(l);
+
+	l->limit     = (double) initial;
+	l->min       = (double) min;
+	l->max       = (double) max;
+	l->tolerance = tolerance;
+	l->baseline  = 0.0;
+	l->inflight  = 0U;
+	l->wait_ms   = wait_ms;
+	l->reserved  = 0.0;
+	l->vclock    = 0.0;
+	atomic_init(&(l->rejected), 0UL);
+
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i) {
+		xnd_limiter_lane_t *q = &(l->lanes[i]);
+
+		q->weight   = xnd_limiter_weights[i];
+		q->inflight = 0U;
+		q->waiting  = 0U;
+		q->finish   = 0.0;
+		q->admitted = 0UL;
+		q->waited   = 0ULL;
+		q->longest  = 0ULL;
+		memset(q->waits, 0, sizeof(q->waits));
+		atomic_init(&(q->rejected), 0UL);
+	}
+
+	return l;
+}
+
+void
+xnd_limiter_destroy(xnd_limiter_t *l)
+{
+	if (l == NULL)
+		return;
+
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i)
+		pthread_cond_destroy(&(l->lanes[i].cond));
+	pthread_mutex_destroy(&(l->lock));
+	xnd_free(l);
+}
+
+int
+xnd_limiter_lanes(xnd_limiter_t *l, const unsigned int *weights,
+                  double reserved)
+{
+	if (l == NULL || weights == NULL || reserved < 0.0 || reserved >= 1.0)
+		return -1;
+
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i)
+		if (weights[i] == 0U)
+			return -1;
+
+	pthread_mutex_lock(&(l->lock));
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i)
+		l->lanes[i].weight = weights[i];
+	l->reserved = reserved;
+	xnd_limiter_wake(l);
+	pthread_mutex_unlock(&(l->lock));
+
+	return 0;
+}
+
+int
+xnd_limiter_acquire(xnd_limiter_t *l, unsigned int lane,
+                    unsigned long long deadline)
+{
+	xnd_limiter_lane_t *q;
+	struct timespec ts;
+	unsigned long long now, until, waited = 0ULL, us;
+	unsigned int bucket = 0U;
+	double start;
+	int res = 0, slept = 0;
+
+	if (lane >= XND_LIMITER_LANES)
+		return -1;
+	q = &(l->lanes[lane]);
+
+	now = xnd_http_request_now();
+	until = now + (unsigned long long) l->wait_ms * 1000000ULL;
+	if (deadline != 0ULL && deadline < until)
+		until = deadline;
+
+	ts.tv_sec = (time_t) (until / 1000000000ULL);
+	ts.tv_nsec = (long) (until % 1000000000ULL);
+
+	pthread_mutex_lock(&(l->lock));
+
+	/** Queued in its lane until it fits and no other lane is due first */
+	++(q->waiting);
+	while (xnd_limiter_turn(l) != (int) lane && res == 0) {
+		slept = 1;
+		if (until <= now ||
+		    pthread_cond_timedwait(&(q->cond), &(l->lock),
+		                           &ts) == ETIMEDOUT)
+			res = -1;
+	}
+	--(q->waiting);
+
+	if (res == 0) {
+		/** Start-time fair queueing, an idle lane banks no credit. */
+		start = q->finish > l->vclock ? q->finish : l->vclock;
+		q->finish = start + 1.0 / (double) q->weight;
+		l->vclock = start;
+
+		++(l->inflight);
+		++(q->inflight);
+
+		if (slept)
+			waited = xnd_http_request_now() - now;
+		for (us = waited / 1000ULL; us > 0ULL &&
+		     bucket + 1U < XND_LIMITER_BUCKETS; us >>= 1)
+			++bucket;
+
+		++(q->admitted);
+		++(q->waits[bucket]);
+		q->waited += waited;
+		if (waited > q->longest)
+			q->longest = waited;
+	}
+
+	/** Another slot may be free, or the turn passed to another lane */
+	xnd_limiter_wake(l);
+
+	pthread_mutex_unlock(&(l->lock));
+
+	if (res == -1) {
+		atomic_fetch_add_explicit(&(l->rejected), 1UL,
+		                          memory_order_relaxed);
+		atomic_fetch_add_explicit(&(q->rejected), 1UL,
+		                          memory_order_relaxed);
+	}
+
+	return res;
+}
+
+void
+xnd_limiter_release(xnd_limiter_t *l, unsigned int lane,
+                    unsigned long long latency, int dropped)
+{
+	int congested;
+
+	pthread_mutex_lock(&(l->lock));
+
+	if (lane < XND_LIMITER_LANES)
+		--(l->lanes[lane].inflight);
+
+	if (latency == 0ULL && !dropped) {
+		--(l->inflight);
+		xnd_limiter_wake(l);
+		pthread_mutex_unlock(&(l->lock));
+		return;
+	}
+
+	if (!dropped && l->baseline == 0.0)
+		l->baseline = (double) latency;
+	congested = dropped || (double) latency > l->baseline * l->tolerance;
+
+	/** Slowly, so that a lasting shift of latency is eventually the new
+	    baseline, while a creeping one is still noticed. */
+	if (!dropped)
+		l->baseline += XND_LIMITER_BASELINE_WEIGHT *
+		               ((double) latency - l->baseline);
+
+	if (congested) {
+		/** Congested, back off. */
+		l->limit *= XND_LIMITER_BACKOFF;
+		if (l->limit < l->min)
+			l->limit = l->min;
+	} else {
+		/** Only calls made near the limit probe for more. */
+		if ((double) l->inflight * 2.0 >= l->limit) {
+			l->limit += 1.0 / l->limit;
+			if (l->limit > l->max)
+				l->limit = l->max;
+		}
+	}
+
+	--(l->inflight);
+	xnd_limiter_wake(l);
+
+	pthread_mutex_unlock(&(l->lock));
+}
+
+unsigned int
+xnd_limiter_limit(xnd_limiter_t *l)
+{
+	unsigned int limit;
+
+	pthread_mutex_lock(&(l->lock));
+	limit = (unsigned int) l->limit;
+	pthread_mutex_unlock(&(l->lock));
+
+	return limit;
+}
+
+unsigned long long
+xnd_limiter_wait_p99(const xnd_limiter_t *l, unsigned int lane)
+{
+	const xnd_limiter_lane_t *q = &(l->lanes[lane]);
+	unsigned long need, seen = 0UL;
+
+	if (q->admitted == 0UL)
+		return 0ULL;
+
+	need = q->admitted - q->admitted / 100UL;
+	for (unsigned int i = 0U; i < XND_LIMITER_BUCKETS; ++i) {
+		seen += q->waits[i];
+		if (seen >= need)
+			return (1ULL << i) * 1000ULL;
+	}
+
+	return q->longest;
+}
+
+void
+xnd_limiter_forked(xnd_limiter_t *l)
+{
+	if (l == NULL)
+		return;
+
+	/** Waiters of the parent are gone, the conditions are merely
+	    rebuilt. */
+	xnd_limiter_conds(l);
+	l->inflight = 0U;
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i) {
+		l->lanes[i].inflight = 0U;
+		l->lanes[i].waiting = 0U;
+	}
+	pthread_mutex_unlock(&(l->lock));
+}
+
+static void
+xnd_limiter_conds(xnd_limiter_t *l)
+{
+	pthread_condattr_t attr;
+
+	/** Waits are measured on the monotonic clock, like deadlines. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i)
+		pthread_cond_init(&(l->lanes[i].cond), &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+static int
+xnd_limiter_fits(const xnd_limiter_t *l, unsigned int lane)
+{
+	const xnd_limiter_lane_t *q = &(l->lanes[lane]);
+
+	if ((double) l->inflight + 1.0 > l->limit)
+		return 0;
+
+	/** The reserved share is left to the first lane. */
+	return lane == 0U || q->inflight == 0U ||
+	       (double) q->inflight + 1.0 <= l->limit * (1.0 - l->reserved);
+}
+
+static int
+xnd_limiter_turn(const xnd_limiter_t *l)
+{
+	double tag, best = 0.0;
+	int turn = -1;
+
+	/** The lane of the earliest virtual start, ties to the first */
+	for (unsigned int i = 0U; i < XND_LIMITER_LANES; ++i) {
+		const xnd_limiter_lane_t *q = &(l->lanes[i]);
+
+		if (q->waiting == 0U || !xnd_limiter_fits(l, i))
+			continue;
+
+		tag = q->finish > l->vclock ? q->finish : l->vclock;
+		if (turn == -1 || tag < best) {
+			turn = (int) i;
+			best = tag;
+		}
+	}
+
+	return turn;
+}
+
+static void
+xnd_limiter_wake(xnd_limiter_t *l)
+{
+	int turn = xnd_limiter_turn(l);
+
+	if (turn != -1)
+		pthread_cond_signal(&(l->lanes[turn].cond));
+}
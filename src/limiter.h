@@ -0,0 +1,162 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_LIMITER_H
+#define XND_LIMITER_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/** Weight of a new sample in the baseline latency. */
+#define XND_LIMITER_BASELINE_WEIGHT (0.05)
+
+/** Multiplicative decrease of the limit on congestion. */
+#define XND_LIMITER_BACKOFF (0.9)
+
+/** Number of priority lanes, lane 0 being the interactive one. */
+#define XND_LIMITER_LANES (2U)
+
+/** Buckets of the wait histograms, the last holding waits of 2^30 us on. */
+#define XND_LIMITER_BUCKETS (32U)
+
+/**
+ * \brief Priority lane of a limiter, whose calls wait in a queue of their own.
+ */
+typedef struct xnd_limiter_lane_t {
+	pthread_cond_t     cond;     /** Signalled on the turn of the lane. */
+	unsigned int       weight;   /** Share of slots while lanes contend. */
+	unsigned int       inflight; /** Calls in flight. */
+	unsigned int       waiting;  /** Calls waiting for a slot. */
+	double             finish;   /** Virtual finish of its last slot. */
+	unsigned long      admitted; /** Calls given a slot. */
+	unsigned long long waited;   /** Total wait of admitted calls in ns. */
+	unsigned long long longest;  /** Longest wait in ns. */
+	unsigned long      waits[XND_LIMITER_BUCKETS]; /** Waits histogram,
+	                                                  log2 of us. */
+	atomic_ulong       rejected; /** Calls rejected. */
+} xnd_limiter_lane_t;
+
+/**
+ * \brief Adaptive concurrency limiter, AIMD on observed latency. The limit
+ * grows by one per limit-worth of successful calls which kept the latency
+ * within a tolerance of its baseline, and shrinks by 10% on a slower or
+ * dropped call. Calls over the limit wait up to a bound, then are rejected.
+ * Waiting calls queue in priority lanes, served by weighted fair queueing,
+ * and a share of the limit is kept from every lane but the first.
+ */
+typedef struct xnd_limiter_t {
+	pthread_mutex_t lock;      /** Guards the state below. */
+	double          limit;     /** Current limit. */
+	double          min;       /** Lower bound of the limit. */
+	double          max;       /** Upper bound of the limit. */
+	double          tolerance; /** Congested latency over baseline. */
+	double          baseline;  /** Smoothed latency in ns, 0 if unknown. */
+	unsigned int    inflight;  /** Calls in flight. */
+	long            wait_ms;   /** Maximum wait for a slot. */
+	double          reserved;  /** Share of the limit kept for lane 0. */
+	double          vclock;    /** Virtual time of the last slot given. */
+	atomic_ulong    rejected;  /** Calls rejected. */
+	xnd_limiter_lane_t lanes[XND_LIMITER_LANES]; /** Priority lanes. */
+} xnd_limiter_t;
+
+/**
+ * \brief Creates new concurrency limiter.
+ * \param initial The initial limit.
+ * \param min The lower bound of the limit, at least 1.
+ * \param max The upper bound of the limit.
+ * \param tolerance The ratio of latency to its baseline beyond which calls
+ * are congested, more than 1.
+ * \param wait_ms The maximum wait for a slot in milliseconds, 0 rejects calls
+ * over the limit right away.
+ * \return NULL on failure.
+ */
+extern xnd_limiter_t *
+xnd_limiter_new(unsigned int initial, unsigned int min, unsigned int max,
+                double tolerance, long wait_ms);
+
+/**
+ * \brief Destroys concurrency limiter.
+ * \param l The concurrency limiter to destroy.
+ */
+extern void
+xnd_limiter_destroy(xnd_limiter_t *l);
+
+/**
+ * \brief Sets the priority lanes of the limiter. Lanes start weighted 4:1,
+ * with nothing reserved.
+ * \param l The concurrency limiter.
+ * \param weights The weight of every lane, the share of slots given to its
+ * waiting calls while other lanes wait too.
+ * \param reserved The share of the limit, from 0 to 1 excluded, which calls
+ * of lanes other than the first never take, though each may always have a
+ * call in flight.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_limiter_lanes(xnd_limiter_t *l, const unsigned int *weights,
+                  double reserved);
+
+/**
+ * \brief Acquires a slot for a call, waiting up to the bound of the limiter
+ * or the deadline of the call, whichever comes first.
+ * \param l The concurrency limiter.
+ * \param lane The priority lane of the call.
+ * \param deadline The deadline of the call on the monotonic clock in ns, 0
+ * for none.
+ * \return 0 on success, -1 if the call is rejected.
+ */
+extern int
+xnd_limiter_acquire(xnd_limiter_t *l, unsigned int lane,
+                    unsigned long long deadline);
+
+/**
+ * \brief Releases the slot of a finished call and adapts the limit.
+ * \param l The concurrency limiter.
+ * \param lane The priority lane of the call.
+ * \param latency The latency of the call in ns, 0 if the call was aborted
+ * and tells nothing about congestion.
+ * \param dropped Whether the call timed out or was turned down by an
+ * overloaded server.
+ */
+extern void
+xnd_limiter_release(xnd_limiter_t *l, unsigned int lane,
+                    unsigned long long latency, int dropped);
+
+/**
+ * \brief Retrieves the current limit, rounded down.
+ * \param l The concurrency limiter.
+ */
+extern unsigned int
+xnd_limiter_limit(xnd_limiter_t *l);
+
+/**
+ * \brief Retrieves the 99th percentile of the waits of a lane, as the upper
+ * bound of its histogram bucket, with the lock of the limiter held.
+ * \param l The concurrency limiter.
+ * \param lane The priority lane.
+ * \return The wait in ns, 0 if no call was admitted.
+ */
+extern unsigned long long
+xnd_limiter_wait_p99(const xnd_limiter_t *l, unsigned int lane);
+
+/**
+ * \brief Resets the limiter in a child process after `fork()`, held by the
+ * forking thread. Calls in flight in the parent are dropped, their threads
+ * do not exist in the child.
+ * \param l The concurrency limiter.
+ */
+extern void
+xnd_limiter_forked(xnd_limiter_t *l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
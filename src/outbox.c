@@ -0,0 +1,976 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alloc.h"
+#include "http_request.h"
+#include "outbox.h"
+#include "xendit_private.h"
+
+/** The magic number of complete records, "XOB1". */
+#define XND_OUTBOX_MAGIC (0x31424f58U)
+
+/** Fields of a request record: method, path, key and body. */
+#define XND_OUTBOX_FIELDS (4)
+
+/** Smallest segment size accepted. */
+#define XND_OUTBOX_SEGMENT_MIN (4096UL)
+
+/** Kind of a record. */
+typedef enum xnd_outbox_kind_t {
+	XND_OUTBOX_REQUEST = 1, /** Request, with its fields. */
+	XND_OUTBOX_DONE    = 2  /** Completion marker of a request. */
+} xnd_outbox_kind_t;
+
+/** Header of a record, followed by its NUL-terminated fields. */
+typedef struct xnd_outbox_record_t {
+	uint32_t magic;    /** The magic number, once the record is complete. */
+	uint32_t check;    /** Hash of the record past this member. */
+	uint32_t size;     /** Size of the record, a multiple of 8. */
+	uint32_t kind;     /** Kind of the record. */
+	uint64_t seq;      /** Sequence number of the request. */
+	uint32_t status;   /** HTTP status of a completion marker. */
+	uint32_t sizes[XND_OUTBOX_FIELDS]; /** Sizes of the fields. */
+	uint32_t reserved; /** Zero. */
+} xnd_outbox_record_t;
+
+/** Replays the segments of the directory. */
+static int
+xnd_outbox_load(xnd_outbox_t *o);
+
+/** Maps a segment, created if `create` is non-zero. */
+static xnd_outbox_segment_t *
+xnd_outbox_map(xnd_outbox_t *o, unsigned int id, int create);
+
+/** Reads the complete records of a segment, up to the first torn one. */
+static void
+xnd_outbox_scan(xnd_outbox_t *o, xnd_outbox_segment_t *seg);
+
+/** Appends a record to the last segment, rolling over to a new one. */
+static xnd_outbox_record_t *
+xnd_outbox_append(xnd_outbox_t *o, xnd_outbox_kind_t kind,
+                  unsigned long long seq, long status,
+                  const char *const *fields, const uint32_t *sizes);
+
+/** Adds the request of a record to the entries. */
+static void
+xnd_outbox_add(xnd_outbox_t *o, const xnd_outbox_record_t *rec,
+               unsigned int segment);
+
+/** Makes room for one more entry in the entries and the index. */
+static int
+xnd_outbox_reserve(xnd_outbox_t *o);
+
+/** Fills the index with the live entries. */
+static void
+xnd_outbox_reindex(xnd_outbox_t *o);
+
+/** Finds an entry by idempotency key, -1 if none. */
+static long
+xnd_outbox_lookup(const xnd_outbox_t *o, const char *key, uint32_t hash);
+
+/** Finds an entry by sequence number, -1 if none. */
+static long
+xnd_outbox_find(const xnd_outbox_t *o, unsigned long long seq);
+
+/** Finds a live segment by number. */
+static xnd_outbox_segment_t *
+xnd_outbox_segment(xnd_outbox_t *o, unsigned int id);
+
+/** Marks a request done, in memory and in the log. */
+static void
+xnd_outbox_complete(xnd_outbox_t *o, const xnd_outbox_entry_t *e,
+                    long status);
+
+/** Deletes the oldest segments once all of their requests are done. */
+static void
+xnd_outbox_retire(xnd_outbox_t *o);
+
+/** Sends the queued requests. */
+static void *
+xnd_outbox_work(void *arg);
+
+/** Sends a request once. */
+static int
+xnd_outbox_send(xnd_outbox_t *o, const xnd_outbox_entry_t *e, long *status,
+                xnd_string_t **res);
+
+/** Waits for the turn of the caller at the send rate, -1 if closed. */
+static int
+xnd_outbox_pace(xnd_outbox_t *o);
+
+/** Waits a while, unless closed, -1 if closed. */
+static int
+xnd_outbox_sleep(xnd_outbox_t *o, unsigned long long until);
+
+/** Builds the path of a segment. */
+static void
+xnd_outbox_path(const xnd_outbox_t *o, unsigned int id, char *path);
+
+/** Hashes bytes, FNV-1a. */
+static uint32_t
+xnd_outbox_hash(const void *data, size_t size);
+
+/** Orders segment numbers. */
+static int
+xnd_outbox_order(const void *a, const void *b);
+
+xnd_outbox_t *
+xnd_outbox_open(const xnd_client_t *x, const char *dir,
+                const xnd_outbox_options_t *options)
+{
+	pthread_condattr_t attr;
+	char path[PATH_MAX];
+	xnd_outbox_t *o;
+
+	if (x == NULL || dir == NULL || !dir[0] || options == NULL ||
+	    options->senders == 0U || options->high_water == 0U ||
+	    options->rate < 0.0 || options->wait_ms < 0L ||
+	    (options->segment_size != 0UL &&
+	     options->segment_size < XND_OUTBOX_SEGMENT_MIN) ||
+	    strlen(dir) + 16UL > sizeof(path))
+		return NULL;
+
+	o = xnd_calloc(1UL, sizeof(xnd_outbox_t));
+	if (o == NULL)
+		return NULL;
+
+	o->client = x;
+	o->lockfd = -1;
+	o->forks = xnd_sdk_forks();
+	o->segment_size = options->segment_size != 0UL ?
+	                  options->segment_size : XND_OUTBOX_SEGMENT_SIZE;
+	o->sync = options->sync;
+	o->high_water = options->high_water;
+	o->wait_ms = options->wait_ms;
+	if (options->rate > 0.0)
+		o->interval = (unsigned long long) (1e9 / options->rate);
+	o->on_done = options->on_done;
+	o->data = options->data;
+	o->next_seq = 1ULL;
+	atomic_init(&(o->queued), 0UL);
+	atomic_init(&(o->duplicates), 0UL);
+	atomic_init(&(o->busy), 0UL);
+	atomic_init(&(o->sent), 0UL);
+	atomic_init(&(o->retries), 0UL);
+
+	/** Waits are measured on the monotonic clock. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(o->room), &attr);
+	pthread_cond_init(&(o->wake), &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&(o->ready), NULL);
+	pthread_mutex_init(&(o->lock), NULL);
+
+	o->dir = xnd_strdup(dir);
+	o->senders = xnd_calloc(options->senders, sizeof(pthread_t));
+	if (o->dir == NULL || o->senders == NULL)
+		goto fail;
+
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+		goto fail;
+
+	/** A second queue on the same log would send its requests twice. */
+	snprintf(path, sizeof(path), "%s/lock", dir);
+	o->lockfd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (o->lockfd == -1 || flock(o->lockfd, LOCK_EX | LOCK_NB) == -1)
+		goto fail;
+
+	if (xnd_outbox_load(o) == -1)
+		goto fail;
+
+	for (; o->nsenders < options->senders; ++(o->nsenders))
+		if (pthread_create(&(o->senders[o->nsenders]), NULL,
+		                   xnd_outbox_work, o) != 0)
+			goto fail;
+
+	return o;
+
+fail:
+	xnd_outbox_close(o);
+
+	return NULL;
+}
+
+void
+xnd_outbox_close(xnd_outbox_t *o)
+{
+	int forked;
+
+	if (o == NULL)
+		return;
+
+	/** In a forked child, the senders and their lock, maybe held at fork(),
+	    are the parent's, and so are the log and its flock: the shared
+	    segments are only unmapped, nothing is appended or deleted. */
+	forked = o->forks != xnd_sdk_forks();
+	if (!forked) {
+		pthread_mutex_lock(&(o->lock));
+		o->stopping = 1;
+		pthread_cond_broadcast(&(o->ready));
+		pthread_cond_broadcast(&(o->room));
+		pthread_cond_broadcast(&(o->wake));
+		pthread_mutex_unlock(&(o->lock));
+
+		for (unsigned int i = 0U; i < o->nsenders; ++i)
+			pthread_join(o->senders[i], NULL);
+	}
+
+	for (size_t i = 0UL; i < o->nsegments; ++i) {
+		munmap(o->segments[i].map, o->segments[i].size);
+		close(o->segments[i].fd);
+	}
+
+	if (o->lockfd != -1)
+		close(o->lockfd);
+
+	if (!forked) {
+		pthread_cond_destroy(&(o->ready));
+		pthread_cond_destroy(&(o->room));
+		pthread_cond_destroy(&(o->wake));
+		pthread_mutex_destroy(&(o->lock));
+	}
+
+	xnd_free(o->segments);
+	xnd_free(o->entries);
+	xnd_free(o->index);
+	xnd_free(o->senders);
+	xnd_free(o->dir);
+	xnd_free(o);
+}
+
+xnd_outbox_status_t
+xnd_outbox_enqueue(xnd_outbox_t *o, const char *method, const char *path,
+                   const char *key, const char *body)
+{
+	const char *fields[XND_OUTBOX_FIELDS] = { method, path, key, body };
+	uint32_t sizes[XND_OUTBOX_FIELDS];
+	unsigned long long deadline = 0ULL;
+	xnd_outbox_segment_t *seg;
+	xnd_outbox_record_t *rec;
+	struct timespec ts;
+	uint32_t hash;
+
+	if (o == NULL || method == NULL || !method[0] || path == NULL ||
+	    path[0] != '/' || key == NULL || !key[0] ||
+	    strlen(key) > XND_OUTBOX_KEY_MAX)
+		return XND_OUTBOX_FAILED;
+
+	for (int i = 0; i < XND_OUTBOX_FIELDS; ++i)
+		sizes[i] = fields[i] ? (uint32_t) strlen(fields[i]) : 0U;
+	hash = xnd_outbox_hash(key, sizes[2]);
+
+	pthread_mutex_lock(&(o->lock));
+
+	for (;;) {
+		if (o->stopping) {
+			pthread_mutex_unlock(&(o->lock));
+			return XND_OUTBOX_FAILED;
+		}
+
+		if (xnd_outbox_lookup(o, key, hash) != -1L) {
+			pthread_mutex_unlock(&(o->lock));
+			atomic_fetch_add(&(o->duplicates), 1UL);
+			return XND_OUTBOX_DUPLICATE;
+		}
+
+		if (o->pending < o->high_water)
+			break;
+
+		/** Backpressure, past the high-water mark only. */
+		if (deadline == 0ULL)
+			deadline = xnd_http_request_now() +
+			           (unsigned long long) o->wait_ms * 1000000ULL;
+		if (xnd_http_request_now() >= deadline) {
+			pthread_mutex_unlock(&(o->lock));
+			atomic_fetch_add(&(o->busy), 1UL);
+			return XND_OUTBOX_BUSY;
+		}
+
+		ts.tv_sec = (time_t) (deadline / 1000000000ULL);
+		ts.tv_nsec = (long) (deadline % 1000000000ULL);
+		pthread_cond_timedwait(&(o->room), &(o->lock), &ts);
+	}
+
+	if (xnd_outbox_reserve(o) == -1) {
+		pthread_mutex_unlock(&(o->lock));
+		return XND_OUTBOX_FAILED;
+	}
+
+	rec = xnd_outbox_append(o, XND_OUTBOX_REQUEST, o->next_seq, 0L, fields,
+	                        sizes);
+	if (rec == NULL) {
+		pthread_mutex_unlock(&(o->lock));
+		return XND_OUTBOX_FAILED;
+	}
+
+	seg = &(o->segments[o->nsegments - 1UL]);
+	xnd_outbox_add(o, rec, seg->id);
+	++(o->next_seq);
+	++(o->pending);
+	++(seg->pending);
+
+	pthread_cond_signal(&(o->ready));
+	pthread_mutex_unlock(&(o->lock));
+
+	atomic_fetch_add(&(o->queued), 1UL);
+
+	return XND_OUTBOX_QUEUED;
+}
+
+int
+xnd_outbox_flush(xnd_outbox_t *o, long timeout_ms)
+{
+	unsigned long long deadline;
+	struct timespec ts;
+	int res = 0;
+
+	if (o == NULL || timeout_ms < 0L)
+		return -1;
+
+	deadline = xnd_http_request_now() +
+	           (unsigned long long) timeout_ms * 1000000ULL;
+	ts.tv_sec = (time_t) (deadline / 1000000000ULL);
+	ts.tv_nsec = (long) (deadline % 1000000000ULL);
+
+	pthread_mutex_lock(&(o->lock));
+
+	while (o->pending > 0UL && !o->stopping) {
+		if (timeout_ms == 0L) {
+			pthread_cond_wait(&(o->room), &(o->lock));
+			continue;
+		}
+		if (xnd_http_request_now() >= deadline)
+			break;
+		pthread_cond_timedwait(&(o->room), &(o->lock), &ts);
+	}
+
+	if (o->pending > 0UL)
+		res = -1;
+
+	pthread_mutex_unlock(&(o->lock));
+
+	return res;
+}
+
+int
+xnd_outbox_stats(xnd_outbox_t *o, xnd_outbox_stats_t *stats)
+{
+	if (o == NULL || stats == NULL)
+		return -1;
+
+	stats->queued     = atomic_load(&(o->queued));
+	stats->duplicates = atomic_load(&(o->duplicates));
+	stats->busy       = atomic_load(&(o->busy));
+	stats->sent       = atomic_load(&(o->sent));
+	stats->retries    = atomic_load(&(o->retries));
+
+	pthread_mutex_lock(&(o->lock));
+	stats->replayed = o->replayed;
+	stats->pending  = o->pending;
+	stats->segments = o->nsegments;
+	pthread_mutex_unlock(&(o->lock));
+
+	return 0;
+}
+
+static int
+xnd_outbox_load(xnd_outbox_t *o)
+{
+	unsigned int *ids = NULL, *tmp;
+	size_t nids = 0UL, max = 0UL;
+	xnd_outbox_segment_t *seg;
+	char path[PATH_MAX];
+	struct dirent *ent;
+	struct stat st;
+	unsigned long id;
+	char *end;
+	DIR *d;
+
+	d = opendir(o->dir);
+	if (d == NULL)
+		return -1;
+
+	while ((ent = readdir(d)) != NULL) {
+		if (strlen(ent->d_name) != 12UL)
+			continue;
+		id = strtoul(ent->d_name, &end, 16);
+		if (end != ent->d_name + 8 || strcmp(end, ".log") != 0)
+			continue;
+
+		if (nids == max) {
+			max = max ? max * 2UL : 16UL;
+			tmp = xnd_realloc(ids, max * sizeof(unsigned int));
+			if (tmp == NULL) {
+				closedir(d);
+				xnd_free(ids);
+				return -1;
+			}
+			ids = tmp;
+		}
+		ids[nids++] = (unsigned int) id;
+	}
+
+	closedir(d);
+
+	if (nids > 0UL)
+		qsort(ids, nids, sizeof(unsigned int), xnd_outbox_order);
+
+	for (size_t i = 0UL; i < nids; ++i) {
+		/** A crash between creating the last segment and sizing it
+		    leaves it empty, a torn append of no record at all. */
+		if (i + 1UL == nids) {
+			xnd_outbox_path(o, ids[i], path);
+			if (stat(path, &st) == 0 &&
+			    (size_t) st.st_size < sizeof(xnd_outbox_record_t)) {
+				unlink(path);
+				break;
+			}
+		}
+
+		seg = xnd_outbox_map(o, ids[i], 0);
+		if (seg == NULL) {
+			xnd_free(ids);
+			return -1;
+		}
+		xnd_outbox_scan(o, seg);
+	}
+
+	xnd_free(ids);
+
+	/** Whatever follows the last complete record is a torn append, wiped
+	    before it is appended over. */
+	if (o->nsegments > 0UL) {
+		seg = &(o->segments[o->nsegments - 1UL]);
+		memset(seg->map + seg->tail, 0, seg->size - seg->tail);
+	}
+
+	for (size_t i = 0UL; i < o->nentries; ++i) {
+		if (o->entries[i].done)
+			continue;
+		++(o->pending);
+		++(xnd_outbox_segment(o, o->entries[i].segment)->pending);
+	}
+	o->replayed = o->pending;
+
+	xnd_outbox_retire(o);
+
+	/** Sized for the entries found, with room to grow. */
+	return xnd_outbox_reserve(o);
+}
+
+static xnd_outbox_segment_t *
+xnd_outbox_map(xnd_outbox_t *o, unsigned int id, int create)
+{
+	xnd_outbox_segment_t *seg, *tmp;
+	char path[PATH_MAX];
+	struct stat st;
+	size_t max;
+
+	if (o->nsegments == o->segments_max) {
+		max = o->segments_max ? o->segments_max * 2UL : 8UL;
+		tmp = xnd_realloc(o->segments,
+		                  max * sizeof(xnd_outbox_segment_t));
+		if (tmp == NULL)
+			return NULL;
+		o->segments = tmp;
+		o->segments_max = max;
+	}
+
+	seg = &(o->segments[o->nsegments]);
+	seg->id = id;
+	seg->tail = 0UL;
+	seg->pending = 0UL;
+
+	xnd_outbox_path(o, id, path);
+	seg->fd = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL :
+	                                           0), 0600);
+	if (seg->fd == -1)
+		return NULL;
+
+	if (create) {
+		seg->size = o->segment_size;
+		if (ftruncate(seg->fd, (off_t) seg->size) == -1)
+			goto fail;
+	} else {
+		if (fstat(seg->fd, &st) == -1 ||
+		    (size_t) st.st_size < sizeof(xnd_outbox_record_t))
+			goto fail;
+		seg->size = (size_t) st.st_size;
+	}
+
+	seg->map = mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                seg->fd, 0);
+	if (seg->map == MAP_FAILED)
+		goto fail;
+
+	++(o->nsegments);
+
+	return seg;
+
+fail:
+	close(seg->fd);
+	if (create)
+		unlink(path);
+
+	return NULL;
+}
+
+static void
+xnd_outbox_scan(xnd_outbox_t *o, xnd_outbox_segment_t *seg)
+{
+	const xnd_outbox_record_t *rec;
+	const char *data;
+	size_t need;
+	long i;
+
+	while (seg->tail + sizeof(xnd_outbox_record_t) <= seg->size) {
+		rec = (const xnd_outbox_record_t *) (seg->map + seg->tail);
+		if (rec->magic != XND_OUTBOX_MAGIC ||
+		    rec->size < sizeof(xnd_outbox_record_t) ||
+		    rec->size % 8U != 0U || rec->size > seg->size - seg->tail ||
+		    rec->check != xnd_outbox_hash(&(rec->size), rec->size -
+		                                  2UL * sizeof(uint32_t)))
+			break;
+
+		if (rec->kind == XND_OUTBOX_REQUEST) {
+			/** Fields are checked to fit, NUL-terminated. */
+			need = sizeof(xnd_outbox_record_t);
+			data = (const char *) (rec + 1);
+			for (int f = 0; f < XND_OUTBOX_FIELDS; ++f) {
+				need += rec->sizes[f] + 1UL;
+				if (need > rec->size || data[need -
+				    sizeof(xnd_outbox_record_t) - 1UL] != '\0')
+					return;
+			}
+			if (o->nentries > 0UL &&
+			    rec->seq <= o->entries[o->nentries - 1UL].seq)
+				return;
+			if (xnd_outbox_reserve(o) == -1)
+				return;
+			xnd_outbox_add(o, rec, seg->id);
+			o->next_seq = rec->seq + 1ULL;
+		} else if (rec->kind == XND_OUTBOX_DONE) {
+			i = xnd_outbox_find(o, rec->seq);
+			if (i != -1L)
+				o->entries[i].done = 1;
+		}
+
+		seg->tail += rec->size;
+	}
+}
+
+static xnd_outbox_record_t *
+xnd_outbox_append(xnd_outbox_t *o, xnd_outbox_kind_t kind,
+                  unsigned long long seq, long status,
+                  const char *const *fields, const uint32_t *sizes)
+{
+	size_t size = sizeof(xnd_outbox_record_t), page, start;
+	xnd_outbox_segment_t *seg = NULL;
+	xnd_outbox_record_t *rec;
+	char *data;
+
+	if (kind == XND_OUTBOX_REQUEST)
+		for (int i = 0; i < XND_OUTBOX_FIELDS; ++i)
+			size += sizes[i] + 1UL;
+	size = (size + 7UL) & ~7UL;
+	if (size > o->segment_size)
+		return NULL;
+
+	if (o->nsegments > 0UL)
+		seg = &(o->segments[o->nsegments - 1UL]);
+	if (seg == NULL || seg->tail + size > seg->size) {
+		seg = xnd_outbox_map(o, seg != NULL ? seg->id + 1U : 0U, 1);
+		if (seg == NULL)
+			return NULL;
+	}
+
+	rec = (xnd_outbox_record_t *) (seg->map + seg->tail);
+	memset(rec, 0, size);
+	rec->size = (uint32_t) size;
+	rec->kind = (uint32_t) kind;
+	rec->seq = seq;
+	rec->status = (uint32_t) status;
+
+	data = (char *) (rec + 1);
+	if (kind == XND_OUTBOX_REQUEST) {
+		for (int i = 0; i < XND_OUTBOX_FIELDS; ++i) {
+			rec->sizes[i] = sizes[i];
+			if (sizes[i] > 0U)
+				memcpy(data, fields[i], sizes[i]);
+			data += sizes[i] + 1UL;
+		}
+	}
+
+	rec->check = xnd_outbox_hash(&(rec->size),
+	                             size - 2UL * sizeof(uint32_t));
+
+	/** The magic number goes last, a crash before it leaves a torn record
+	    which replays ignore. */
+	atomic_signal_fence(memory_order_release);
+	rec->magic = XND_OUTBOX_MAGIC;
+
+	if (o->sync) {
+		page = (size_t) sysconf(_SC_PAGESIZE);
+		start = seg->tail & ~(page - 1UL);
+		msync(seg->map + start, seg->tail + size - start, MS_SYNC);
+	}
+
+	seg->tail += size;
+
+	return rec;
+}
+
+static void
+xnd_outbox_add(xnd_outbox_t *o, const xnd_outbox_record_t *rec,
+               unsigned int segment)
+{
+	xnd_outbox_entry_t *e = &(o->entries[o->nentries]);
+	const char *data = (const char *) (rec + 1);
+	size_t slot;
+
+	e->seq = rec->seq;
+	e->segment = segment;
+	e->method = data;
+	data += rec->sizes[0] + 1UL;
+	e->path = data;
+	data += rec->sizes[1] + 1UL;
+	e->key = data;
+	data += rec->sizes[2] + 1UL;
+	e->body = rec->sizes[3] > 0U ? data : NULL;
+	e->hash = xnd_outbox_hash(e->key, rec->sizes[2]);
+	e->done = 0;
+
+	slot = e->hash & (o->index_max - 1UL);
+	while (o->index[slot] != 0UL)
+		slot = (slot + 1UL) & (o->index_max - 1UL);
+	o->index[slot] = ++(o->nentries);
+}
+
+static int
+xnd_outbox_reserve(xnd_outbox_t *o)
+{
+	xnd_outbox_entry_t *entries;
+	size_t max, *index;
+
+	if (o->nentries == o->entries_max) {
+		max = o->entries_max ? o->entries_max * 2UL : 64UL;
+		entries = xnd_realloc(o->entries,
+		                      max * sizeof(xnd_outbox_entry_t));
+		if (entries == NULL)
+			return -1;
+		o->entries = entries;
+		o->entries_max = max;
+	}
+
+	/** At most half full, so that probes stay short. */
+	if ((o->nentries + 1UL) * 2UL > o->index_max) {
+		max = o->index_max ? o->index_max * 2UL : 128UL;
+		index = xnd_calloc(max, sizeof(size_t));
+		if (index == NULL)
+			return -1;
+		xnd_free(o->index);
+		o->index = index;
+		o->index_max = max;
+		xnd_outbox_reindex(o);
+	}
+
+	return 0;
+}
+
+static void
+xnd_outbox_reindex(xnd_outbox_t *o)
+{
+	size_t slot;
+
+	memset(o->index, 0, o->index_max * sizeof(size_t));
+
+	for (size_t i = 0UL; i < o->nentries; ++i) {
+		slot = o->entries[i].hash & (o->index_max - 1UL);
+		while (o->index[slot] != 0UL)
+			slot = (slot + 1UL) & (o->index_max - 1UL);
+		o->index[slot] = i + 1UL;
+	}
+}
+
+static long
+xnd_outbox_lookup(const xnd_outbox_t *o, const char *key, uint32_t hash)
+{
+	const xnd_outbox_entry_t *e;
+	size_t slot;
+
+	if (o->index_max == 0UL)
+		return -1L;
+
+	for (slot = hash & (o->index_max - 1UL); o->index[slot] != 0UL;
+	     slot = (slot + 1UL) & (o->index_max - 1UL)) {
+		e = &(o->entries[o->index[slot] - 1UL]);
+		if (e->hash == hash && strcmp(e->key, key) == 0)
+			return (long) (o->index[slot] - 1UL);
+	}
+
+	return -1L;
+}
+
+static long
+xnd_outbox_find(const xnd_outbox_t *o, unsigned long long seq)
+{
+	size_t lo = 0UL, hi = o->nentries, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2UL;
+		if (o->entries[mid].seq < seq)
+			lo = mid + 1UL;
+		else
+			hi = mid;
+	}
+
+	if (lo == o->nentries || o->entries[lo].seq != seq)
+		return -1L;
+
+	return (long) lo;
+}
+
+static xnd_outbox_segment_t *
+xnd_outbox_segment(xnd_outbox_t *o, unsigned int id)
+{
+	for (size_t i = 0UL; i < o->nsegments; ++i)
+		if (o->segments[i].id == id)
+			return &(o->segments[i]);
+
+	return NULL;
+}
+
+static void
+xnd_outbox_complete(xnd_outbox_t *o, const xnd_outbox_entry_t *e,
+                    long status)
+{
+	xnd_outbox_segment_t *seg;
+	long i;
+
+	i = xnd_outbox_find(o, e->seq);
+	if (i == -1L || o->entries[i].done)
+		return;
+
+	/** Should the marker not be written, the request is sent again after
+	    a restart, and Xendit answers it by its idempotency key. */
+	xnd_outbox_append(o, XND_OUTBOX_DONE, e->seq, status, NULL, NULL);
+
+	o->entries[i].done = 1;
+	--(o->pending);
+	seg = xnd_outbox_segment(o, e->segment);
+	if (seg != NULL)
+		--(seg->pending);
+
+	xnd_outbox_retire(o);
+	pthread_cond_broadcast(&(o->room));
+}
+
+static void
+xnd_outbox_retire(xnd_outbox_t *o)
+{
+	xnd_outbox_segment_t *seg;
+	char path[PATH_MAX];
+	size_t n, retired = 0UL;
+
+	/** Oldest first, so that completion markers never outlive the
+	    requests they complete. The last segment is appended to. */
+	while (o->nsegments > 1UL && o->segments[0].pending == 0UL) {
+		seg = &(o->segments[0]);
+
+		for (n = 0UL; n < o->nentries; ++n)
+			if (o->entries[n].segment != seg->id)
+				break;
+		memmove(o->entries, o->entries + n,
+		        (o->nentries - n) * sizeof(xnd_outbox_entry_t));
+		o->nentries -= n;
+		o->cursor = o->cursor > n ? o->cursor - n : 0UL;
+
+		munmap(seg->map, seg->size);
+		close(seg->fd);
+		xnd_outbox_path(o, seg->id, path);
+		unlink(path);
+
+		memmove(o->segments, o->segments + 1,
+		        (o->nsegments - 1UL) * sizeof(xnd_outbox_segment_t));
+		--(o->nsegments);
+		++retired;
+	}
+
+	if (retired > 0UL && o->index != NULL)
+		xnd_outbox_reindex(o);
+}
+
+static void *
+xnd_outbox_work(void *arg)
+{
+	xnd_outbox_t *o = arg;
+	unsigned long long backoff, max = XND_OUTBOX_BACKOFF_MAX_MS;
+	xnd_outbox_entry_t e;
+	xnd_string_t *res;
+	long status;
+	int r;
+
+	res = xnd_string_new(NULL);
+	if (res == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&(o->lock));
+
+	while (!o->stopping) {
+		while (o->cursor < o->nentries && o->entries[o->cursor].done)
+			++(o->cursor);
+		if (o->cursor == o->nentries) {
+			pthread_cond_wait(&(o->ready), &(o->lock));
+			continue;
+		}
+
+		e = o->entries[(o->cursor)++];
+		backoff = (unsigned long long) XND_OUTBOX_BACKOFF_MS;
+
+		/** A request left unsent on close stays pending in the log. */
+		for (;;) {
+			if (xnd_outbox_pace(o) == -1)
+				goto out;
+
+			pthread_mutex_unlock(&(o->lock));
+			xnd_string_clear(&res);
+			r = xnd_outbox_send(o, &e, &status, &res);
+			pthread_mutex_lock(&(o->lock));
+
+			if (r == 0 && status < 500L && status != 429L)
+				break;
+
+			atomic_fetch_add(&(o->retries), 1UL);
+			if (xnd_outbox_sleep(o, xnd_http_request_now() +
+			                     backoff * 1000000ULL) == -1)
+				goto out;
+			backoff = backoff * 2ULL < max ? backoff * 2ULL : max;
+		}
+
+		/** Called before the marker, while the segment of the request
+		    is still mapped: at least once across crashes. */
+		if (o->on_done != NULL) {
+			pthread_mutex_unlock(&(o->lock));
+			o->on_done(e.key, status, res->data, o->data);
+			pthread_mutex_lock(&(o->lock));
+		}
+
+		xnd_outbox_complete(o, &e, status);
+		atomic_fetch_add(&(o->sent), 1UL);
+	}
+
+out:
+	pthread_mutex_unlock(&(o->lock));
+	xnd_string_destroy(&res);
+
+	return NULL;
+}
+
+static int
+xnd_outbox_send(xnd_outbox_t *o, const xnd_outbox_entry_t *e, long *status,
+                xnd_string_t **res)
+{
+	xnd_http_request_t *req;
+	int r;
+
+	*status = 0L;
+
+	req = xnd_http_request_new(e->method, XND_BASEURL);
+	if (req == NULL)
+		return -1;
+
+	if (xnd_client_request(o->client, req) == -1 ||
+	    xnd_http_request_path(req, e->path) == -1 ||
+	    xnd_http_request_header(req, "X-IDEMPOTENCY-KEY", e->key) == -1 ||
+	    (e->body != NULL && xnd_http_request_payload(req, e->body) == -1)) {
+		xnd_http_request_destroy(req);
+		return -1;
+	}
+
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+
+	r = xnd_client_send(o->client, req, "outbox", (void *) res);
+	*status = req->status;
+
+	xnd_http_request_destroy(req);
+
+	return r;
+}
+
+static int
+xnd_outbox_pace(xnd_outbox_t *o)
+{
+	unsigned long long now, at;
+
+	if (o->stopping)
+		return -1;
+	if (o->interval == 0ULL)
+		return 0;
+
+	/** Turns are handed out in order, one interval apart. */
+	now = xnd_http_request_now();
+	at = o->next_send > now ? o->next_send : now;
+	o->next_send = at + o->interval;
+
+	return xnd_outbox_sleep(o, at);
+}
+
+static int
+xnd_outbox_sleep(xnd_outbox_t *o, unsigned long long until)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) (until / 1000000000ULL);
+	ts.tv_nsec = (long) (until % 1000000000ULL);
+
+	while (!o->stopping && xnd_http_request_now() < until)
+		pthread_cond_timedwait(&(o->wake), &(o->lock), &ts);
+
+	return o->stopping ? -1 : 0;
+}
+
+static void
+xnd_outbox_path(const xnd_outbox_t *o, unsigned int id, char *path)
+{
+	snprintf(path, PATH_MAX, "%s/%08x.log", o->dir, id);
+}
+
+static uint32_t
+xnd_outbox_hash(const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0UL; i < size; ++i) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static int
+xnd_outbox_order(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a;
+	unsigned int y = *(const unsigned int *) b;
+
+	return (x > y) - (x < y);
+}
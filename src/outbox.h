@@ -0,0 +1,106 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_OUTBOX_H
+#define XND_OUTBOX_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "xendit.h"
+
+/** Default size of a segment of the log. */
+#define XND_OUTBOX_SEGMENT_SIZE (4UL << 20)
+
+/** Maximum size of an idempotency key. */
+#define XND_OUTBOX_KEY_MAX (255UL)
+
+/** First wait before a failed request is sent again, doubled up to the
+    maximum on each failure. */
+#define XND_OUTBOX_BACKOFF_MS (100L)
+
+/** Maximum wait before a failed request is sent again. */
+#define XND_OUTBOX_BACKOFF_MAX_MS (10000L)
+
+/**
+ * \brief Segment of the log, a file of requests and completion markers
+ * appended through a shared memory mapping.
+ */
+typedef struct xnd_outbox_segment_t {
+	unsigned int  id;      /** Number of the segment, in its file name. */
+	int           fd;      /** File descriptor of the segment. */
+	char         *map;     /** Memory mapping of the segment. */
+	size_t        size;    /** Size of the segment. */
+	size_t        tail;    /** Offset of the next record. */
+	size_t        pending; /** Requests of the segment not done yet. */
+} xnd_outbox_segment_t;
+
+/**
+ * \brief Request of the log, its strings pointing into its segment.
+ */
+typedef struct xnd_outbox_entry_t {
+	unsigned long long  seq;     /** Sequence number. */
+	unsigned int        segment; /** Segment holding the request. */
+	const char         *method;  /** HTTP method. */
+	const char         *path;    /** Path under the base URL. */
+	const char         *key;     /** Idempotency key. */
+	const char         *body;    /** JSON body, NULL if none. */
+	uint32_t            hash;    /** Hash of the idempotency key. */
+	int                 done;    /** Whether a response completed it. */
+} xnd_outbox_entry_t;
+
+struct xnd_outbox_t {
+	const xnd_client_t   *client;     /** Client of the requests. */
+	char                 *dir;        /** Directory of the log. */
+	int                   lockfd;     /** Lock of the directory. */
+	size_t                segment_size; /** Size of new segments. */
+	int                   sync;       /** Whether records are synced. */
+	unsigned int          high_water; /** Pending requests at most. */
+	long                  wait_ms;    /** Wait for room past it. */
+	unsigned long long    interval;   /** Time between sends in ns. */
+	unsigned long long    next_send;  /** When the next send may go. */
+	xnd_outbox_cb_t       on_done;    /** Completion callback or NULL. */
+	void                 *data;       /** User-defined data of it. */
+	xnd_outbox_segment_t *segments;   /** Live segments, oldest first. */
+	size_t                nsegments;  /** Number of live segments. */
+	size_t                segments_max; /** Capacity of the segments. */
+	xnd_outbox_entry_t   *entries;    /** Requests of the live segments,
+	                                      by sequence number. */
+	size_t                nentries;   /** Number of requests. */
+	size_t                entries_max; /** Capacity of the requests. */
+	size_t                cursor;     /** Next request to send. */
+	unsigned long long    next_seq;   /** Next sequence number. */
+	size_t               *index;      /** Requests by idempotency key,
+	                                      open addressing, 0 if empty. */
+	size_t                index_max;  /** Slots of the index. */
+	size_t                pending;    /** Requests not done yet. */
+	size_t                replayed;   /** Requests found pending on open. */
+	pthread_mutex_t       lock;       /** Guards the log. */
+	pthread_cond_t        ready;      /** Signals a request queued. */
+	pthread_cond_t        room;       /** Signals a request done. */
+	pthread_cond_t        wake;       /** Cuts waits short on close. */
+	pthread_t            *senders;    /** Threads sending the requests. */
+	unsigned int          nsenders;   /** Number of senders. */
+	int                   stopping;   /** Set once closed. */
+	unsigned int          forks;      /** Fork generation of the senders,
+	                                      see `xnd_sdk_forks()`. */
+	atomic_ulong          queued;     /** Requests queued. */
+	atomic_ulong          duplicates; /** Requests already queued. */
+	atomic_ulong          busy;       /** Requests turned down. */
+	atomic_ulong          sent;       /** Requests done. */
+	atomic_ulong          retries;    /** Failed sends tried again. */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
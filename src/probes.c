@@ -0,0 +1,30 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "probes.h"
+
+#ifdef XND_USDT
+
+/** Tracers increment these in place, they live in the ".probes" section. */
+#define XND_PROBE_SEMAPHORE(name) \
+	volatile unsigned short xendit_##name##_semaphore \
+	__attribute__((section(".probes"))) = 0
+
+XND_PROBE_SEMAPHORE(request__create);
+XND_PROBE_SEMAPHORE(send__start);
+XND_PROBE_SEMAPHORE(first__byte);
+XND_PROBE_SEMAPHORE(send__done);
+XND_PROBE_SEMAPHORE(bind__start);
+XND_PROBE_SEMAPHORE(bind__done);
+XND_PROBE_SEMAPHORE(cache__hit);
+XND_PROBE_SEMAPHORE(cache__miss);
+
+#else
+
+/** ISO C forbids empty translation units. */
+typedef int xnd_probes_unused_t;
+
+#endif
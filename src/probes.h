@@ -0,0 +1,64 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_PROBES_H
+#define XND_PROBES_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * USDT probes of the "xendit" provider, built with `-DXND_USDT=ON`. A probe
+ * is a single nop until a tracer attaches to it, and its arguments are only
+ * evaluated while its semaphore says a tracer is attached, so that unused
+ * probes cost a predicted branch:
+ *
+ *     if (XND_PROBE_ENABLED(send__start))
+ *         XND_PROBE(send__start, req, method, url, for_user_id);
+ *
+ * Probes and their arguments, strings may be NULL:
+ * - request__create(req, method, url)
+ * - send__start(req, method, url without query, for_user_id)
+ * - first__byte(req, status)
+ * - send__done(req, status, result, latency_ns)
+ * - bind__start(endpoint, for_user_id, size)
+ * - bind__done(endpoint, for_user_id, result)
+ * - cache__hit(endpoint, for_user_id)
+ * - cache__miss(endpoint, for_user_id)
+ */
+
+#ifdef XND_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define XND_PROBE_ENABLED(name) \
+	__builtin_expect(xendit_##name##_semaphore != 0, 0)
+#define XND_PROBE(name, ...) STAP_PROBEV(xendit, name, __VA_ARGS__)
+
+/** Semaphores, counting the tracers attached to each probe. */
+extern volatile unsigned short xendit_request__create_semaphore;
+extern volatile unsigned short xendit_send__start_semaphore;
+extern volatile unsigned short xendit_first__byte_semaphore;
+extern volatile unsigned short xendit_send__done_semaphore;
+extern volatile unsigned short xendit_bind__start_semaphore;
+extern volatile unsigned short xendit_bind__done_semaphore;
+extern volatile unsigned short xendit_cache__hit_semaphore;
+extern volatile unsigned short xendit_cache__miss_semaphore;
+
+#else
+
+#define XND_PROBE_ENABLED(name) 0
+#define XND_PROBE(name, ...) do { } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "registry.h"
+
+/** Objects of the calling thread in every registry, last claimed first. */
+static _Thread_local xnd_registry_entry_t *xnd_registry_held = NULL;
+
+/** Releases the objects of an exiting thread. */
+static pthread_key_t xnd_registry_key;
+static pthread_once_t xnd_registry_key_once = PTHREAD_ONCE_INIT;
+
+/** Creates the key releasing objects. */
+static void
+xnd_registry_key_new(void);
+
+/** Releases the objects of an exiting thread. */
+static void
+xnd_registry_exit(void *held);
+
+/** Whether the calling thread holds an object. */
+static int
+xnd_registry_holds(const xnd_registry_entry_t *e);
+
+xnd_registry_entry_t *
+xnd_registry_claim(xnd_registry_t *r)
+{
+	xnd_registry_entry_t *e, *head;
+
+	pthread_once(&xnd_registry_key_once, xnd_registry_key_new);
+
+	for (e = atomic_load(&(r->head)); e != NULL; e = e->link)
+		if (xnd_registry_take(e) == 0)
+			break;
+
+	if (e == NULL) {
+		e = calloc(1UL, r->size);
+		if (e == NULL)
+			return NULL;
+
+		atomic_init(&(e->owned), 1);
+		e->id = atomic_fetch_add(&(r->count), 1UL);
+
+		head = atomic_load(&(r->head));
+		do {
+			e->link = head;
+		} while (!atomic_compare_exchange_weak(&(r->head), &head, e));
+	}
+
+	e->held = xnd_registry_held;
+	xnd_registry_held = e;
+	pthread_setspecific(xnd_registry_key, e);
+
+	return e;
+}
+
+int
+xnd_registry_take(xnd_registry_entry_t *e)
+{
+	int owned = 0;
+
+	return atomic_compare_exchange_strong(&(e->owned), &owned, 1) ? 0 : -1;
+}
+
+void
+xnd_registry_release(xnd_registry_entry_t *e)
+{
+	atomic_store(&(e->owned), 0);
+}
+
+void
+xnd_registry_forked(xnd_registry_t *r)
+{
+	for (xnd_registry_entry_t *e = atomic_load(&(r->head)); e != NULL;
+	     e = e->link)
+		if (!xnd_registry_holds(e))
+			xnd_registry_release(e);
+}
+
+static void
+xnd_registry_key_new(void)
+{
+	pthread_key_create(&xnd_registry_key, xnd_registry_exit);
+}
+
+static void
+xnd_registry_exit(void *held)
+{
+	xnd_registry_entry_t *e = held, *next;
+
+	/** Once released, another thread may claim it and relink it. */
+	for (; e != NULL; e = next) {
+		next = e->held;
+		xnd_registry_release(e);
+	}
+}
+
+static int
+xnd_registry_holds(const xnd_registry_entry_t *e)
+{
+	for (xnd_registry_entry_t *h = xnd_registry_held; h != NULL;
+	     h = h->held)
+		if (h == e)
+			return 1;
+
+	return 0;
+}
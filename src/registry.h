@@ -0,0 +1,80 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_REGISTRY_H
+#define XND_REGISTRY_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * \brief Header of an object of a registry, the first member of the object.
+ */
+typedef struct xnd_registry_entry_t {
+	atomic_int                   owned; /** Whether a thread owns it. */
+	unsigned long                id;    /** Object number, from 0. */
+	struct xnd_registry_entry_t *link;  /** Next object, never unlinked. */
+	struct xnd_registry_entry_t *held;  /** Next object of its thread. */
+} xnd_registry_entry_t;
+
+/**
+ * \brief Registry of per-thread objects. A thread claims an object on first
+ * use, which only it touches then, without locks, and which is handed over
+ * to another thread once it exits. Objects are never freed, and are allocated
+ * by the C library rather than an allocator which may be gone by the time a
+ * thread exits.
+ */
+typedef struct xnd_registry_t {
+	_Atomic(xnd_registry_entry_t *) head;  /** Every object so far, pushed
+	                                           at the head only. */
+	atomic_ulong                    count; /** Objects so far. */
+	size_t                          size;  /** Size of an object. */
+} xnd_registry_t;
+
+/** Static initializer of a registry of objects of a type. */
+#define XND_REGISTRY_INIT(type) { NULL, 0UL, sizeof(type) }
+
+/**
+ * \brief Claims an object released by an exited thread, or creates one, for
+ * the calling thread.
+ * \param r The registry.
+ * \return NULL on failure.
+ */
+extern xnd_registry_entry_t *
+xnd_registry_claim(xnd_registry_t *r);
+
+/**
+ * \brief Takes an object over from the thread owning it, if none does.
+ * \param e The object.
+ * \return 0 on success, -1 if a live thread owns it.
+ */
+extern int
+xnd_registry_take(xnd_registry_entry_t *e);
+
+/**
+ * \brief Releases an object taken over, see `xnd_registry_take()`.
+ * \param e The object.
+ */
+extern void
+xnd_registry_release(xnd_registry_entry_t *e);
+
+/**
+ * \brief Releases the objects of the threads of the parent in a child
+ * process after `fork()`, but those of the calling thread.
+ * \param r The registry.
+ */
+extern void
+xnd_registry_forked(xnd_registry_t *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
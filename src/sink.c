@@ -0,0 +1,266 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "alloc.h"
+#include "sink.h"
+
+/** Creates a sink, with a buffer unless memory-mapped. */
+static xnd_sink_t *
+xnd_sink_new(xnd_sink_kind_t kind, int fd, size_t max_body);
+
+/** Passes bytes on to the file descriptor or callback of a sink. */
+static int
+xnd_sink_emit(xnd_sink_t *sink, const char *ptr, size_t size);
+
+/** Maps the window of the file holding the next byte of a sink. */
+static int
+xnd_sink_map(xnd_sink_t *sink);
+
+xnd_sink_t *
+xnd_sink_fd(int fd, size_t max_body)
+{
+	if (fd < 0)
+		return NULL;
+
+	return xnd_sink_new(XND_SINK_FD, fd, max_body);
+}
+
+xnd_sink_t *
+xnd_sink_mmap(const char *path, size_t max_body)
+{
+	xnd_sink_t *sink;
+	int fd;
+
+	if (path == NULL || !path[0])
+		return NULL;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return NULL;
+
+	sink = xnd_sink_new(XND_SINK_MMAP, fd, max_body);
+	if (sink == NULL)
+		close(fd);
+
+	return sink;
+}
+
+xnd_sink_t *
+xnd_sink_callback(xnd_sink_cb_t cb, void *data, size_t max_body)
+{
+	xnd_sink_t *sink;
+
+	if (cb == NULL)
+		return NULL;
+
+	sink = xnd_sink_new(XND_SINK_CALLBACK, -1, max_body);
+	if (sink == NULL)
+		return NULL;
+
+	sink->cb = cb;
+	sink->data = data;
+
+	return sink;
+}
+
+size_t
+xnd_sink_size(const xnd_sink_t *sink)
+{
+	if (sink == NULL)
+		return 0UL;
+
+	return sink->size;
+}
+
+void
+xnd_sink_destroy(xnd_sink_t *sink)
+{
+	if (sink == NULL)
+		return;
+
+	xnd_sink_flush(sink);
+
+	if (sink->kind == XND_SINK_MMAP)
+		close(sink->fd);
+	else
+		xnd_free(sink->buf);
+
+	xnd_free(sink);
+}
+
+int
+xnd_sink_write(xnd_sink_t *sink, const char *chunk, size_t size)
+{
+	size_t n;
+
+	if (sink == NULL || sink->failed)
+		return -1;
+
+	/** Aborted before a byte over the limit is written. */
+	if (sink->max > 0UL && size > sink->max - sink->size) {
+		sink->failed = 1;
+		return -1;
+	}
+
+	while (size > 0UL) {
+		if (sink->kind == XND_SINK_MMAP &&
+		    (sink->buf == NULL || sink->used == sink->capacity) &&
+		    xnd_sink_map(sink) == -1)
+			break;
+
+		/** Chunks as large as the buffer skip it. */
+		if (sink->kind != XND_SINK_MMAP &&
+		    (sink->used + size > sink->capacity ||
+		     size >= sink->capacity)) {
+			if (xnd_sink_flush(sink) == -1)
+				break;
+			if (size >= sink->capacity) {
+				n = sink->capacity;
+				if (xnd_sink_emit(sink, chunk, n) == -1)
+					break;
+				chunk += n;
+				size -= n;
+				sink->size += n;
+				continue;
+			}
+		}
+
+		n = sink->capacity - sink->used;
+		if (n > size)
+			n = size;
+		memcpy(sink->buf + sink->used, chunk, n);
+		sink->used += n;
+		sink->size += n;
+		chunk += n;
+		size -= n;
+	}
+
+	if (size > 0UL) {
+		sink->failed = 1;
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+xnd_sink_flush(xnd_sink_t *sink)
+{
+	if (sink == NULL)
+		return -1;
+
+	if (sink->kind != XND_SINK_MMAP) {
+		if (sink->used > 0UL &&
+		    xnd_sink_emit(sink, sink->buf, sink->used) == -1) {
+			sink->failed = 1;
+			return -1;
+		}
+		sink->used = 0UL;
+		return sink->failed ? -1 : 0;
+	}
+
+	/** The window is dropped, pages past the trimmed end would fault. */
+	if (sink->buf != NULL) {
+		munmap(sink->buf, sink->capacity);
+		sink->buf = NULL;
+	}
+	if (ftruncate(sink->fd, (off_t) sink->size) == -1)
+		sink->failed = 1;
+
+	return sink->failed ? -1 : 0;
+}
+
+static xnd_sink_t *
+xnd_sink_new(xnd_sink_kind_t kind, int fd, size_t max_body)
+{
+	xnd_sink_t *sink;
+
+	sink = xnd_malloc(sizeof(xnd_sink_t));
+	if (sink == NULL)
+		return NULL;
+
+	sink->kind     = kind;
+	sink->fd       = fd;
+	sink->cb       = NULL;
+	sink->data     = NULL;
+	sink->buf      = NULL;
+	sink->used     = 0UL;
+	sink->offset   = 0;
+	sink->size     = 0UL;
+	sink->max      = max_body;
+	sink->failed   = 0;
+
+	if (kind == XND_SINK_MMAP) {
+		sink->capacity = XND_SINK_WINDOW;
+		return sink;
+	}
+
+	sink->capacity = XND_SINK_BUFFER;
+	sink->buf = xnd_malloc(sink->capacity);
+	if (sink->buf == NULL) {
+		xnd_free(sink);
+		return NULL;
+	}
+
+	return sink;
+}
+
+static int
+xnd_sink_emit(xnd_sink_t *sink, const char *ptr, size_t size)
+{
+	ssize_t n;
+
+	if (sink->kind == XND_SINK_CALLBACK)
+		return sink->cb(ptr, size, sink->data) == 0 ? 0 : -1;
+
+	while (size > 0UL) {
+		n = write(sink->fd, ptr, size);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		ptr += n;
+		size -= (size_t) n;
+	}
+
+	return 0;
+}
+
+static int
+xnd_sink_map(xnd_sink_t *sink)
+{
+	void *map;
+	int res;
+
+	if (sink->buf != NULL)
+		munmap(sink->buf, sink->capacity);
+	sink->buf = NULL;
+
+	/** Windows are aligned on their size, a multiple of the page size. */
+	sink->offset = (off_t) (sink->size - sink->size % sink->capacity);
+	sink->used = sink->size - (size_t) sink->offset;
+
+	/** Allocated rather than truncated, a full disk fails here instead of
+	    faulting on the mapping. */
+	res = posix_fallocate(sink->fd, sink->offset, (off_t) sink->capacity);
+	if (res != 0)
+		return -1;
+
+	map = mmap(NULL, sink->capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+	           sink->fd, sink->offset);
+	if (map == MAP_FAILED)
+		return -1;
+
+	sink->buf = map;
+
+	return 0;
+}
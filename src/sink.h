@@ -0,0 +1,71 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_SINK_H
+#define XND_SINK_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "xendit.h"
+
+/** The size of the buffer of file descriptor and callback sinks. */
+#define XND_SINK_BUFFER (65536UL)
+
+/** The size of the window mapped at once by memory-mapped sinks. */
+#define XND_SINK_WINDOW (1048576UL)
+
+/**
+ * \brief Kind of sink.
+ */
+typedef enum xnd_sink_kind_t {
+	XND_SINK_FD       = 0, /** Writes to a file descriptor. */
+	XND_SINK_MMAP     = 1, /** Copies into a mapped file window. */
+	XND_SINK_CALLBACK = 2  /** Passes chunks to a callback. */
+} xnd_sink_kind_t;
+
+struct xnd_sink_t {
+	xnd_sink_kind_t  kind;     /** Kind of sink. */
+	int              fd;       /** Output file, -1 for callbacks. */
+	xnd_sink_cb_t    cb;       /** Callback of callback sinks. */
+	void            *data;     /** User-defined data of the callback. */
+	char            *buf;      /** Buffer, or mapped window. */
+	size_t           used;     /** Bytes used in the buffer or window. */
+	size_t           capacity; /** Size of the buffer or window. */
+	off_t            offset;   /** File offset of the mapped window. */
+	size_t           size;     /** Bytes of body written. */
+	size_t           max;      /** Maximum body size, 0 for unlimited. */
+	int              failed;   /** Set once a write failed. */
+};
+
+/**
+ * \brief Writes a chunk of a body into a sink, buffered.
+ * \param sink The sink.
+ * \param chunk The chunk.
+ * \param size The size of the chunk.
+ * \return 0 on success, -1 if the sink failed or the body went past the
+ * maximum size.
+ */
+extern int
+xnd_sink_write(xnd_sink_t *sink, const char *chunk, size_t size);
+
+/**
+ * \brief Flushes what a sink buffers.
+ * \param sink The sink.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_sink_flush(xnd_sink_t *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,9 +4,13 @@
  * found in the LICENSE file or at https://opensource.org/licenses/MIT.
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-#include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "alloc.h"
 #include "strings.h"
 
 /** The dynamic string's initial capacity. */
@@ -15,11 +19,49 @@
 /** The dynamic string's growth factor. */
 #define XND_STRING_GROWTH (2UL)
 
+/** Percent-encoding lookup table, each entry is a bitmask of
+    `xnd_string_encoding_t` modes in which the byte is kept as is. */
+static const unsigned char xnd_string_safe[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0x00 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0x10 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 3, 3, 2,  /** 0x20 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0, 0,  /** 0x30 */
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,  /** 0x40 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 3,  /** 0x50 */
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,  /** 0x60 */
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 3, 0,  /** 0x70 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0x80 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0x90 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0xA0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0xB0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0xC0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0xD0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0xE0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  /** 0xF0 */
+};
+
+/** Hexadecimal digits used by percent-encoding. */
+static const char xnd_string_hex[16] = "0123456789ABCDEF";
+
+/** Base64 alphabet. */
+static const char xnd_string_b64[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
 /** Resizes the capacity of a dynamic string according to the hinted new
     size. */
 static int
 xnd_string_resize(xnd_string_t **s, size_t hint_size);
 
+/** Measures the number of leading bytes which need no percent-encoding. */
+static size_t
+xnd_string_safe_prefix(const unsigned char *str, size_t size,
+                       xnd_string_encoding_t mode);
+
+/** Measures a string of at most `size` bytes, `__SIZE_MAX__` meaning
+    unbounded, which `strnlen` must not be given once calls are inlined. */
+static size_t
+xnd_string_length(const char *str, size_t size);
+
 xnd_string_t *
 xnd_string_new(const char *str)
 {
@@ -37,7 +79,7 @@ xnd_string_new(const char *str)
 		capacity = size;
 
 	/** HACK: temporary struct hack. */
-	s = malloc(sizeof(xnd_string_t) + (sizeof(char) * (capacity + 1UL)));
+	s = xnd_malloc(sizeof(xnd_string_t) + (sizeof(char) * (capacity + 1UL)));
 	if (s == NULL)
 		return NULL;
 
@@ -55,7 +97,7 @@ xnd_string_destroy(xnd_string_t **s)
 	if (s == NULL || *s == NULL)
 		return;
 
-	free(*s);
+	xnd_free(*s);
 	*s = NULL;
 }
 
@@ -136,6 +178,176 @@ xnd_string_zeroize(xnd_string_t **s)
 	return 0;
 }
 
+int
+xnd_string_reserve(xnd_string_t **s, size_t capacity)
+{
+	if (s == NULL || *s == NULL)
+		return -1;
+
+	return xnd_string_resize(s, capacity);
+}
+
+size_t
+xnd_string_encoded_size(const char *str, size_t size,
+                        xnd_string_encoding_t mode)
+{
+	const unsigned char *p = (const unsigned char *) str;
+	size_t len, i, encsz;
+
+	if (str == NULL)
+		return 0UL;
+
+	len = xnd_string_length(str, size);
+	i = xnd_string_safe_prefix(p, len, mode);
+
+	for (encsz = i; i < len; ++i)
+		encsz += (xnd_string_safe[p[i]] & mode) ? 1UL : 3UL;
+
+	return encsz;
+}
+
+int
+xnd_string_sized_encode(xnd_string_t **s, const char *str, size_t size,
+                        xnd_string_encoding_t mode)
+{
+	const unsigned char *p = (const unsigned char *) str;
+	size_t len, prefix, encsz, i;
+	char *out;
+
+	if (s == NULL || *s == NULL)
+		return -1;
+
+	if (str == NULL || !str[0])
+		return 0; /** empty string, return immediately */
+
+	encsz = xnd_string_encoded_size(str, size, mode);
+	len = xnd_string_length(str, size);
+
+	/** Nothing to escape, copied at once. */
+	prefix = encsz == len ? len : xnd_string_safe_prefix(p, len, mode);
+
+	if (xnd_string_resize(s, (*s)->size + encsz) == -1)
+		return -1;
+
+	out = (*s)->data + (*s)->size;
+	memcpy(out, str, prefix); /** already-safe fast path */
+	out += prefix;
+
+	for (i = prefix; i < len; ++i) {
+		if (xnd_string_safe[p[i]] & mode) {
+			*out++ = (char) p[i];
+		} else {
+			*out++ = '%';
+			*out++ = xnd_string_hex[p[i] >> 4];
+			*out++ = xnd_string_hex[p[i] & 0x0F];
+		}
+	}
+
+	(*s)->size += encsz;
+	(*s)->data[(*s)->size] = '\0';
+
+	return 0;
+}
+
+int
+xnd_string_base64(xnd_string_t **s, const char *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	size_t i;
+	char *out;
+
+	if (s == NULL || *s == NULL || (data == NULL && size > 0UL))
+		return -1;
+
+	if (xnd_string_resize(s, (*s)->size + ((size + 2UL) / 3UL) * 4UL) == -1)
+		return -1;
+
+	out = (*s)->data + (*s)->size;
+
+	for (i = 0UL; i + 2UL < size; i += 3UL) {
+		*out++ = xnd_string_b64[p[i] >> 2];
+		*out++ = xnd_string_b64[((p[i] & 0x03) << 4) | (p[i + 1] >> 4)];
+		*out++ = xnd_string_b64[((p[i + 1] & 0x0F) << 2) | (p[i + 2] >> 6)];
+		*out++ = xnd_string_b64[p[i + 2] & 0x3F];
+	}
+
+	if (i < size) {
+		*out++ = xnd_string_b64[p[i] >> 2];
+		if (i + 1UL < size) {
+			*out++ = xnd_string_b64[((p[i] & 0x03) << 4) |
+			                        (p[i + 1] >> 4)];
+			*out++ = xnd_string_b64[(p[i + 1] & 0x0F) << 2];
+		} else {
+			*out++ = xnd_string_b64[(p[i] & 0x03) << 4];
+			*out++ = '=';
+		}
+		*out++ = '=';
+	}
+
+	*out = '\0';
+	(*s)->size = (size_t) (out - (*s)->data);
+
+	return 0;
+}
+
+static size_t
+xnd_string_length(const char *str, size_t size)
+{
+	return size == __SIZE_MAX__ ? strlen(str) : strnlen(str, size);
+}
+
+static size_t
+xnd_string_safe_prefix(const unsigned char *str, size_t size,
+                       xnd_string_encoding_t mode)
+{
+	size_t i = 0UL;
+
+#ifdef __SSE2__
+	/** Bytes of 0x80 and above are negative under signed comparison, hence
+	    they never fall inside any of the ranges below. */
+	const __m128i digit_lo = _mm_set1_epi8('0' - 1);
+	const __m128i digit_hi = _mm_set1_epi8('9' + 1);
+	const __m128i upper_lo = _mm_set1_epi8('A' - 1);
+	const __m128i upper_hi = _mm_set1_epi8('Z' + 1);
+	const __m128i lower_lo = _mm_set1_epi8('a' - 1);
+	const __m128i lower_hi = _mm_set1_epi8('z' + 1);
+	const __m128i dash     = _mm_set1_epi8('-');
+	const __m128i dot      = _mm_set1_epi8('.');
+	const __m128i under    = _mm_set1_epi8('_');
+	const __m128i tilde    = _mm_set1_epi8('~');
+	const __m128i slash    = _mm_set1_epi8(
+		(mode & XND_STRING_ENCODE_PATH) ? '/' : '-'
+	);
+
+	for (; i + 16UL <= size; i += 16UL) {
+		__m128i v, ok;
+		unsigned int mask;
+
+		v = _mm_loadu_si128((const __m128i *) (str + i));
+		ok = _mm_and_si128(_mm_cmpgt_epi8(v, digit_lo),
+		                   _mm_cmpgt_epi8(digit_hi, v));
+		ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(v, upper_lo),
+		                                    _mm_cmpgt_epi8(upper_hi, v)));
+		ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(v, lower_lo),
+		                                    _mm_cmpgt_epi8(lower_hi, v)));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, dash));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, dot));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, under));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, tilde));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, slash));
+
+		mask = (unsigned int) _mm_movemask_epi8(ok);
+		if (mask != 0xFFFFU)
+			return i + (size_t) __builtin_ctz(~mask);
+	}
+#endif
+
+	while (i < size && (xnd_string_safe[str[i]] & mode))
+		++i;
+
+	return i;
+}
+
 static int
 xnd_string_resize(xnd_string_t **s, size_t hint_size)
 {
@@ -151,7 +363,8 @@ xnd_string_resize(xnd_string_t **s, size_t hint_size)
 		newcap = (*s)->capacity * XND_STRING_GROWTH;
 
 	/** HACK: temporary struct hack. */
-	tmp = realloc(*s, sizeof(xnd_string_t) + (sizeof(char) * (newcap + 1UL)));
+	tmp = xnd_realloc(*s, sizeof(xnd_string_t) +
+	                      (sizeof(char) * (newcap + 1UL)));
 	if (tmp == NULL)
 		return -1;
 
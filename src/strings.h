@@ -13,6 +13,14 @@ extern "C" {
 
 #include <stddef.h>
 
+/**
+ * \brief Percent-encoding modes, see RFC 3986 section 2.
+ */
+typedef enum xnd_string_encoding_t {
+	XND_STRING_ENCODE_QUERY = 1, /** Keeps only unreserved characters. */
+	XND_STRING_ENCODE_PATH  = 2  /** Keeps unreserved characters and '/'. */
+} xnd_string_encoding_t;
+
 /**
  * \brief Dynamic string.
  */
@@ -77,6 +85,52 @@ xnd_string_clear(xnd_string_t **s);
 extern int
 xnd_string_zeroize(xnd_string_t **s);
 
+/**
+ * \brief Makes sure the dynamic string can hold at least `capacity` bytes
+ * without any further reallocation.
+ * \param s The dynamic string to reserve.
+ * \param capacity The minimum capacity, not including NTB.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_string_reserve(xnd_string_t **s, size_t capacity);
+
+/**
+ * \brief Measures the size of a string once it is percent-encoded.
+ * \param str The string to be measured.
+ * \param size The maximum number of bytes to be measured.
+ * \param mode The percent-encoding mode.
+ * \return The size of the encoded string, not including NTB.
+ */
+extern size_t
+xnd_string_encoded_size(const char *str, size_t size,
+                        xnd_string_encoding_t mode);
+
+/**
+ * \brief Appends a percent-encoded string no more than provided size. The
+ * encoded size is measured first so the dynamic string is resized at most
+ * once, and leading bytes that need no encoding are copied in bulk.
+ * \param s The dynamic string to append.
+ * \param str The string to be encoded.
+ * \param size The maximum number of bytes to be encoded.
+ * \param mode The percent-encoding mode.
+ * \return 0 on successful appending, -1 otherwise.
+ */
+extern int
+xnd_string_sized_encode(xnd_string_t **s, const char *str, size_t size,
+                        xnd_string_encoding_t mode);
+
+/**
+ * \brief Appends the Base64 encoding, see RFC 4648 section 4, of the given
+ * bytes.
+ * \param s The dynamic string to append.
+ * \param data The bytes to be encoded.
+ * \param size The number of bytes to be encoded.
+ * \return 0 on successful appending, -1 otherwise.
+ */
+extern int
+xnd_string_base64(xnd_string_t **s, const char *data, size_t size);
+
 /**
  * \brief Inserts string at the specified index.
  * \param S The dynamic string to insert.
@@ -88,6 +142,16 @@ xnd_string_zeroize(xnd_string_t **s);
 #define xnd_string_insert(S, Str, I) \
         xnd_string_sized_insert(S, Str, I, __SIZE_MAX__)
 
+/**
+ * \brief Appends a percent-encoded string.
+ * \param S The dynamic string to append.
+ * \param Str The string to be encoded.
+ * \param Mode The percent-encoding mode.
+ * \return 0 on successful appending, -1 otherwise.
+ */
+#define xnd_string_encode(S, Str, Mode) \
+        xnd_string_sized_encode(S, Str, __SIZE_MAX__, Mode)
+
 #ifdef __cplusplus
 }
 #endif
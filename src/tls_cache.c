@@ -0,0 +1,336 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "alloc.h"
+#include "tls_cache.h"
+
+/** The magic number of cache files, "XNDTLSC1". */
+#define XND_TLS_CACHE_MAGIC (0x31435354444e5858ULL)
+
+/** Header of a cache file. */
+typedef struct xnd_tls_cache_header_t {
+	uint64_t magic;     /** The magic number. */
+	uint32_t slots;     /** The number of slots. */
+	uint32_t slot_size; /** The size of each slot. */
+} xnd_tls_cache_header_t;
+
+/** Slot of a cache file, holding one session. */
+typedef struct xnd_tls_cache_slot_t {
+	int64_t       valid_until;  /** Expiry as UNIX timestamp, 0 if empty. */
+	uint32_t      hash;         /** Hash of the session identity. */
+	uint32_t      data_len;     /** Size of the session data. */
+	uint16_t      key_len;      /** Size of the session key. */
+	uint16_t      shmac_len;    /** Size of the salted hash. */
+	char          key[XND_TLS_CACHE_KEY_MAX];
+	unsigned char shmac[XND_TLS_CACHE_SHMAC_MAX];
+	unsigned char data[XND_TLS_CACHE_DATA_MAX];
+} xnd_tls_cache_slot_t;
+
+/** Hashes the identity of a session, FNV-1a. */
+static uint32_t
+xnd_tls_cache_hash(const void *id, size_t size);
+
+/** Retrieves the slots of the cache file. */
+static xnd_tls_cache_slot_t *
+xnd_tls_cache_slots(xnd_tls_cache_t *c);
+
+xnd_tls_cache_t *
+xnd_tls_cache_open(const char *path, long max_age)
+{
+	xnd_tls_cache_t *c;
+	xnd_tls_cache_header_t *header;
+	struct stat st;
+
+	if (path == NULL || !path[0] || max_age < 0L)
+		return NULL;
+
+	c = xnd_malloc(sizeof(xnd_tls_cache_t));
+	if (c == NULL)
+		return NULL;
+
+	c->size = sizeof(xnd_tls_cache_header_t)
+	        + sizeof(xnd_tls_cache_slot_t) * XND_TLS_CACHE_SLOTS;
+	c->max_age = max_age;
+	c->map = MAP_FAILED;
+
+	c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (c->fd == -1) {
+		xnd_free(c);
+		return NULL;
+	}
+
+	if (flock(c->fd, LOCK_EX) == -1 || fstat(c->fd, &st) == -1)
+		goto fail;
+
+	if ((size_t) st.st_size != c->size && ftruncate(c->fd, 0) == -1)
+		goto fail;
+	if ((size_t) st.st_size != c->size &&
+	    ftruncate(c->fd, (off_t) c->size) == -1)
+		goto fail;
+
+	c->map = mmap(NULL, c->size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd,
+	              0);
+	if (c->map == MAP_FAILED)
+		goto fail;
+
+	/** A fresh or foreign file is reset, it is only an optimization. */
+	header = c->map;
+	if (header->magic != XND_TLS_CACHE_MAGIC ||
+	    header->slots != XND_TLS_CACHE_SLOTS ||
+	    header->slot_size != sizeof(xnd_tls_cache_slot_t)) {
+		memset(c->map, 0, c->size);
+		header->magic = XND_TLS_CACHE_MAGIC;
+		header->slots = XND_TLS_CACHE_SLOTS;
+		header->slot_size = sizeof(xnd_tls_cache_slot_t);
+	}
+
+	flock(c->fd, LOCK_UN);
+
+	return c;
+
+fail:
+	if (c->map != MAP_FAILED)
+		munmap(c->map, c->size);
+	close(c->fd);
+	xnd_free(c);
+
+	return NULL;
+}
+
+int
+xnd_tls_cache_reopen(xnd_tls_cache_t *c)
+{
+	char path[32];
+	int fd;
+
+	if (c == NULL)
+		return -1;
+
+	/** The same file, as a new open file of its own. */
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", c->fd);
+	fd = open(path, O_RDWR | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	if (dup2(fd, c->fd) == -1 ||
+	    fcntl(c->fd, F_SETFD, FD_CLOEXEC) == -1) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	return 0;
+}
+
+void
+xnd_tls_cache_close(xnd_tls_cache_t *c)
+{
+	if (c == NULL)
+		return;
+
+	munmap(c->map, c->size);
+	close(c->fd);
+	xnd_free(c);
+}
+
+int
+xnd_tls_cache_put(xnd_tls_cache_t *c, const char *key,
+                  const unsigned char *shmac, size_t shmac_len,
+                  const unsigned char *data, size_t data_len,
+                  int64_t valid_until)
+{
+	xnd_tls_cache_slot_t *slots, *slot = NULL;
+	size_t key_len = (key != NULL) ? strlen(key) : 0UL;
+	int64_t now = (int64_t) time(NULL);
+	uint32_t hash;
+
+	if (c == NULL || data == NULL || data_len == 0UL)
+		return -1;
+
+	if ((key_len == 0UL && shmac_len == 0UL) ||
+	    key_len >= XND_TLS_CACHE_KEY_MAX ||
+	    shmac_len > XND_TLS_CACHE_SHMAC_MAX ||
+	    data_len > XND_TLS_CACHE_DATA_MAX)
+		return -1; /** Unkeyed or too large to be stored */
+
+	if (c->max_age > 0L &&
+	    (valid_until <= 0 || valid_until > now + c->max_age))
+		valid_until = now + c->max_age;
+
+	if (valid_until <= now)
+		return -1;
+
+	hash = key_len ? xnd_tls_cache_hash(key, key_len)
+	               : xnd_tls_cache_hash(shmac, shmac_len);
+
+	if (flock(c->fd, LOCK_EX) == -1)
+		return -1;
+
+	/** Linear probing for the same identity, otherwise the first free slot,
+	    otherwise the slot closest to expiry is evicted. */
+	slots = xnd_tls_cache_slots(c);
+	for (uint32_t i = 0U; i < XND_TLS_CACHE_SLOTS; ++i) {
+		xnd_tls_cache_slot_t *s;
+
+		s = &slots[(hash + i) % XND_TLS_CACHE_SLOTS];
+		if (s->valid_until > now && s->hash == hash &&
+		    s->key_len == key_len && s->shmac_len == shmac_len &&
+		    memcmp(s->key, key_len ? key : "", key_len) == 0 &&
+		    (key_len || memcmp(s->shmac, shmac, shmac_len) == 0)) {
+			slot = s;
+			break;
+		}
+
+		if (slot == NULL)
+			slot = s;
+		else if (s->valid_until <= now && slot->valid_until > now)
+			slot = s; /** free slot */
+		else if (slot->valid_until > now &&
+		         s->valid_until < slot->valid_until)
+			slot = s; /** closer to expiry */
+	}
+
+	slot->valid_until = 0; /** Invalidated while being written */
+	slot->hash = hash;
+	slot->key_len = (uint16_t) key_len;
+	slot->shmac_len = (uint16_t) shmac_len;
+	slot->data_len = (uint32_t) data_len;
+	memcpy(slot->key, key_len ? key : "", key_len);
+	slot->key[key_len] = '\0';
+	if (shmac_len)
+		memcpy(slot->shmac, shmac, shmac_len);
+	memcpy(slot->data, data, data_len);
+	slot->valid_until = valid_until;
+
+	flock(c->fd, LOCK_UN);
+
+	return 0;
+}
+
+int
+xnd_tls_cache_foreach(xnd_tls_cache_t *c, xnd_tls_cache_cb_t cb, void *data)
+{
+	xnd_tls_cache_slot_t *slots;
+	int64_t now = (int64_t) time(NULL);
+	int n = 0;
+
+	if (c == NULL || cb == NULL)
+		return -1;
+
+	if (flock(c->fd, LOCK_SH) == -1)
+		return -1;
+
+	slots = xnd_tls_cache_slots(c);
+	for (uint32_t i = 0U; i < XND_TLS_CACHE_SLOTS; ++i) {
+		xnd_tls_cache_slot_t *s = &slots[i];
+
+		if (s->valid_until <= now)
+			continue;
+
+		if (cb(s->key_len ? s->key : NULL,
+		       s->shmac_len ? s->shmac : NULL, s->shmac_len,
+		       s->data, s->data_len, data) == 0)
+			++n;
+	}
+
+	flock(c->fd, LOCK_UN);
+
+	return n;
+}
+
+#if XND_TLS_CACHE_SUPPORTED
+/** Imports one stored session into a curl instance. */
+static int
+xnd_tls_cache_import(const char *key, const unsigned char *shmac,
+                     size_t shmac_len, const unsigned char *data,
+                     size_t data_len, void *curl)
+{
+	if (curl_easy_ssls_import(curl, key, shmac, shmac_len, data,
+	                          data_len) != CURLE_OK)
+		return -1;
+
+	return 0;
+}
+
+/** Stores one session exported from a curl instance. */
+static CURLcode
+xnd_tls_cache_export(CURL *curl, void *userptr, const char *key,
+                     const unsigned char *shmac, size_t shmac_len,
+                     const unsigned char *data, size_t data_len,
+                     curl_off_t valid_until, int ietf_tls_id,
+                     const char *alpn, size_t earlydata_max)
+{
+	(void) curl;
+	(void) ietf_tls_id;
+	(void) alpn;
+	(void) earlydata_max;
+
+	/** A session which does not fit is skipped, not an error. */
+	xnd_tls_cache_put(userptr, key, shmac, shmac_len, data, data_len,
+	                  (int64_t) valid_until);
+
+	return CURLE_OK;
+}
+#endif
+
+int
+xnd_tls_cache_load(xnd_tls_cache_t *c, CURL *curl)
+{
+	if (c == NULL || curl == NULL)
+		return -1;
+
+#if XND_TLS_CACHE_SUPPORTED
+	return xnd_tls_cache_foreach(c, xnd_tls_cache_import, curl);
+#else
+	return -1;
+#endif
+}
+
+int
+xnd_tls_cache_save(xnd_tls_cache_t *c, CURL *curl)
+{
+	if (c == NULL || curl == NULL)
+		return -1;
+
+#if XND_TLS_CACHE_SUPPORTED
+	if (curl_easy_ssls_export(curl, xnd_tls_cache_export, c) != CURLE_OK)
+		return -1;
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static uint32_t
+xnd_tls_cache_hash(const void *id, size_t size)
+{
+	const unsigned char *p = id;
+	uint32_t hash = 2166136261U;
+
+	for (size_t i = 0UL; i < size; ++i) {
+		hash ^= p[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static xnd_tls_cache_slot_t *
+xnd_tls_cache_slots(xnd_tls_cache_t *c)
+{
+	return (xnd_tls_cache_slot_t *)
+	       ((char *) c->map + sizeof(xnd_tls_cache_header_t));
+}
@@ -0,0 +1,142 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_TLS_CACHE_H
+#define XND_TLS_CACHE_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <curl/curl.h>
+
+/** Whether libcurl can export and import TLS sessions, since 8.12.0. */
+#if LIBCURL_VERSION_NUM >= 0x080c00
+#define XND_TLS_CACHE_SUPPORTED 1
+#else
+#define XND_TLS_CACHE_SUPPORTED 0
+#endif
+
+/** The number of sessions kept in a cache file. */
+#define XND_TLS_CACHE_SLOTS (64U)
+
+/** The maximum size of a session key, including NTB. */
+#define XND_TLS_CACHE_KEY_MAX (256U)
+
+/** The maximum size of a salted hash of a session key. */
+#define XND_TLS_CACHE_SHMAC_MAX (64U)
+
+/** The maximum size of serialized session data. */
+#define XND_TLS_CACHE_DATA_MAX (3072U)
+
+/**
+ * \brief Persistent TLS session cache. Sessions are stored in a fixed-size,
+ * memory-mapped file, one slot per peer, so that they survive process
+ * restarts and are shared by every process mapping the same file. Writers
+ * and readers are serialized across processes with `flock(2)`.
+ */
+typedef struct xnd_tls_cache_t {
+	int    fd;      /** File descriptor of the cache file. */
+	void  *map;     /** Memory mapping of the cache file. */
+	size_t size;    /** Size of the memory mapping. */
+	long   max_age; /** Maximum age of stored sessions in seconds. */
+} xnd_tls_cache_t;
+
+/**
+ * \brief Callback for each stored session.
+ *
+ * \details Parameters:
+ * 1. (const char *) The session key, may be NULL if only the salted hash is
+ * known.
+ * 2. (const unsigned char *) The salted hash of the session key.
+ * 3. (size_t) The size of the salted hash.
+ * 4. (const unsigned char *) The serialized session data.
+ * 5. (size_t) The size of the session data.
+ * 6. (void *) The pointer to user-defined data.
+ */
+typedef int (*xnd_tls_cache_cb_t) (const char *, const unsigned char *, size_t,
+                                   const unsigned char *, size_t, void *);
+
+/**
+ * \brief Opens a TLS session cache file, creating it if needed.
+ * \param path The path of the cache file.
+ * \param max_age The maximum age of stored sessions in seconds, 0 keeps the
+ * lifetime given by the server.
+ * \return NULL on failure.
+ */
+extern xnd_tls_cache_t *
+xnd_tls_cache_open(const char *path, long max_age);
+
+/**
+ * \brief Reopens the cache file in a child process after `fork()`, so that
+ * its `flock(2)` locks exclude the parent again rather than being shared.
+ * \param c The TLS session cache.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_tls_cache_reopen(xnd_tls_cache_t *c);
+
+/**
+ * \brief Closes a TLS session cache, the file is kept.
+ * \param c The TLS session cache to close.
+ */
+extern void
+xnd_tls_cache_close(xnd_tls_cache_t *c);
+
+/**
+ * \brief Stores a session, replacing the one of the same key if any.
+ * \param c The TLS session cache.
+ * \param key The session key, may be NULL if `shmac` is given.
+ * \param shmac The salted hash of the session key, may be NULL.
+ * \param shmac_len The size of the salted hash.
+ * \param data The serialized session data.
+ * \param data_len The size of the session data.
+ * \param valid_until The expiry of the session as a UNIX timestamp.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_tls_cache_put(xnd_tls_cache_t *c, const char *key,
+                  const unsigned char *shmac, size_t shmac_len,
+                  const unsigned char *data, size_t data_len,
+                  int64_t valid_until);
+
+/**
+ * \brief Iterates every unexpired session.
+ * \param c The TLS session cache.
+ * \param cb The callback invoked for each session.
+ * \param data The user-defined data passed to the callback.
+ * \return The number of sessions visited, -1 on failure.
+ */
+extern int
+xnd_tls_cache_foreach(xnd_tls_cache_t *c, xnd_tls_cache_cb_t cb, void *data);
+
+/**
+ * \brief Imports every unexpired session into the curl instance, or into its
+ * share if it has one.
+ * \param c The TLS session cache.
+ * \param curl The curl instance.
+ * \return The number of sessions imported, -1 on failure.
+ */
+extern int
+xnd_tls_cache_load(xnd_tls_cache_t *c, CURL *curl);
+
+/**
+ * \brief Exports every session of the curl instance, or of its share if it has
+ * one, into the cache.
+ * \param c The TLS session cache.
+ * \param curl The curl instance.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_tls_cache_save(xnd_tls_cache_t *c, CURL *curl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
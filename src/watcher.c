@@ -0,0 +1,626 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "http_request.h"
+#include "watcher.h"
+#include "xendit_private.h"
+
+/** Schedules due balances into batches, and calls back on changes. */
+static void *
+xnd_watcher_run(void *arg);
+
+/** Sends the polls of batches. */
+static void *
+xnd_watcher_work(void *arg);
+
+/** Turns the wheel up to a tick, moving due balances into the batch. */
+static void
+xnd_watcher_turn(xnd_watcher_t *w, unsigned long long tick);
+
+/** Reschedules the balances of a polled batch, collecting callbacks due. */
+static void
+xnd_watcher_settle(xnd_watcher_t *w, unsigned long long now);
+
+/** Puts a balance on the wheel slot of its due tick. */
+static void
+xnd_watcher_schedule(xnd_watcher_t *w, xnd_watch_t *watch);
+
+/** Takes a balance off its wheel slot. */
+static void
+xnd_watcher_unschedule(xnd_watcher_t *w, xnd_watch_t *watch);
+
+/** Forgets a balance without subscriptions, off the wheel. */
+static void
+xnd_watcher_forget(xnd_watcher_t *w, xnd_watch_t *watch);
+
+/** Stops and joins the threads of the watcher. */
+static void
+xnd_watcher_stop(xnd_watcher_t *w, int scheduler);
+
+/** Whether two optional parameters are the same. */
+static int
+xnd_watch_same(const char *a, const char *b);
+
+/** Copies an optional parameter, empty strings being none. */
+static int
+xnd_watch_param(char **dst, const char *src);
+
+xnd_watcher_t *
+xnd_watcher_new(const xnd_client_t *x, const xnd_watcher_options_t *options)
+{
+	pthread_condattr_t attr;
+	xnd_watcher_t *w;
+	unsigned long long tick_ms;
+
+	if (x == NULL || options == NULL || options->min_interval_ms <= 0L ||
+	    options->max_interval_ms < options->min_interval_ms ||
+	    options->fanout == 0U)
+		return NULL;
+
+	w = xnd_calloc(1UL, sizeof(xnd_watcher_t));
+	if (w == NULL)
+		return NULL;
+
+	w->workers = xnd_calloc(options->fanout, sizeof(pthread_t));
+	if (w->workers == NULL) {
+		xnd_free(w);
+		return NULL;
+	}
+
+	/** A few ticks per minimum interval keep due times precise enough. */
+	tick_ms = (unsigned long long) options->min_interval_ms / 4ULL;
+	if (tick_ms == 0ULL)
+		tick_ms = 1ULL;
+
+	w->client = x;
+	w->tick_ns = tick_ms * 1000000ULL;
+	w->min_ticks = (unsigned long long) options->min_interval_ms / tick_ms;
+	w->max_ticks = (unsigned long long) options->max_interval_ms / tick_ms;
+	w->cursor = xnd_http_request_now() / w->tick_ns;
+	w->forks = xnd_sdk_forks();
+	atomic_init(&(w->taken), 0UL);
+	atomic_init(&(w->polls), 0UL);
+	atomic_init(&(w->batches), 0UL);
+	atomic_init(&(w->notified), 0UL);
+
+	/** Ticks are measured on the monotonic clock. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(w->wake), &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&(w->work), NULL);
+	pthread_cond_init(&(w->done), NULL);
+	pthread_mutex_init(&(w->lock), NULL);
+
+	for (; w->nworkers < options->fanout; ++(w->nworkers))
+		if (pthread_create(&(w->workers[w->nworkers]), NULL,
+		                   xnd_watcher_work, w) != 0)
+			break;
+
+	if (w->nworkers < options->fanout ||
+	    pthread_create(&(w->thread), NULL, xnd_watcher_run, w) != 0) {
+		xnd_watcher_stop(w, 0);
+		pthread_cond_destroy(&(w->wake));
+		pthread_cond_destroy(&(w->work));
+		pthread_cond_destroy(&(w->done));
+		pthread_mutex_destroy(&(w->lock));
+		xnd_free(w->workers);
+		xnd_free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+void
+xnd_watcher_destroy(xnd_watcher_t *w)
+{
+	xnd_watch_t *watch, *next;
+	xnd_watch_sub_t *sub, *sub_next;
+	int forked;
+
+	if (w == NULL)
+		return;
+
+	/** In a forked child, the threads and their lock, maybe held at fork(),
+	    are the parent's: only the memory is freed. */
+	forked = w->forks != xnd_sdk_forks();
+	if (!forked)
+		xnd_watcher_stop(w, 1);
+
+	for (watch = w->watches; watch != NULL; watch = next) {
+		next = watch->next;
+		for (sub = watch->subs; sub != NULL; sub = sub_next) {
+			sub_next = sub->next;
+			xnd_free(sub);
+		}
+		xnd_free(watch->for_user_id);
+		xnd_free(watch->account_type);
+		xnd_free(watch->currency);
+		xnd_free(watch);
+	}
+
+	for (sub = w->graveyard; sub != NULL; sub = sub_next) {
+		sub_next = sub->next;
+		xnd_free(sub);
+	}
+
+	if (!forked) {
+		pthread_cond_destroy(&(w->wake));
+		pthread_cond_destroy(&(w->work));
+		pthread_cond_destroy(&(w->done));
+		pthread_mutex_destroy(&(w->lock));
+	}
+
+	xnd_free(w->notes);
+	xnd_free(w->batch);
+	xnd_free(w->workers);
+	xnd_free(w);
+}
+
+int
+xnd_watch(xnd_watcher_t *w, const char *for_user_id,
+          const char *account_type, const char *currency, xnd_watch_cb_t cb,
+          void *data)
+{
+	xnd_watch_t *watch;
+	xnd_watch_sub_t *sub;
+	void *tmp;
+	int id;
+
+	if (w == NULL || cb == NULL)
+		return -1;
+
+	sub = xnd_malloc(sizeof(xnd_watch_sub_t));
+	if (sub == NULL)
+		return -1;
+
+	pthread_mutex_lock(&(w->lock));
+
+	/** The batch and callbacks are sized here, so that the scheduler never
+	    allocates, though not while the scheduler goes through them. */
+	while (w->running > 0U ||
+	       (w->notifying && !pthread_equal(pthread_self(), w->thread)))
+		pthread_cond_wait(&(w->done), &(w->lock));
+
+	if (w->next_id == INT_MAX)
+		goto fail;
+
+	if (w->nsubs + 1UL > w->notes_max) {
+		tmp = xnd_realloc(w->notes, (w->nsubs + 1UL) * 2UL *
+		                            sizeof(xnd_watch_note_t));
+		if (tmp == NULL)
+			goto fail;
+		w->notes = tmp;
+		w->notes_max = (w->nsubs + 1UL) * 2UL;
+	}
+
+	for (watch = w->watches; watch != NULL; watch = watch->next)
+		if (xnd_watch_same(watch->for_user_id, for_user_id) &&
+		    xnd_watch_same(watch->account_type, account_type) &&
+		    xnd_watch_same(watch->currency, currency))
+			break;
+
+	if (watch == NULL) {
+		if (w->nwatches + 1UL > w->batch_max) {
+			tmp = xnd_realloc(w->batch, (w->nwatches + 1UL) * 2UL *
+			                            sizeof(xnd_watch_t *));
+			if (tmp == NULL)
+				goto fail;
+			w->batch = tmp;
+			w->batch_max = (w->nwatches + 1UL) * 2UL;
+		}
+
+		watch = xnd_calloc(1UL, sizeof(xnd_watch_t));
+		if (watch == NULL ||
+		    xnd_watch_param(&(watch->for_user_id), for_user_id) ||
+		    xnd_watch_param(&(watch->account_type), account_type) ||
+		    xnd_watch_param(&(watch->currency), currency)) {
+			if (watch != NULL) {
+				xnd_free(watch->for_user_id);
+				xnd_free(watch->account_type);
+				xnd_free(watch->currency);
+				xnd_free(watch);
+			}
+			goto fail;
+		}
+
+		watch->changed = xnd_http_request_now();
+		watch->due = w->cursor + 1ULL;
+		watch->next = w->watches;
+		w->watches = watch;
+		++(w->nwatches);
+		xnd_watcher_schedule(w, watch);
+	} else if (!watch->inflight) {
+		/** Polled on the next tick, for the first balance of the new
+		    subscription. */
+		xnd_watcher_unschedule(w, watch);
+		watch->due = w->cursor + 1ULL;
+		xnd_watcher_schedule(w, watch);
+	}
+
+	id = w->next_id++;
+	sub->id = id;
+	sub->cb = cb;
+	sub->data = data;
+	sub->fresh = 1;
+	atomic_init(&(sub->gone), 0);
+	sub->next = watch->subs;
+	watch->subs = sub;
+	++(w->nsubs);
+
+	pthread_cond_signal(&(w->wake));
+	pthread_mutex_unlock(&(w->lock));
+
+	return id;
+
+fail:
+	pthread_mutex_unlock(&(w->lock));
+	xnd_free(sub);
+
+	return -1;
+}
+
+int
+xnd_unwatch(xnd_watcher_t *w, int id)
+{
+	xnd_watch_t *watch;
+	xnd_watch_sub_t **i, *sub = NULL;
+
+	if (w == NULL || id < 0)
+		return -1;
+
+	pthread_mutex_lock(&(w->lock));
+
+	for (watch = w->watches; watch != NULL && sub == NULL;
+	     watch = watch->next) {
+		for (i = &(watch->subs); *i != NULL; i = &((*i)->next)) {
+			if ((*i)->id == id) {
+				sub = *i;
+				*i = sub->next;
+				break;
+			}
+		}
+		if (sub != NULL)
+			break;
+	}
+
+	if (sub == NULL) {
+		pthread_mutex_unlock(&(w->lock));
+		return -1;
+	}
+
+	atomic_store(&(sub->gone), 1);
+	--(w->nsubs);
+
+	/** Balances being polled or passed to callbacks are forgotten by the
+	    scheduler once they fall due. */
+	if (watch->subs == NULL && !watch->inflight && !w->notifying)
+		xnd_watcher_forget(w, watch);
+
+	if (w->notifying && pthread_equal(pthread_self(), w->thread)) {
+		/** Unsubscribed from a callback, which may come next. */
+		sub->next = w->graveyard;
+		w->graveyard = sub;
+	} else {
+		while (w->notifying)
+			pthread_cond_wait(&(w->done), &(w->lock));
+		xnd_free(sub);
+	}
+
+	pthread_mutex_unlock(&(w->lock));
+
+	return 0;
+}
+
+int
+xnd_watcher_stats(const xnd_watcher_t *w, xnd_watcher_stats_t *stats)
+{
+	if (w == NULL || stats == NULL)
+		return -1;
+
+	stats->polls = atomic_load(&(w->polls));
+	stats->batches = atomic_load(&(w->batches));
+	stats->notifications = atomic_load(&(w->notified));
+
+	return 0;
+}
+
+static void *
+xnd_watcher_run(void *arg)
+{
+	xnd_watcher_t *w = arg;
+	xnd_watch_note_t *note;
+	xnd_watch_sub_t *sub;
+	struct timespec ts;
+	unsigned long long now, tick;
+
+	pthread_mutex_lock(&(w->lock));
+
+	while (!w->stopping) {
+		now = xnd_http_request_now();
+		tick = now / w->tick_ns;
+
+		xnd_watcher_turn(w, tick);
+
+		if (w->nbatch == 0UL) {
+			now = (tick + 1ULL) * w->tick_ns;
+			ts.tv_sec = (time_t) (now / 1000000000ULL);
+			ts.tv_nsec = (long) (now % 1000000000ULL);
+			if (w->nwatches == 0UL)
+				pthread_cond_wait(&(w->wake), &(w->lock));
+			else
+				pthread_cond_timedwait(&(w->wake), &(w->lock),
+				                       &ts);
+			continue;
+		}
+
+		/** Every due poll goes out in one batch over the workers. */
+		atomic_store(&(w->taken), 0UL);
+		w->running = w->nworkers;
+		++(w->batch_id);
+		pthread_cond_broadcast(&(w->work));
+		while (w->running > 0U)
+			pthread_cond_wait(&(w->done), &(w->lock));
+		atomic_fetch_add(&(w->batches), 1UL);
+
+		xnd_watcher_settle(w, xnd_http_request_now());
+		if (w->nnotes == 0UL)
+			continue;
+
+		/** Callbacks may watch and unwatch, so the lock is let go. */
+		w->notifying = 1;
+		pthread_mutex_unlock(&(w->lock));
+
+		for (size_t i = 0UL; i < w->nnotes; ++i) {
+			note = &(w->notes[i]);
+			if (atomic_load(&(note->sub->gone)))
+				continue;
+			note->sub->cb(note->watch->for_user_id,
+			              note->watch->account_type,
+			              note->watch->currency, note->balance,
+			              note->sub->data);
+			atomic_fetch_add(&(w->notified), 1UL);
+		}
+
+		pthread_mutex_lock(&(w->lock));
+		w->notifying = 0;
+		while (w->graveyard != NULL) {
+			sub = w->graveyard;
+			w->graveyard = sub->next;
+			xnd_free(sub);
+		}
+		pthread_cond_broadcast(&(w->done));
+	}
+
+	pthread_mutex_unlock(&(w->lock));
+
+	return NULL;
+}
+
+static void *
+xnd_watcher_work(void *arg)
+{
+	xnd_watcher_t *w = arg;
+	xnd_watch_t *watch;
+	xnd_balance_t balance;
+	unsigned long seen = 0UL;
+	size_t i;
+
+	pthread_mutex_lock(&(w->lock));
+
+	for (;;) {
+		while (w->batch_id == seen && !w->stopping)
+			pthread_cond_wait(&(w->work), &(w->lock));
+		if (w->batch_id == seen)
+			break;
+		seen = w->batch_id;
+
+		pthread_mutex_unlock(&(w->lock));
+
+		while ((i = atomic_fetch_add(&(w->taken), 1UL)) < w->nbatch) {
+			watch = w->batch[i];
+			balance.balance = 0.0;
+			watch->status = xnd_balance(w->client,
+			                            watch->for_user_id,
+			                            watch->account_type,
+			                            watch->currency, &balance);
+			watch->polled = balance.balance;
+			atomic_fetch_add(&(w->polls), 1UL);
+		}
+
+		pthread_mutex_lock(&(w->lock));
+		if (--(w->running) == 0U)
+			pthread_cond_broadcast(&(w->done));
+	}
+
+	pthread_mutex_unlock(&(w->lock));
+
+	return NULL;
+}
+
+static void
+xnd_watcher_turn(xnd_watcher_t *w, unsigned long long tick)
+{
+	xnd_watch_t **i, *watch;
+	unsigned long long from;
+
+	w->nbatch = 0UL;
+
+	if (tick <= w->cursor)
+		return;
+
+	/** Every slot passed since the last turn, at most one revolution. */
+	from = w->cursor + 1ULL;
+	if (tick - w->cursor > XND_WATCHER_SLOTS)
+		from = tick - XND_WATCHER_SLOTS + 1ULL;
+	w->cursor = tick;
+
+	for (; from <= tick; ++from) {
+		i = &(w->slots[from & (XND_WATCHER_SLOTS - 1UL)]);
+		while (*i != NULL) {
+			watch = *i;
+			if (watch->due > tick) {
+				i = &(watch->wheel);
+				continue;
+			}
+
+			*i = watch->wheel;
+			watch->wheel = NULL;
+
+			if (watch->subs == NULL) {
+				xnd_watcher_forget(w, watch);
+				continue;
+			}
+
+			watch->inflight = 1;
+			w->batch[w->nbatch++] = watch;
+		}
+	}
+}
+
+static void
+xnd_watcher_settle(xnd_watcher_t *w, unsigned long long now)
+{
+	xnd_watch_t *watch;
+	xnd_watch_note_t *note;
+	unsigned long long interval;
+	int changed;
+
+	w->nnotes = 0UL;
+
+	for (size_t i = 0UL; i < w->nbatch; ++i) {
+		watch = w->batch[i];
+		watch->inflight = 0;
+
+		if (watch->subs == NULL) {
+			xnd_watcher_forget(w, watch);
+			continue;
+		}
+
+		changed = 0;
+		if (watch->status == 0) {
+			changed = !watch->known ||
+			          watch->polled != watch->balance;
+			if (changed)
+				watch->changed = now;
+			watch->known = 1;
+			watch->balance = watch->polled;
+		}
+
+		for (xnd_watch_sub_t *sub = watch->subs; sub != NULL;
+		     sub = sub->next) {
+			if (watch->status != 0 || (!changed && !sub->fresh))
+				continue;
+			sub->fresh = 0;
+			note = &(w->notes[w->nnotes++]);
+			note->sub = sub;
+			note->watch = watch;
+			note->balance = watch->balance;
+		}
+
+		/** The longer a balance has not changed, the less often it is
+		    polled. Failed polls are retried alike. */
+		interval = (now - watch->changed) / w->tick_ns /
+		           XND_WATCHER_DECAY;
+		if (interval < w->min_ticks)
+			interval = w->min_ticks;
+		if (interval > w->max_ticks)
+			interval = w->max_ticks;
+
+		watch->due = now / w->tick_ns + interval;
+		xnd_watcher_schedule(w, watch);
+	}
+
+	w->nbatch = 0UL;
+}
+
+static void
+xnd_watcher_schedule(xnd_watcher_t *w, xnd_watch_t *watch)
+{
+	xnd_watch_t **slot;
+
+	slot = &(w->slots[watch->due & (XND_WATCHER_SLOTS - 1UL)]);
+	watch->wheel = *slot;
+	*slot = watch;
+}
+
+static void
+xnd_watcher_unschedule(xnd_watcher_t *w, xnd_watch_t *watch)
+{
+	xnd_watch_t **i;
+
+	i = &(w->slots[watch->due & (XND_WATCHER_SLOTS - 1UL)]);
+	for (; *i != NULL; i = &((*i)->wheel)) {
+		if (*i == watch) {
+			*i = watch->wheel;
+			watch->wheel = NULL;
+			return;
+		}
+	}
+}
+
+static void
+xnd_watcher_forget(xnd_watcher_t *w, xnd_watch_t *watch)
+{
+	xnd_watcher_unschedule(w, watch);
+
+	for (xnd_watch_t **i = &(w->watches); *i != NULL; i = &((*i)->next)) {
+		if (*i == watch) {
+			*i = watch->next;
+			break;
+		}
+	}
+	--(w->nwatches);
+
+	xnd_free(watch->for_user_id);
+	xnd_free(watch->account_type);
+	xnd_free(watch->currency);
+	xnd_free(watch);
+}
+
+static void
+xnd_watcher_stop(xnd_watcher_t *w, int scheduler)
+{
+	pthread_mutex_lock(&(w->lock));
+	w->stopping = 1;
+	pthread_cond_broadcast(&(w->wake));
+	pthread_cond_broadcast(&(w->work));
+	pthread_mutex_unlock(&(w->lock));
+
+	if (scheduler)
+		pthread_join(w->thread, NULL);
+
+	for (unsigned int i = 0U; i < w->nworkers; ++i)
+		pthread_join(w->workers[i], NULL);
+}
+
+static int
+xnd_watch_same(const char *a, const char *b)
+{
+	if (a == NULL || b == NULL || !a[0] || !b[0])
+		return (a == NULL || !a[0]) && (b == NULL || !b[0]);
+
+	return strcmp(a, b) == 0;
+}
+
+static int
+xnd_watch_param(char **dst, const char *src)
+{
+	*dst = NULL;
+
+	if (src == NULL || !src[0])
+		return 0;
+
+	*dst = xnd_strdup(src);
+
+	return *dst == NULL ? -1 : 0;
+}
@@ -0,0 +1,107 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_WATCHER_H
+#define XND_WATCHER_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "xendit.h"
+
+/** The number of slots of the timer wheel, a power of two. */
+#define XND_WATCHER_SLOTS (512UL)
+
+/** Balances are polled again after the time since they last changed divided
+    by this, within the minimum and maximum intervals. */
+#define XND_WATCHER_DECAY (4ULL)
+
+/**
+ * \brief Subscription to a watched balance.
+ */
+typedef struct xnd_watch_sub_t {
+	int                     id;    /** Subscription ID. */
+	xnd_watch_cb_t          cb;    /** Callback. */
+	void                   *data;  /** User-defined data of the callback. */
+	int                     fresh; /** Whether no balance was passed yet. */
+	atomic_int              gone;  /** Set once unsubscribed. */
+	struct xnd_watch_sub_t *next;  /** Next subscription of the balance. */
+} xnd_watch_sub_t;
+
+/**
+ * \brief Watched balance, polled once for all of its subscriptions.
+ */
+typedef struct xnd_watch_t {
+	char               *for_user_id;  /** Sub-account ID or NULL. */
+	char               *account_type; /** Balance type or NULL. */
+	char               *currency;     /** Currency filter or NULL. */
+	double              balance;      /** Last balance polled. */
+	int                 known;        /** Whether a balance was polled. */
+	unsigned long long  changed;      /** When it last changed, in ns. */
+	unsigned long long  due;          /** Tick it is due at. */
+	int                 inflight;     /** Whether it is in the batch. */
+	int                 status;       /** Status of the last poll. */
+	double              polled;       /** Balance of the last poll. */
+	xnd_watch_sub_t    *subs;         /** Subscriptions, NULL once gone. */
+	struct xnd_watch_t *wheel;        /** Next balance of the wheel slot. */
+	struct xnd_watch_t *next;         /** Next balance of the watcher. */
+} xnd_watch_t;
+
+/**
+ * \brief Callback due on the watcher thread.
+ */
+typedef struct xnd_watch_note_t {
+	xnd_watch_sub_t *sub;     /** Subscription. */
+	xnd_watch_t     *watch;   /** Watched balance. */
+	double           balance; /** Balance passed. */
+} xnd_watch_note_t;
+
+struct xnd_watcher_t {
+	const xnd_client_t *client;    /** Client of the polls. */
+	unsigned long long  min_ticks; /** Minimum interval in ticks. */
+	unsigned long long  max_ticks; /** Maximum interval in ticks. */
+	unsigned long long  tick_ns;   /** Length of a tick. */
+	unsigned long long  cursor;    /** Last tick the wheel was turned to. */
+	xnd_watch_t        *slots[XND_WATCHER_SLOTS]; /** Timer wheel. */
+	xnd_watch_t        *watches;   /** Every watched balance. */
+	size_t              nwatches;  /** Number of watched balances. */
+	size_t              nsubs;     /** Number of subscriptions. */
+	int                 next_id;   /** Next subscription ID. */
+	pthread_mutex_t     lock;      /** Guards the watcher. */
+	pthread_cond_t      wake;      /** Wakes the scheduler up. */
+	pthread_cond_t      work;      /** Hands a batch to the workers. */
+	pthread_cond_t      done;      /** Signals a batch or callbacks done. */
+	pthread_t           thread;    /** Scheduler thread. */
+	pthread_t          *workers;   /** Threads sending the polls. */
+	unsigned int        nworkers;  /** Number of workers. */
+	unsigned int        running;   /** Workers busy with the batch. */
+	unsigned long       batch_id;  /** Number of the current batch. */
+	xnd_watch_t       **batch;     /** Balances of the batch. */
+	size_t              nbatch;    /** Number of balances of the batch. */
+	size_t              batch_max; /** Capacity of the batch. */
+	atomic_size_t       taken;     /** Balances of the batch taken. */
+	xnd_watch_note_t   *notes;     /** Callbacks due. */
+	size_t              nnotes;    /** Number of callbacks due. */
+	size_t              notes_max; /** Capacity of the callbacks. */
+	xnd_watch_sub_t    *graveyard; /** Gone while calling back. */
+	int                 notifying; /** Whether callbacks are called. */
+	int                 stopping;  /** Set once destroyed. */
+	unsigned int        forks;     /** Fork generation of the threads,
+	                                   see `xnd_sdk_forks()`. */
+	atomic_ulong        polls;     /** Balance calls sent. */
+	atomic_ulong        batches;   /** Batches sent. */
+	atomic_ulong        notified;  /** Callbacks called. */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,692 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "webhook.h"
+#include "xendit_private.h"
+
+/** Kinds of bound members. */
+enum {
+	XND_WEBHOOK_SPAN,    /** JSON string. */
+	XND_WEBHOOK_NUMBER,  /** JSON number. */
+	XND_WEBHOOK_BOOLEAN, /** JSON boolean. */
+	XND_WEBHOOK_HINT     /** Not bound, only tells the event type. */
+};
+
+/** Member of callback payloads, bound into the event. */
+typedef struct xnd_webhook_member_t {
+	const char       *name;   /** Name of the member. */
+	size_t            size;   /** Size of the name. */
+	size_t            offset; /** Offset in the event. */
+	int               kind;   /** Kind of member. */
+	xnd_event_type_t  hint;   /** Event type it tells. */
+} xnd_webhook_member_t;
+
+#define XND_WEBHOOK_MEMBER(name, member, kind, hint) \
+	{ name, sizeof(name) - 1UL, offsetof(xnd_event_t, member), kind, hint }
+
+/** Members bound, every other one is skipped. */
+static const xnd_webhook_member_t xnd_webhook_members[] = {
+	XND_WEBHOOK_MEMBER("id", id, XND_WEBHOOK_SPAN, XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("external_id", external_id, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("user_id", user_id, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("status", status, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("currency", currency, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("bank_code", bank_code, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("description", description, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("amount", amount, XND_WEBHOOK_NUMBER,
+	                   XND_EVENT_UNKNOWN),
+	XND_WEBHOOK_MEMBER("paid_amount", invoice.paid_amount,
+	                   XND_WEBHOOK_NUMBER, XND_EVENT_INVOICE),
+	XND_WEBHOOK_MEMBER("payment_method", invoice.payment_method,
+	                   XND_WEBHOOK_SPAN, XND_EVENT_INVOICE),
+	XND_WEBHOOK_MEMBER("payment_channel", invoice.payment_channel,
+	                   XND_WEBHOOK_SPAN, XND_EVENT_INVOICE),
+	XND_WEBHOOK_MEMBER("paid_at", invoice.paid_at, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_INVOICE),
+	XND_WEBHOOK_MEMBER("payer_email", invoice.payer_email,
+	                   XND_WEBHOOK_SPAN, XND_EVENT_INVOICE),
+	XND_WEBHOOK_MEMBER("merchant_name", id, XND_WEBHOOK_HINT,
+	                   XND_EVENT_INVOICE),
+	XND_WEBHOOK_MEMBER("account_holder_name",
+	                   disbursement.account_holder_name, XND_WEBHOOK_SPAN,
+	                   XND_EVENT_DISBURSEMENT),
+	XND_WEBHOOK_MEMBER("disbursement_description", description,
+	                   XND_WEBHOOK_SPAN, XND_EVENT_DISBURSEMENT),
+	XND_WEBHOOK_MEMBER("failure_code", disbursement.failure_code,
+	                   XND_WEBHOOK_SPAN, XND_EVENT_DISBURSEMENT),
+	XND_WEBHOOK_MEMBER("is_instant", disbursement.is_instant,
+	                   XND_WEBHOOK_BOOLEAN, XND_EVENT_DISBURSEMENT)
+};
+
+/** Runs the handlers of queued events. */
+static void *
+xnd_webhook_work(void *arg);
+
+/** Stops and joins the workers of the receiver. */
+static void
+xnd_webhook_stop(xnd_webhook_t *w);
+
+/** Whether a token is accepted, in constant time. */
+static int
+xnd_webhook_verify(const xnd_webhook_t *w, const char *token, size_t size);
+
+/** Binds a payload into an event, without copying. */
+static int
+xnd_webhook_bind(const char *body, size_t size, xnd_event_type_t type,
+                 xnd_event_t *event);
+
+/** Binds a member of a payload. */
+static void
+xnd_webhook_member(xnd_event_t *event, const char *name, size_t size,
+                   const char *value, size_t value_size,
+                   xnd_event_type_t *hint);
+
+/** Skips a JSON value, NULL if malformed. */
+static const char *
+xnd_webhook_value(const char *p, const char *end);
+
+/** Skips a JSON string from its opening quote, NULL if unterminated. */
+static const char *
+xnd_webhook_string(const char *p, const char *end);
+
+/** Skips whitespace. */
+static const char *
+xnd_webhook_space(const char *p, const char *end);
+
+/** Moves the spans of an event from a payload to its copy. */
+static void
+xnd_webhook_rebase(xnd_event_t *event, const char *from, char *to);
+
+/** Whether a header name is the given lowercase name. */
+static int
+xnd_webhook_header_is(const char *name, size_t size, const char *lower);
+
+xnd_webhook_t *
+xnd_webhook_new(const xnd_webhook_options_t *options)
+{
+	pthread_condattr_t attr;
+	xnd_webhook_t *w;
+
+	if (options == NULL || options->threads == 0U ||
+	    options->capacity == 0U || options->wait_ms < 0L)
+		return NULL;
+
+	w = xnd_calloc(1UL, sizeof(xnd_webhook_t));
+	if (w == NULL)
+		return NULL;
+
+	w->slots = xnd_calloc(options->capacity, sizeof(xnd_webhook_slot_t));
+	w->workers = xnd_calloc(options->threads, sizeof(pthread_t));
+	if (w->slots == NULL || w->workers == NULL) {
+		xnd_free(w->slots);
+		xnd_free(w->workers);
+		xnd_free(w);
+		return NULL;
+	}
+
+	w->capacity = options->capacity;
+	w->wait_ms = options->wait_ms;
+	w->forks = xnd_sdk_forks();
+	atomic_init(&(w->accepted), 0UL);
+	atomic_init(&(w->forbidden), 0UL);
+	atomic_init(&(w->invalid), 0UL);
+	atomic_init(&(w->busy), 0UL);
+	atomic_init(&(w->handled), 0UL);
+	atomic_init(&(w->unhandled), 0UL);
+
+	/** Waits for room are measured on the monotonic clock. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(w->room), &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&(w->ready), NULL);
+	pthread_mutex_init(&(w->lock), NULL);
+
+	for (; w->nworkers < options->threads; ++(w->nworkers))
+		if (pthread_create(&(w->workers[w->nworkers]), NULL,
+		                   xnd_webhook_work, w) != 0)
+			break;
+
+	if (w->nworkers < options->threads) {
+		xnd_webhook_destroy(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+void
+xnd_webhook_destroy(xnd_webhook_t *w)
+{
+	int forked;
+
+	if (w == NULL)
+		return;
+
+	/** In a forked child, the workers and their lock, maybe held at fork(),
+	    are the parent's: queued events are left to the parent. */
+	forked = w->forks != xnd_sdk_forks();
+	if (!forked)
+		xnd_webhook_stop(w);
+
+	for (unsigned int i = 0U; i < w->capacity; ++i)
+		xnd_free(w->slots[i].buf);
+
+	/** Tokens are secrets */
+	memset(w->tokens, 0, sizeof(w->tokens));
+
+	if (!forked) {
+		pthread_cond_destroy(&(w->ready));
+		pthread_cond_destroy(&(w->room));
+		pthread_mutex_destroy(&(w->lock));
+	}
+
+	xnd_free(w->slots);
+	xnd_free(w->workers);
+	xnd_free(w);
+}
+
+int
+xnd_webhook_token(xnd_webhook_t *w, const char *token)
+{
+	size_t size;
+
+	if (w == NULL || token == NULL || w->ntokens == XND_WEBHOOK_TOKENS)
+		return -1;
+
+	size = strlen(token);
+	if (size == 0UL || size > XND_WEBHOOK_TOKEN_MAX)
+		return -1;
+
+	memcpy(w->tokens[w->ntokens], token, size);
+	w->sizes[w->ntokens] = size;
+	++(w->ntokens);
+
+	return 0;
+}
+
+int
+xnd_webhook_handler(xnd_webhook_t *w, xnd_event_type_t type,
+                    xnd_event_cb_t cb, void *data)
+{
+	if (w == NULL || (unsigned int) type >= XND_EVENT_TYPES)
+		return -1;
+
+	w->cbs[type] = cb;
+	w->data[type] = data;
+
+	return 0;
+}
+
+xnd_webhook_status_t
+xnd_webhook_submit(xnd_webhook_t *w, xnd_event_type_t type,
+                   const char *token, const char *body, size_t size)
+{
+	xnd_webhook_slot_t *slot;
+	xnd_event_t event;
+	struct timespec ts;
+	unsigned long long until;
+	void *tmp;
+
+	if (w == NULL || (unsigned int) type >= XND_EVENT_TYPES)
+		return XND_WEBHOOK_INVALID;
+
+	if (token == NULL || !xnd_webhook_verify(w, token, strlen(token))) {
+		atomic_fetch_add_explicit(&(w->forbidden), 1UL,
+		                          memory_order_relaxed);
+		return XND_WEBHOOK_FORBIDDEN;
+	}
+
+	/** Bound where it is submitted, so that the server can answer */
+	if (body == NULL || xnd_webhook_bind(body, size, type, &event) == -1) {
+		atomic_fetch_add_explicit(&(w->invalid), 1UL,
+		                          memory_order_relaxed);
+		return XND_WEBHOOK_INVALID;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	until = (unsigned long long) ts.tv_sec * 1000000000ULL
+	      + (unsigned long long) ts.tv_nsec
+	      + (unsigned long long) w->wait_ms * 1000000ULL;
+	ts.tv_sec = (time_t) (until / 1000000000ULL);
+	ts.tv_nsec = (long) (until % 1000000000ULL);
+
+	pthread_mutex_lock(&(w->lock));
+
+	/** Backpressure, a full queue turns callbacks down to be retried */
+	while (w->count == w->capacity) {
+		if (w->wait_ms == 0L ||
+		    pthread_cond_timedwait(&(w->room), &(w->lock),
+		                           &ts) == ETIMEDOUT)
+			goto busy;
+	}
+
+	/** Slot buffers only ever grow, and are handed over to workers
+	    rather than copied again. */
+	slot = &(w->slots[(w->head + w->count) % w->capacity]);
+	if (slot->cap < size) {
+		tmp = xnd_realloc(slot->buf, size);
+		if (tmp == NULL)
+			goto busy;
+		slot->buf = tmp;
+		slot->cap = size;
+	}
+
+	memcpy(slot->buf, body, size);
+	xnd_webhook_rebase(&event, body, slot->buf);
+	slot->event = event;
+	++(w->count);
+
+	pthread_cond_signal(&(w->ready));
+	pthread_mutex_unlock(&(w->lock));
+
+	atomic_fetch_add_explicit(&(w->accepted), 1UL, memory_order_relaxed);
+
+	return XND_WEBHOOK_ACCEPTED;
+
+busy:
+	pthread_mutex_unlock(&(w->lock));
+	atomic_fetch_add_explicit(&(w->busy), 1UL, memory_order_relaxed);
+
+	return XND_WEBHOOK_BUSY;
+}
+
+xnd_webhook_status_t
+xnd_webhook_submit_http(xnd_webhook_t *w, xnd_event_type_t type,
+                        const char *request, size_t size)
+{
+	const char *p, *end, *eol, *colon, *body = NULL, *value;
+	char token[XND_WEBHOOK_TOKEN_MAX + 2UL] = "";
+	size_t length = 0UL, vsize;
+	int sized = 0;
+
+	if (w == NULL || request == NULL)
+		return XND_WEBHOOK_INVALID;
+
+	end = request + size;
+
+	/** Header lines, after the request line */
+	p = memchr(request, '\n', size);
+	while (p != NULL && ++p < end) {
+		eol = memchr(p, '\n', (size_t) (end - p));
+		if (eol == NULL)
+			break;
+		if (eol == p || (eol == p + 1 && *p == '\r')) {
+			body = eol + 1;
+			break;
+		}
+
+		colon = memchr(p, ':', (size_t) (eol - p));
+		if (colon != NULL) {
+			value = xnd_webhook_space(colon + 1, eol);
+			vsize = (size_t) (eol - value);
+			while (vsize > 0UL && (value[vsize - 1UL] == '\r' ||
+			                       value[vsize - 1UL] == ' ' ||
+			                       value[vsize - 1UL] == '\t'))
+				--vsize;
+
+			if (xnd_webhook_header_is(p, (size_t) (colon - p),
+			                          "x-callback-token")) {
+				/** Longer than any token, so refused */
+				if (vsize > XND_WEBHOOK_TOKEN_MAX)
+					vsize = XND_WEBHOOK_TOKEN_MAX + 1UL;
+				memcpy(token, value, vsize);
+				token[vsize] = '\0';
+			} else if (xnd_webhook_header_is(p,
+			                                 (size_t) (colon - p),
+			                                 "content-length")) {
+				/** Nine digits at most, a malformed length
+				    leaves the request without a body */
+				length = 0UL;
+				sized = vsize > 0UL && vsize < 10UL;
+				for (size_t i = 0UL; i < vsize && sized; ++i) {
+					sized = value[i] >= '0' &&
+					        value[i] <= '9';
+					length = length * 10UL +
+					         (size_t) (value[i] - '0');
+				}
+				if (!sized)
+					break;
+			}
+		}
+		p = eol;
+	}
+
+	if (body == NULL || (sized && length > (size_t) (end - body))) {
+		atomic_fetch_add_explicit(&(w->invalid), 1UL,
+		                          memory_order_relaxed);
+		return XND_WEBHOOK_INVALID;
+	}
+
+	return xnd_webhook_submit(w, type, token, body,
+	                          sized ? length : (size_t) (end - body));
+}
+
+int
+xnd_webhook_stats(xnd_webhook_t *w, xnd_webhook_stats_t *stats)
+{
+	if (w == NULL || stats == NULL)
+		return -1;
+
+	stats->accepted = atomic_load(&(w->accepted));
+	stats->forbidden = atomic_load(&(w->forbidden));
+	stats->invalid = atomic_load(&(w->invalid));
+	stats->busy = atomic_load(&(w->busy));
+	stats->handled = atomic_load(&(w->handled));
+	stats->unhandled = atomic_load(&(w->unhandled));
+
+	pthread_mutex_lock(&(w->lock));
+	stats->queued = w->count;
+	pthread_mutex_unlock(&(w->lock));
+
+	return 0;
+}
+
+static void *
+xnd_webhook_work(void *arg)
+{
+	xnd_webhook_t *w = arg;
+	xnd_webhook_slot_t *slot;
+	xnd_event_t event;
+	char *buf = NULL, *tmp_buf;
+	size_t cap = 0UL, tmp_cap;
+
+	for (;;) {
+		pthread_mutex_lock(&(w->lock));
+
+		while (w->count == 0U && !w->stopping)
+			pthread_cond_wait(&(w->ready), &(w->lock));
+
+		/** Queued events are handled before stopping */
+		if (w->count == 0U) {
+			pthread_mutex_unlock(&(w->lock));
+			break;
+		}
+
+		/** The payload is taken along by swapping buffers, the slot
+		    reuses the one of the last event handled. */
+		slot = &(w->slots[w->head]);
+		event = slot->event;
+		tmp_buf = slot->buf;
+		tmp_cap = slot->cap;
+		slot->buf = buf;
+		slot->cap = cap;
+		buf = tmp_buf;
+		cap = tmp_cap;
+
+		w->head = (w->head + 1U) % w->capacity;
+		--(w->count);
+
+		pthread_cond_signal(&(w->room));
+		pthread_mutex_unlock(&(w->lock));
+
+		if (w->cbs[event.type] != NULL) {
+			w->cbs[event.type](&event, w->data[event.type]);
+			atomic_fetch_add_explicit(&(w->handled), 1UL,
+			                          memory_order_relaxed);
+		} else {
+			atomic_fetch_add_explicit(&(w->unhandled), 1UL,
+			                          memory_order_relaxed);
+		}
+	}
+
+	xnd_free(buf);
+
+	return NULL;
+}
+
+static void
+xnd_webhook_stop(xnd_webhook_t *w)
+{
+	pthread_mutex_lock(&(w->lock));
+	w->stopping = 1;
+	pthread_cond_broadcast(&(w->ready));
+	pthread_mutex_unlock(&(w->lock));
+
+	for (unsigned int i = 0U; i < w->nworkers; ++i)
+		pthread_join(w->workers[i], NULL);
+	w->nworkers = 0U;
+}
+
+static int
+xnd_webhook_verify(const xnd_webhook_t *w, const char *token, size_t size)
+{
+	unsigned int ok = 0U;
+
+	/** Every byte of every accepted token is compared, so that the time
+	    taken tells nothing about how much of a guess matched. */
+	for (unsigned int t = 0U; t < w->ntokens; ++t) {
+		size_t diff = w->sizes[t] ^ size;
+
+		for (size_t i = 0UL; i < XND_WEBHOOK_TOKEN_MAX; ++i)
+			diff |= (size_t) (w->tokens[t][i] ^
+			                  (i < size ? (unsigned char) token[i] :
+			                              0U));
+
+		ok |= (unsigned int) (diff == 0UL);
+	}
+
+	return (int) ok;
+}
+
+static int
+xnd_webhook_bind(const char *body, size_t size, xnd_event_type_t type,
+                 xnd_event_t *event)
+{
+	const char *p, *end = body + size, *name, *value;
+	xnd_event_type_t hint = XND_EVENT_UNKNOWN;
+	size_t name_size;
+
+	memset(event, 0, sizeof(xnd_event_t));
+
+	p = xnd_webhook_space(body, end);
+	if (p == end || *p != '{')
+		return -1;
+	p = xnd_webhook_space(p + 1, end);
+
+	/** Top-level members, nested values are skipped */
+	while (p < end && *p != '}') {
+		if (*p != '"')
+			return -1;
+		name = p + 1;
+		p = xnd_webhook_string(p, end);
+		if (p == NULL)
+			return -1;
+		name_size = (size_t) (p - name) - 1UL;
+
+		p = xnd_webhook_space(p, end);
+		if (p == end || *p != ':')
+			return -1;
+		value = xnd_webhook_space(p + 1, end);
+		p = xnd_webhook_value(value, end);
+		if (p == NULL)
+			return -1;
+
+		xnd_webhook_member(event, name, name_size, value,
+		                   (size_t) (p - value), &hint);
+
+		p = xnd_webhook_space(p, end);
+		if (p < end && *p == ',')
+			p = xnd_webhook_space(p + 1, end);
+		else if (p == end || *p != '}')
+			return -1;
+	}
+
+	if (p == end || xnd_webhook_space(p + 1, end) != end ||
+	    event->id.data == NULL)
+		return -1;
+
+	event->type = type != XND_EVENT_UNKNOWN ? type : hint;
+	event->payload.data = body;
+	event->payload.size = size;
+
+	return 0;
+}
+
+static void
+xnd_webhook_member(xnd_event_t *event, const char *name, size_t size,
+                   const char *value, size_t value_size,
+                   xnd_event_type_t *hint)
+{
+	const xnd_webhook_member_t *m = NULL;
+	char number[64], *end;
+	void *dst;
+
+	for (size_t i = 0UL; i < sizeof(xnd_webhook_members) /
+	                         sizeof(xnd_webhook_members[0]); ++i)
+		if (xnd_webhook_members[i].size == size &&
+		    memcmp(xnd_webhook_members[i].name, name, size) == 0) {
+			m = &(xnd_webhook_members[i]);
+			break;
+		}
+	if (m == NULL)
+		return;
+
+	if (m->hint != XND_EVENT_UNKNOWN)
+		*hint = m->hint;
+
+	/** Values of another type are left unbound */
+	dst = (char *) event + m->offset;
+	switch (m->kind) {
+	case XND_WEBHOOK_SPAN:
+		if (*value != '"')
+			return;
+		((xnd_span_t *) dst)->data = value + 1;
+		((xnd_span_t *) dst)->size = value_size - 2UL;
+		return;
+	case XND_WEBHOOK_NUMBER:
+		if (value_size >= sizeof(number) ||
+		    (*value != '-' && (*value < '0' || *value > '9')))
+			return;
+		memcpy(number, value, value_size);
+		number[value_size] = '\0';
+		*(double *) dst = strtod(number, &end);
+		return;
+	case XND_WEBHOOK_BOOLEAN:
+		*(int *) dst = *value == 't';
+		return;
+	default:
+		return;
+	}
+}
+
+static const char *
+xnd_webhook_value(const char *p, const char *end)
+{
+	int depth = 0;
+
+	if (p == end)
+		return NULL;
+
+	switch (*p) {
+	case '"':
+		return xnd_webhook_string(p, end);
+	case '{':
+	case '[':
+		while (p < end) {
+			if (*p == '"') {
+				p = xnd_webhook_string(p, end);
+				if (p == NULL)
+					return NULL;
+				continue;
+			}
+			if (*p == '{' || *p == '[')
+				++depth;
+			else if ((*p == '}' || *p == ']') && --depth == 0)
+				return p + 1;
+			++p;
+		}
+		return NULL;
+	case 't':
+		return end - p >= 4 && memcmp(p, "true", 4UL) == 0 ?
+		       p + 4 : NULL;
+	case 'f':
+		return end - p >= 5 && memcmp(p, "false", 5UL) == 0 ?
+		       p + 5 : NULL;
+	case 'n':
+		return end - p >= 4 && memcmp(p, "null", 4UL) == 0 ?
+		       p + 4 : NULL;
+	default:
+		if (*p != '-' && (*p < '0' || *p > '9'))
+			return NULL;
+		while (p < end && ((*p >= '0' && *p <= '9') || *p == '-' ||
+		                   *p == '+' || *p == '.' || *p == 'e' ||
+		                   *p == 'E'))
+			++p;
+		return p;
+	}
+}
+
+static const char *
+xnd_webhook_string(const char *p, const char *end)
+{
+	for (++p; p < end; ++p) {
+		if (*p == '\\')
+			++p;
+		else if (*p == '"')
+			return p + 1;
+	}
+
+	return NULL;
+}
+
+static const char *
+xnd_webhook_space(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' ||
+	                   *p == '\r'))
+		++p;
+
+	return p;
+}
+
+static void
+xnd_webhook_rebase(xnd_event_t *event, const char *from, char *to)
+{
+	xnd_span_t *spans[] = {
+		&(event->id), &(event->external_id), &(event->user_id),
+		&(event->status), &(event->currency), &(event->bank_code),
+		&(event->description), &(event->invoice.payment_method),
+		&(event->invoice.payment_channel), &(event->invoice.paid_at),
+		&(event->invoice.payer_email),
+		&(event->disbursement.account_holder_name),
+		&(event->disbursement.failure_code), &(event->payload)
+	};
+
+	for (size_t i = 0UL; i < sizeof(spans) / sizeof(spans[0]); ++i)
+		if (spans[i]->data != NULL)
+			spans[i]->data = to + (spans[i]->data - from);
+}
+
+static int
+xnd_webhook_header_is(const char *name, size_t size, const char *lower)
+{
+	size_t i;
+
+	for (i = 0UL; i < size && lower[i]; ++i) {
+		char c = name[i];
+
+		if (c >= 'A' && c <= 'Z')
+			c = (char) (c - 'A' + 'a');
+		if (c != lower[i])
+			return 0;
+	}
+
+	return i == size && !lower[i];
+}
@@ -0,0 +1,66 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Copyright 2023 Haydar Alaidrus
+ * Use of this source code is governed by an MIT-style license that can be
+ * found in the LICENSE file or at https://opensource.org/licenses/MIT.
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef XND_WEBHOOK_H
+#define XND_WEBHOOK_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "xendit.h"
+
+/** Callback tokens accepted at once. */
+#define XND_WEBHOOK_TOKENS (4U)
+
+/** Maximum size of a callback token. */
+#define XND_WEBHOOK_TOKEN_MAX (128UL)
+
+/**
+ * \brief Slot of the queue of a webhook receiver.
+ */
+typedef struct xnd_webhook_slot_t {
+	char        *buf;   /** Copy of the payload, kept for reuse. */
+	size_t       cap;   /** Capacity of the buffer. */
+	xnd_event_t  event; /** Event bound to the buffer. */
+} xnd_webhook_slot_t;
+
+struct xnd_webhook_t {
+	unsigned char       tokens[XND_WEBHOOK_TOKENS][XND_WEBHOOK_TOKEN_MAX];
+	                                /** Accepted tokens, zero-padded. */
+	size_t              sizes[XND_WEBHOOK_TOKENS]; /** Token sizes. */
+	unsigned int        ntokens;    /** Number of accepted tokens. */
+	xnd_event_cb_t      cbs[XND_EVENT_TYPES];  /** Handlers by type. */
+	void               *data[XND_EVENT_TYPES]; /** Data of the handlers. */
+	xnd_webhook_slot_t *slots;      /** Ring of queued events. */
+	unsigned int        capacity;   /** Number of slots. */
+	unsigned int        head;       /** Slot of the oldest event. */
+	unsigned int        count;      /** Events queued. */
+	long                wait_ms;    /** Wait for room in a full queue. */
+	pthread_mutex_t     lock;       /** Guards the queue. */
+	pthread_cond_t      ready;      /** Signals an event queued. */
+	pthread_cond_t      room;       /** Signals a slot freed. */
+	pthread_t          *workers;    /** Threads running the handlers. */
+	unsigned int        nworkers;   /** Number of workers. */
+	int                 stopping;   /** Set once destroyed. */
+	unsigned int        forks;      /** Fork generation of the workers,
+	                                    see `xnd_sdk_forks()`. */
+	atomic_ulong        accepted;   /** Events queued. */
+	atomic_ulong        forbidden;  /** Callbacks with a wrong token. */
+	atomic_ulong        invalid;    /** Callbacks not parsed. */
+	atomic_ulong        busy;       /** Callbacks turned down. */
+	atomic_ulong        handled;    /** Events passed to a handler. */
+	atomic_ulong        unhandled;  /** Events without a handler. */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,41 +4,187 @@
  * found in the LICENSE file or at https://opensource.org/licenses/MIT.
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
 
+#include "alloc.h"
+#include "http_handles.h"
 #include "http_request.h"
 #include "xendit_private.h"
 
+/** Guards the global state below, and the fork handlers. */
+static pthread_mutex_t xnd_sdk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Whether the global state is set up. */
+static int xnd_sdk_ready = 0;
+
+/** Explicit initializations not cleaned up yet. */
+static unsigned int xnd_sdk_refs = 0U;
+
+/** Live contexts, rebuilt in children after fork(). */
+static xnd_context_t *xnd_sdk_contexts = NULL;
+
+/** Whether the last initialization was cleaned up while contexts lived, the
+    last of them then tears the global state down. */
+static int xnd_sdk_stopping = 0;
+
+/** Forks the process descends from, bumped in children. */
+static atomic_uint xnd_sdk_generation = 0U;
+
+/** Registers the fork handlers once per process. */
+static pthread_once_t xnd_sdk_atfork_once = PTHREAD_ONCE_INIT;
+
+/** Sets up the global state, under the SDK lock. */
+static void
+xnd_sdk_start(void);
+
+/** Tears the global state down, under the SDK lock, once neither an
+    initialization nor a context is left. */
+static void
+xnd_sdk_stop(void);
+
+/** Registers the fork handlers. */
+static void
+xnd_sdk_atfork(void);
+
+/** Quiesces the clients before fork(). */
+static void
+xnd_sdk_prepare(void);
+
+/** Resumes the clients in the parent after fork(). */
+static void
+xnd_sdk_parent(void);
+
+/** Rebuilds the clients in the child after fork(). */
+static void
+xnd_sdk_child(void);
+
+/** Builds the Authorization header value of an API key. */
+static xnd_string_t *
+xnd_client_auth(const char *key);
+
+/** Whether a URL is under `XND_BASEURL` or an endpoint of the client, the
+    only hosts its credentials are sent to. */
+static int
+xnd_client_trusts(const xnd_client_t *x, const char *url);
+
+/** Whether a URL is under a base URL, rather than on a host extending it. */
+static int
+xnd_client_under(const char *url, const char *base, size_t size);
+
+/** Fills the statistics of a lane, with the lock of the limiter held. */
+static void
+xnd_client_lane_stats(const xnd_limiter_t *l, unsigned int lane,
+                      xnd_lane_stats_t *stats);
+
 void
 xnd_sdk_init(void)
 {
-	xnd_http_request_init();
+	pthread_mutex_lock(&xnd_sdk_lock);
+	xnd_sdk_start();
+	++xnd_sdk_refs;
+	xnd_sdk_stopping = 0;
+	pthread_mutex_unlock(&xnd_sdk_lock);
+}
+
+int
+xnd_sdk_init_with_allocator(const xnd_allocator_t *allocator)
+{
+	int status = -1;
+
+	pthread_mutex_lock(&xnd_sdk_lock);
+
+	/** Memory allocated already would be freed by the wrong allocator. */
+	if (!xnd_sdk_ready && allocator != NULL &&
+	    xnd_alloc_set(allocator) == 0) {
+		xnd_sdk_start();
+		++xnd_sdk_refs;
+		status = 0;
+	}
+
+	pthread_mutex_unlock(&xnd_sdk_lock);
+
+	return status;
 }
 
 void
 xnd_sdk_cleanup(void)
 {
-	xnd_http_request_cleanup();
+	pthread_mutex_lock(&xnd_sdk_lock);
+
+	if (xnd_sdk_refs > 0U)
+		--xnd_sdk_refs;
+
+	xnd_sdk_stop();
+
+	pthread_mutex_unlock(&xnd_sdk_lock);
 }
 
 xnd_client_t *
 xnd_client_new(const char *key)
 {
+	xnd_context_t *ctx;
 	xnd_client_t *x;
 
 	if (key == NULL || !key[0])
 		return NULL;
 
-	x = malloc(sizeof(xnd_client_t));
+	ctx = xnd_context_new();
+	if (ctx == NULL)
+		return NULL;
+
+	/** The client is left holding the only reference. */
+	x = xnd_client_new_in(ctx, key);
+	if (x != NULL)
+		x->shared = 0;
+	xnd_context_destroy(ctx);
+
+	return x;
+}
+
+xnd_client_t *
+xnd_client_new_in(xnd_context_t *ctx, const char *key)
+{
+	xnd_client_t *x;
+
+	if (ctx == NULL || key == NULL || !key[0])
+		return NULL;
+
+	x = xnd_malloc(sizeof(xnd_client_t));
 	if (x == NULL)
 		return NULL;
 
 	x->key = xnd_string_new(key);
 	if (x->key == NULL) {
-		free(x);
+		xnd_free(x);
 		return NULL;
 	}
 
+	/** Built once, rather than encoded again by every request. */
+	x->auth = xnd_client_auth(key);
+	if (x->auth == NULL) {
+		xnd_string_zeroize(&(x->key));
+		xnd_string_destroy(&(x->key));
+		xnd_free(x);
+		return NULL;
+	}
+
+	atomic_fetch_add(&(ctx->refs), 1U);
+	x->context = ctx;
+	x->shared = 1;
+
+	x->transport = NULL;
+	x->cancel = NULL;
+	x->balances = NULL;
+	x->priority = XND_PRIORITY_INTERACTIVE;
+	x->endpoints = NULL;
+
+	x->timeouts.connect_ms      = 10000L;
+	x->timeouts.total_ms        = 60000L;
+	x->timeouts.low_speed_limit = 0L;
+	x->timeouts.low_speed_time  = 0L;
+	x->timeouts.retries         = 0U;
+
 	return x;
 }
 
@@ -48,6 +194,610 @@ xnd_client_destroy(xnd_client_t *x)
 	if (x == NULL)
 		return;
 
+	xnd_balance_cache_close(x->balances);
+	xnd_http_transport_destroy(x->transport);
+	xnd_endpoints_destroy(x->endpoints);
+	xnd_context_destroy(x->context);
+	xnd_string_zeroize(&(x->auth));
+	xnd_string_destroy(&(x->auth));
+	xnd_string_zeroize(&(x->key));
 	xnd_string_destroy(&(x->key));
-	free(x);
+	xnd_free(x);
+}
+
+int
+xnd_client_warmup(xnd_client_t *x, const xnd_warmup_options_t *options)
+{
+	if (x == NULL || x->shared)
+		return -1;
+
+	return xnd_context_warmup(x->context, options);
+}
+
+int
+xnd_client_probe(const xnd_client_t *x)
+{
+	if (x == NULL)
+		return -1;
+
+	return xnd_http_pool_probe(x->context->pool, XND_BASEURL);
+}
+
+int
+xnd_client_tls_cache(xnd_client_t *x, const char *path, long max_age)
+{
+	if (x == NULL || x->shared)
+		return -1;
+
+	return xnd_context_tls_cache(x->context, path, max_age);
+}
+
+int
+xnd_client_sidecar(xnd_client_t *x, const char *endpoint)
+{
+	if (x == NULL || x->shared)
+		return -1;
+
+	return xnd_context_sidecar(x->context, endpoint);
+}
+
+int
+xnd_client_endpoints(xnd_client_t *x, const char *const *urls, unsigned int n,
+                     const xnd_endpoint_options_t *options)
+{
+	xnd_endpoints_t *e = NULL;
+
+	if (x == NULL)
+		return -1;
+
+	if (n > 0U) {
+		e = xnd_endpoints_new(urls, n, options, x->context->pool);
+		if (e == NULL)
+			return -1;
+	}
+
+	xnd_endpoints_destroy(x->endpoints);
+	x->endpoints = e;
+
+	return 0;
+}
+
+int
+xnd_client_endpoint_stats(const xnd_client_t *x, unsigned int i,
+                          xnd_endpoint_stats_t *stats)
+{
+	xnd_endpoint_t *ep;
+
+	if (x == NULL || x->endpoints == NULL || i >= x->endpoints->n ||
+	    stats == NULL)
+		return -1;
+
+	ep = &(x->endpoints->endpoints[i]);
+	stats->url        = ep->url;
+	stats->healthy    = atomic_load(&(ep->healthy));
+	stats->latency_ms = (double) atomic_load(&(ep->ewma)) / 1e6;
+	stats->in_flight  = atomic_load(&(ep->inflight));
+	stats->requests   = atomic_load(&(ep->requests));
+	stats->failures   = atomic_load(&(ep->failures));
+
+	return 0;
+}
+
+int
+xnd_client_timeouts(xnd_client_t *x, const xnd_timeouts_t *timeouts)
+{
+	if (x == NULL || timeouts == NULL || timeouts->connect_ms < 0L ||
+	    timeouts->total_ms < 0L || timeouts->low_speed_limit < 0L ||
+	    timeouts->low_speed_time < 0L)
+		return -1;
+
+	x->timeouts = *timeouts;
+
+	return 0;
+}
+
+xnd_cancel_t *
+xnd_cancel_new(void)
+{
+	xnd_cancel_t *token;
+
+	token = xnd_malloc(sizeof(xnd_cancel_t));
+	if (token == NULL)
+		return NULL;
+
+	atomic_init(&(token->cancelled), 0);
+
+	return token;
+}
+
+void
+xnd_cancel_destroy(xnd_cancel_t *token)
+{
+	xnd_free(token);
+}
+
+void
+xnd_cancel(xnd_cancel_t *token)
+{
+	if (token != NULL)
+		atomic_store(&(token->cancelled), 1);
+}
+
+void
+xnd_cancel_reset(xnd_cancel_t *token)
+{
+	if (token != NULL)
+		atomic_store(&(token->cancelled), 0);
+}
+
+int
+xnd_client_cancel_token(xnd_client_t *x, xnd_cancel_t *token)
+{
+	if (x == NULL)
+		return -1;
+
+	x->cancel = token;
+
+	return 0;
+}
+
+int
+xnd_client_request(const xnd_client_t *x, xnd_http_request_t *req)
+{
+	xnd_http_limits_t limits;
+
+	if (x == NULL || req == NULL)
+		return -1;
+
+	/** The deadline starts now, and is shared by every retry. */
+	limits.deadline = 0ULL;
+	if (x->timeouts.total_ms > 0L)
+		limits.deadline = xnd_http_request_now() +
+		    (unsigned long long) x->timeouts.total_ms * 1000000ULL;
+	limits.connect_ms      = x->timeouts.connect_ms;
+	limits.low_speed_limit = x->timeouts.low_speed_limit;
+	limits.low_speed_time  = x->timeouts.low_speed_time;
+	limits.retries         = x->timeouts.retries;
+	limits.cancel = (x->cancel != NULL) ? &(x->cancel->cancelled) : NULL;
+
+	if (xnd_http_request_headers(req, x->context->headers) == -1)
+		return -1;
+
+	/** The API key never leaves for another host, e.g. of a signed URL. */
+	if (xnd_client_trusts(x, req->url->data) &&
+	    xnd_http_request_header(req, "Authorization",
+	                            x->auth->data) == -1)
+		return -1;
+
+	xnd_http_request_pool(req, x->context->pool);
+	xnd_http_request_transport(req, x->transport);
+	xnd_http_request_limits(req, &limits);
+
+	return 0;
+}
+
+int
+xnd_client_send(const xnd_client_t *x, xnd_http_request_t *req,
+                const char *endpoint, void *data)
+{
+	xnd_limiter_t *limiter = x->context->limiter;
+	xnd_breakers_t *breakers = x->context->breakers;
+	xnd_breaker_outcome_t outcome;
+	unsigned long long start, sent;
+	unsigned int tried = 0U;
+	size_t base = 0UL;
+	int probe = 0, res, i = -1, cancelled, unreachable;
+
+	if (breakers != NULL) {
+		probe = xnd_breakers_allow(breakers, endpoint);
+		if (probe == -1)
+			return -1;
+	}
+
+	if (limiter != NULL &&
+	    xnd_limiter_acquire(limiter, (unsigned int) x->priority,
+	                        req->limits.deadline) == -1) {
+		if (breakers != NULL)
+			xnd_breakers_record(breakers, endpoint, probe,
+			                    XND_BREAKER_ABORTED);
+		return -1;
+	}
+
+	/** Calls to the default base URL go to one of the client instead. */
+	if (x->endpoints != NULL &&
+	    strncmp(req->url->data, XND_BASEURL,
+	            sizeof(XND_BASEURL) - 1UL) == 0)
+		base = sizeof(XND_BASEURL) - 1UL;
+
+	start = xnd_http_request_now();
+
+	for (;;) {
+		if (base > 0UL) {
+			i = xnd_endpoints_pick(x->endpoints, tried);
+			tried |= 1U << i;
+			if (xnd_endpoints_rebase(x->endpoints, i, &(req->url),
+			                         &base) == -1) {
+				xnd_endpoints_record(x->endpoints, i, 0ULL, 0);
+				res = -1;
+				break;
+			}
+		}
+
+		sent = xnd_http_request_now();
+		res = xnd_http_request_send_with_data(req, data);
+		if (i == -1)
+			break;
+
+		cancelled = req->limits.cancel != NULL &&
+		            atomic_load(req->limits.cancel);
+		unreachable = res == -1 && !cancelled &&
+		              (req->error == CURLE_COULDNT_CONNECT ||
+		               req->error == CURLE_COULDNT_RESOLVE_HOST);
+		sent = cancelled ? 0ULL : xnd_http_request_now() - sent;
+		xnd_endpoints_record(x->endpoints, i, sent, unreachable);
+
+		/** Nothing reached the server, so even calls which are not
+		    idempotent go to another endpoint. */
+		if (!unreachable || xnd_http_request_remaining(req) == 0L ||
+		    tried == (1U << x->endpoints->n) - 1U)
+			break;
+	}
+
+	/** Server errors and overload count against the endpoint, while a
+	    cancelled call says nothing about it. */
+	if (req->limits.cancel != NULL && atomic_load(req->limits.cancel))
+		outcome = XND_BREAKER_ABORTED;
+	else if (res == -1 || req->status >= 500L || req->status == 429L)
+		outcome = XND_BREAKER_FAILURE;
+	else
+		outcome = XND_BREAKER_SUCCESS;
+
+	if (limiter != NULL)
+		xnd_limiter_release(limiter, (unsigned int) x->priority,
+		                    outcome == XND_BREAKER_ABORTED ? 0ULL :
+		                    xnd_http_request_now() - start,
+		                    outcome == XND_BREAKER_FAILURE);
+
+	if (breakers != NULL)
+		xnd_breakers_record(breakers, endpoint, probe, outcome);
+
+	return res;
+}
+
+int
+xnd_client_concurrency(xnd_client_t *x,
+                       const xnd_concurrency_options_t *options)
+{
+	if (x == NULL || x->shared)
+		return -1;
+
+	return xnd_context_concurrency(x->context, options);
+}
+
+int
+xnd_client_priority(xnd_client_t *x, xnd_priority_t priority)
+{
+	if (x == NULL || (unsigned int) priority >= XND_LIMITER_LANES)
+		return -1;
+
+	x->priority = priority;
+
+	return 0;
+}
+
+int
+xnd_client_breaker(xnd_client_t *x, const xnd_breaker_options_t *options)
+{
+	if (x == NULL || x->shared)
+		return -1;
+
+	return xnd_context_breaker(x->context, options);
+}
+
+xnd_circuit_state_t
+xnd_client_circuit(const xnd_client_t *x, const char *endpoint)
+{
+	if (x == NULL || x->context->breakers == NULL || endpoint == NULL)
+		return XND_CIRCUIT_CLOSED;
+
+	return xnd_breakers_state(x->context->breakers, endpoint);
+}
+
+int
+xnd_client_balance_cache(xnd_client_t *x, const char *path, long ttl_ms)
+{
+	xnd_balance_cache_t *balances = NULL;
+
+	if (x == NULL)
+		return -1;
+
+	if (path != NULL) {
+		balances = xnd_balance_cache_open(path, ttl_ms, x->key->data);
+		if (balances == NULL)
+			return -1;
+	}
+
+	xnd_balance_cache_close(x->balances);
+	x->balances = balances;
+
+	return 0;
+}
+
+int
+xnd_client_stats(const xnd_client_t *x, xnd_client_stats_t *stats)
+{
+	xnd_limiter_t *limiter;
+	xnd_breakers_t *breakers;
+
+	if (x == NULL || stats == NULL)
+		return -1;
+
+	limiter = x->context->limiter;
+	breakers = x->context->breakers;
+
+	stats->warm_requests = atomic_load(&(x->context->pool->warm));
+	stats->cold_requests = atomic_load(&(x->context->pool->cold));
+
+	stats->concurrency_limit = 0U;
+	stats->in_flight = 0U;
+	stats->limited_requests = 0UL;
+	memset(stats->lanes, 0, sizeof(stats->lanes));
+	if (limiter != NULL) {
+		pthread_mutex_lock(&(limiter->lock));
+		stats->concurrency_limit = (unsigned int) limiter->limit;
+		stats->in_flight = limiter->inflight;
+		for (unsigned int i = 0U; i < XND_PRIORITIES; ++i)
+			xnd_client_lane_stats(limiter, i, &(stats->lanes[i]));
+		pthread_mutex_unlock(&(limiter->lock));
+		stats->limited_requests = atomic_load(&(limiter->rejected));
+	}
+
+	stats->broken_requests = 0UL;
+	if (breakers != NULL)
+		stats->broken_requests = atomic_load(&(breakers->rejected));
+
+	return 0;
+}
+
+int
+xnd_client_record(xnd_client_t *x, const char *path)
+{
+	xnd_http_transport_t *t = NULL;
+
+	if (x == NULL)
+		return -1;
+
+	if (path != NULL) {
+		t = xnd_http_transport_record_new(path, NULL);
+		if (t == NULL)
+			return -1;
+	}
+
+	xnd_http_transport_destroy(x->transport);
+	x->transport = t;
+
+	return 0;
+}
+
+int
+xnd_client_replay(xnd_client_t *x, const char *path)
+{
+	xnd_http_transport_t *t = NULL;
+
+	if (x == NULL)
+		return -1;
+
+	if (path != NULL) {
+		t = xnd_http_transport_replay_new(path);
+		if (t == NULL)
+			return -1;
+	}
+
+	xnd_http_transport_destroy(x->transport);
+	x->transport = t;
+
+	return 0;
+}
+
+int
+xnd_client_uring(xnd_client_t *x, int enable)
+{
+	xnd_http_transport_t *t = NULL;
+
+	if (x == NULL)
+		return -1;
+
+	if (enable) {
+		t = xnd_http_transport_uring_new();
+		if (t == NULL)
+			return -1;
+	}
+
+	xnd_http_transport_destroy(x->transport);
+	x->transport = t;
+
+	return 0;
+}
+
+void
+xnd_sdk_attach(xnd_context_t *ctx)
+{
+	/** Lazily, for programs which never called xnd_sdk_init(). */
+	pthread_mutex_lock(&xnd_sdk_lock);
+	xnd_sdk_start();
+	ctx->next = xnd_sdk_contexts;
+	xnd_sdk_contexts = ctx;
+	pthread_mutex_unlock(&xnd_sdk_lock);
+}
+
+void
+xnd_sdk_detach(xnd_context_t *ctx)
+{
+	pthread_mutex_lock(&xnd_sdk_lock);
+	for (xnd_context_t **i = &xnd_sdk_contexts; *i != NULL;
+	     i = &((*i)->next)) {
+		if (*i == ctx) {
+			*i = ctx->next;
+			break;
+		}
+	}
+	/** Programs which never initialized keep the global state up for their
+	    next client, rather than setting it up again for each. */
+	if (xnd_sdk_stopping)
+		xnd_sdk_stop();
+	pthread_mutex_unlock(&xnd_sdk_lock);
+}
+
+unsigned int
+xnd_sdk_forks(void)
+{
+	/** Objects made without a client, e.g. webhook receivers, count on
+	    the fork handlers too. */
+	pthread_once(&xnd_sdk_atfork_once, xnd_sdk_atfork);
+
+	return atomic_load_explicit(&xnd_sdk_generation, memory_order_relaxed);
+}
+
+static void
+xnd_sdk_start(void)
+{
+	pthread_once(&xnd_sdk_atfork_once, xnd_sdk_atfork);
+
+	if (xnd_sdk_ready)
+		return;
+
+	xnd_http_request_init();
+	xnd_sdk_ready = 1;
+}
+
+static void
+xnd_sdk_stop(void)
+{
+	if (xnd_sdk_refs > 0U || !xnd_sdk_ready)
+		return;
+
+	/** Contexts still alive keep it up, the last one gone tears it down. */
+	xnd_sdk_stopping = xnd_sdk_contexts != NULL;
+	if (xnd_sdk_stopping)
+		return;
+
+	xnd_http_request_cleanup();
+	xnd_alloc_set(NULL);
+	xnd_sdk_ready = 0;
+}
+
+static void
+xnd_sdk_atfork(void)
+{
+	pthread_atfork(xnd_sdk_prepare, xnd_sdk_parent, xnd_sdk_child);
+}
+
+static void
+xnd_sdk_prepare(void)
+{
+	/** No context comes or goes, and no breaker, limiter or pool is left
+	    half updated by a thread which does not exist in the child. */
+	pthread_mutex_lock(&xnd_sdk_lock);
+
+	for (xnd_context_t *x = xnd_sdk_contexts; x != NULL; x = x->next) {
+		if (x->breakers != NULL)
+			pthread_mutex_lock(&(x->breakers->lock));
+		if (x->limiter != NULL)
+			pthread_mutex_lock(&(x->limiter->lock));
+		xnd_http_pool_prepare(x->pool);
+	}
+}
+
+static void
+xnd_sdk_parent(void)
+{
+	for (xnd_context_t *x = xnd_sdk_contexts; x != NULL; x = x->next) {
+		xnd_http_pool_parent(x->pool);
+		if (x->limiter != NULL)
+			pthread_mutex_unlock(&(x->limiter->lock));
+		if (x->breakers != NULL)
+			pthread_mutex_unlock(&(x->breakers->lock));
+	}
+
+	pthread_mutex_unlock(&xnd_sdk_lock);
+}
+
+static void
+xnd_sdk_child(void)
+{
+	/** Settings, pinned addresses and the balance and TLS session cache
+	    files are kept copy-on-write, connections, calls in flight and the
+	    in-memory caches of libcurl belong to the parent. */
+	for (xnd_context_t *x = xnd_sdk_contexts; x != NULL; x = x->next) {
+		xnd_limiter_forked(x->limiter);
+		xnd_breakers_forked(x->breakers);
+		xnd_http_pool_forked(x->pool);
+	}
+	xnd_http_handles_forked();
+	atomic_fetch_add(&xnd_sdk_generation, 1U);
+
+	pthread_mutex_unlock(&xnd_sdk_lock);
+}
+
+static xnd_string_t *
+xnd_client_auth(const char *key)
+{
+	xnd_string_t *cred, *auth;
+
+	cred = xnd_string_new(key);
+	if (cred == NULL)
+		return NULL;
+
+	xnd_string_append(&cred, ':');
+
+	auth = xnd_string_new("Basic ");
+	if (auth != NULL &&
+	    xnd_string_base64(&auth, cred->data, cred->size) == -1)
+		xnd_string_destroy(&auth);
+
+	xnd_string_zeroize(&cred);
+	xnd_string_destroy(&cred);
+
+	return auth;
+}
+
+static int
+xnd_client_trusts(const xnd_client_t *x, const char *url)
+{
+	const xnd_endpoint_t *ep;
+
+	if (xnd_client_under(url, XND_BASEURL, sizeof(XND_BASEURL) - 1UL))
+		return 1;
+
+	for (unsigned int i = 0U; x->endpoints != NULL &&
+	     i < x->endpoints->n; ++i) {
+		ep = &(x->endpoints->endpoints[i]);
+		if (xnd_client_under(url, ep->url, ep->size))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+xnd_client_under(const char *url, const char *base, size_t size)
+{
+	return strncmp(url, base, size) == 0 &&
+	       (url[size] == '\0' || url[size] == '/' || url[size] == '?');
+}
+
+static void
+xnd_client_lane_stats(const xnd_limiter_t *l, unsigned int lane,
+                      xnd_lane_stats_t *stats)
+{
+	const xnd_limiter_lane_t *q = &(l->lanes[lane]);
+
+	stats->queued = q->waiting;
+	stats->in_flight = q->inflight;
+	stats->admitted = q->admitted;
+	stats->rejected = atomic_load(&(q->rejected));
+	stats->wait_mean_ms = q->admitted == 0UL ? 0.0 :
+	                      (double) q->waited / (double) q->admitted / 1e6;
+	stats->wait_p99_ms = (double) xnd_limiter_wait_p99(l, lane) / 1e6;
+	stats->wait_max_ms = (double) q->longest / 1e6;
 }
@@ -11,13 +11,95 @@
 extern "C" {
 #endif
 
+#include <stdatomic.h>
+
+#include "balance_cache.h"
+#include "breaker.h"
+#include "endpoints.h"
+#include "http_headers.h"
+#include "http_pool.h"
+#include "http_request.h"
+#include "http_transport.h"
+#include "limiter.h"
 #include "strings.h"
 #include "xendit.h"
 
+struct xnd_context_t {
+	xnd_http_headers_t   *headers;   /** Static headers of every call. */
+	xnd_http_pool_t      *pool;      /** Connection pool of the clients. */
+	xnd_limiter_t        *limiter;   /** Concurrency limiter or NULL. */
+	xnd_breakers_t       *breakers;  /** Circuit breakers or NULL. */
+	atomic_uint           refs;      /** Creator and clients holding it. */
+	struct xnd_context_t *next;      /** Next live context of the SDK. */
+};
+
 struct xnd_client_t {
-	xnd_string_t *key; /** The secret API key. */
+	xnd_string_t         *key;       /** The secret API key. */
+	xnd_string_t         *auth;      /** Authorization header value. */
+	xnd_context_t        *context;   /** Context, of its own or shared. */
+	int                   shared;    /** Whether the context is borrowed. */
+	xnd_http_transport_t *transport; /** Transport, NULL for curl. */
+	xnd_timeouts_t        timeouts;  /** Time limits of every call. */
+	xnd_cancel_t         *cancel;    /** Cancellation token or NULL. */
+	xnd_balance_cache_t  *balances;  /** Shared balance cache or NULL. */
+	xnd_priority_t        priority;  /** Lane of its calls. */
+	xnd_endpoints_t      *endpoints; /** Base URLs or NULL. */
+};
+
+struct xnd_cancel_t {
+	atomic_int cancelled; /** Set once cancelled. */
 };
 
+/**
+ * \brief Sets up the global state of the SDK if needed, and registers a
+ * context, so that it is rebuilt in children after `fork()`.
+ * \param ctx The client context.
+ */
+extern void
+xnd_sdk_attach(xnd_context_t *ctx);
+
+/**
+ * \brief Retrieves the number of forks the process descends from, since the
+ * fork handlers of the SDK were registered, which the first call does, so
+ * that objects whose threads are the parent's are told apart in a child.
+ * \return The fork generation of the process.
+ */
+extern unsigned int
+xnd_sdk_forks(void);
+
+/**
+ * \brief Unregisters a context before it is destroyed.
+ * \param ctx The client context.
+ */
+extern void
+xnd_sdk_detach(xnd_context_t *ctx);
+
+/**
+ * \brief Prepares an HTTP request of the client, with the static headers,
+ * credentials, connection pool, transport, time limits and cancellation of
+ * the client. Credentials are only sent under `XND_BASEURL` or an endpoint of
+ * the client.
+ * \param x The Xendit client.
+ * \param req The HTTP request.
+ * \return 0 on success, -1 otherwise.
+ */
+extern int
+xnd_client_request(const xnd_client_t *x, xnd_http_request_t *req);
+
+/**
+ * \brief Sends an HTTP request of the client to an endpoint, through the
+ * circuit breaker of the endpoint and the concurrency limiter of its context,
+ * to one of the base URLs of the client if it has any.
+ * \param x The Xendit client.
+ * \param req The HTTP request, prepared by `xnd_client_request()`.
+ * \param endpoint The endpoint, naming its circuit breaker.
+ * \param data The user-defined data to be passed to the write cb function.
+ * \return 0 if a response is received, -1 otherwise.
+ */
+extern int
+xnd_client_send(const xnd_client_t *x, xnd_http_request_t *req,
+                const char *endpoint, void *data);
+
 #ifdef __cplusplus
 }
 #endif
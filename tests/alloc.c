@@ -0,0 +1,214 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "strings.h"
+#include "xendit.h"
+#include "support/stub_server.h"
+
+static long live_blocks = 0L;
+static long total_blocks = 0L;
+
+static void *
+counting_malloc(size_t size)
+{
+	void *ptr = malloc(size);
+
+	if (ptr != NULL) {
+		++live_blocks;
+		++total_blocks;
+	}
+
+	return ptr;
+}
+
+static void
+counting_free(void *ptr)
+{
+	if (ptr != NULL)
+		--live_blocks;
+
+	free(ptr);
+}
+
+static void *
+counting_realloc(void *ptr, size_t size)
+{
+	void *newptr = realloc(ptr, size);
+
+	if (ptr == NULL && newptr != NULL) {
+		++live_blocks;
+		++total_blocks;
+	}
+
+	return newptr;
+}
+
+static int
+test_xnd_alloc_emulation(void)
+{
+	xnd_allocator_t allocator = {
+		counting_malloc, counting_free, counting_realloc, NULL, NULL
+	};
+	char *str, *zeroed;
+
+	if (xnd_alloc_set(&allocator) != 0)
+		return 0;
+
+	/** test calloc and strdup emulated on top of malloc */
+	str = xnd_strdup("abc");
+	zeroed = xnd_calloc(4UL, 4UL);
+	if (str == NULL || strcmp(str, "abc") != 0 || zeroed == NULL)
+		return 0;
+	for (size_t i = 0UL; i < 16UL; ++i)
+		if (zeroed[i] != 0)
+			return 0;
+	if (live_blocks != 2L)
+		return 0;
+	xnd_free(str);
+	xnd_free(zeroed);
+	if (live_blocks != 0L)
+		return 0;
+
+	/** test overflowing calloc */
+	if (xnd_calloc(__SIZE_MAX__, 2UL) != NULL)
+		return 0;
+
+	/** test incomplete allocator is rejected */
+	allocator.realloc_fn = NULL;
+	if (xnd_alloc_set(&allocator) != -1)
+		return 0;
+
+	xnd_alloc_set(NULL);
+
+	return 1;
+}
+
+static int
+test_xnd_sdk_init_with_allocator(void)
+{
+	xnd_allocator_t allocator = {
+		counting_malloc, counting_free, counting_realloc, NULL, NULL
+	};
+	xnd_client_t *x;
+	xnd_string_t *s;
+	long before;
+
+	if (xnd_sdk_init_with_allocator(NULL) != -1)
+		return 0;
+	if (xnd_sdk_init_with_allocator(&allocator) != 0)
+		return 0;
+
+	/** test SDK and curl allocations go through the hooks */
+	before = total_blocks;
+	s = xnd_string_new("abc");
+	if (s == NULL || total_blocks != before + 1L)
+		return 0;
+	xnd_string_destroy(&s);
+
+	before = total_blocks;
+	x = xnd_client_new("secret");
+	if (x == NULL || total_blocks <= before + 3L)
+		return 0;
+	xnd_client_destroy(x);
+
+	xnd_sdk_cleanup();
+
+	/** test every block is returned */
+	if (live_blocks != 0L)
+		return 0;
+
+	return 1;
+}
+
+/** Thread calling before and after the SDK is set up again. */
+typedef struct survivor_t {
+	pthread_barrier_t  called;    /** Passed once a call is done. */
+	pthread_barrier_t  restarted; /** Passed once the SDK is up again. */
+	xnd_client_t      *x;         /** The client of the next call. */
+	int                failed;    /** Whether a call failed. */
+} survivor_t;
+
+static void *
+survive(void *arg)
+{
+	survivor_t *s = arg;
+	xnd_balance_t balance;
+
+	for (int i = 0; i < 2; ++i) {
+		if (i > 0)
+			pthread_barrier_wait(&(s->restarted));
+		if (xnd_balance(s->x, NULL, NULL, NULL, &balance) != 0)
+			s->failed = 1;
+		pthread_barrier_wait(&(s->called));
+	}
+
+	return NULL;
+}
+
+static int
+test_xnd_sdk_reinit_with_allocator(void)
+{
+	xnd_allocator_t allocator = {
+		counting_malloc, counting_free, counting_realloc, NULL, NULL
+	};
+	survivor_t s = { .failed = 0 };
+	pthread_t thread;
+	xnd_stub_t *stub;
+
+	stub = xnd_stub_new(200, "{\"balance\":1}");
+	if (stub == NULL)
+		return 0;
+
+	pthread_barrier_init(&(s.called), NULL, 2U);
+	pthread_barrier_init(&(s.restarted), NULL, 2U);
+
+	/** The thread keeps a curl instance built by the C library. */
+	xnd_sdk_init();
+	s.x = xnd_client_new("secret");
+	if (s.x == NULL || xnd_client_sidecar(s.x, xnd_stub_url(stub)) != 0 ||
+	    pthread_create(&thread, NULL, survive, &s) != 0)
+		return 0;
+	pthread_barrier_wait(&(s.called));
+	xnd_client_destroy(s.x);
+	xnd_sdk_cleanup();
+
+	/** test the thread calls again without the instance, which the new
+	    hooks did not allocate and must not free */
+	live_blocks = 0L;
+	if (xnd_sdk_init_with_allocator(&allocator) != 0)
+		return 0;
+	s.x = xnd_client_new("secret");
+	if (s.x == NULL || xnd_client_sidecar(s.x, xnd_stub_url(stub)) != 0)
+		return 0;
+	pthread_barrier_wait(&(s.restarted));
+	pthread_barrier_wait(&(s.called));
+	if (pthread_join(thread, NULL) != 0 || s.failed ||
+	    xnd_stub_requests(stub) != 2UL)
+		return 0;
+	xnd_client_destroy(s.x);
+	xnd_sdk_cleanup();
+
+	if (live_blocks != 0L)
+		return 0;
+
+	pthread_barrier_destroy(&(s.called));
+	pthread_barrier_destroy(&(s.restarted));
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	if (! test_xnd_alloc_emulation())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_sdk_init_with_allocator())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_sdk_reinit_with_allocator())
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
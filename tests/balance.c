@@ -1,9 +1,253 @@
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "xendit.h"
 
+static int
+test_xnd_balance_replay(void)
+{
+	const char *capture =
+	    "> GET " XND_BASEURL "/balance?account_type=CASH\n"
+	    "< 200 16\n"
+	    "{\"balance\":1000}\n"
+	    "> GET " XND_BASEURL "/balance?account_type=TAX\n"
+	    "< 401 2\n"
+	    "{}\n";
+	char path[] = "/tmp/xnd-balance-XXXXXX";
+	xnd_client_t *x;
+	xnd_balance_t balance = { 0.0 };
+	xnd_timeouts_t timeouts = { 1000L, 5000L, 1L, 10L, 2U };
+	xnd_cancel_t *token;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return 0;
+	if (write(fd, capture, strlen(capture)) != (ssize_t) strlen(capture))
+		return 0;
+	close(fd);
+
+	x = xnd_client_new("secret");
+	if (x == NULL || xnd_client_replay(x, path) != 0)
+		return 0;
+	unlink(path);
+
+	/** test binding a recorded response, offline */
+	if (xnd_balance(x, NULL, "CASH", NULL, &balance) != 0)
+		return 0;
+	if (balance.balance != 1000.0)
+		return 0;
+
+	/** test error statuses and unrecorded calls */
+	if (xnd_balance(x, NULL, "TAX", NULL, &balance) != -1)
+		return 0;
+	if (xnd_balance(x, NULL, "HOLDING", NULL, &balance) != -1)
+		return 0;
+
+	/** test cancellation, until the token is reset */
+	token = xnd_cancel_new();
+	if (token == NULL || xnd_client_cancel_token(x, token) != 0)
+		return 0;
+	xnd_cancel(token);
+	if (xnd_balance(x, NULL, "CASH", NULL, &balance) != -1)
+		return 0;
+	xnd_cancel_reset(token);
+	if (xnd_balance(x, NULL, "CASH", NULL, &balance) != 0)
+		return 0;
+	xnd_client_cancel_token(x, NULL);
+	xnd_cancel_destroy(token);
+
+	/** test time limits */
+	if (xnd_client_timeouts(x, &timeouts) != 0)
+		return 0;
+	timeouts.connect_ms = -1L;
+	if (xnd_client_timeouts(x, &timeouts) != -1)
+		return 0;
+
+	/** test invalid capture files */
+	if (xnd_client_replay(x, path) != -1)
+		return 0;
+
+	xnd_client_destroy(x);
+
+	return 1;
+}
+
+/** Writes a capture file answering CASH balance calls with a balance. */
+static int
+capture_balance(const char *path, const char *body)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f == NULL)
+		return 0;
+	fprintf(f, "> GET " XND_BASEURL "/balance?account_type=CASH\n"
+	           "< 200 %zu\n%s\n", strlen(body), body);
+
+	return fclose(f) == 0;
+}
+
+static int
+test_xnd_balance_cache(void)
+{
+	char path[] = "/tmp/xnd-balance-XXXXXX";
+	char cache[] = "/tmp/xnd-balance-cache-XXXXXX";
+	xnd_client_t *x;
+	xnd_balance_t balance = { 0.0 };
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return 0;
+	close(fd);
+	fd = mkstemp(cache);
+	if (fd == -1)
+		return 0;
+	close(fd);
+
+	x = xnd_client_new("secret");
+	if (x == NULL || xnd_client_balance_cache(x, cache, 60000L) != 0)
+		return 0;
+
+	/** test a response without a balance fails, and is not cached */
+	if (! capture_balance(path, "{\"error_code\":\"X\"}") ||
+	    xnd_client_replay(x, path) != 0 ||
+	    xnd_balance(x, NULL, "CASH", NULL, &balance) != -1 ||
+	    ! capture_balance(path, "not json") ||
+	    xnd_client_replay(x, path) != 0 ||
+	    xnd_balance(x, NULL, "CASH", NULL, &balance) != -1)
+		return 0;
+
+	/** test a fetched balance is served from the cache afterwards */
+	if (! capture_balance(path, "{\"balance\":1000}") ||
+	    xnd_client_replay(x, path) != 0 ||
+	    xnd_balance(x, NULL, "CASH", NULL, &balance) != 0 ||
+	    balance.balance != 1000.0)
+		return 0;
+	if (! capture_balance(path, "{\"balance\":2000}") ||
+	    xnd_client_replay(x, path) != 0 ||
+	    xnd_balance(x, NULL, "CASH", NULL, &balance) != 0 ||
+	    balance.balance != 1000.0)
+		return 0;
+
+	/** test the cache is keyed by the parameters of the call */
+	if (xnd_balance(x, NULL, "TAX", NULL, &balance) != -1)
+		return 0;
+
+	/** test disabling the cache */
+	if (xnd_client_balance_cache(x, NULL, 0L) != 0 ||
+	    xnd_balance(x, NULL, "CASH", NULL, &balance) != 0 ||
+	    balance.balance != 2000.0)
+		return 0;
+
+	unlink(path);
+	unlink(cache);
+	xnd_client_destroy(x);
+
+	return 1;
+}
+
+static int
+test_xnd_balance_columns(void)
+{
+	const char *capture =
+	    "> GET " XND_BASEURL "/balance?account_type=CASH\n"
+	    "< 200 18\n"
+	    "{\"balance\":1234.5}\n"
+	    "> GET " XND_BASEURL "/balance?account_type=CASH\n"
+	    "> for-user-id: u-1\n"
+	    "< 200 34\n"
+	    "{\"balance\":-0.07,\"currency\":\"IDR\"}\n"
+	    "> GET " XND_BASEURL "/balance?account_type=HOLDING&currency=USD\n"
+	    "< 200 13\n"
+	    "{\"balance\":3}\n"
+	    "> GET " XND_BASEURL "/balance?account_type=TAX\n"
+	    "< 401 2\n"
+	    "{}\n";
+	const xnd_balance_query_t queries[] = {
+		{ NULL, "CASH", NULL },
+		{ "u-1", "CASH", NULL },
+		{ NULL, "HOLDING", "USD" },
+		{ NULL, "TAX", NULL },
+	};
+	const uint32_t offsets[] = { 0U, 1U, 5U, 6U, 7U };
+	const int64_t amounts[] = { 123450, -7, 300 };
+	char path[] = "/tmp/xnd-balance-XXXXXX";
+	xnd_balance_columns_view_t view;
+	xnd_balance_columns_t *c;
+	xnd_client_t *x;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return 0;
+	if (write(fd, capture, strlen(capture)) != (ssize_t) strlen(capture))
+		return 0;
+	close(fd);
+
+	x = xnd_client_new("secret");
+	c = xnd_balance_columns_new();
+	if (x == NULL || c == NULL || xnd_client_replay(x, path) != 0)
+		return 0;
+	unlink(path);
+
+	/** test rows are kept, and flagged, when a call fails */
+	if (xnd_balance_columns_fetch(x, c, queries, 4UL, 3U) != -1 ||
+	    xnd_balance_columns_view(c, &view) != 0 || view.rows != 4UL)
+		return 0;
+	for (size_t i = 0UL; i < 3UL; ++i)
+		if (view.amounts[i] != amounts[i] || view.valid[i] != 1U)
+			return 0;
+	if (view.valid[3] != 0U)
+		return 0;
+
+	/** test strings are encoded in order, then as responses name them */
+	if (view.ntypes != 4UL || view.types[0] != 1U || view.types[1] != 1U ||
+	    view.types[2] != 2U || view.types[3] != 3U ||
+	    strcmp(view.type_names[view.types[2]], "HOLDING") != 0)
+		return 0;
+	if (view.ncurrencies != 3UL || view.currencies[0] != 0U ||
+	    view.currencies[1] != 2U || view.currencies[2] != 1U ||
+	    strcmp(view.currency_names[0], "") != 0 ||
+	    strcmp(view.currency_names[2], "IDR") != 0)
+		return 0;
+	for (size_t i = 0UL; i < 5UL; ++i)
+		if (view.id_offsets[i] != offsets[i])
+			return 0;
+	if (strcmp(view.ids + view.id_offsets[1], "u-1") != 0)
+		return 0;
+
+	/** test appending on a single thread, then clearing */
+	if (xnd_balance_columns_fetch(x, c, queries, 1UL, 0U) != 0 ||
+	    xnd_balance_columns_view(c, &view) != 0 || view.rows != 5UL ||
+	    view.amounts[4] != 123450 || view.id_offsets[5] != 8U)
+		return 0;
+	xnd_balance_columns_clear(c);
+	if (xnd_balance_columns_view(c, &view) != 0 || view.rows != 0UL ||
+	    view.ntypes != 4UL)
+		return 0;
+
+	xnd_balance_columns_destroy(c);
+	xnd_client_destroy(x);
+
+	return 1;
+}
+
 int
 main(void)
 {
+	xnd_sdk_init();
+
+	if (! test_xnd_balance_replay())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_balance_cache())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_balance_columns())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
 	exit(EXIT_SUCCESS);
 }
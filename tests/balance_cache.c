@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "balance_cache.h"
+
+#define KEYS       (64)
+#define ITERATIONS (20000)
+
+static int
+test_xnd_balance_cache_put(const char *path)
+{
+	xnd_balance_cache_t *c, *other;
+	struct timespec ts = { 0, 60000000L };
+	char key[XND_BALANCE_CACHE_KEY_MAX + 1];
+	double balance = 0.0;
+
+	c = xnd_balance_cache_open(path, 50L, "secret");
+	other = xnd_balance_cache_open(path, 50L, "other");
+	if (c == NULL || other == NULL)
+		return 0;
+
+	/** test storing and replacing balances of the same key */
+	if (xnd_balance_cache_get(c, "\x1f" "CASH\x1f", &balance) != -1)
+		return 0;
+	if (xnd_balance_cache_put(c, "\x1f" "CASH\x1f", 1.0) != 0 ||
+	    xnd_balance_cache_put(c, "\x1f" "CASH\x1f", 2.0) != 0)
+		return 0;
+	if (xnd_balance_cache_get(c, "\x1f" "CASH\x1f", &balance) != 0 ||
+	    balance != 2.0)
+		return 0;
+
+	/** test balances of other API keys are not served */
+	if (xnd_balance_cache_get(other, "\x1f" "CASH\x1f", &balance) != -1)
+		return 0;
+
+	/** test oversized keys are rejected */
+	memset(key, 'k', sizeof(key) - 1UL);
+	key[sizeof(key) - 1UL] = '\0';
+	if (xnd_balance_cache_put(c, key, 1.0) != -1)
+		return 0;
+
+	/** test balances expire */
+	nanosleep(&ts, NULL);
+	if (xnd_balance_cache_get(c, "\x1f" "CASH\x1f", &balance) != -1)
+		return 0;
+
+	xnd_balance_cache_close(other);
+	xnd_balance_cache_close(c);
+
+	return 1;
+}
+
+static int
+test_xnd_balance_cache_stale(const char *path)
+{
+	xnd_balance_cache_t *c;
+	xnd_balance_cache_slot_t *slots, *slot = NULL;
+	struct timespec ts;
+	uint64_t now;
+	double balance = 0.0;
+
+	c = xnd_balance_cache_open(path, 60000L, "secret");
+	if (c == NULL || xnd_balance_cache_put(c, "\x1f" "HOLD\x1f", 1.0) != 0)
+		return 0;
+
+	slots = (xnd_balance_cache_slot_t *)
+	        ((char *) c->map + sizeof(xnd_balance_cache_header_t));
+	for (unsigned int i = 0U; i < XND_BALANCE_CACHE_SLOTS; ++i)
+		if (strcmp(slots[i].key, "\x1f" "HOLD\x1f") == 0)
+			slot = &(slots[i]);
+	if (slot == NULL)
+		return 0;
+
+	/** test an entry being written is a miss, and is left to its writer */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	now = (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+	atomic_store(&(slot->seq), atomic_load(&(slot->seq)) + 1U);
+	atomic_store(&(slot->claim), now | 1ULL);
+	if (xnd_balance_cache_get(c, "\x1f" "HOLD\x1f", &balance) != -1 ||
+	    xnd_balance_cache_put(c, "\x1f" "HOLD\x1f", 2.0) != -1)
+		return 0;
+
+	/** test the entry of a writer which died writing it is taken over */
+	atomic_store(&(slot->claim), (now - XND_BALANCE_CACHE_STALE_MS *
+	                              2000000ULL) | 1ULL);
+	if (xnd_balance_cache_put(c, "\x1f" "HOLD\x1f", 3.0) != 0 ||
+	    xnd_balance_cache_get(c, "\x1f" "HOLD\x1f", &balance) != 0 ||
+	    balance != 3.0 || atomic_load(&(slot->claim)) != 0ULL)
+		return 0;
+
+	xnd_balance_cache_close(c);
+
+	return 1;
+}
+
+/** Writes balances whose fraction names their key, or reads them back and
+    checks they were never torn. */
+static int
+exercise(const char *path, int writer, unsigned int seed)
+{
+	xnd_balance_cache_t *c;
+	char key[32];
+	double balance;
+
+	c = xnd_balance_cache_open(path, 10000L, "secret");
+	if (c == NULL)
+		return 0;
+
+	for (int i = 0; i < ITERATIONS; ++i) {
+		int k = (int) (rand_r(&seed) % KEYS);
+
+		snprintf(key, sizeof(key), "user-%d\x1f\x1f", k);
+		if (writer) {
+			xnd_balance_cache_put(c, key, (double) i + k / 100.0);
+		} else if (xnd_balance_cache_get(c, key, &balance) == 0) {
+			long cents = (long) (balance * 100.0 + 0.5) % 100L;
+
+			if (cents != (long) k)
+				return 0;
+		}
+	}
+
+	xnd_balance_cache_close(c);
+
+	return 1;
+}
+
+static int
+test_xnd_balance_cache_processes(const char *path)
+{
+	pid_t pids[4];
+	int status, ok = 1;
+
+	/** test concurrent writers and readers across processes */
+	for (int i = 0; i < 4; ++i) {
+		pids[i] = fork();
+		if (pids[i] == -1)
+			return 0;
+		if (pids[i] == 0)
+			_exit(exercise(path, i % 2, (unsigned int) i + 1U) ?
+			      EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < 4; ++i)
+		if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != EXIT_SUCCESS)
+			ok = 0;
+
+	return ok;
+}
+
+int
+main(void)
+{
+	char path[] = "/tmp/xnd-balance-cache-XXXXXX";
+	int fd, ok;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		exit(EXIT_FAILURE);
+	close(fd);
+
+	ok = test_xnd_balance_cache_put(path) &&
+	     test_xnd_balance_cache_stale(path) &&
+	     test_xnd_balance_cache_processes(path);
+	unlink(path);
+
+	if (! ok)
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xendit.h"
+#include "support/stub_server.h"
+
+#define ROWS (20000)
+
+/** Invalid rows and progress reported. */
+typedef struct seen_t {
+	size_t errors;
+	size_t line;
+	char   field[32];
+	size_t progress;
+	size_t total;
+	size_t abort_at;
+} seen_t;
+
+static void
+on_error(size_t line, const char *field, const char *reason, void *data)
+{
+	seen_t *seen = data;
+
+	(void) reason;
+
+	if (seen->errors++ == 0UL) {
+		seen->line = line;
+		snprintf(seen->field, sizeof(seen->field), "%s",
+		         field ? field : "");
+	}
+}
+
+static int
+on_progress(size_t rows, size_t total, void *data)
+{
+	seen_t *seen = data;
+
+	seen->progress = rows;
+	seen->total = total;
+
+	return seen->abort_at != 0UL && rows >= seen->abort_at;
+}
+
+/** Writes a temporary file, returns its path. */
+static int
+write_file(char *path, const char *contents)
+{
+	FILE *fp;
+	int fd;
+
+	strcpy(path, "/tmp/xnd-batch-XXXXXX");
+	fd = mkstemp(path);
+	if (fd == -1)
+		return 0;
+
+	fp = fdopen(fd, "w");
+	if (fp == NULL)
+		return 0;
+	fputs(contents, fp);
+	fclose(fp);
+
+	return 1;
+}
+
+static int
+test_xnd_batch_csv(void)
+{
+	xnd_batch_options_t options = { "payroll-1", XND_BATCH_CSV, on_error,
+	                                on_progress, NULL };
+	xnd_batch_disbursement_t batch;
+	seen_t seen = { 0 };
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	char path[32], body[1024], head[1024];
+	const char *expected =
+		"{\"reference\":\"payroll-1\",\"disbursements\":["
+		"{\"amount\":10000,\"bank_code\":\"BCA\","
+		"\"bank_account_name\":\"Doe, John\","
+		"\"bank_account_number\":\"1234567890\","
+		"\"description\":\"Salary \\\"May\\\"\","
+		"\"external_id\":\"p-1\"},"
+		"{\"amount\":2500.5,\"bank_code\":\"BNI_SYR\","
+		"\"bank_account_name\":\"Jane\","
+		"\"bank_account_number\":\"42\","
+		"\"description\":\"Two\\nlines\"}]}";
+
+	stub = xnd_stub_new(200, "{\"id\":\"batch_1\",\"status\":\"NEEDS_"
+	                         "APPROVAL\"}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+	options.data = &seen;
+
+	if (!write_file(path,
+	                "external_id,amount,bank_code,bank_account_name,"
+	                "bank_account_number,description,notes\r\n"
+	                "p-1,10000,BCA,\"Doe, John\",1234567890,"
+	                "\"Salary \"\"May\"\"\",ignored\r\n"
+	                "\r\n"
+	                ",2500.5,BNI_SYR,Jane,42,\"Two\nlines\"\n"))
+		return 0;
+
+	if (xnd_batch_disbursement(NULL, path, &options, &batch) != -1 ||
+	    xnd_batch_disbursement(x, NULL, &options, &batch) != -1 ||
+	    xnd_batch_disbursement(x, "/nonexistent", &options, &batch) != -1)
+		return 0;
+
+	/** test rows are streamed as JSON, with the exact length */
+	if (xnd_batch_disbursement(x, path, &options, &batch) != 0 ||
+	    strcmp(batch.id, "batch_1") != 0 ||
+	    strcmp(batch.status, "NEEDS_APPROVAL") != 0 ||
+	    batch.rows != 2UL || batch.invalid != 0UL || seen.errors != 0UL ||
+	    seen.progress != 2UL || seen.total != 2UL)
+		return 0;
+	if (xnd_stub_last_body(stub, body, sizeof(body)) != strlen(expected) ||
+	    strcmp(body, expected) != 0)
+		return 0;
+	snprintf(body, sizeof(body), "Content-Length: %zu\r\n",
+	         strlen(expected));
+	xnd_stub_last_request(stub, head, sizeof(head));
+	if (strncmp(head, "POST /batch_disbursements ", 26UL) != 0 ||
+	    strstr(head, body) == NULL)
+		return 0;
+	unlink(path);
+
+	/** test invalid rows are reported and nothing is sent */
+	if (!write_file(path,
+	                "amount,bank_code,bank_account_name,"
+	                "bank_account_number,description\n"
+	                "100,BCA,A,1,ok\n"
+	                "100,bca,B,2,lowercase\n"
+	                "-5,BCA,C,3,negative\n"
+	                "100,BCA,\"D\"x,4,malformed\n"
+	                "100,BCA,E,12a,letters\n"))
+		return 0;
+	if (xnd_batch_disbursement(x, path, &options, &batch) != -1 ||
+	    batch.rows != 1UL || batch.invalid != 4UL || seen.errors != 4UL ||
+	    seen.line != 3UL || strcmp(seen.field, "bank_code") != 0 ||
+	    xnd_stub_requests(stub) != 1UL || batch.id[0])
+		return 0;
+	unlink(path);
+
+	/** test a missing column fails on the header */
+	seen.errors = 0UL;
+	if (!write_file(path, "amount,bank_code,description\n1,BCA,x\n"))
+		return 0;
+	if (xnd_batch_disbursement(x, path, &options, &batch) != -1 ||
+	    seen.errors != 1UL || seen.line != 1UL ||
+	    strcmp(seen.field, "bank_account_name") != 0 ||
+	    xnd_stub_requests(stub) != 1UL)
+		return 0;
+	unlink(path);
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_batch_ndjson(void)
+{
+	xnd_batch_options_t options = { "r", XND_BATCH_NDJSON, on_error,
+	                                NULL, NULL };
+	xnd_batch_disbursement_t batch;
+	seen_t seen = { 0 };
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	char path[32], body[1024];
+	const char *expected =
+		"{\"reference\":\"r\",\"disbursements\":["
+		"{\"amount\":7,\"bank_code\":\"MANDIRI\","
+		"\"bank_account_name\":\"\xc3\xa9\\\\\","
+		"\"bank_account_number\":\"9\","
+		"\"description\":\"d\"}]}";
+
+	stub = xnd_stub_new(200, "{\"id\":\"batch_2\",\"status\":\"x\"}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+	options.data = &seen;
+
+	/** test members are picked whatever their order */
+	if (!write_file(path,
+	                "\n"
+	                "{\"description\":\"d\",\"amount\":7,\"bank_code\":"
+	                "\"MANDIRI\",\"bank_account_number\":\"9\","
+	                "\"bank_account_name\":\"\\u00e9\\\\\",\"x\":[1]}\n"))
+		return 0;
+	if (xnd_batch_disbursement(x, path, &options, &batch) != 0 ||
+	    strcmp(batch.id, "batch_2") != 0 || batch.rows != 1UL)
+		return 0;
+	xnd_stub_last_body(stub, body, sizeof(body));
+	if (strcmp(body, expected) != 0)
+		return 0;
+	unlink(path);
+
+	/** test rows of the wrong shape or types are reported */
+	if (!write_file(path,
+	                "{\"amount\":\"7\",\"bank_code\":\"B\","
+	                "\"bank_account_name\":\"n\","
+	                "\"bank_account_number\":\"1\",\"description\":\"d\"}\n"
+	                "[1,2]\n"
+	                "{\"amount\":1,\n"))
+		return 0;
+	if (xnd_batch_disbursement(x, path, &options, &batch) != -1 ||
+	    batch.invalid != 3UL || seen.line != 1UL ||
+	    strcmp(seen.field, "amount") != 0 ||
+	    xnd_stub_requests(stub) != 1UL)
+		return 0;
+	unlink(path);
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_batch_large(void)
+{
+	xnd_batch_options_t options = { "big", XND_BATCH_CSV, NULL,
+	                                on_progress, NULL };
+	xnd_batch_disbursement_t batch;
+	seen_t seen = { 0 };
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	char path[32], body[64];
+	size_t size;
+	FILE *fp;
+	int fd;
+
+	stub = xnd_stub_new(200, "{\"id\":\"batch_3\",\"status\":\"x\"}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+	options.data = &seen;
+
+	strcpy(path, "/tmp/xnd-batch-XXXXXX");
+	fd = mkstemp(path);
+	fp = fd != -1 ? fdopen(fd, "w") : NULL;
+	if (fp == NULL)
+		return 0;
+
+	/** Each row is {"amount":100000,...} of a known size */
+	fputs("amount,bank_code,bank_account_name,bank_account_number,"
+	      "description\n", fp);
+	for (int i = 0; i < ROWS; ++i)
+		fprintf(fp, "100000,BCA,Employee %05d,%010d,Salary\n", i, i);
+	fclose(fp);
+	size = strlen("{\"amount\":100000,\"bank_code\":\"BCA\","
+	              "\"bank_account_name\":\"Employee 00000\","
+	              "\"bank_account_number\":\"0000000000\","
+	              "\"description\":\"Salary\"}");
+	size = size * (size_t) ROWS + (size_t) ROWS - 1UL +
+	       strlen("{\"reference\":\"big\",\"disbursements\":[]}");
+
+	/** test a large file is streamed whole */
+	if (xnd_batch_disbursement(x, path, &options, &batch) != 0 ||
+	    batch.rows != (size_t) ROWS || seen.progress != (size_t) ROWS ||
+	    xnd_stub_last_body(stub, body, sizeof(body)) != size)
+		return 0;
+
+	/** test the upload is aborted from the progress callback */
+	seen.abort_at = 100UL;
+	if (xnd_batch_disbursement(x, path, &options, &batch) != -1 ||
+	    seen.progress != 100UL || batch.id[0])
+		return 0;
+	unlink(path);
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_batch_csv())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_batch_ndjson())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_batch_large())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
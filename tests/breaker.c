@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "breaker.h"
+
+static int
+test_xnd_breakers(void)
+{
+	struct timespec ts = { 0, 60000000L };
+	xnd_breakers_t *b;
+
+	b = xnd_breakers_new(2U, 50L, 1U);
+	if (b == NULL)
+		return 0;
+
+	/** test consecutive failures open the breaker */
+	if (xnd_breakers_allow(b, "a") != 0)
+		return 0;
+	xnd_breakers_record(b, "a", 0, XND_BREAKER_FAILURE);
+	xnd_breakers_record(b, "a", 0, XND_BREAKER_SUCCESS);
+	xnd_breakers_record(b, "a", 0, XND_BREAKER_FAILURE);
+	if (xnd_breakers_state(b, "a") != XND_CIRCUIT_CLOSED)
+		return 0;
+	xnd_breakers_record(b, "a", 0, XND_BREAKER_FAILURE);
+	if (xnd_breakers_state(b, "a") != XND_CIRCUIT_OPEN)
+		return 0;
+
+	/** test calls fail fast while open, other endpoints aside */
+	if (xnd_breakers_allow(b, "a") != -1 ||
+	    xnd_breakers_allow(b, "b") != 0)
+		return 0;
+	if (atomic_load(&(b->rejected)) != 1UL)
+		return 0;
+
+	/** test a single probe when half-open, a failed one reopens */
+	nanosleep(&ts, NULL);
+	if (xnd_breakers_state(b, "a") != XND_CIRCUIT_HALF_OPEN)
+		return 0;
+	if (xnd_breakers_allow(b, "a") != 1 ||
+	    xnd_breakers_allow(b, "a") != -1)
+		return 0;
+	xnd_breakers_record(b, "a", 1, XND_BREAKER_FAILURE);
+	if (xnd_breakers_state(b, "a") != XND_CIRCUIT_OPEN)
+		return 0;
+
+	/** test an aborted probe frees its place, a successful one closes */
+	nanosleep(&ts, NULL);
+	if (xnd_breakers_allow(b, "a") != 1)
+		return 0;
+	xnd_breakers_record(b, "a", 1, XND_BREAKER_ABORTED);
+	if (xnd_breakers_allow(b, "a") != 1)
+		return 0;
+	xnd_breakers_record(b, "a", 1, XND_BREAKER_SUCCESS);
+	if (xnd_breakers_state(b, "a") != XND_CIRCUIT_CLOSED ||
+	    xnd_breakers_allow(b, "a") != 0)
+		return 0;
+
+	xnd_breakers_destroy(b);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	if (! test_xnd_breakers())
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xendit.h"
+#include "support/stub_server.h"
+
+#define CLIENTS (1000)
+
+static int
+test_xnd_context_clients(void)
+{
+	static xnd_client_t *clients[CLIENTS];
+	xnd_concurrency_options_t concurrency = { 4U, 1U, 4U, 4.0, 1000L,
+	                                          { 0U, 0U }, 0.0 };
+	xnd_client_stats_t stats;
+	xnd_balance_t balance;
+	xnd_context_t *ctx;
+	xnd_stub_t *stub;
+	char key[16], head[1024];
+
+	stub = xnd_stub_new(200, "{\"balance\":42}");
+	ctx = xnd_context_new();
+	if (stub == NULL || ctx == NULL ||
+	    xnd_context_sidecar(ctx, xnd_stub_url(stub)) != 0 ||
+	    xnd_context_connections(ctx, 2U) != 0 ||
+	    xnd_context_concurrency(ctx, &concurrency) != 0)
+		return 0;
+
+	if (xnd_client_new_in(NULL, "sk_0000") != NULL ||
+	    xnd_client_new_in(ctx, "") != NULL)
+		return 0;
+
+	for (int i = 0; i < CLIENTS; ++i) {
+		snprintf(key, sizeof(key), "sk_%04d", i);
+		clients[i] = xnd_client_new_in(ctx, key);
+		if (clients[i] == NULL)
+			return 0;
+	}
+
+	/** test the settings of a shared context are not set by its clients */
+	if (xnd_client_sidecar(clients[0], NULL) != -1 ||
+	    xnd_client_concurrency(clients[0], NULL) != -1 ||
+	    xnd_client_breaker(clients[0], NULL) != -1 ||
+	    xnd_client_tls_cache(clients[0], NULL, 0L) != -1)
+		return 0;
+
+	/** test every client calls with its own key on one connection */
+	for (int i = 0; i < CLIENTS; ++i)
+		if (xnd_balance(clients[i], NULL, NULL, NULL, &balance) != 0 ||
+		    balance.balance != 42.0)
+			return 0;
+	xnd_stub_last_request(stub, head, sizeof(head));
+	if (strstr(head, "Authorization: Basic c2tfMDk5OTo=\r\n") == NULL ||
+	    xnd_stub_connections(stub) != 1UL ||
+	    xnd_stub_requests(stub) != (unsigned long) CLIENTS)
+		return 0;
+
+	/** test the pool and limiter are accounted for the whole context */
+	if (xnd_client_stats(clients[CLIENTS - 1], &stats) != 0 ||
+	    stats.cold_requests != 1UL ||
+	    stats.warm_requests != (unsigned long) CLIENTS - 1UL ||
+	    stats.concurrency_limit == 0U)
+		return 0;
+
+	/** test the context outlives its destruction while clients hold it */
+	xnd_context_destroy(ctx);
+	if (xnd_balance(clients[0], NULL, NULL, NULL, &balance) != 0 ||
+	    xnd_stub_connections(stub) != 1UL)
+		return 0;
+
+	for (int i = 0; i < CLIENTS; ++i)
+		xnd_client_destroy(clients[i]);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_context_own(void)
+{
+	xnd_balance_t balance;
+	xnd_stub_t *stub;
+	xnd_client_t *x, *y;
+
+	stub = xnd_stub_new(200, "{\"balance\":7}");
+	x = xnd_client_new("secret");
+	y = xnd_client_new("other");
+	if (stub == NULL || x == NULL || y == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0 ||
+	    xnd_client_sidecar(y, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	/** test clients of their own context do not share connections */
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != 0 ||
+	    xnd_balance(y, NULL, NULL, NULL, &balance) != 0 ||
+	    xnd_stub_connections(stub) != 2UL)
+		return 0;
+
+	xnd_client_destroy(x);
+	xnd_client_destroy(y);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_context_clients())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_context_own())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
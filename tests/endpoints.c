@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "endpoints.h"
+#include "http_request.h"
+#include "xendit.h"
+#include "support/stub_server.h"
+
+int
+test_xnd_endpoints_pick(void)
+{
+	const char *urls[] = { "http://a.test/", "http://b.test" };
+	xnd_string_t *url;
+	xnd_endpoints_t *e;
+	xnd_http_pool_t *pool;
+	size_t base = sizeof(XND_BASEURL) - 1UL;
+
+	pool = xnd_http_pool_new();
+	if (pool == NULL)
+		return 0;
+
+	if (xnd_endpoints_new(urls, 0U, NULL, pool) != NULL)
+		return 0;
+
+	e = xnd_endpoints_new(urls, 2U, NULL, pool);
+	if (e == NULL || strcmp(e->endpoints[0].url, "http://a.test") != 0 ||
+	    e->endpoints[0].size != 13UL)
+		return 0;
+
+	/** The faster endpoint wins, until it is loaded enough. */
+	atomic_store(&(e->endpoints[0].ewma), 1000000ULL);
+	atomic_store(&(e->endpoints[1].ewma), 10000000ULL);
+	for (int i = 0; i < 100; ++i) {
+		if (xnd_endpoints_pick(e, 0U) != 0)
+			return 0;
+		xnd_endpoints_record(e, 0, 1000000ULL, 0);
+	}
+	atomic_store(&(e->endpoints[0].inflight), 20U);
+	if (xnd_endpoints_pick(e, 0U) != 1)
+		return 0;
+	xnd_endpoints_record(e, 1, 10000000ULL, 0);
+	atomic_store(&(e->endpoints[0].inflight), 0U);
+
+	if (xnd_endpoints_pick(e, 1U) != 1 || xnd_endpoints_pick(e, 3U) != -1)
+		return 0;
+	xnd_endpoints_record(e, 1, 10000000ULL, 0);
+
+	/** Unreachable endpoints are skipped, unless nothing else is left. */
+	if (xnd_endpoints_pick(e, 0U) != 0)
+		return 0;
+	xnd_endpoints_record(e, 0, 0ULL, 1);
+	if (atomic_load(&(e->endpoints[0].healthy)) ||
+	    atomic_load(&(e->endpoints[0].failures)) != 1UL ||
+	    atomic_load(&(e->endpoints[0].requests)) != 101UL)
+		return 0;
+	for (int i = 0; i < 100; ++i) {
+		if (xnd_endpoints_pick(e, 0U) != 1)
+			return 0;
+		xnd_endpoints_record(e, 1, 10000000ULL, 0);
+	}
+	if (xnd_endpoints_pick(e, 2U) != 0)
+		return 0;
+	xnd_endpoints_record(e, 0, 0ULL, 1);
+
+	url = xnd_string_new(XND_BASEURL "/balance?currency=IDR");
+	if (url == NULL || xnd_endpoints_rebase(e, 1, &url, &base) == -1 ||
+	    strcmp(url->data, "http://b.test/balance?currency=IDR") != 0 ||
+	    base != 13UL || xnd_endpoints_rebase(e, 0, &url, &base) == -1 ||
+	    strcmp(url->data, "http://a.test/balance?currency=IDR") != 0)
+		return 0;
+
+	xnd_string_destroy(&url);
+	xnd_endpoints_destroy(e);
+	xnd_http_pool_destroy(pool);
+
+	return 1;
+}
+
+int
+test_xnd_endpoints_health(void)
+{
+	xnd_endpoint_options_t options = { 20L, 0.5 };
+	const char *urls[2];
+	char dead[64];
+	xnd_stub_t *stub, *gone;
+	xnd_endpoints_t *e;
+	xnd_http_pool_t *pool;
+
+	pool = xnd_http_pool_new();
+	stub = xnd_stub_new(200, "");
+	gone = xnd_stub_new(200, "");
+	if (pool == NULL || stub == NULL || gone == NULL)
+		return 0;
+	snprintf(dead, sizeof(dead), "%s", xnd_stub_url(gone));
+	xnd_stub_destroy(gone);
+
+	urls[0] = xnd_stub_url(stub);
+	urls[1] = dead;
+	e = xnd_endpoints_new(urls, 2U, &options, pool);
+	if (e == NULL)
+		return 0;
+
+	/** A failed call takes the endpoint out, a check brings it back. */
+	xnd_endpoints_pick(e, 2U);
+	xnd_endpoints_record(e, 0, 0ULL, 1);
+	for (int i = 0; i < 100 && !atomic_load(&(e->endpoints[0].healthy));
+	     ++i)
+		usleep(10000);
+
+	if (!atomic_load(&(e->endpoints[0].healthy)) ||
+	    atomic_load(&(e->endpoints[0].ewma)) == 0ULL ||
+	    xnd_stub_requests(stub) == 0UL)
+		return 0;
+
+	/** Dead endpoints are found out without any call. */
+	for (int i = 0; i < 100 && atomic_load(&(e->endpoints[1].healthy));
+	     ++i)
+		usleep(10000);
+	if (atomic_load(&(e->endpoints[1].healthy)) ||
+	    atomic_load(&(e->endpoints[1].requests)) != 0UL)
+		return 0;
+
+	xnd_endpoints_destroy(e);
+	xnd_stub_destroy(stub);
+	xnd_http_pool_destroy(pool);
+
+	return 1;
+}
+
+int
+test_xnd_endpoints_fork(void)
+{
+	xnd_endpoint_options_t options = { 20L, 0.5 };
+	const char *urls[1];
+	xnd_stub_t *stub;
+	xnd_endpoint_t *ep;
+	xnd_endpoints_t *e;
+	xnd_http_pool_t *pool;
+	pid_t pid;
+	int status, picks = 2;
+
+#ifdef __SANITIZE_THREAD__
+	/** ThreadSanitizer takes threads started in a child for the dead
+	    threads of the parent. */
+	picks = 1;
+#endif
+
+	pool = xnd_http_pool_new();
+	stub = xnd_stub_new(200, "");
+	if (pool == NULL || stub == NULL)
+		return 0;
+	urls[0] = xnd_stub_url(stub);
+	e = xnd_endpoints_new(urls, 1U, &options, pool);
+	if (e == NULL)
+		return 0;
+
+	/** test a child destroys the set without joining the parent's checker,
+	    and that its first pick starts checks of its own */
+	for (int pick = 0; pick < picks; ++pick) {
+		pid = fork();
+		if (pid == -1)
+			return 0;
+		if (pid == 0) {
+			alarm(10U);
+			status = 1;
+			if (pick) {
+				xnd_endpoints_pick(e, 0U);
+				xnd_endpoints_record(e, 0, 0ULL, 1);
+				ep = &(e->endpoints[0]);
+				for (int i = 0; i < 100 &&
+				     !atomic_load(&(ep->healthy)); ++i)
+					usleep(10000);
+				status = atomic_load(&(ep->healthy));
+			}
+			xnd_endpoints_destroy(e);
+			_exit(status ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+		if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status) != EXIT_SUCCESS)
+			return 0;
+	}
+
+	xnd_endpoints_destroy(e);
+	xnd_stub_destroy(stub);
+	xnd_http_pool_destroy(pool);
+
+	return 1;
+}
+
+int
+test_xnd_client_endpoints(void)
+{
+	const char *urls[3], *bad[] = { "ftp://a.test" };
+	xnd_endpoint_stats_t stats;
+	xnd_stub_t *a, *b, *gone;
+	xnd_balance_t balance;
+	xnd_client_t *x;
+	char dead[64], req[256];
+
+	a = xnd_stub_new(200, "{\"balance\":1}");
+	b = xnd_stub_new(200, "{\"balance\":1}");
+	gone = xnd_stub_new(200, "");
+	x = xnd_client_new("secret");
+	if (a == NULL || b == NULL || gone == NULL || x == NULL)
+		return 0;
+	snprintf(dead, sizeof(dead), "%s", xnd_stub_url(gone));
+	xnd_stub_destroy(gone);
+
+	urls[0] = dead;
+	urls[1] = xnd_stub_url(a);
+	urls[2] = xnd_stub_url(b);
+	if (xnd_client_endpoints(x, bad, 1U, NULL) != -1 ||
+	    xnd_client_endpoints(x, urls, XND_ENDPOINTS_MAX + 1U, NULL) != -1 ||
+	    xnd_client_endpoint_stats(x, 0U, &stats) != -1 ||
+	    xnd_client_endpoints(x, urls, 3U, NULL) == -1)
+		return 0;
+
+	/** The dead endpoint costs a single failover, every call succeeds. */
+	for (int i = 0; i < 20; ++i)
+		if (xnd_balance(x, NULL, "CASH", NULL, &balance) == -1 ||
+		    balance.balance != 1.0)
+			return 0;
+
+	if (xnd_client_endpoint_stats(x, 0U, &stats) == -1 ||
+	    strcmp(stats.url, dead) != 0 || stats.healthy ||
+	    stats.requests != 1UL || stats.failures != 1UL ||
+	    stats.in_flight != 0U)
+		return 0;
+	if (xnd_client_endpoint_stats(x, 1U, &stats) == -1 || !stats.healthy ||
+	    stats.requests != xnd_stub_requests(a) || stats.failures != 0UL ||
+	    (stats.requests > 0UL && stats.latency_ms <= 0.0))
+		return 0;
+	if (xnd_stub_requests(a) + xnd_stub_requests(b) != 20UL ||
+	    xnd_client_endpoint_stats(x, 3U, &stats) != -1)
+		return 0;
+
+	xnd_stub_last_request(xnd_stub_requests(a) > 0UL ? a : b, req,
+	                      sizeof(req));
+	if (strncmp(req, "GET /balance?account_type=CASH ", 31UL) != 0)
+		return 0;
+
+	/** Back to the default base URL. */
+	if (xnd_client_endpoints(x, NULL, 0U, NULL) == -1 ||
+	    xnd_client_endpoint_stats(x, 0U, &stats) != -1)
+		return 0;
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(a);
+	xnd_stub_destroy(b);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_endpoints_pick())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_endpoints_health())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_endpoints_fork())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_client_endpoints())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
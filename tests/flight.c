@@ -0,0 +1,171 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xendit.h"
+
+#define THREADS (4)
+#define CALLS   (300)
+
+/** Keeps the calling threads alive together, each with a ring. */
+static pthread_barrier_t barrier;
+
+/** Dumps the flight recorder into a buffer. */
+static int
+dump(char *buf, size_t size, int signo)
+{
+	FILE *f = tmpfile();
+	size_t n;
+
+	if (f == NULL)
+		return -1;
+
+	if (signo != 0) {
+		if (xnd_flight_dump_on_signal(signo, fileno(f)) != 0 ||
+		    raise(signo) != 0)
+			return -1;
+	} else if (xnd_flight_dump(fileno(f)) == -1) {
+		return -1;
+	}
+
+	rewind(f);
+	n = fread(buf, 1UL, size - 1UL, f);
+	buf[n] = '\0';
+	fclose(f);
+
+	return 0;
+}
+
+/** Counts lines of a dump containing a string. */
+static int
+count(const char *buf, const char *str)
+{
+	int n = 0;
+
+	for (const char *line = buf; *line; ) {
+		const char *end = strchr(line, '\n');
+		const char *found = strstr(line, str);
+
+		if (end == NULL)
+			break;
+		if (found != NULL && found < end)
+			++n;
+		line = end + 1;
+	}
+
+	return n;
+}
+
+static void *
+call(void *arg)
+{
+	xnd_balance_t balance;
+
+	pthread_barrier_wait(&barrier);
+	for (int i = 0; i < CALLS; ++i)
+		xnd_balance(arg, NULL, "CASH", NULL, &balance);
+	pthread_barrier_wait(&barrier);
+
+	return NULL;
+}
+
+static void *
+dump_while_called(void *arg)
+{
+	static char buf[1 << 20];
+
+	(void) arg;
+
+	for (int i = 0; i < 20; ++i)
+		if (dump(buf, sizeof(buf), 0) == -1)
+			return buf;
+
+	return NULL;
+}
+
+static int
+test_xnd_flight_dump(void)
+{
+	const char *capture =
+	    "> GET " XND_BASEURL "/balance?account_type=CASH\n"
+	    "< 200 16\n"
+	    "{\"balance\":1000}\n";
+	static char buf[1 << 20];
+	char path[] = "/tmp/xnd-flight-XXXXXX";
+	pthread_t threads[THREADS], dumper;
+	xnd_balance_t balance;
+	xnd_client_t *x;
+	void *failed;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1 ||
+	    write(fd, capture, strlen(capture)) != (ssize_t) strlen(capture))
+		return 0;
+	close(fd);
+
+	x = xnd_client_new("secret");
+	if (x == NULL || xnd_client_replay(x, path) != 0)
+		return 0;
+	unlink(path);
+
+	/** test requests are recorded with their path, not their query */
+	if (xnd_balance(x, NULL, "CASH", NULL, &balance) != 0 ||
+	    xnd_balance(x, NULL, "TAX", NULL, &balance) != -1)
+		return 0;
+	if (dump(buf, sizeof(buf), 0) == -1 ||
+	    count(buf, "GET /balance status=200 error=0 attempts=1") != 1 ||
+	    count(buf, "GET /balance status=0 error=-1 attempts=1") != 1 ||
+	    count(buf, "account_type") != 0)
+		return 0;
+
+	/** test rings wrap, and dumps run while threads record */
+	pthread_barrier_init(&barrier, NULL, THREADS);
+	for (int i = 0; i < THREADS; ++i)
+		if (pthread_create(&threads[i], NULL, call, x) != 0)
+			return 0;
+	if (pthread_create(&dumper, NULL, dump_while_called, NULL) != 0)
+		return 0;
+	for (int i = 0; i < THREADS; ++i)
+		pthread_join(threads[i], NULL);
+	pthread_join(dumper, &failed);
+	if (failed != NULL)
+		return 0;
+
+	/** test dumps on signal, rings of exited threads are kept */
+	if (dump(buf, sizeof(buf), SIGUSR1) == -1 ||
+	    count(buf, "xnd-flight ") != 2 + 128 * THREADS)
+		return 0;
+
+	/** test rings of exited threads are handed over */
+	pthread_barrier_destroy(&barrier);
+	pthread_barrier_init(&barrier, NULL, 1);
+	if (pthread_create(&threads[0], NULL, call, x) != 0)
+		return 0;
+	pthread_join(threads[0], NULL);
+	if (dump(buf, sizeof(buf), 0) == -1 ||
+	    count(buf, "xnd-flight ") != 2 + 128 * THREADS ||
+	    count(buf, "ring=5 ") != 0)
+		return 0;
+
+	pthread_barrier_destroy(&barrier);
+	xnd_client_destroy(x);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_flight_dump())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,182 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_handles.h"
+#include "http_pool.h"
+#include "http_request.h"
+#include "support/stub_server.h"
+
+/** Sends a GET request through a pool, returns its curl instance. */
+static CURL *
+pooled_get(xnd_http_pool_t *pool, const char *url)
+{
+	xnd_http_request_t *req;
+	CURL *curl = NULL;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, url);
+	if (req == NULL)
+		return NULL;
+
+	xnd_http_request_pool(req, pool);
+	if (xnd_http_request_send_with_data(req, NULL) == 0 &&
+	    req->status == 200L)
+		curl = req->curl;
+	xnd_http_request_destroy(req);
+
+	return curl;
+}
+
+/** Takes an instance and gives it back, on a thread of its own. */
+static void *
+take_and_give(void *arg)
+{
+	CURL *curl = xnd_http_handles_get();
+
+	xnd_http_handles_put(curl);
+	*((CURL **) arg) = curl;
+
+	return NULL;
+}
+
+/** Takes an instance, on a thread of its own. */
+static void *
+take(void *arg)
+{
+	*((CURL **) arg) = xnd_http_handles_get();
+
+	return NULL;
+}
+
+/** Thread caching an instance across a flush by another thread. */
+typedef struct live_t {
+	pthread_barrier_t cached;  /** Passed once the instance is cached. */
+	pthread_barrier_t flushed; /** Passed once the caches are flushed. */
+	CURL             *curl;    /** The cached instance. */
+	int               kept;    /** Whether it was still cached. */
+} live_t;
+
+static void *
+keep(void *arg)
+{
+	live_t *live = arg;
+	char *mark = NULL;
+	CURL *curl;
+
+	/** Marked once cached, a new instance at the same address is not. */
+	live->curl = xnd_http_handles_get();
+	xnd_http_handles_put(live->curl);
+	curl_easy_setopt(live->curl, CURLOPT_PRIVATE, live);
+	pthread_barrier_wait(&(live->cached));
+	pthread_barrier_wait(&(live->flushed));
+
+	curl = xnd_http_handles_get();
+	curl_easy_getinfo(curl, CURLINFO_PRIVATE, &mark);
+	live->kept = curl == live->curl && mark == (char *) live;
+	xnd_http_handles_put(curl);
+
+	return NULL;
+}
+
+static int
+test_xnd_http_handles_reuse(void)
+{
+	xnd_http_pool_t *pool;
+	xnd_stub_t *stub;
+	CURL *first, *curl[XND_HTTP_HANDLES_MAX + 1U];
+
+	stub = xnd_stub_new(200, "{}");
+	pool = xnd_http_pool_new();
+	if (stub == NULL || pool == NULL)
+		return 0;
+
+	/** test requests of a thread reuse its instance, and the connection
+	    kept by the pool */
+	first = pooled_get(pool, xnd_stub_url(stub));
+	if (first == NULL || pooled_get(pool, xnd_stub_url(stub)) != first ||
+	    xnd_stub_connections(stub) != 1UL)
+		return 0;
+
+	/** test instances outlive the pool they were used through */
+	xnd_http_pool_destroy(pool);
+	pool = xnd_http_pool_new();
+	if (pool == NULL || pooled_get(pool, xnd_stub_url(stub)) != first ||
+	    xnd_stub_requests(stub) != 3UL)
+		return 0;
+
+	/** test the cache is bounded, and last in, first out */
+	for (unsigned int i = 0U; i <= XND_HTTP_HANDLES_MAX; ++i)
+		if ((curl[i] = xnd_http_handles_get()) == NULL)
+			return 0;
+	for (unsigned int i = 0U; i <= XND_HTTP_HANDLES_MAX; ++i)
+		xnd_http_handles_put(curl[i]);
+	for (unsigned int i = XND_HTTP_HANDLES_MAX; i > 0U; --i)
+		if (xnd_http_handles_get() != curl[i - 1U])
+			return 0;
+	for (unsigned int i = 0U; i < XND_HTTP_HANDLES_MAX; ++i)
+		xnd_http_handles_put(curl[i]);
+
+	xnd_http_pool_destroy(pool);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_http_handles_threads(void)
+{
+	CURL *own, *given = NULL, *taken = NULL;
+	pthread_t thread;
+	live_t live;
+
+	own = xnd_http_handles_get();
+	if (own == NULL)
+		return 0;
+	xnd_http_handles_put(own);
+
+	/** test threads do not share caches, but hand them over on exit */
+	if (pthread_create(&thread, NULL, take_and_give, &given) != 0 ||
+	    pthread_join(thread, NULL) != 0 || given == NULL || given == own)
+		return 0;
+	if (pthread_create(&thread, NULL, take, &taken) != 0 ||
+	    pthread_join(thread, NULL) != 0 || taken != given)
+		return 0;
+	xnd_http_handles_put(taken);
+
+	/** test the caches are emptied before the global cleanup, those of
+	    live threads included */
+	pthread_barrier_init(&(live.cached), NULL, 2U);
+	pthread_barrier_init(&(live.flushed), NULL, 2U);
+	if (pthread_create(&thread, NULL, keep, &live) != 0)
+		return 0;
+	pthread_barrier_wait(&(live.cached));
+	xnd_http_handles_flush();
+	pthread_barrier_wait(&(live.flushed));
+	if (pthread_join(thread, NULL) != 0 || live.kept)
+		return 0;
+	pthread_barrier_destroy(&(live.cached));
+	pthread_barrier_destroy(&(live.flushed));
+
+	own = xnd_http_handles_get();
+	if (own == NULL)
+		return 0;
+	xnd_http_handles_put(own);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_http_request_init();
+
+	if (! test_xnd_http_handles_reuse())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_http_handles_threads())
+		exit(EXIT_FAILURE);
+
+	xnd_http_request_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_headers.h"
+
+static int
+test_xnd_http_headers_set(void)
+{
+	xnd_http_headers_t *h;
+	struct curl_slist *list;
+
+	h = xnd_http_headers_new();
+	if (h == NULL)
+		return 0;
+
+	/** test appending records */
+	if (xnd_http_headers_set(h, "Content-Type", "application/json") != 0)
+		return 0;
+	if (xnd_http_headers_set(h, "for-user-id", "abc") != 0)
+		return 0;
+	if (xnd_http_headers_set(h, "X-Trace", "1") != 0)
+		return 0;
+	if (h->count != 3UL)
+		return 0;
+
+	/** test replacing in place with a longer and a shorter value */
+	if (xnd_http_headers_set(h, "FOR-USER-ID", "abcdefghij") != 0)
+		return 0;
+	if (strcmp(xnd_http_headers_get(h, "for-user-id"), "abcdefghij") != 0)
+		return 0;
+	if (xnd_http_headers_set(h, "content-type", "text/csv") != 0)
+		return 0;
+	if (h->count != 3UL)
+		return 0;
+
+	/** test the list handed to curl */
+	list = xnd_http_headers_slist(h);
+	if (list == NULL || strcmp(list->data, "Content-Type: text/csv") != 0)
+		return 0;
+	list = list->next;
+	if (list == NULL || strcmp(list->data, "for-user-id: abcdefghij") != 0)
+		return 0;
+	list = list->next;
+	if (list == NULL || strcmp(list->data, "X-Trace: 1") != 0)
+		return 0;
+	if (list->next != NULL)
+		return 0;
+
+	/** test the list stays cached while the set is untouched */
+	if (xnd_http_headers_slist(h) != h->list || h->dirty)
+		return 0;
+
+	/** test invalid records */
+	if (xnd_http_headers_set(h, "", "value") != -1)
+		return 0;
+	if (xnd_http_headers_set(h, "key", "") != -1)
+		return 0;
+	if (xnd_http_headers_get(h, "missing") != NULL)
+		return 0;
+
+	xnd_http_headers_destroy(h);
+
+	return 1;
+}
+
+static int
+test_xnd_http_headers_merge(void)
+{
+	xnd_http_headers_t *base, *h;
+
+	base = xnd_http_headers_new();
+	h = xnd_http_headers_new();
+	if (base == NULL || h == NULL)
+		return 0;
+
+	xnd_http_headers_set(base, "Content-Type", "application/json");
+	xnd_http_headers_set(base, "Accept", "*/*");
+
+	/** test merging into an empty set */
+	if (xnd_http_headers_merge(h, base) != 0)
+		return 0;
+	if (h->count != 2UL)
+		return 0;
+	if (strcmp(xnd_http_headers_get(h, "Accept"), "*/*") != 0)
+		return 0;
+
+	/** test merging over existing records */
+	xnd_http_headers_set(h, "for-user-id", "abc");
+	xnd_http_headers_set(base, "Accept", "application/json");
+	if (xnd_http_headers_merge(h, base) != 0)
+		return 0;
+	if (h->count != 3UL)
+		return 0;
+	if (strcmp(xnd_http_headers_get(h, "Accept"), "application/json") != 0)
+		return 0;
+	if (strcmp(xnd_http_headers_get(h, "for-user-id"), "abc") != 0)
+		return 0;
+
+	/** test reuse after clearing */
+	if (xnd_http_headers_clear(h) != 0)
+		return 0;
+	if (xnd_http_headers_slist(h) != NULL)
+		return 0;
+	if (xnd_http_headers_merge(h, base) != 0 || h->count != 2UL)
+		return 0;
+
+	xnd_http_headers_destroy(h);
+	xnd_http_headers_destroy(base);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	if (! test_xnd_http_headers_set())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_http_headers_merge())
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "http_pool.h"
+#include "http_request.h"
+#include "support/stub_server.h"
+
+static int
+test_xnd_http_pool_resolve(void)
+{
+	xnd_http_pool_t *pool;
+
+	pool = xnd_http_pool_new();
+	if (pool == NULL)
+		return 0;
+
+	/** test pinning, then re-pinning replaces the entry */
+	if (xnd_http_pool_resolve(pool, "http://localhost:8080/balance") != 0)
+		return 0;
+	if (xnd_http_pool_resolve(pool, "http://localhost:8080") != 0)
+		return 0;
+	if (pool->resolve == NULL || pool->resolve->next != NULL)
+		return 0;
+	if (strncmp(pool->resolve->data, "localhost:8080:", 15) != 0)
+		return 0;
+
+	/** test invalid URL */
+	if (xnd_http_pool_resolve(pool, "") != -1)
+		return 0;
+
+	xnd_http_pool_destroy(pool);
+
+	return 1;
+}
+
+static int
+test_xnd_http_pool_warmup(void)
+{
+	xnd_stub_t *stub;
+	xnd_http_pool_t *pool;
+	xnd_http_request_t *req;
+	xnd_string_t *res;
+
+	stub = xnd_stub_new(200, "{}");
+	pool = xnd_http_pool_new();
+	if (stub == NULL || pool == NULL)
+		return 0;
+
+	/** test opening connections ahead of time */
+	if (xnd_http_pool_keepalive(pool, 30L) != 0)
+		return 0;
+	if (xnd_http_pool_warmup(pool, xnd_stub_url(stub), 2U) != 2)
+		return 0;
+	if (xnd_stub_connections(stub) != 2UL)
+		return 0;
+	if (xnd_http_pool_probe(pool, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	/** test the request is served on a warm connection */
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, xnd_stub_url(stub));
+	if (req == NULL)
+		return 0;
+	res = xnd_string_new(NULL);
+	if (res == NULL)
+		return 0;
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+	if (xnd_http_request_send_with_data(req, (void *) &res) != 0)
+		return 0;
+	if (strcmp(res->data, "{}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_http_request_destroy(req);
+
+	if (atomic_load(&(pool->warm)) != 1UL || atomic_load(&(pool->cold)))
+		return 0;
+	if (xnd_stub_connections(stub) != 2UL)
+		return 0;
+
+	xnd_http_pool_destroy(pool);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+sidecar_get(xnd_http_pool_t *pool, xnd_stub_t *stub, char *head, size_t size)
+{
+	xnd_http_request_t *req;
+	xnd_string_t *res;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET,
+	                           "https://api.test:8443/v2/balance");
+	res = xnd_string_new(NULL);
+	if (req == NULL || res == NULL)
+		return 0;
+
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+	if (xnd_http_request_send_with_data(req, (void *) &res) != 0 ||
+	    strcmp(res->data, "{}") != 0)
+		return 0;
+
+	xnd_string_destroy(&res);
+	xnd_http_request_destroy(req);
+	xnd_stub_last_request(stub, head, size);
+
+	return 1;
+}
+
+static int
+test_xnd_http_pool_sidecar(void)
+{
+	char path[] = "/tmp/xnd-sidecar-XXXXXX", sock[64], head[1024];
+	xnd_stub_t *loopback, *unix_socket;
+	xnd_http_pool_t *pool;
+
+	if (mkdtemp(path) == NULL)
+		return 0;
+	snprintf(sock, sizeof(sock), "%s/sidecar.sock", path);
+
+	loopback = xnd_stub_new(200, "{}");
+	unix_socket = xnd_stub_new_unix(sock, 200, "{}");
+	pool = xnd_http_pool_new();
+	if (loopback == NULL || unix_socket == NULL || pool == NULL)
+		return 0;
+
+	/** test invalid endpoints */
+	if (xnd_http_pool_sidecar(pool, "unix:") != -1 ||
+	    xnd_http_pool_sidecar(pool, "http://127.0.0.1") != -1 ||
+	    xnd_http_pool_sidecar(pool, "http://:80") != -1 ||
+	    xnd_http_pool_sidecar(pool, "tcp://127.0.0.1:80") != -1)
+		return 0;
+
+	/** test sidecars off loopback are refused */
+	if (xnd_http_pool_sidecar(pool, "http://10.1.2.3:8080") != -1 ||
+	    xnd_http_pool_sidecar(pool, "http://127.0.0.1.example:80") != -1 ||
+	    xnd_http_pool_sidecar(pool, "http://localhost.example:80") != -1 ||
+	    xnd_http_pool_sidecar(pool, "http://[::2]:80") != -1 ||
+	    xnd_http_pool_sidecar(pool, "http://128.0.0.1:80") != -1)
+		return 0;
+	if (xnd_http_pool_sidecar(pool, "http://localhost:80") != 0 ||
+	    xnd_http_pool_sidecar(pool, "http://[::1]:80") != 0 ||
+	    xnd_http_pool_sidecar(pool, "http://127.1.2.3:80/") != 0)
+		return 0;
+
+	/** test plain HTTP on loopback, keeping the logical host and path */
+	if (xnd_http_pool_sidecar(pool, xnd_stub_url(loopback)) != 0)
+		return 0;
+	if (! sidecar_get(pool, loopback, head, sizeof(head)))
+		return 0;
+	if (strncmp(head, "GET /v2/balance HTTP/1.1\r\n", 26) != 0 ||
+	    strstr(head, "\r\nHost: api.test:8443\r\n") == NULL)
+		return 0;
+
+	/** test Unix domain socket */
+	if (xnd_http_pool_sidecar(pool, xnd_stub_url(unix_socket)) != 0)
+		return 0;
+	if (! sidecar_get(pool, unix_socket, head, sizeof(head)))
+		return 0;
+	if (strncmp(head, "GET /v2/balance HTTP/1.1\r\n", 26) != 0 ||
+	    strstr(head, "\r\nHost: api.test:8443\r\n") == NULL)
+		return 0;
+	if (xnd_stub_requests(loopback) != 1UL)
+		return 0;
+
+	/** test direct connections again, api.test does not resolve */
+	if (xnd_http_pool_sidecar(pool, NULL) != 0)
+		return 0;
+	if (sidecar_get(pool, unix_socket, head, sizeof(head)))
+		return 0;
+
+	xnd_http_pool_destroy(pool);
+	xnd_stub_destroy(unix_socket);
+	xnd_stub_destroy(loopback);
+	rmdir(path);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_http_request_init();
+
+	if (! test_xnd_http_pool_resolve())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_http_pool_warmup())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_http_pool_sidecar())
+		exit(EXIT_FAILURE);
+
+	xnd_http_request_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
@@ -1,9 +1,163 @@
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "http_request.h"
+#include "support/stub_server.h"
+
+static int
+test_xnd_http_request_query(void)
+{
+	xnd_http_request_t *req;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, "https://example.com");
+	if (req == NULL)
+		return 0;
+
+	/** test encoding of key and value */
+	if (xnd_http_request_query(req, "account_type", "CASH") != 0)
+		return 0;
+	if (xnd_http_request_query(req, "q", "a b&c=d") != 0)
+		return 0;
+	if (strcmp(req->queries->data, "?account_type=CASH&q=a%20b%26c%3Dd") != 0)
+		return 0;
+
+	/** test path encoding, keeping the separators */
+	if (xnd_http_request_path(req, "/v2/some id") != 0)
+		return 0;
+	if (strcmp(req->url->data, "https://example.com/v2/some%20id") != 0)
+		return 0;
+	xnd_http_request_destroy(req);
+
+	return 1;
+}
+
+/** Sends GET request to the stub, returns elapsed milliseconds. */
+static long
+timed_get(xnd_stub_t *stub, const xnd_http_limits_t *limits, int *res,
+          xnd_string_t **body)
+{
+	xnd_http_request_t *req;
+	unsigned long long start;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, xnd_stub_url(stub));
+	if (req == NULL)
+		return -1L;
+
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+	xnd_http_request_limits(req, limits);
+
+	start = xnd_http_request_now();
+	*res = xnd_http_request_send_with_data(req, (void *) body);
+	if (*res == 0 && req->status != 200L)
+		*res = (int) req->status;
+	xnd_http_request_destroy(req);
+
+	return (long) ((xnd_http_request_now() - start) / 1000000ULL);
+}
+
+static void *
+cancel_later(void *arg)
+{
+	struct timespec ts = { 0, 100000000L };
+
+	nanosleep(&ts, NULL);
+	atomic_store((atomic_int *) arg, 1);
+
+	return NULL;
+}
+
+static int
+test_xnd_http_request_limits(void)
+{
+	xnd_http_limits_t limits = { 0ULL, 0L, 0L, 0L, 0U, NULL };
+	xnd_string_t *body;
+	xnd_stub_t *stub;
+	atomic_int cancel;
+	pthread_t thread;
+	long elapsed;
+	int res;
+
+	stub = xnd_stub_new(200, "{}");
+	body = xnd_string_new(NULL);
+	if (stub == NULL || body == NULL)
+		return 0;
+
+	/** test the deadline bounds a stalled call */
+	xnd_stub_stall(stub, 1);
+	limits.deadline = xnd_http_request_now() + 200000000ULL;
+	elapsed = timed_get(stub, &limits, &res, &body);
+	if (res != -1 || elapsed < 150L || elapsed > 1000L)
+		return 0;
+
+	/** test retries share the deadline */
+	limits.deadline = xnd_http_request_now() + 300000000ULL;
+	limits.retries = 5U;
+	elapsed = timed_get(stub, &limits, &res, &body);
+	if (res != -1 || elapsed > 1000L)
+		return 0;
+
+	/** test an expired deadline does not send at all */
+	if (timed_get(stub, &limits, &res, &body) < 0L || res != -1)
+		return 0;
+
+	/** test cancellation from another thread */
+	atomic_init(&cancel, 0);
+	limits.deadline = 0ULL;
+	limits.retries = 0U;
+	limits.cancel = &cancel;
+	if (pthread_create(&thread, NULL, cancel_later, &cancel) != 0)
+		return 0;
+	elapsed = timed_get(stub, &limits, &res, &body);
+	pthread_join(thread, NULL);
+	if (res != -1 || elapsed > 2000L)
+		return 0;
+
+	/** test transient responses are retried, and not delivered */
+	xnd_stub_stall(stub, 0);
+	xnd_stub_respond(stub, 503, "busy");
+	atomic_store(&cancel, 0);
+	limits.retries = 2U;
+	limits.deadline = xnd_http_request_now() + 5000000000ULL;
+	timed_get(stub, &limits, &res, &body);
+	if (res != 503 || xnd_stub_requests(stub) != 3UL ||
+	    strcmp(body->data, "busy") != 0)
+		return 0;
+
+	/** test transient responses without a body are retried too */
+	xnd_string_clear(&body);
+	xnd_stub_respond(stub, 503, "");
+	limits.deadline = xnd_http_request_now() + 5000000000ULL;
+	timed_get(stub, &limits, &res, &body);
+	if (res != 503 || xnd_stub_requests(stub) != 6UL || body->size != 0UL)
+		return 0;
+
+	/** test non-transient responses are not retried */
+	xnd_string_clear(&body);
+	xnd_stub_respond(stub, 200, "{}");
+	timed_get(stub, &limits, &res, &body);
+	if (res != 0 || xnd_stub_requests(stub) != 7UL ||
+	    strcmp(body->data, "{}") != 0)
+		return 0;
+
+	xnd_string_destroy(&body);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
 
 int
 main(void)
 {
+	xnd_http_request_init();
+
+	if (! test_xnd_http_request_query())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_http_request_limits())
+		exit(EXIT_FAILURE);
+
+	xnd_http_request_cleanup();
+
 	exit(EXIT_SUCCESS);
 }
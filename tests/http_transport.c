@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "http_request.h"
+#include "http_transport.h"
+#include "support/stub_server.h"
+
+/** Writes a capture file at a unique path from template. */
+static int
+write_capture(char *path, const char *contents)
+{
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return -1;
+
+	if (write(fd, contents, strlen(contents)) !=
+	    (ssize_t) strlen(contents)) {
+		close(fd);
+		return -1;
+	}
+
+	return close(fd);
+}
+
+/** Sends request through transport, returns the received body. */
+static xnd_string_t *
+exchange(xnd_http_transport_t *t, const char *url, const char *user, long *status)
+{
+	xnd_http_request_t *req;
+	xnd_string_t *res;
+
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, url);
+	res = xnd_string_new(NULL);
+	if (req == NULL || res == NULL)
+		return NULL;
+
+	if (user != NULL)
+		xnd_http_request_header(req, "for-user-id", user);
+	xnd_http_request_basic_auth(req, "secret", NULL);
+	xnd_http_request_transport(req, t);
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+
+	if (xnd_http_request_send_with_data(req, (void *) &res) == -1)
+		xnd_string_destroy(&res);
+
+	*status = req->status;
+	xnd_http_request_destroy(req);
+
+	return res;
+}
+
+static int
+test_xnd_http_transport_replay(void)
+{
+	char path[] = "/tmp/xnd-replay-XXXXXX";
+	xnd_http_transport_t *t;
+	xnd_string_t *res;
+	long status;
+
+	if (write_capture(path,
+	    "# balance\n"
+	    "> GET http://api.test/balance\n"
+	    "< 200 2\n"
+	    "{}\n"
+	    "\n"
+	    "> GET http://api.test/balance\n"
+	    "< 503 0\n"
+	    "\n"
+	    "> GET http://api.test/balance\n"
+	    "> for-user-id: 42\n"
+	    "< 200 16\n"
+	    "{\"balance\":1000}\n") == -1)
+		return 0;
+
+	t = xnd_http_transport_replay_new(path);
+	unlink(path);
+	if (t == NULL)
+		return 0;
+
+	/** test records of the same request are served in turn */
+	res = exchange(t, "http://api.test/balance", NULL, &status);
+	if (res == NULL || status != 200L || strcmp(res->data, "{}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+
+	res = exchange(t, "http://api.test/balance", NULL, &status);
+	if (res == NULL || status != 503L || res->size != 0UL)
+		return 0;
+	xnd_string_destroy(&res);
+
+	/** test the last record keeps being served */
+	res = exchange(t, "http://api.test/balance", NULL, &status);
+	if (res == NULL || status != 503L)
+		return 0;
+	xnd_string_destroy(&res);
+
+	/** test matching on recorded headers */
+	res = exchange(t, "http://api.test/balance", "42", &status);
+	if (res == NULL || status != 200L ||
+	    strcmp(res->data, "{\"balance\":1000}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+
+	/** test unrecorded requests fail */
+	if (exchange(t, "http://api.test/balance?currency=IDR", NULL, &status))
+		return 0;
+
+	xnd_http_transport_destroy(t);
+
+	/** test malformed and empty captures */
+	strcpy(path, "/tmp/xnd-replay-XXXXXX");
+	if (write_capture(path, "> GET http://api.test\n< 200 9\n{}\n") == -1)
+		return 0;
+	t = xnd_http_transport_replay_new(path);
+	unlink(path);
+	if (t != NULL)
+		return 0;
+
+	strcpy(path, "/tmp/xnd-replay-XXXXXX");
+	if (write_capture(path, "# nothing\n") == -1)
+		return 0;
+	t = xnd_http_transport_replay_new(path);
+	unlink(path);
+	if (t != NULL)
+		return 0;
+
+	return 1;
+}
+
+static int
+test_xnd_http_transport_record(void)
+{
+	char path[] = "/tmp/xnd-record-XXXXXX";
+	char url[128];
+	xnd_stub_t *stub;
+	xnd_http_transport_t *t;
+	xnd_string_t *res;
+	FILE *fp;
+	char buf[512];
+	size_t n;
+	long status;
+
+	stub = xnd_stub_new(200, "{\"balance\":7}");
+	if (stub == NULL || write_capture(path, "") == -1)
+		return 0;
+	snprintf(url, sizeof(url), "%s/balance", xnd_stub_url(stub));
+
+	/** test recording against the stub */
+	t = xnd_http_transport_record_new(path, NULL);
+	if (t == NULL)
+		return 0;
+	res = exchange(t, url, "42", &status);
+	if (res == NULL || status != 200L ||
+	    strcmp(res->data, "{\"balance\":7}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_http_transport_destroy(t);
+
+	/** test credentials are not recorded */
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return 0;
+	n = fread(buf, 1UL, sizeof(buf) - 1UL, fp);
+	buf[n] = '\0';
+	fclose(fp);
+	if (strstr(buf, "Authorization") != NULL ||
+	    strstr(buf, "> for-user-id: 42\n") == NULL)
+		return 0;
+
+	/** test replaying the recording without the stub */
+	xnd_stub_destroy(stub);
+	t = xnd_http_transport_replay_new(path);
+	unlink(path);
+	if (t == NULL)
+		return 0;
+	res = exchange(t, url, "42", &status);
+	if (res == NULL || status != 200L ||
+	    strcmp(res->data, "{\"balance\":7}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_http_transport_destroy(t);
+
+	return 1;
+}
+
+/** Streams a body of repeated digits. */
+static size_t
+read_digits(char *buf, size_t size, void *data)
+{
+	size_t *left = data, n = size < *left ? size : *left;
+
+	for (size_t i = 0UL; i < n; ++i)
+		buf[i] = (char) ('0' + (*left - i) % 10UL);
+	*left -= n;
+
+	return n;
+}
+
+/** Sends request through transport and pool, returns the received body. */
+static xnd_string_t *
+uring_exchange(xnd_http_transport_t *t, xnd_http_pool_t *pool,
+               const char *method, const char *url,
+               const xnd_http_body_t *body, long *error)
+{
+	xnd_http_limits_t limits = { 0ULL, 0L, 0L, 0L, 0U, NULL };
+	xnd_http_request_t *req;
+	xnd_string_t *res;
+
+	req = xnd_http_request_new(method, url);
+	res = xnd_string_new(NULL);
+	if (req == NULL || res == NULL)
+		return NULL;
+
+	limits.deadline = xnd_http_request_now() + 200000000ULL;
+	xnd_http_request_limits(req, &limits);
+	xnd_http_request_basic_auth(req, "secret", NULL);
+	xnd_http_request_transport(req, t);
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+	if (body != NULL)
+		xnd_http_request_body(req, body);
+	else if (strcmp(method, XND_HTTP_REQUEST_POST) == 0)
+		xnd_http_request_payload(req, "{\"amount\":1}");
+
+	if (xnd_http_request_send_with_data(req, (void *) &res) == -1 ||
+	    req->status != 200L)
+		xnd_string_destroy(&res);
+
+	*error = req->error;
+	xnd_http_request_destroy(req);
+
+	return res;
+}
+
+static int
+test_xnd_http_transport_uring(void)
+{
+	const char *url = "https://api.xendit.co/balance?account_type=CASH";
+	char head[1024], body[64], path[64];
+	size_t left = 100000UL;
+	xnd_http_body_t stream = { read_digits, NULL, &left, 100000UL };
+	xnd_http_transport_t *t;
+	xnd_http_pool_t *pool;
+	xnd_stub_t *stub;
+	xnd_string_t *res;
+	long error;
+
+	/** io_uring may be unavailable, e.g. disabled in a container. */
+	t = xnd_http_transport_uring_new();
+	if (t == NULL)
+		return 1;
+
+	stub = xnd_stub_new(200, "{\"balance\":7}");
+	pool = xnd_http_pool_new();
+	if (stub == NULL || pool == NULL ||
+	    xnd_http_pool_sidecar(pool, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	/** test requests go to the sidecar in origin form, kept alive */
+	for (int i = 0; i < 10; ++i) {
+		res = uring_exchange(t, pool, XND_HTTP_REQUEST_GET, url, NULL,
+		                     &error);
+		if (res == NULL || strcmp(res->data, "{\"balance\":7}") != 0)
+			return 0;
+		xnd_string_destroy(&res);
+	}
+	xnd_stub_last_request(stub, head, sizeof(head));
+	if (strncmp(head, "GET /balance?account_type=CASH HTTP/1.1\r\n"
+	                  "Host: api.xendit.co\r\n", 59UL) != 0 ||
+	    strstr(head, "\r\nAuthorization: Basic ") == NULL ||
+	    xnd_stub_connections(stub) != 1UL ||
+	    atomic_load(&(pool->warm)) != 9UL)
+		return 0;
+
+	/** test payloads, and bodies streamed beyond the buffers */
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_POST, url, NULL, &error);
+	if (res == NULL || xnd_stub_last_body(stub, body, sizeof(body)) !=
+	    12UL || strcmp(body, "{\"amount\":1}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_POST, url, &stream,
+	                     &error);
+	if (res == NULL || left != 0UL ||
+	    xnd_stub_last_body(stub, body, sizeof(body)) != 100000UL ||
+	    strncmp(body, "0987654321", 10UL) != 0)
+		return 0;
+	xnd_string_destroy(&res);
+
+	/** test chunked responses and heads without a body */
+	xnd_stub_chunked(stub, 1);
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_GET, url, NULL, &error);
+	if (res == NULL || strcmp(res->data, "{\"balance\":7}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_stub_chunked(stub, 0);
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_HEAD, url, NULL, &error);
+	if (res == NULL || res->size != 0UL ||
+	    xnd_stub_connections(stub) != 1UL)
+		return 0;
+	xnd_string_destroy(&res);
+
+	/** test the deadline bounds a stalled sidecar, then a new connection
+	    is opened */
+	xnd_stub_stall(stub, 1);
+	if (uring_exchange(t, pool, XND_HTTP_REQUEST_GET, url, NULL,
+	                   &error) != NULL || error != CURLE_OPERATION_TIMEDOUT)
+		return 0;
+	xnd_stub_stall(stub, 0);
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_GET, url, NULL, &error);
+	if (res == NULL || xnd_stub_connections(stub) != 2UL)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_stub_destroy(stub);
+
+	/** test a connection closed by a restarted sidecar is reopened */
+	snprintf(path, sizeof(path), "/tmp/xnd-uring-%d.sock", (int) getpid());
+	stub = xnd_stub_new_unix(path, 200, "{}");
+	if (stub == NULL ||
+	    xnd_http_pool_sidecar(pool, xnd_stub_url(stub)) != 0)
+		return 0;
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_GET, url, NULL, &error);
+	if (res == NULL)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_stub_destroy(stub);
+	stub = xnd_stub_new_unix(path, 200, "{\"restarted\":1}");
+	res = uring_exchange(t, pool, XND_HTTP_REQUEST_GET, url, NULL, &error);
+	if (stub == NULL || res == NULL ||
+	    strcmp(res->data, "{\"restarted\":1}") != 0)
+		return 0;
+	xnd_string_destroy(&res);
+	xnd_stub_destroy(stub);
+
+	/** test HTTPS without a sidecar is left to curl */
+	xnd_http_pool_sidecar(pool, NULL);
+	if (uring_exchange(t, pool, XND_HTTP_REQUEST_GET,
+	                   "https://127.0.0.1:1/", NULL, &error) != NULL ||
+	    error != CURLE_COULDNT_CONNECT)
+		return 0;
+
+	xnd_http_pool_destroy(pool);
+	xnd_http_transport_destroy(t);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	if (! test_xnd_http_transport_replay())
+		exit(EXIT_FAILURE);
+
+	if (! test_xnd_http_transport_record())
+		exit(EXIT_FAILURE);
+
+	if (! test_xnd_http_transport_uring())
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
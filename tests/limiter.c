@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "limiter.h"
+
+static int
+test_xnd_limiter_aimd(void)
+{
+	xnd_limiter_t *l;
+
+	/** test invalid bounds */
+	if (xnd_limiter_new(1U, 0U, 4U, 2.0, 0L) != NULL ||
+	    xnd_limiter_new(8U, 1U, 4U, 2.0, 0L) != NULL ||
+	    xnd_limiter_new(2U, 1U, 4U, 1.0, 0L) != NULL)
+		return 0;
+
+	l = xnd_limiter_new(2U, 1U, 4U, 2.0, 0L);
+	if (l == NULL)
+		return 0;
+
+	/** test calls over the limit are rejected */
+	if (xnd_limiter_acquire(l, 0U, 0ULL) != 0 ||
+	    xnd_limiter_acquire(l, 0U, 0ULL) != 0 ||
+	    xnd_limiter_acquire(l, 0U, 0ULL) != -1)
+		return 0;
+	if (atomic_load(&(l->rejected)) != 1UL)
+		return 0;
+
+	/** test additive increase on steady latency, up to the bound */
+	for (int i = 0; i < 64; ++i) {
+		xnd_limiter_release(l, 0U, 1000000ULL, 0);
+		if (xnd_limiter_acquire(l, 0U, 0ULL) != 0)
+			return 0;
+	}
+	if (xnd_limiter_limit(l) != 4U)
+		return 0;
+
+	/** test multiplicative decrease on congestion, down to the bound */
+	xnd_limiter_release(l, 0U, 10000000ULL, 0);
+	if (xnd_limiter_limit(l) != 3U)
+		return 0;
+	for (int i = 0; i < 32; ++i) {
+		xnd_limiter_release(l, 0U, 0ULL, 1);
+		if (xnd_limiter_acquire(l, 0U, 0ULL) != 0)
+			return 0;
+	}
+	if (xnd_limiter_limit(l) != 1U)
+		return 0;
+
+	/** test aborted calls only free their slot */
+	xnd_limiter_release(l, 0U, 0ULL, 0);
+	if (l->inflight != 0U || xnd_limiter_limit(l) != 1U)
+		return 0;
+
+	xnd_limiter_destroy(l);
+
+	return 1;
+}
+
+/** Calls admitted in order, by lane. */
+typedef struct admitted_t {
+	xnd_limiter_t  *l;
+	pthread_mutex_t lock;
+	unsigned int    order[16];
+	unsigned int    n;
+} admitted_t;
+
+typedef struct call_t {
+	admitted_t  *admitted;
+	unsigned int lane;
+} call_t;
+
+static void *
+call(void *arg)
+{
+	call_t *c = arg;
+	admitted_t *a = c->admitted;
+
+	if (xnd_limiter_acquire(a->l, c->lane, 0ULL) == 0) {
+		pthread_mutex_lock(&(a->lock));
+		a->order[a->n++] = c->lane;
+		pthread_mutex_unlock(&(a->lock));
+		xnd_limiter_release(a->l, c->lane, 0ULL, 0);
+	}
+
+	return NULL;
+}
+
+static int
+test_xnd_limiter_lanes(void)
+{
+	unsigned int weights[XND_LIMITER_LANES] = { 4U, 1U };
+	struct timespec ts = { 0, 1000000L };
+	admitted_t a = { NULL, PTHREAD_MUTEX_INITIALIZER, { 0U }, 0U };
+	call_t calls[10];
+	pthread_t threads[10];
+	unsigned int interactive = 0U, waiting;
+	xnd_limiter_t *l;
+
+	l = xnd_limiter_new(4U, 4U, 4U, 2.0, 0L);
+	if (l == NULL)
+		return 0;
+
+	/** test invalid lanes */
+	if (xnd_limiter_lanes(l, weights, 1.0) != -1 ||
+	    xnd_limiter_acquire(l, XND_LIMITER_LANES, 0ULL) != -1)
+		return 0;
+
+	/** test bulk calls never take the reserved share */
+	if (xnd_limiter_lanes(l, weights, 0.5) != 0 ||
+	    xnd_limiter_acquire(l, 1U, 0ULL) != 0 ||
+	    xnd_limiter_acquire(l, 1U, 0ULL) != 0 ||
+	    xnd_limiter_acquire(l, 1U, 0ULL) != -1 ||
+	    xnd_limiter_acquire(l, 0U, 0ULL) != 0 ||
+	    xnd_limiter_acquire(l, 0U, 0ULL) != 0 ||
+	    xnd_limiter_acquire(l, 0U, 0ULL) != -1)
+		return 0;
+	if (atomic_load(&(l->lanes[1].rejected)) != 1UL ||
+	    atomic_load(&(l->lanes[0].rejected)) != 1UL ||
+	    l->lanes[0].admitted != 2UL || l->lanes[1].inflight != 2U)
+		return 0;
+	for (int i = 0; i < 4; ++i)
+		xnd_limiter_release(l, i < 2 ? 1U : 0U, 0ULL, 0);
+	xnd_limiter_destroy(l);
+
+	/** test waiting calls are given slots in proportion to their weight */
+	l = xnd_limiter_new(1U, 1U, 1U, 2.0, 5000L);
+	if (l == NULL || xnd_limiter_lanes(l, weights, 0.0) != 0 ||
+	    xnd_limiter_acquire(l, 1U, 0ULL) != 0)
+		return 0;
+	a.l = l;
+	for (int i = 0; i < 10; ++i) {
+		calls[i].admitted = &a;
+		calls[i].lane = i < 5 ? 0U : 1U;
+		if (pthread_create(&(threads[i]), NULL, call, &(calls[i])) != 0)
+			return 0;
+	}
+	do {
+		nanosleep(&ts, NULL);
+		pthread_mutex_lock(&(l->lock));
+		waiting = l->lanes[0].waiting + l->lanes[1].waiting;
+		pthread_mutex_unlock(&(l->lock));
+	} while (waiting < 10U);
+	xnd_limiter_release(l, 1U, 0ULL, 0);
+	for (int i = 0; i < 10; ++i)
+		pthread_join(threads[i], NULL);
+
+	for (int i = 0; i < 5; ++i)
+		interactive += a.order[i] == 0U;
+	if (a.n != 10U || interactive < 4U)
+		return 0;
+
+	/** test waits are accounted per lane */
+	if (l->lanes[0].admitted != 5UL || l->lanes[1].admitted != 6UL ||
+	    l->lanes[1].longest == 0ULL ||
+	    xnd_limiter_wait_p99(l, 1U) < l->lanes[1].longest / 2ULL)
+		return 0;
+	xnd_limiter_destroy(l);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	if (! test_xnd_limiter_aimd())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_limiter_lanes())
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,364 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "xendit.h"
+#include "support/stub_server.h"
+
+/** Completions seen. */
+typedef struct done_t {
+	pthread_mutex_t lock;
+	unsigned long   calls;
+	int             ok;
+} done_t;
+
+static void
+on_done(const char *key, long status, const char *body, void *data)
+{
+	done_t *done = data;
+
+	pthread_mutex_lock(&(done->lock));
+	++(done->calls);
+	if (strncmp(key, "k-", 2UL) != 0 || status != 200L ||
+	    strcmp(body, "{\"id\":\"d-1\"}") != 0)
+		done->ok = 0;
+	pthread_mutex_unlock(&(done->lock));
+}
+
+/** Counts the log files of a directory. */
+static int
+count_logs(const char *dir)
+{
+	struct dirent *ent;
+	int n = 0;
+	DIR *d;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return -1;
+	while ((ent = readdir(d)) != NULL)
+		if (strstr(ent->d_name, ".log") != NULL)
+			++n;
+	closedir(d);
+
+	return n;
+}
+
+/** Removes a log directory. */
+static void
+remove_dir(const char *dir)
+{
+	struct dirent *ent;
+	char path[512];
+	DIR *d;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return;
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		unlink(path);
+	}
+	closedir(d);
+	rmdir(dir);
+}
+
+int
+test_xnd_outbox_send(void)
+{
+	xnd_outbox_options_t options = { 2U, 0.0, 100U, 0L, 4096UL, 0, on_done,
+	                                 NULL };
+	char dir[] = "/tmp/xnd-outbox-XXXXXX";
+	done_t done = { PTHREAD_MUTEX_INITIALIZER, 0UL, 1 };
+	char key[32], body[64], req[1024];
+	xnd_outbox_stats_t stats;
+	xnd_outbox_t *o;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+
+	options.data = &done;
+	stub = xnd_stub_new(200, "{\"id\":\"d-1\"}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL || mkdtemp(dir) == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) == -1)
+		return 0;
+
+	o = xnd_outbox_open(x, dir, &options);
+	if (o == NULL || xnd_outbox_open(x, dir, &options) != NULL)
+		return 0;
+
+	if (xnd_outbox_enqueue(o, "POST", "disbursements", "k-a", NULL) !=
+	    XND_OUTBOX_FAILED ||
+	    xnd_outbox_enqueue(o, "POST", "/disbursements", "", NULL) !=
+	    XND_OUTBOX_FAILED)
+		return 0;
+
+	for (int i = 0; i < 50; ++i) {
+		snprintf(key, sizeof(key), "k-%d", i);
+		snprintf(body, sizeof(body), "{\"amount\":%d}", i + 1);
+		if (xnd_outbox_enqueue(o, "POST", "/disbursements", key,
+		                       body) != XND_OUTBOX_QUEUED)
+			return 0;
+	}
+	if (xnd_outbox_enqueue(o, "POST", "/disbursements", "k-7", "{}") !=
+	    XND_OUTBOX_DUPLICATE)
+		return 0;
+
+	if (xnd_outbox_flush(o, 5000L) == -1 || xnd_stub_requests(stub) != 50UL)
+		return 0;
+
+	/** Done requests are still known by key. */
+	if (xnd_outbox_enqueue(o, "POST", "/disbursements", "k-49", "{}") !=
+	    XND_OUTBOX_DUPLICATE)
+		return 0;
+
+	xnd_stub_last_request(stub, req, sizeof(req));
+	if (strncmp(req, "POST /disbursements ", 20UL) != 0 ||
+	    strstr(req, "X-IDEMPOTENCY-KEY: k-") == NULL)
+		return 0;
+	xnd_stub_last_body(stub, body, sizeof(body));
+	if (strncmp(body, "{\"amount\":", 10UL) != 0)
+		return 0;
+
+	/** Segments of done requests are deleted, but the last one. */
+	if (xnd_outbox_stats(o, &stats) == -1 || stats.queued != 50UL ||
+	    stats.duplicates != 2UL || stats.sent != 50UL ||
+	    stats.pending != 0UL || stats.replayed != 0UL ||
+	    stats.segments != 1UL || count_logs(dir) != 1)
+		return 0;
+
+	pthread_mutex_lock(&(done.lock));
+	if (done.calls != 50UL || !done.ok)
+		return 0;
+	pthread_mutex_unlock(&(done.lock));
+
+	xnd_outbox_close(o);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+	remove_dir(dir);
+
+	return 1;
+}
+
+int
+test_xnd_outbox_replay(void)
+{
+	xnd_outbox_options_t options = { 1U, 2.0, 100U, 0L, 0UL, 1, NULL,
+	                                 NULL };
+	char dir[] = "/tmp/xnd-outbox-XXXXXX", path[64];
+	xnd_outbox_stats_t stats;
+	xnd_outbox_t *o;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	int status, fd;
+	pid_t pid;
+
+	stub = xnd_stub_new(200, "{}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL || mkdtemp(dir) == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) == -1)
+		return 0;
+
+	/** The child dies once the first of three requests is done, the
+	    others paced behind it. */
+	pid = fork();
+	if (pid == -1)
+		return 0;
+	if (pid == 0) {
+		o = xnd_outbox_open(x, dir, &options);
+		if (o == NULL ||
+		    xnd_outbox_enqueue(o, "POST", "/a", "r-1", "{}") !=
+		    XND_OUTBOX_QUEUED ||
+		    xnd_outbox_enqueue(o, "POST", "/a", "r-2", "{}") !=
+		    XND_OUTBOX_QUEUED ||
+		    xnd_outbox_enqueue(o, "POST", "/a", "r-3", NULL) !=
+		    XND_OUTBOX_QUEUED)
+			_exit(EXIT_FAILURE);
+		do {
+			usleep(1000);
+			xnd_outbox_stats(o, &stats);
+		} while (stats.sent == 0UL);
+		_exit(EXIT_SUCCESS);
+	}
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS ||
+	    xnd_stub_requests(stub) != 1UL)
+		return 0;
+
+	/** test a crash between creating a segment and sizing it does not
+	    keep the queue from opening, the empty segment is dropped */
+	snprintf(path, sizeof(path), "%s/00000001.log", dir);
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1)
+		return 0;
+	close(fd);
+
+	/** Only the requests left pending are sent again. */
+	options.rate = 0.0;
+	o = xnd_outbox_open(x, dir, &options);
+	if (o == NULL || access(path, F_OK) != -1)
+		return 0;
+	if (o == NULL || xnd_outbox_flush(o, 5000L) == -1 ||
+	    xnd_stub_requests(stub) != 3UL ||
+	    xnd_outbox_stats(o, &stats) == -1 || stats.replayed != 2UL ||
+	    stats.sent != 2UL ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "r-1", "{}") !=
+	    XND_OUTBOX_DUPLICATE)
+		return 0;
+
+	xnd_outbox_close(o);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+	remove_dir(dir);
+
+	return 1;
+}
+
+int
+test_xnd_outbox_backpressure(void)
+{
+	xnd_outbox_options_t options = { 1U, 0.0, 2U, 0L, 0UL, 0, NULL, NULL };
+	char dir[] = "/tmp/xnd-outbox-XXXXXX";
+	unsigned long long start;
+	xnd_outbox_stats_t stats;
+	struct timespec ts;
+	xnd_outbox_t *o;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+
+	stub = xnd_stub_new(503, "{}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL || mkdtemp(dir) == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) == -1)
+		return 0;
+
+	o = xnd_outbox_open(x, dir, &options);
+	if (o == NULL ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "b-1", "{}") !=
+	    XND_OUTBOX_QUEUED ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "b-2", "{}") !=
+	    XND_OUTBOX_QUEUED ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "b-3", "{}") != XND_OUTBOX_BUSY)
+		return 0;
+	xnd_outbox_close(o);
+
+	/** Past the mark, it waits for room before turning requests down. */
+	options.wait_ms = 50L;
+	o = xnd_outbox_open(x, dir, &options);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = (unsigned long long) ts.tv_sec * 1000000000ULL +
+	        (unsigned long long) ts.tv_nsec;
+	if (o == NULL ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "b-3", "{}") != XND_OUTBOX_BUSY)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	if ((unsigned long long) ts.tv_sec * 1000000000ULL +
+	    (unsigned long long) ts.tv_nsec - start < 50000000ULL)
+		return 0;
+
+	/** Server errors are sent again until answered. */
+	for (int i = 0; i < 200; ++i) {
+		if (xnd_outbox_stats(o, &stats) == -1)
+			return 0;
+		if (stats.retries > 0UL)
+			break;
+		usleep(10000);
+	}
+	xnd_stub_respond(stub, 200, "{}");
+	if (stats.retries == 0UL || stats.replayed != 2UL ||
+	    xnd_outbox_flush(o, 5000L) == -1 ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "b-3", "{}") !=
+	    XND_OUTBOX_QUEUED || xnd_outbox_flush(o, 5000L) == -1 ||
+	    xnd_outbox_stats(o, &stats) == -1 || stats.busy != 1UL ||
+	    stats.sent != 3UL)
+		return 0;
+
+	xnd_outbox_close(o);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+	remove_dir(dir);
+
+	return 1;
+}
+
+int
+test_xnd_outbox_fork(void)
+{
+	xnd_outbox_options_t options = { 2U, 0.0, 10U, 0L, 0UL, 0, NULL, NULL };
+	char dir[] = "/tmp/xnd-outbox-XXXXXX";
+	xnd_outbox_stats_t stats;
+	xnd_outbox_t *o;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	int status;
+	pid_t pid;
+
+	stub = xnd_stub_new(503, "{}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL || mkdtemp(dir) == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) == -1)
+		return 0;
+
+	o = xnd_outbox_open(x, dir, &options);
+	if (o == NULL ||
+	    xnd_outbox_enqueue(o, "POST", "/a", "f-1", "{}") !=
+	    XND_OUTBOX_QUEUED)
+		return 0;
+
+	/** test a child closes the queue without joining the senders of the
+	    parent, nor touching its log */
+	pid = fork();
+	if (pid == -1)
+		return 0;
+	if (pid == 0) {
+		alarm(10U);
+		xnd_outbox_close(o);
+		xnd_client_destroy(x);
+		_exit(EXIT_SUCCESS);
+	}
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS)
+		return 0;
+
+	/** test the parent still holds the log, and sends its request */
+	xnd_stub_respond(stub, 200, "{}");
+	if (xnd_outbox_open(x, dir, &options) != NULL ||
+	    count_logs(dir) != 1 || xnd_outbox_flush(o, 5000L) == -1 ||
+	    xnd_outbox_stats(o, &stats) == -1 || stats.sent != 1UL)
+		return 0;
+
+	xnd_outbox_close(o);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+	remove_dir(dir);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_outbox_send())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_outbox_replay())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_outbox_backpressure())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_outbox_fork())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sink.h"
+#include "xendit.h"
+#include "support/stub_server.h"
+
+#define BODY_SIZE (2621440UL)
+
+/** Fills a body whose bytes tell their offset apart. */
+static char *
+make_body(size_t size)
+{
+	char *body = malloc(size + 1UL);
+
+	if (body == NULL)
+		return NULL;
+	for (size_t i = 0UL; i < size; ++i)
+		body[i] = (char) ('a' + (i * 7UL + i / 4099UL) % 26UL);
+	body[size] = '\0';
+
+	return body;
+}
+
+/** Compares a file with a body. */
+static int
+same_file(const char *path, const char *body, size_t size)
+{
+	FILE *f = fopen(path, "r");
+	char buf[4096];
+	size_t n, off = 0UL;
+
+	if (f == NULL)
+		return 0;
+	while ((n = fread(buf, 1UL, sizeof(buf), f)) > 0UL) {
+		if (off + n > size || memcmp(buf, body + off, n) != 0)
+			break;
+		off += n;
+	}
+	fclose(f);
+
+	return off == size;
+}
+
+typedef struct chunks_t {
+	size_t calls;
+	size_t largest;
+	size_t size;
+} chunks_t;
+
+static int
+count_chunk(const char *chunk, size_t size, void *data)
+{
+	chunks_t *chunks = data;
+
+	(void) chunk;
+	++chunks->calls;
+	chunks->size += size;
+	if (size > chunks->largest)
+		chunks->largest = size;
+
+	return chunks->size > 200000UL ? -1 : 0;
+}
+
+static int
+test_xnd_sink_write(const char *body)
+{
+	char path[] = "/tmp/xnd-sink-XXXXXX";
+	chunks_t chunks = { 0UL, 0UL, 0UL };
+	xnd_sink_t *sink;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return 0;
+
+	/** test small chunks are buffered and large ones written through */
+	sink = xnd_sink_fd(fd, 0UL);
+	if (sink == NULL)
+		return 0;
+	for (size_t off = 0UL; off < 100000UL; off += 1000UL)
+		if (xnd_sink_write(sink, body + off, 1000UL) != 0)
+			return 0;
+	if (xnd_sink_write(sink, body + 100000UL, 200000UL) != 0 ||
+	    xnd_sink_flush(sink) != 0 || xnd_sink_size(sink) != 300000UL)
+		return 0;
+	xnd_sink_destroy(sink);
+	close(fd);
+	if (! same_file(path, body, 300000UL))
+		return 0;
+
+	/** test the maximum body size aborts before going past it */
+	sink = xnd_sink_mmap(path, 5000UL);
+	if (sink == NULL)
+		return 0;
+	if (xnd_sink_write(sink, body, 4000UL) != 0 ||
+	    xnd_sink_write(sink, body + 4000UL, 1001UL) != -1 ||
+	    xnd_sink_write(sink, body + 4000UL, 1UL) != -1)
+		return 0;
+	xnd_sink_destroy(sink);
+	if (! same_file(path, body, 4000UL))
+		return 0;
+
+	/** test memory-mapped sinks slide past their window */
+	sink = xnd_sink_mmap(path, 0UL);
+	if (sink == NULL)
+		return 0;
+	for (size_t off = 0UL; off < BODY_SIZE; off += 16384UL)
+		if (xnd_sink_write(sink, body + off, 16384UL) != 0)
+			return 0;
+	if (xnd_sink_flush(sink) != 0 || ! same_file(path, body, BODY_SIZE))
+		return 0;
+	xnd_sink_destroy(sink);
+
+	/** test callback sinks get bounded chunks and may abort */
+	sink = xnd_sink_callback(count_chunk, &chunks, 0UL);
+	if (sink == NULL)
+		return 0;
+	for (size_t off = 0UL; off < 150000UL; off += 1500UL)
+		if (xnd_sink_write(sink, body + off, 1500UL) != 0)
+			return 0;
+	if (xnd_sink_flush(sink) != 0 || chunks.size != 150000UL ||
+	    chunks.largest > XND_SINK_BUFFER || chunks.calls != 3UL)
+		return 0;
+	if (xnd_sink_write(sink, body, 100000UL) != -1)
+		return 0;
+	xnd_sink_destroy(sink);
+
+	unlink(path);
+
+	return 1;
+}
+
+static int
+test_xnd_client_download(const char *body)
+{
+	char path[] = "/tmp/xnd-download-XXXXXX", head[1024];
+	struct stat st;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	xnd_sink_t *sink;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		return 0;
+	close(fd);
+
+	stub = xnd_stub_new(200, body);
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	/** test a body is streamed into a file */
+	sink = xnd_sink_mmap(path, 0UL);
+	if (sink == NULL ||
+	    xnd_client_download(x, XND_BASEURL "/reports/1", sink) != 0)
+		return 0;
+	xnd_sink_destroy(sink);
+	xnd_stub_last_request(stub, head, sizeof(head));
+	if (! same_file(path, body, BODY_SIZE) ||
+	    strstr(head, "\r\nAuthorization: Basic ") == NULL)
+		return 0;
+
+	/** test the API key is not sent to another host, nor to a host
+	    extending the name of the API's */
+	sink = xnd_sink_mmap(path, 0UL);
+	if (sink == NULL ||
+	    xnd_client_download(x, "https://files.example.test/r/1", sink) !=
+	    0)
+		return 0;
+	xnd_sink_destroy(sink);
+	xnd_stub_last_request(stub, head, sizeof(head));
+	if (! same_file(path, body, BODY_SIZE) ||
+	    strstr(head, "Authorization") != NULL)
+		return 0;
+
+	sink = xnd_sink_mmap(path, 0UL);
+	if (sink == NULL ||
+	    xnd_client_download(x, XND_BASEURL ".example.test/r/1", sink) !=
+	    0)
+		return 0;
+	xnd_sink_destroy(sink);
+	xnd_stub_last_request(stub, head, sizeof(head));
+	if (strstr(head, "Authorization") != NULL)
+		return 0;
+
+	/** test bodies over the maximum size abort the download */
+	sink = xnd_sink_mmap(path, BODY_SIZE / 2UL);
+	if (sink == NULL ||
+	    xnd_client_download(x, XND_BASEURL "/reports/1", sink) != -1 ||
+	    xnd_sink_size(sink) > BODY_SIZE / 2UL)
+		return 0;
+	xnd_sink_destroy(sink);
+
+	/** test error bodies do not reach the sink */
+	xnd_stub_respond(stub, 404, "{\"error_code\":\"NOT_FOUND\"}");
+	sink = xnd_sink_mmap(path, 0UL);
+	if (sink == NULL ||
+	    xnd_client_download(x, XND_BASEURL "/reports/2", sink) != -1)
+		return 0;
+	xnd_sink_destroy(sink);
+	if (stat(path, &st) != 0 || st.st_size != 0)
+		return 0;
+
+	unlink(path);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	char *body;
+	int ok;
+
+	body = make_body(BODY_SIZE);
+	if (body == NULL)
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_init();
+
+	ok = test_xnd_sink_write(body) && test_xnd_client_download(body);
+
+	xnd_sdk_cleanup();
+	free(body);
+
+	if (! ok)
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -207,6 +207,93 @@ test_xnd_string_zeroize(void)
 	return 1;
 }
 
+static int
+test_xnd_string_encode(void)
+{
+	xnd_string_t *s;
+	const char *safe = "abcdefghijklmnopqrstuvwxyz-ABCDEFGHIJKLMNOPQRSTUVWXYZ_"
+	                   "0123456789.~";
+
+	/** test already-safe string, longer than a SIMD block */
+	s = xnd_string_new("?");
+	if (s == NULL)
+		return 0;
+	if (xnd_string_encoded_size(safe, __SIZE_MAX__,
+	                            XND_STRING_ENCODE_QUERY) != strlen(safe))
+		return 0;
+	if (xnd_string_encode(&s, safe, XND_STRING_ENCODE_QUERY) != 0)
+		return 0;
+	if (s->size != strlen(safe) + 1UL || strcmp(s->data + 1, safe) != 0)
+		return 0;
+	xnd_string_destroy(&s);
+
+	/** test reserved, space and non-ASCII characters */
+	s = xnd_string_new(NULL);
+	if (s == NULL)
+		return 0;
+	if (xnd_string_encoded_size("a b&c=d/\xc3\xa9", __SIZE_MAX__,
+	                            XND_STRING_ENCODE_QUERY) != 22UL)
+		return 0;
+	if (xnd_string_encode(&s, "a b&c=d/\xc3\xa9", XND_STRING_ENCODE_QUERY))
+		return 0;
+	if (strcmp(s->data, "a%20b%26c%3Dd%2F%C3%A9") != 0)
+		return 0;
+	xnd_string_destroy(&s);
+
+	/** test unsafe byte past the first SIMD block */
+	s = xnd_string_new(NULL);
+	if (s == NULL)
+		return 0;
+	if (xnd_string_encode(&s, "0123456789abcdefghij klmnop/qr",
+	                      XND_STRING_ENCODE_PATH) != 0)
+		return 0;
+	if (strcmp(s->data, "0123456789abcdefghij%20klmnop/qr") != 0)
+		return 0;
+	xnd_string_destroy(&s);
+
+	/** test sized encoding */
+	s = xnd_string_new(NULL);
+	if (s == NULL)
+		return 0;
+	if (xnd_string_sized_encode(&s, "a b c", 3UL,
+	                            XND_STRING_ENCODE_QUERY) != 0)
+		return 0;
+	if (strcmp(s->data, "a%20b") != 0)
+		return 0;
+	xnd_string_destroy(&s);
+
+	return 1;
+}
+
+static int
+test_xnd_string_base64(void)
+{
+	xnd_string_t *s;
+
+	s = xnd_string_new("Basic ");
+	if (s == NULL)
+		return 0;
+
+	/** test padding of every remainder */
+	if (xnd_string_base64(&s, "key:", 4UL) != 0)
+		return 0;
+	if (strcmp(s->data, "Basic a2V5Og==") != 0)
+		return 0;
+	xnd_string_clear(&s);
+	if (xnd_string_base64(&s, "key:1", 5UL) != 0)
+		return 0;
+	if (strcmp(s->data, "a2V5OjE=") != 0)
+		return 0;
+	xnd_string_clear(&s);
+	if (xnd_string_base64(&s, "key:12", 6UL) != 0)
+		return 0;
+	if (strcmp(s->data, "a2V5OjEy") != 0)
+		return 0;
+	xnd_string_destroy(&s);
+
+	return 1;
+}
+
 int
 main(void)
 {
@@ -220,6 +307,10 @@ main(void)
 		exit(EXIT_FAILURE);
 	if (! test_xnd_string_zeroize())
 		exit(EXIT_FAILURE);
+	if (! test_xnd_string_encode())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_string_base64())
+		exit(EXIT_FAILURE);
 
 	exit(EXIT_SUCCESS);
 }
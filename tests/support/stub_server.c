@@ -0,0 +1,466 @@
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "stub_server.h"
+
+#define XND_STUB_MAX_CONNECTIONS (64)
+#define XND_STUB_BUFFER_SIZE     (16384)
+#define XND_STUB_BODY_SIZE       (65536)
+
+typedef struct xnd_stub_conn_t {
+	int    fd;
+	size_t size;
+	size_t skip; /** Request body bytes yet to be read. */
+	int    pending; /** Head read, answered once the body is in. */
+	int    head;    /** Whether the request is a HEAD. */
+	char   buf[XND_STUB_BUFFER_SIZE];
+} xnd_stub_conn_t;
+
+struct xnd_stub_t {
+	int              listener;
+	int              wake[2];
+	pthread_t        thread;
+	pthread_mutex_t  lock;
+	int              status;
+	int              stall;  /** Leaves requests unanswered. */
+	int              chunked; /** Sends bodies in chunks. */
+	char            *body;
+	char             url[128];
+	char             last[1024]; /** Head of the last request. */
+	char             lastbody[XND_STUB_BODY_SIZE]; /** Its body, cut. */
+	size_t           lastbodysz; /** Full size of its body. */
+	atomic_ulong     connections;
+	atomic_ulong     requests;
+	xnd_stub_conn_t  conns[XND_STUB_MAX_CONNECTIONS];
+};
+
+/** Finds the value of a header, the key given lowercase with a colon. */
+static const char *
+xnd_stub_header(const char *head, size_t size, const char *key)
+{
+	size_t keylen = strlen(key), j;
+
+	for (size_t i = 0; i + 2 + keylen < size; ++i) {
+		if (head[i] != '\r' || head[i + 1] != '\n')
+			continue;
+		for (j = 0; j < keylen; ++j)
+			if (tolower((unsigned char) head[i + 2 + j]) != key[j])
+				break;
+		if (j == keylen)
+			return head + i + 2 + keylen;
+	}
+
+	return NULL;
+}
+
+/** Answers with the canned body in chunks of 5 bytes, and a trailer. */
+static int
+xnd_stub_answer_chunked(xnd_stub_t *stub, xnd_stub_conn_t *c)
+{
+	size_t bodysz = strlen(stub->body), size = 0;
+	char *buf;
+	int res = 0;
+
+	buf = malloc(bodysz * 3 + 256);
+	if (buf == NULL)
+		return -1;
+
+	size += (size_t) sprintf(buf, "HTTP/1.1 %d Stub\r\n"
+	                              "Transfer-Encoding: chunked\r\n"
+	                              "\r\n", stub->status);
+	for (size_t i = 0; !c->head && i < bodysz; i += 5) {
+		size_t n = bodysz - i < 5 ? bodysz - i : 5;
+
+		size += (size_t) sprintf(buf + size, "%zx%s\r\n", n,
+		                         i == 0 ? ";ext=1" : "");
+		memcpy(buf + size, stub->body + i, n);
+		size += n;
+		memcpy(buf + size, "\r\n", 2);
+		size += 2;
+	}
+	if (!c->head)
+		size += (size_t) sprintf(buf + size,
+		                         "0\r\nX-Trailer: 1\r\n\r\n");
+
+	if (write(c->fd, buf, size) != (ssize_t) size)
+		res = -1;
+	free(buf);
+
+	return res;
+}
+
+static int
+xnd_stub_answer(xnd_stub_t *stub, xnd_stub_conn_t *c)
+{
+	char header[256];
+	struct iovec iov[2];
+	size_t bodysz;
+	int n;
+
+	pthread_mutex_lock(&stub->lock);
+	/** Counted first, clients may be done as soon as it is sent. */
+	atomic_fetch_add(&stub->requests, 1UL);
+	if (stub->chunked) {
+		n = xnd_stub_answer_chunked(stub, c);
+		pthread_mutex_unlock(&stub->lock);
+		return n;
+	}
+	bodysz = strlen(stub->body);
+	n = snprintf(header, sizeof(header),
+	             "HTTP/1.1 %d Stub\r\n"
+	             "Content-Type: application/json\r\n"
+	             "Content-Length: %zu\r\n"
+	             "\r\n", stub->status, bodysz);
+	/** One write, lest Nagle hold the body for a delayed ACK. */
+	if (c->head)
+		bodysz = 0;
+	iov[0].iov_base = header;
+	iov[0].iov_len = (size_t) n;
+	iov[1].iov_base = stub->body;
+	iov[1].iov_len = bodysz;
+	if (writev(c->fd, iov, 2) != (ssize_t) ((size_t) n + bodysz)) {
+		pthread_mutex_unlock(&stub->lock);
+		return -1;
+	}
+	pthread_mutex_unlock(&stub->lock);
+
+	return 0;
+}
+
+static int
+xnd_stub_serve(xnd_stub_t *stub, xnd_stub_conn_t *c)
+{
+	static const char go_on[] = "HTTP/1.1 100 Continue\r\n\r\n";
+	const char *value;
+	char *end;
+	size_t headsz, take, keep, off;
+	int n;
+
+	for (;;) {
+		if (c->pending) {
+			take = c->skip < c->size ? c->skip : c->size;
+
+			pthread_mutex_lock(&stub->lock);
+			off = stub->lastbodysz < sizeof(stub->lastbody) - 1 ?
+			      stub->lastbodysz : sizeof(stub->lastbody) - 1;
+			keep = sizeof(stub->lastbody) - 1 - off;
+			if (keep > take)
+				keep = take;
+			memcpy(stub->lastbody + off, c->buf, keep);
+			stub->lastbody[off + keep] = '\0';
+			stub->lastbodysz += take;
+			pthread_mutex_unlock(&stub->lock);
+
+			memmove(c->buf, c->buf + take, c->size - take);
+			c->size -= take;
+			c->skip -= take;
+			if (c->skip > 0)
+				return 0;
+
+			c->pending = 0;
+			if (xnd_stub_answer(stub, c) == -1)
+				return -1;
+		}
+
+		end = memmem(c->buf, c->size, "\r\n\r\n", 4);
+		if (end == NULL)
+			return c->size < sizeof(c->buf) ? 0 : -1;
+
+		headsz = (size_t) (end - c->buf) + 4;
+
+		pthread_mutex_lock(&stub->lock);
+		if (stub->stall) {
+			pthread_mutex_unlock(&stub->lock);
+			c->size = 0;
+			return 0;
+		}
+		n = headsz < sizeof(stub->last) ? (int) headsz
+		                                : (int) sizeof(stub->last) - 1;
+		memcpy(stub->last, c->buf, (size_t) n);
+		stub->last[n] = '\0';
+		stub->lastbody[0] = '\0';
+		stub->lastbodysz = 0;
+		pthread_mutex_unlock(&stub->lock);
+
+		value = xnd_stub_header(c->buf, headsz, "content-length:");
+		c->skip = value != NULL ? strtoul(value, NULL, 10) : 0;
+		c->head = strncmp(c->buf, "HEAD ", 5) == 0;
+		c->pending = 1;
+
+		value = xnd_stub_header(c->buf, headsz, "expect:");
+		if (value != NULL && c->skip > 0 &&
+		    strncmp(value, " 100-continue", 13) == 0 &&
+		    write(c->fd, go_on, sizeof(go_on) - 1) !=
+		    (ssize_t) sizeof(go_on) - 1)
+			return -1;
+
+		memmove(c->buf, c->buf + headsz, c->size - headsz);
+		c->size -= headsz;
+	}
+}
+
+static void *
+xnd_stub_loop(void *arg)
+{
+	xnd_stub_t *stub = arg;
+	struct pollfd fds[XND_STUB_MAX_CONNECTIONS + 2];
+
+	for (;;) {
+		nfds_t n = 0;
+
+		fds[n].fd = stub->wake[0];
+		fds[n++].events = POLLIN;
+		fds[n].fd = stub->listener;
+		fds[n++].events = POLLIN;
+		for (int i = 0; i < XND_STUB_MAX_CONNECTIONS; ++i) {
+			fds[n].fd = stub->conns[i].fd;
+			fds[n++].events = POLLIN;
+		}
+
+		if (poll(fds, n, -1) < 0)
+			continue;
+
+		if (fds[0].revents)
+			break;
+
+		if (fds[1].revents & POLLIN) {
+			int fd = accept(stub->listener, NULL, NULL);
+
+			for (int i = 0; fd >= 0 && i < XND_STUB_MAX_CONNECTIONS; ++i) {
+				if (stub->conns[i].fd < 0) {
+					stub->conns[i].fd = fd;
+					stub->conns[i].size = 0;
+					stub->conns[i].skip = 0;
+					stub->conns[i].pending = 0;
+					atomic_fetch_add(&stub->connections, 1UL);
+					fd = -1;
+				}
+			}
+			if (fd >= 0)
+				close(fd);
+		}
+
+		for (int i = 0; i < XND_STUB_MAX_CONNECTIONS; ++i) {
+			xnd_stub_conn_t *c = &stub->conns[i];
+			ssize_t r;
+
+			if (c->fd < 0 || !fds[i + 2].revents)
+				continue;
+
+			r = read(c->fd, c->buf + c->size, sizeof(c->buf) - c->size);
+			if (r <= 0 ||
+			    (c->size += (size_t) r, xnd_stub_serve(stub, c)) == -1) {
+				close(c->fd);
+				c->fd = -1;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/** Starts serving on a bound listener, takes ownership of the stub. */
+static xnd_stub_t *
+xnd_stub_start(xnd_stub_t *stub)
+{
+	if (stub->listener < 0 || listen(stub->listener, 128) < 0 ||
+	    pipe(stub->wake) < 0) {
+		if (stub->listener >= 0)
+			close(stub->listener);
+		free(stub->body);
+		free(stub);
+		return NULL;
+	}
+
+	if (pthread_create(&stub->thread, NULL, xnd_stub_loop, stub) != 0) {
+		close(stub->listener);
+		close(stub->wake[0]);
+		close(stub->wake[1]);
+		free(stub->body);
+		free(stub);
+		return NULL;
+	}
+
+	return stub;
+}
+
+static xnd_stub_t *
+xnd_stub_alloc(int status, const char *body)
+{
+	xnd_stub_t *stub;
+
+	stub = calloc(1, sizeof(xnd_stub_t));
+	if (stub == NULL)
+		return NULL;
+
+	stub->status = status;
+	stub->body = strdup(body != NULL ? body : "");
+	for (int i = 0; i < XND_STUB_MAX_CONNECTIONS; ++i)
+		stub->conns[i].fd = -1;
+	pthread_mutex_init(&stub->lock, NULL);
+
+	return stub;
+}
+
+xnd_stub_t *
+xnd_stub_new(int status, const char *body)
+{
+	xnd_stub_t *stub;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	stub = xnd_stub_alloc(status, body);
+	if (stub == NULL)
+		return NULL;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	stub->listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (stub->listener >= 0 &&
+	    (bind(stub->listener, (struct sockaddr *) &addr, len) < 0 ||
+	     getsockname(stub->listener, (struct sockaddr *) &addr,
+	                 &len) < 0)) {
+		close(stub->listener);
+		stub->listener = -1;
+	}
+
+	snprintf(stub->url, sizeof(stub->url), "http://127.0.0.1:%u",
+	         (unsigned int) ntohs(addr.sin_port));
+
+	return xnd_stub_start(stub);
+}
+
+xnd_stub_t *
+xnd_stub_new_unix(const char *path, int status, const char *body)
+{
+	xnd_stub_t *stub;
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return NULL;
+
+	stub = xnd_stub_alloc(status, body);
+	if (stub == NULL)
+		return NULL;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	stub->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (stub->listener >= 0 &&
+	    bind(stub->listener, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		close(stub->listener);
+		stub->listener = -1;
+	}
+
+	snprintf(stub->url, sizeof(stub->url), "unix:%s", path);
+
+	return xnd_stub_start(stub);
+}
+
+void
+xnd_stub_destroy(xnd_stub_t *stub)
+{
+	if (stub == NULL)
+		return;
+
+	if (write(stub->wake[1], "x", 1) == 1)
+		pthread_join(stub->thread, NULL);
+
+	for (int i = 0; i < XND_STUB_MAX_CONNECTIONS; ++i)
+		if (stub->conns[i].fd >= 0)
+			close(stub->conns[i].fd);
+
+	close(stub->listener);
+	close(stub->wake[0]);
+	close(stub->wake[1]);
+	if (strncmp(stub->url, "unix:", 5) == 0)
+		unlink(stub->url + 5);
+	pthread_mutex_destroy(&stub->lock);
+	free(stub->body);
+	free(stub);
+}
+
+void
+xnd_stub_respond(xnd_stub_t *stub, int status, const char *body)
+{
+	char *copy = strdup(body != NULL ? body : "");
+
+	pthread_mutex_lock(&stub->lock);
+	free(stub->body);
+	stub->status = status;
+	stub->body = copy;
+	pthread_mutex_unlock(&stub->lock);
+}
+
+void
+xnd_stub_stall(xnd_stub_t *stub, int stall)
+{
+	pthread_mutex_lock(&stub->lock);
+	stub->stall = stall;
+	pthread_mutex_unlock(&stub->lock);
+}
+
+void
+xnd_stub_chunked(xnd_stub_t *stub, int chunked)
+{
+	pthread_mutex_lock(&stub->lock);
+	stub->chunked = chunked;
+	pthread_mutex_unlock(&stub->lock);
+}
+
+const char *
+xnd_stub_url(const xnd_stub_t *stub)
+{
+	return stub->url;
+}
+
+unsigned long
+xnd_stub_connections(const xnd_stub_t *stub)
+{
+	return atomic_load(&stub->connections);
+}
+
+unsigned long
+xnd_stub_requests(const xnd_stub_t *stub)
+{
+	return atomic_load(&stub->requests);
+}
+
+void
+xnd_stub_last_request(xnd_stub_t *stub, char *buf, size_t size)
+{
+	pthread_mutex_lock(&stub->lock);
+	snprintf(buf, size, "%s", stub->last);
+	pthread_mutex_unlock(&stub->lock);
+}
+
+size_t
+xnd_stub_last_body(xnd_stub_t *stub, char *buf, size_t size)
+{
+	size_t bodysz;
+
+	pthread_mutex_lock(&stub->lock);
+	snprintf(buf, size, "%s", stub->lastbody);
+	bodysz = stub->lastbodysz;
+	pthread_mutex_unlock(&stub->lock);
+
+	return bodysz;
+}
@@ -0,0 +1,103 @@
+#ifndef XND_TESTS_STUB_SERVER_H
+#define XND_TESTS_STUB_SERVER_H 1
+
+#include <stddef.h>
+
+/**
+ * \brief Local HTTP/1.1 keep-alive stub server for tests, serving one canned
+ * response on a loopback port from a background thread.
+ */
+typedef struct xnd_stub_t xnd_stub_t;
+
+/**
+ * \brief Starts new stub server on an ephemeral loopback port.
+ * \param status The HTTP status of the canned response.
+ * \param body The body of the canned response.
+ * \return NULL on failure.
+ */
+extern xnd_stub_t *
+xnd_stub_new(int status, const char *body);
+
+/**
+ * \brief Starts new stub server on a Unix domain socket.
+ * \param path The path of the socket, replaced if it exists.
+ * \param status The HTTP status of the canned response.
+ * \param body The body of the canned response.
+ * \return NULL on failure.
+ */
+extern xnd_stub_t *
+xnd_stub_new_unix(const char *path, int status, const char *body);
+
+/**
+ * \brief Stops and destroys stub server.
+ * \param stub The stub server to destroy.
+ */
+extern void
+xnd_stub_destroy(xnd_stub_t *stub);
+
+/**
+ * \brief Changes the canned response of the stub server.
+ * \param stub The stub server.
+ * \param status The HTTP status of the canned response.
+ * \param body The body of the canned response.
+ */
+extern void
+xnd_stub_respond(xnd_stub_t *stub, int status, const char *body);
+
+/**
+ * \brief Makes the stub server leave requests unanswered, as a stalled peer
+ * would, or answer them again.
+ * \param stub The stub server.
+ * \param stall Whether to stall.
+ */
+extern void
+xnd_stub_stall(xnd_stub_t *stub, int stall);
+
+/**
+ * \brief Makes the stub server send its canned body in chunks, with
+ * "Transfer-Encoding: chunked", or with a Content-Length again.
+ * \param stub The stub server.
+ * \param chunked Whether to send chunks.
+ */
+extern void
+xnd_stub_chunked(xnd_stub_t *stub, int chunked);
+
+/**
+ * \brief Retrieves the base URL of the stub server, e.g.
+ * "http://127.0.0.1:12345", or "unix:/path" for Unix domain socket stubs.
+ */
+extern const char *
+xnd_stub_url(const xnd_stub_t *stub);
+
+/**
+ * \brief Retrieves the number of connections accepted so far.
+ */
+extern unsigned long
+xnd_stub_connections(const xnd_stub_t *stub);
+
+/**
+ * \brief Retrieves the number of requests served so far.
+ */
+extern unsigned long
+xnd_stub_requests(const xnd_stub_t *stub);
+
+/**
+ * \brief Copies the request line and headers of the last request served.
+ * \param stub The stub server.
+ * \param buf The buffer receiving the NUL-terminated request head.
+ * \param size The size of the buffer.
+ */
+extern void
+xnd_stub_last_request(xnd_stub_t *stub, char *buf, size_t size);
+
+/**
+ * \brief Copies the body of the last request served, cut to 64 KiB.
+ * \param stub The stub server.
+ * \param buf The buffer receiving the NUL-terminated body.
+ * \param size The size of the buffer.
+ * \return The full size of the body.
+ */
+extern size_t
+xnd_stub_last_body(xnd_stub_t *stub, char *buf, size_t size);
+
+#endif
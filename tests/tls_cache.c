@@ -0,0 +1,327 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "http_request.h"
+#include "tls_cache.h"
+
+/** Exit status of a child which could not run a command, as sh(1) does. */
+#define NOT_FOUND (127)
+
+/** Exit status of a child whose libcurl cannot export sessions. */
+#define UNAVAILABLE (2)
+
+static int
+count_session(const char *key, const unsigned char *shmac, size_t shmac_len,
+              const unsigned char *data, size_t data_len, void *userdata)
+{
+	(void) shmac;
+	(void) shmac_len;
+
+	if (key != NULL && strcmp(key, "api.xendit.co:443") == 0 &&
+	    data_len == 4UL && memcmp(data, "new!", 4UL) == 0)
+		++*((int *) userdata);
+
+	return 0;
+}
+
+static int
+test_xnd_tls_cache_put(const char *path)
+{
+	xnd_tls_cache_t *c;
+	unsigned char shmac[32] = { 1, 2, 3 };
+	int64_t later = (int64_t) time(NULL) + 3600;
+	int found = 0;
+
+	c = xnd_tls_cache_open(path, 0L);
+	if (c == NULL)
+		return 0;
+
+	/** test storing and replacing sessions of the same key */
+	if (xnd_tls_cache_put(c, "api.xendit.co:443", NULL, 0UL,
+	                      (const unsigned char *) "old!", 4UL, later) != 0)
+		return 0;
+	if (xnd_tls_cache_put(c, "api.xendit.co:443", NULL, 0UL,
+	                      (const unsigned char *) "new!", 4UL, later) != 0)
+		return 0;
+	if (xnd_tls_cache_put(c, NULL, shmac, sizeof(shmac),
+	                      (const unsigned char *) "salt", 4UL, later) != 0)
+		return 0;
+	if (xnd_tls_cache_foreach(c, count_session, &found) != 2 || found != 1)
+		return 0;
+
+	/** test expired and unkeyed sessions are rejected */
+	if (xnd_tls_cache_put(c, "expired:443", NULL, 0UL,
+	                      (const unsigned char *) "data", 4UL,
+	                      (int64_t) time(NULL) - 1) != -1)
+		return 0;
+	if (xnd_tls_cache_put(c, NULL, NULL, 0UL,
+	                      (const unsigned char *) "data", 4UL, later) != -1)
+		return 0;
+
+	xnd_tls_cache_close(c);
+
+	return 1;
+}
+
+static int
+test_xnd_tls_cache_persist(const char *path)
+{
+	xnd_tls_cache_t *c;
+	pid_t pid;
+	int status, found = 0;
+
+	/** test sessions written by another process survive its exit */
+	pid = fork();
+	if (pid == -1)
+		return 0;
+
+	if (pid == 0) {
+		c = xnd_tls_cache_open(path, 60L);
+		if (c == NULL)
+			_exit(EXIT_FAILURE);
+		if (xnd_tls_cache_put(c, "other.host:443", NULL, 0UL,
+		                      (const unsigned char *) "data", 4UL,
+		                      (int64_t) time(NULL) + 3600) != 0)
+			_exit(EXIT_FAILURE);
+		xnd_tls_cache_close(c);
+		_exit(EXIT_SUCCESS);
+	}
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS)
+		return 0;
+
+	c = xnd_tls_cache_open(path, 0L);
+	if (c == NULL)
+		return 0;
+	if (xnd_tls_cache_foreach(c, count_session, &found) != 3 || found != 1)
+		return 0;
+	xnd_tls_cache_close(c);
+
+	return 1;
+}
+
+/** Runs a command, quietly, returns its pid or -1. */
+static pid_t
+spawn(char *const argv[])
+{
+	pid_t pid;
+	int fd;
+
+	pid = fork();
+	if (pid == 0) {
+		fd = open("/dev/null", O_RDWR);
+		if (fd != -1) {
+			dup2(fd, STDIN_FILENO);
+			dup2(fd, STDOUT_FILENO);
+			dup2(fd, STDERR_FILENO);
+		}
+		execvp(argv[0], argv);
+		_exit(NOT_FOUND);
+	}
+
+	return pid;
+}
+
+/** Waits for a child, returns its exit status or -1. */
+static int
+reap(pid_t pid)
+{
+	int status;
+
+	if (pid == -1 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return -1;
+
+	return WEXITSTATUS(status);
+}
+
+/** Picks a free port on loopback. */
+static unsigned short
+free_port(void)
+{
+	struct sockaddr_in addr = { .sin_family = AF_INET };
+	socklen_t size = sizeof(addr);
+	unsigned short port = 0U;
+	int fd;
+
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return 0U;
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+	    getsockname(fd, (struct sockaddr *) &addr, &size) == 0)
+		port = ntohs(addr.sin_port);
+	close(fd);
+
+	return port;
+}
+
+/** Waits up to 10 seconds for a server to listen on a loopback port. */
+static int
+listening(unsigned short port)
+{
+	struct sockaddr_in addr = { .sin_family = AF_INET };
+	struct timespec ts = { 0, 50000000L };
+	int fd, ok = 0;
+
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	for (int i = 0; i < 200 && !ok; ++i) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd == -1)
+			return 0;
+		ok = connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+		close(fd);
+		if (!ok)
+			nanosleep(&ts, NULL);
+	}
+
+	return ok;
+}
+
+/** Sends the first request of a fresh process with the session cache,
+    exits with UNAVAILABLE if sessions cannot be exported. The stub answers
+    with a summary of the handshake, "New, ..." or "Reused, ...". */
+static void
+first_request(const char *url, const char *cafile, const char *cache,
+              int resume)
+{
+	xnd_http_pool_t *pool;
+	xnd_http_request_t *req;
+	xnd_string_t *body;
+	int n, ok;
+
+	xnd_http_request_init();
+
+	pool = xnd_http_pool_new();
+	req = xnd_http_request_new(XND_HTTP_REQUEST_GET, url);
+	body = xnd_string_new(NULL);
+	if (pool == NULL || req == NULL || body == NULL ||
+	    xnd_http_pool_cainfo(pool, cafile) == -1)
+		_exit(EXIT_FAILURE);
+
+	n = xnd_http_pool_tls_cache(pool, cache, 0L);
+	if (n == -1)
+		_exit(UNAVAILABLE);
+
+	xnd_http_request_pool(req, pool);
+	xnd_http_request_callback(req, xnd_http_request_default_callback);
+	ok = xnd_http_request_send_with_data(req, (void *) &body) == 0 &&
+	     req->status == 200L &&
+	     (resume ? n > 0 && strstr(body->data, "\nReused, ") != NULL
+	             : n == 0 && strstr(body->data, "\nNew, ") != NULL);
+
+	xnd_string_destroy(&body);
+	xnd_http_request_destroy(req);
+	xnd_http_pool_destroy(pool);
+	xnd_http_request_cleanup();
+
+	_exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static int
+test_xnd_tls_cache_resume(void)
+{
+	char dir[] = "/tmp/xnd_tls_stub_XXXXXX", cert[64], key[64], cache[64];
+	char accept[32], url[64];
+	char *req[] = {
+		"openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes",
+		"-days", "1", "-subj", "/CN=127.0.0.1",
+		"-addext", "subjectAltName=IP:127.0.0.1",
+		"-keyout", key, "-out", cert, NULL
+	};
+	char *server[] = {
+		"openssl", "s_server", "-quiet", "-www", "-accept", accept,
+		"-cert", cert, "-key", key, NULL
+	};
+	pid_t stub, pid;
+	unsigned short port;
+	int status = -1;
+
+	/** Sessions are exported from libcurl 8.12.0 on. */
+	if (curl_version_info(CURLVERSION_NOW)->version_num < 0x080c00) {
+		fprintf(stderr, "skipped TLS resumption, libcurl < 8.12.0\n");
+		return 1;
+	}
+
+	if (mkdtemp(dir) == NULL)
+		return 0;
+	snprintf(cert, sizeof(cert), "%s/cert.pem", dir);
+	snprintf(key, sizeof(key), "%s/key.pem", dir);
+	snprintf(cache, sizeof(cache), "%s/tls.cache", dir);
+
+	/** A throwaway self-signed certificate, as bench/tls_session.sh */
+	status = reap(spawn(req));
+	if (status == NOT_FOUND) {
+		fprintf(stderr, "skipped TLS resumption, no openssl\n");
+		rmdir(dir);
+		return 1;
+	}
+	if (status != 0 || (port = free_port()) == 0U)
+		return 0;
+
+	snprintf(accept, sizeof(accept), "127.0.0.1:%hu", port);
+	snprintf(url, sizeof(url), "https://127.0.0.1:%hu/", port);
+	stub = spawn(server);
+	if (stub == -1)
+		return 0;
+
+	/** test a second process resumes the session stored by the first */
+	status = -1;
+	if (listening(port)) {
+		for (int resume = 0; resume < 2; ++resume) {
+			pid = fork();
+			if (pid == 0)
+				first_request(url, cert, cache, resume);
+			status = reap(pid);
+			if (status != EXIT_SUCCESS)
+				break;
+		}
+	}
+
+	kill(stub, SIGTERM);
+	reap(stub);
+	unlink(cache);
+	unlink(cert);
+	unlink(key);
+	rmdir(dir);
+
+	if (status == UNAVAILABLE) {
+		fprintf(stderr, "skipped TLS resumption, no session export\n");
+		return 1;
+	}
+
+	return status == EXIT_SUCCESS;
+}
+
+int
+main(void)
+{
+	char path[] = "/tmp/xnd_tls_cache_XXXXXX";
+	int fd, ok;
+
+	fd = mkstemp(path);
+	if (fd == -1)
+		exit(EXIT_FAILURE);
+	close(fd);
+
+	ok = test_xnd_tls_cache_put(path) && test_xnd_tls_cache_persist(path);
+	unlink(path);
+
+	if (ok && ! test_xnd_tls_cache_resume())
+		ok = 0;
+
+	if (! ok)
+		exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,248 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xendit.h"
+#include "support/stub_server.h"
+
+/** Callbacks of a subscription. */
+typedef struct seen_t {
+	pthread_mutex_t lock;
+	int             calls;
+	double          last;
+	char            currency[8];
+} seen_t;
+
+static void
+on_balance(const char *for_user_id, const char *account_type,
+           const char *currency, double balance, void *data)
+{
+	seen_t *seen = data;
+
+	(void) for_user_id;
+	(void) account_type;
+
+	pthread_mutex_lock(&(seen->lock));
+	++(seen->calls);
+	seen->last = balance;
+	strcpy(seen->currency, currency ? currency : "");
+	pthread_mutex_unlock(&(seen->lock));
+}
+
+static int
+calls(seen_t *seen, double *last)
+{
+	int n;
+
+	pthread_mutex_lock(&(seen->lock));
+	n = seen->calls;
+	if (last != NULL)
+		*last = seen->last;
+	pthread_mutex_unlock(&(seen->lock));
+
+	return n;
+}
+
+static void
+sleep_ms(long ms)
+{
+	struct timespec ts = { ms / 1000L, (ms % 1000L) * 1000000L };
+
+	nanosleep(&ts, NULL);
+}
+
+/** Waits until a subscription was called back a number of times. */
+static int
+wait_calls(seen_t *seen, int n)
+{
+	for (int i = 0; i < 200; ++i) {
+		if (calls(seen, NULL) >= n)
+			return 1;
+		sleep_ms(10L);
+	}
+
+	return 0;
+}
+
+static int
+test_xnd_watch(void)
+{
+	xnd_watcher_options_t options = { 20L, 100L, 2U };
+	seen_t a = { PTHREAD_MUTEX_INITIALIZER, 0, 0.0, "" };
+	seen_t b = { PTHREAD_MUTEX_INITIALIZER, 0, 0.0, "" };
+	seen_t c = { PTHREAD_MUTEX_INITIALIZER, 0, 0.0, "" };
+	xnd_watcher_stats_t stats;
+	xnd_watcher_t *w;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	double last;
+	int ida, idb, idc;
+
+	stub = xnd_stub_new(200, "{\"balance\":1}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	if (xnd_watcher_new(NULL, &options) != NULL ||
+	    xnd_watcher_new(x, NULL) != NULL)
+		return 0;
+
+	w = xnd_watcher_new(x, &options);
+	if (w == NULL)
+		return 0;
+
+	/** test subscribers get the first balance once */
+	ida = xnd_watch(w, NULL, "CASH", "IDR", on_balance, &a);
+	idb = xnd_watch(w, "", "CASH", "IDR", on_balance, &b);
+	idc = xnd_watch(w, NULL, "CASH", "USD", on_balance, &c);
+	if (ida < 0 || idb < 0 || idc < 0 || xnd_watch(w, NULL, NULL, NULL,
+	                                               NULL, NULL) != -1)
+		return 0;
+	if (!wait_calls(&a, 1) || !wait_calls(&b, 1) || !wait_calls(&c, 1))
+		return 0;
+	sleep_ms(200L);
+	if (calls(&a, &last) != 1 || last != 1.0 || calls(&b, NULL) != 1 ||
+	    calls(&c, NULL) != 1 || strcmp(c.currency, "USD") != 0)
+		return 0;
+
+	/** test a balance is polled once for all of its subscribers, less
+	    often as it stays unchanged */
+	if (xnd_watcher_stats(w, &stats) != 0 || stats.batches == 0UL ||
+	    stats.batches > stats.polls || stats.notifications != 3UL ||
+	    stats.polls > 2UL * (300UL / 20UL))
+		return 0;
+
+	/** test subscribers are called back on change only */
+	if (xnd_unwatch(w, idc) != 0 || xnd_unwatch(w, idc) != -1)
+		return 0;
+	xnd_stub_respond(stub, 200, "{\"balance\":2}");
+	if (!wait_calls(&a, 2) || !wait_calls(&b, 2))
+		return 0;
+	sleep_ms(150L);
+	if (calls(&a, &last) != 2 || last != 2.0 || calls(&b, NULL) != 2 ||
+	    calls(&c, NULL) != 1)
+		return 0;
+
+	xnd_watcher_destroy(w);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+/** Unsubscribes from within its own callback. */
+static void
+on_balance_once(const char *for_user_id, const char *account_type,
+                const char *currency, double balance, void *data)
+{
+	void **args = data;
+
+	on_balance(for_user_id, account_type, currency, balance, args[1]);
+	xnd_unwatch(args[0], *(int *) args[2]);
+}
+
+static int
+test_xnd_unwatch_from_callback(void)
+{
+	xnd_watcher_options_t options = { 20L, 40L, 1U };
+	seen_t a = { PTHREAD_MUTEX_INITIALIZER, 0, 0.0, "" };
+	xnd_watcher_t *w;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	void *args[3];
+	int id;
+
+	stub = xnd_stub_new(200, "{\"balance\":1}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	w = xnd_watcher_new(x, &options);
+	if (w == NULL)
+		return 0;
+
+	args[0] = w;
+	args[1] = &a;
+	args[2] = &id;
+	id = xnd_watch(w, NULL, NULL, NULL, on_balance_once, args);
+	if (id < 0 || !wait_calls(&a, 1))
+		return 0;
+
+	/** test it is not called back after unsubscribing */
+	xnd_stub_respond(stub, 200, "{\"balance\":2}");
+	sleep_ms(200L);
+	if (calls(&a, NULL) != 1 || xnd_unwatch(w, id) != -1)
+		return 0;
+
+	xnd_watcher_destroy(w);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_watcher_fork(void)
+{
+	xnd_watcher_options_t options = { 20L, 40L, 2U };
+	seen_t a = { PTHREAD_MUTEX_INITIALIZER, 0, 0.0, "" };
+	xnd_watcher_t *w;
+	xnd_client_t *x;
+	xnd_stub_t *stub;
+	pid_t pid;
+	int status;
+
+	stub = xnd_stub_new(200, "{\"balance\":1}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	w = xnd_watcher_new(x, &options);
+	if (w == NULL || xnd_watch(w, NULL, NULL, NULL, on_balance, &a) < 0 ||
+	    !wait_calls(&a, 1))
+		return 0;
+
+	/** test a child destroys the watcher without joining the threads of
+	    the parent */
+	pid = fork();
+	if (pid == -1)
+		return 0;
+	if (pid == 0) {
+		alarm(10U);
+		xnd_watcher_destroy(w);
+		xnd_client_destroy(x);
+		_exit(EXIT_SUCCESS);
+	}
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS)
+		return 0;
+
+	xnd_watcher_destroy(w);
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_watch())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_unwatch_from_callback())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_watcher_fork())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
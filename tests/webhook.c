@@ -0,0 +1,329 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xendit.h"
+
+#define INVOICE \
+	"{\"id\":\"579c8d61f23fa4ca35e52da4\",\"external_id\":\"inv-1\"," \
+	"\"user_id\":\"5781d19b2e2385880609791c\",\"is_high\":true," \
+	"\"payment_method\":\"BANK_TRANSFER\",\"status\":\"PAID\"," \
+	"\"merchant_name\":\"Xendit\",\"amount\":50000," \
+	"\"paid_amount\":50000,\"bank_code\":\"PERMATA\"," \
+	"\"paid_at\":\"2016-10-12T08:15:03.404Z\"," \
+	"\"payer_email\":\"a@b.c\",\"description\":\"Say \\\"hi\\\"\"," \
+	"\"items\":[{\"name\":\"}\",\"qty\":1}],\"currency\":\"IDR\"," \
+	"\"payment_channel\":\"PERMATA\"}"
+
+#define DISBURSEMENT \
+	"{\"id\":\"57e214ba82b034c325e84d6e\",\"user_id\":\"u\"," \
+	"\"external_id\":\"d-1\",\"amount\":150000,\"bank_code\":\"BCA\"," \
+	"\"account_holder_name\":\"MICHAEL CHEN\"," \
+	"\"disbursement_description\":\"Refund\",\"status\":\"FAILED\"," \
+	"\"failure_code\":\"INVALID_DESTINATION\",\"is_instant\":false}"
+
+/** Events handled. */
+typedef struct seen_t {
+	pthread_mutex_t lock;
+	unsigned long   calls;
+	int             ok;
+	pthread_mutex_t *gate;
+} seen_t;
+
+static int
+span_is(xnd_span_t span, const char *str)
+{
+	return span.data != NULL && span.size == strlen(str) &&
+	       memcmp(span.data, str, span.size) == 0;
+}
+
+static void
+on_invoice(const xnd_event_t *event, void *data)
+{
+	seen_t *seen = data;
+	int ok;
+
+	ok = event->type == XND_EVENT_INVOICE &&
+	     span_is(event->id, "579c8d61f23fa4ca35e52da4") &&
+	     span_is(event->status, "PAID") &&
+	     span_is(event->currency, "IDR") &&
+	     span_is(event->description, "Say \\\"hi\\\"") &&
+	     span_is(event->invoice.payment_channel, "PERMATA") &&
+	     event->amount == 50000.0 &&
+	     event->invoice.paid_amount == 50000.0 &&
+	     event->disbursement.account_holder_name.data == NULL &&
+	     event->payload.size == strlen(INVOICE);
+
+	pthread_mutex_lock(&(seen->lock));
+	++(seen->calls);
+	seen->ok = seen->ok && ok;
+	pthread_mutex_unlock(&(seen->lock));
+}
+
+static void
+on_disbursement(const xnd_event_t *event, void *data)
+{
+	seen_t *seen = data;
+	int ok;
+
+	/** Holds the worker while the gate is locked */
+	if (seen->gate != NULL) {
+		pthread_mutex_lock(seen->gate);
+		pthread_mutex_unlock(seen->gate);
+	}
+
+	ok = event->type == XND_EVENT_DISBURSEMENT &&
+	     span_is(event->external_id, "d-1") &&
+	     span_is(event->description, "Refund") &&
+	     span_is(event->disbursement.failure_code, "INVALID_DESTINATION") &&
+	     event->disbursement.is_instant == 0 && event->amount == 150000.0;
+
+	pthread_mutex_lock(&(seen->lock));
+	++(seen->calls);
+	seen->ok = seen->ok && ok;
+	pthread_mutex_unlock(&(seen->lock));
+}
+
+static unsigned long
+calls(seen_t *seen)
+{
+	unsigned long n;
+
+	pthread_mutex_lock(&(seen->lock));
+	n = seen->calls;
+	pthread_mutex_unlock(&(seen->lock));
+
+	return n;
+}
+
+static int
+test_xnd_webhook_submit(void)
+{
+	xnd_webhook_options_t options = { 4U, 64U, 1000L };
+	seen_t invoices = { PTHREAD_MUTEX_INITIALIZER, 0UL, 1, NULL };
+	seen_t disbursements = { PTHREAD_MUTEX_INITIALIZER, 0UL, 1, NULL };
+	xnd_webhook_stats_t stats;
+	xnd_webhook_t *w;
+	char body[sizeof(INVOICE)];
+
+	if (xnd_webhook_new(NULL) != NULL)
+		return 0;
+
+	w = xnd_webhook_new(&options);
+	if (w == NULL || xnd_webhook_token(w, "old-token") != 0 ||
+	    xnd_webhook_token(w, "new-token") != 0 ||
+	    xnd_webhook_token(w, "") != -1 ||
+	    xnd_webhook_handler(w, XND_EVENT_INVOICE, on_invoice,
+	                        &invoices) != 0 ||
+	    xnd_webhook_handler(w, XND_EVENT_DISBURSEMENT, on_disbursement,
+	                        &disbursements) != 0)
+		return 0;
+
+	/** test tokens are checked, any accepted one goes */
+	if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, NULL, INVOICE,
+	                       strlen(INVOICE)) != XND_WEBHOOK_FORBIDDEN ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-toke", INVOICE,
+	                       strlen(INVOICE)) != XND_WEBHOOK_FORBIDDEN ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-tokens", INVOICE,
+	                       strlen(INVOICE)) != XND_WEBHOOK_FORBIDDEN ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "old-token", INVOICE,
+	                       strlen(INVOICE)) != XND_WEBHOOK_ACCEPTED)
+		return 0;
+
+	/** test payloads are bound, their buffer reusable right away */
+	for (int i = 0; i < 1000; ++i) {
+		memcpy(body, INVOICE, sizeof(body));
+		if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-token", body,
+		                       strlen(body)) != XND_WEBHOOK_ACCEPTED)
+			return 0;
+		memset(body, 'x', sizeof(body));
+	}
+	if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-token",
+	                       DISBURSEMENT, strlen(DISBURSEMENT)) !=
+	    XND_WEBHOOK_ACCEPTED)
+		return 0;
+
+	/** test malformed payloads are turned down */
+	if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-token", INVOICE,
+	                       strlen(INVOICE) - 1UL) != XND_WEBHOOK_INVALID ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-token",
+	                       "{\"status\":\"PAID\"}", 17UL) !=
+	    XND_WEBHOOK_INVALID ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "new-token",
+	                       "{\"id\":\"1\" \"x\":1}", 16UL) !=
+	    XND_WEBHOOK_INVALID)
+		return 0;
+
+	xnd_webhook_destroy(w);
+
+	if (invoices.calls != 1001UL || !invoices.ok ||
+	    disbursements.calls != 1UL || !disbursements.ok)
+		return 0;
+
+	/** test statistics */
+	w = xnd_webhook_new(&options);
+	if (w == NULL || xnd_webhook_token(w, "t") != 0 ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "t", "{\"id\":\"1\"}",
+	                       10UL) != XND_WEBHOOK_ACCEPTED ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "x", "{}", 2UL) !=
+	    XND_WEBHOOK_FORBIDDEN ||
+	    xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "t", "{}", 2UL) !=
+	    XND_WEBHOOK_INVALID)
+		return 0;
+	if (xnd_webhook_stats(w, &stats) != 0 || stats.accepted != 1UL ||
+	    stats.forbidden != 1UL || stats.invalid != 1UL ||
+	    stats.busy != 0UL)
+		return 0;
+	xnd_webhook_destroy(w);
+
+	return 1;
+}
+
+static int
+test_xnd_webhook_http(void)
+{
+	xnd_webhook_options_t options = { 1U, 4U, 0L };
+	seen_t invoices = { PTHREAD_MUTEX_INITIALIZER, 0UL, 1, NULL };
+	xnd_webhook_t *w;
+	char req[2048];
+	int size;
+
+	w = xnd_webhook_new(&options);
+	if (w == NULL || xnd_webhook_token(w, "secret") != 0 ||
+	    xnd_webhook_handler(w, XND_EVENT_INVOICE, on_invoice,
+	                        &invoices) != 0)
+		return 0;
+
+	/** test headers are read case-insensitively, the body is sized */
+	size = snprintf(req, sizeof(req),
+	                "POST /callbacks/invoice HTTP/1.1\r\n"
+	                "Host: example.com\r\n"
+	                "X-CALLBACK-TOKEN:  secret \r\n"
+	                "Content-Type: application/json\r\n"
+	                "Content-Length: %zu\r\n\r\n%s",
+	                strlen(INVOICE), INVOICE);
+	if (xnd_webhook_submit_http(w, XND_EVENT_INVOICE, req,
+	                            (size_t) size) != XND_WEBHOOK_ACCEPTED)
+		return 0;
+
+	/** test a truncated body and a missing token */
+	if (xnd_webhook_submit_http(w, XND_EVENT_INVOICE, req,
+	                            (size_t) size - 1UL) !=
+	    XND_WEBHOOK_INVALID ||
+	    xnd_webhook_submit_http(w, XND_EVENT_INVOICE,
+	                            "POST / HTTP/1.1\r\n\r\n{\"id\":\"1\"}",
+	                            29UL) != XND_WEBHOOK_FORBIDDEN)
+		return 0;
+
+	xnd_webhook_destroy(w);
+
+	if (invoices.calls != 1UL || !invoices.ok)
+		return 0;
+
+	return 1;
+}
+
+static int
+test_xnd_webhook_backpressure(void)
+{
+	xnd_webhook_options_t options = { 1U, 2U, 0L };
+	pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+	seen_t disbursements = { PTHREAD_MUTEX_INITIALIZER, 0UL, 1, &gate };
+	struct timespec ts = { 0, 1000000L };
+	xnd_webhook_stats_t stats;
+	xnd_webhook_t *w;
+	int busy = 0;
+
+	w = xnd_webhook_new(&options);
+	if (w == NULL || xnd_webhook_token(w, "t") != 0 ||
+	    xnd_webhook_handler(w, XND_EVENT_DISBURSEMENT, on_disbursement,
+	                        &disbursements) != 0)
+		return 0;
+
+	/** test a full queue turns callbacks down while the handler is held */
+	pthread_mutex_lock(&gate);
+	if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "t", DISBURSEMENT,
+	                       strlen(DISBURSEMENT)) != XND_WEBHOOK_ACCEPTED)
+		return 0;
+	do {
+		nanosleep(&ts, NULL);
+		xnd_webhook_stats(w, &stats);
+	} while (stats.queued != 0U);
+	for (int i = 0; i < 7; ++i)
+		if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "t", DISBURSEMENT,
+		                       strlen(DISBURSEMENT)) ==
+		    XND_WEBHOOK_BUSY)
+			++busy;
+	if (busy != 5 || xnd_webhook_stats(w, &stats) != 0 ||
+	    stats.queued != 2U || stats.busy != 5UL || stats.accepted != 3UL)
+		return 0;
+	pthread_mutex_unlock(&gate);
+
+	/** test queued events are handled, then callbacks go through again */
+	while (calls(&disbursements) < 3UL)
+		nanosleep(&ts, NULL);
+	if (xnd_webhook_submit(w, XND_EVENT_UNKNOWN, "t", DISBURSEMENT,
+	                       strlen(DISBURSEMENT)) != XND_WEBHOOK_ACCEPTED)
+		return 0;
+
+	xnd_webhook_destroy(w);
+
+	if (!disbursements.ok)
+		return 0;
+
+	return 1;
+}
+
+static int
+test_xnd_webhook_fork(void)
+{
+	xnd_webhook_options_t options = { 2U, 4U, 0L };
+	xnd_webhook_t *w;
+	pid_t pid;
+	int status;
+
+	w = xnd_webhook_new(&options);
+	if (w == NULL || xnd_webhook_token(w, "t") != 0)
+		return 0;
+
+	/** test a child destroys the receiver without joining the workers of
+	    the parent */
+	pid = fork();
+	if (pid == -1)
+		return 0;
+	if (pid == 0) {
+		alarm(10U);
+		xnd_webhook_destroy(w);
+		_exit(EXIT_SUCCESS);
+	}
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS)
+		return 0;
+
+	xnd_webhook_destroy(w);
+
+	return 1;
+}
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_webhook_submit())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_webhook_http())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_webhook_backpressure())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_webhook_fork())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
+	exit(EXIT_SUCCESS);
+}
@@ -1,9 +1,319 @@
+#include <pthread.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "xendit.h"
+#include "support/stub_server.h"
+
+static void *
+stalled_balance(void *arg)
+{
+	xnd_balance_t balance;
+
+	xnd_balance(arg, NULL, NULL, NULL, &balance);
+
+	return NULL;
+}
+
+/** Calls of each thread sharing a client. */
+#define SHARED_CALLS (100)
+
+static void *
+shared_balance(void *arg)
+{
+	xnd_balance_t balance;
+
+	for (int i = 0; i < SHARED_CALLS; ++i)
+		if (xnd_balance(arg, i % 2 ? "u-1" : NULL, "CASH", NULL,
+		                &balance) != 0 || balance.balance != 1.0)
+			return arg;
+
+	return NULL;
+}
+
+static int
+test_xnd_client_breaker(void)
+{
+	xnd_breaker_options_t options = { 3U, 100L, 1U };
+	struct timespec ts = { 0, 150000000L };
+	xnd_balance_t balance;
+	xnd_client_stats_t stats;
+	xnd_stub_t *stub;
+	xnd_client_t *x;
+
+	stub = xnd_stub_new(503, "{}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL)
+		return 0;
+
+	/** The stub stands in for Xendit, as a sidecar would. */
+	if (xnd_client_sidecar(x, xnd_stub_url(stub)) != 0 ||
+	    xnd_client_breaker(x, &options) != 0)
+		return 0;
+
+	/** test failures open the breaker, which then fails fast */
+	for (int i = 0; i < 3; ++i)
+		if (xnd_balance(x, NULL, NULL, NULL, &balance) != -1)
+			return 0;
+	if (xnd_client_circuit(x, XND_ENDPOINT_BALANCE) != XND_CIRCUIT_OPEN)
+		return 0;
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != -1 ||
+	    xnd_stub_requests(stub) != 3UL)
+		return 0;
+
+	/** test a probe closes the breaker once the endpoint recovered */
+	xnd_stub_respond(stub, 200, "{\"balance\":5}");
+	nanosleep(&ts, NULL);
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != 0 ||
+	    balance.balance != 5.0)
+		return 0;
+	if (xnd_client_circuit(x, XND_ENDPOINT_BALANCE) != XND_CIRCUIT_CLOSED)
+		return 0;
+
+	if (xnd_client_stats(x, &stats) != 0 || stats.broken_requests != 1UL)
+		return 0;
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_client_concurrency(void)
+{
+	xnd_concurrency_options_t options = { 1U, 1U, 8U, 2.0, 0L, { 0U, 0U },
+	                                      0.0 };
+	xnd_timeouts_t timeouts = { 1000L, 500L, 0L, 0L, 0U };
+	struct timespec ts = { 0, 100000000L };
+	xnd_balance_t balance;
+	xnd_client_stats_t stats;
+	xnd_stub_t *stub;
+	xnd_client_t *x;
+	pthread_t thread;
+
+	stub = xnd_stub_new(200, "{\"balance\":1}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL)
+		return 0;
+
+	if (xnd_client_sidecar(x, xnd_stub_url(stub)) != 0 ||
+	    xnd_client_concurrency(x, &options) != 0 ||
+	    xnd_client_timeouts(x, &timeouts) != 0)
+		return 0;
+
+	/** test a call over the limit is rejected while one is stalled */
+	xnd_stub_stall(stub, 1);
+	if (pthread_create(&thread, NULL, stalled_balance, x) != 0)
+		return 0;
+	nanosleep(&ts, NULL);
+	if (xnd_client_stats(x, &stats) != 0 || stats.in_flight != 1U ||
+	    stats.concurrency_limit != 1U)
+		return 0;
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != -1)
+		return 0;
+	pthread_join(thread, NULL);
+
+	/** test calls go through again, the limit growing back */
+	xnd_stub_stall(stub, 0);
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != 0)
+		return 0;
+	if (xnd_client_stats(x, &stats) != 0 || stats.in_flight != 0U ||
+	    stats.limited_requests != 1UL || stats.concurrency_limit != 2U ||
+	    stats.lanes[XND_PRIORITY_INTERACTIVE].admitted != 2UL ||
+	    stats.lanes[XND_PRIORITY_INTERACTIVE].rejected != 1UL)
+		return 0;
+
+	/** test calls of a bulk client wait in their own lane */
+	if (xnd_client_priority(x, (xnd_priority_t) XND_PRIORITIES) != -1 ||
+	    xnd_client_priority(x, XND_PRIORITY_BULK) != 0 ||
+	    xnd_balance(x, NULL, NULL, NULL, &balance) != 0 ||
+	    xnd_client_stats(x, &stats) != 0 ||
+	    stats.lanes[XND_PRIORITY_BULK].admitted != 1UL ||
+	    stats.lanes[XND_PRIORITY_INTERACTIVE].admitted != 2UL)
+		return 0;
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+static int
+test_xnd_client_shared(void)
+{
+	xnd_concurrency_options_t options = { 8U, 1U, 64U, 4.0, 1000L,
+	                                      { 0U, 0U }, 0.0 };
+	xnd_breaker_options_t breaker = { 5U, 1000L, 1U };
+	xnd_client_stats_t stats;
+	pthread_t threads[8];
+	xnd_stub_t *stub;
+	xnd_client_t *x;
+	void *failed = NULL, *res;
+
+	stub = xnd_stub_new(200, "{\"balance\":1}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL)
+		return 0;
+
+	/** The client is set up first, then shared. */
+	if (xnd_client_sidecar(x, xnd_stub_url(stub)) != 0 ||
+	    xnd_client_concurrency(x, &options) != 0 ||
+	    xnd_client_breaker(x, &breaker) != 0)
+		return 0;
+
+	/** test calls from many threads at once on one client */
+	for (int i = 0; i < 8; ++i)
+		if (pthread_create(&threads[i], NULL, shared_balance, x) != 0)
+			return 0;
+	for (int i = 0; i < 8; ++i) {
+		pthread_join(threads[i], &res);
+		if (res != NULL)
+			failed = res;
+	}
+	if (failed != NULL || xnd_stub_requests(stub) != 8UL * SHARED_CALLS)
+		return 0;
+
+	if (xnd_client_stats(x, &stats) != 0 || stats.in_flight != 0U ||
+	    stats.warm_requests + stats.cold_requests != 8UL * SHARED_CALLS ||
+	    stats.limited_requests != 0UL || stats.broken_requests != 0UL)
+		return 0;
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
+
+/** Blocks freed through the counting allocator. */
+static unsigned long freed = 0UL;
+
+static void
+counting_free(void *ptr)
+{
+	if (ptr != NULL)
+		++freed;
+	free(ptr);
+}
+
+static int
+test_xnd_sdk_cleanup(void)
+{
+	xnd_allocator_t allocator = { malloc, counting_free, realloc, NULL,
+	                              NULL };
+	xnd_balance_t balance;
+	xnd_stub_t *stub;
+	xnd_client_t *x;
+	unsigned long before;
+
+	/** The allocator is only taken before the SDK is set up. */
+	xnd_sdk_cleanup();
+	stub = xnd_stub_new(200, "{\"balance\":3}");
+	if (stub == NULL || xnd_sdk_init_with_allocator(&allocator) != 0)
+		return 0;
+	x = xnd_client_new("secret");
+	if (x == NULL || xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	/** test a live client keeps the SDK up through an extra cleanup, and
+	    is freed by the allocator it was allocated by */
+	xnd_sdk_cleanup();
+	xnd_sdk_cleanup();
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != 0 ||
+	    balance.balance != 3.0)
+		return 0;
+	before = freed;
+	xnd_client_destroy(x);
+	if (freed == before)
+		return 0;
+
+	xnd_stub_destroy(stub);
+	xnd_sdk_init();
+
+	return 1;
+}
+
+static int
+test_xnd_sdk_init(void)
+{
+	xnd_allocator_t allocator = { malloc, free, realloc, NULL, NULL };
+
+	/** test initialization is counted, and the allocator comes first */
+	xnd_sdk_init();
+	if (xnd_sdk_init_with_allocator(&allocator) != -1)
+		return 0;
+	xnd_sdk_cleanup();
+
+	return 1;
+}
+
+static int
+test_xnd_client_fork(void)
+{
+	xnd_balance_t balance;
+	xnd_stub_t *stub;
+	xnd_client_t *x;
+	pid_t pid;
+	int status;
+
+	stub = xnd_stub_new(200, "{\"balance\":7}");
+	x = xnd_client_new("secret");
+	if (stub == NULL || x == NULL ||
+	    xnd_client_sidecar(x, xnd_stub_url(stub)) != 0)
+		return 0;
+
+	/** The parent holds a pooled connection before forking. */
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != 0 ||
+	    xnd_stub_connections(stub) != 1UL)
+		return 0;
+
+	/** test the child calls on a connection of its own */
+	pid = fork();
+	if (pid == -1)
+		return 0;
+	if (pid == 0) {
+		status = xnd_balance(x, NULL, NULL, NULL, &balance) == 0 &&
+		         balance.balance == 7.0;
+		xnd_client_destroy(x);
+		_exit(status ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status) != EXIT_SUCCESS)
+		return 0;
+
+	/** test the connection of the parent was left alone */
+	if (xnd_balance(x, NULL, NULL, NULL, &balance) != 0 ||
+	    xnd_stub_connections(stub) != 2UL ||
+	    xnd_stub_requests(stub) != 3UL)
+		return 0;
+
+	xnd_client_destroy(x);
+	xnd_stub_destroy(stub);
+
+	return 1;
+}
 
 int
 main(void)
 {
+	xnd_sdk_init();
+
+	if (! test_xnd_sdk_init())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_sdk_cleanup())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_client_breaker())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_client_concurrency())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_client_shared())
+		exit(EXIT_FAILURE);
+	if (! test_xnd_client_fork())
+		exit(EXIT_FAILURE);
+
+	xnd_sdk_cleanup();
+
 	exit(EXIT_SUCCESS);
 }
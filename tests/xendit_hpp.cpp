@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <utility>
+
+#include <xendit/xendit.hpp>
+
+static int
+test_xnd_client_move(void)
+{
+	xnd::client a { "secret" }, b { "other" }, c { "" };
+
+	if (a.has_error() || b.has_error() || ! c.has_error() ||
+	    a.get() == nullptr || b.get() == nullptr)
+		return 0;
+
+	/** test the moved-from client holds nothing */
+	xnd::client d { std::move(a) };
+	if (d.get() == nullptr || a.get() != nullptr || a.has_error())
+		return 0;
+
+	/** test move-assigning destroys the client held so far, which leak
+	    checkers would report otherwise */
+	xnd_client_t *held = b.get();
+	d = std::move(b);
+	if (d.get() != held || b.get() != nullptr)
+		return 0;
+
+	/** test errors move along */
+	d = std::move(c);
+	if (! d.has_error() || d.get() != nullptr || c.has_error())
+		return 0;
+
+	return 1;
+}
+
+static int
+test_xnd_balance_columns_move(void)
+{
+	xnd::balance_columns a, b;
+
+	if (a.has_error() || b.has_error() || a.rows() != 0 ||
+	    ! a.amounts().empty())
+		return 0;
+
+	/** test move-assigning destroys the columns held so far */
+	b = std::move(a);
+	if (b.has_error() || ! a.has_error())
+		return 0;
+
+	xnd::balance_columns c { std::move(b) };
+	if (c.has_error() || ! b.has_error() || c.rows() != 0)
+		return 0;
+
+	return 1;
+}
+
+#ifdef XND_HAS_MEMORY_RESOURCE
+static int
+test_xnd_sdk_init_refused(void)
+{
+	std::pmr::memory_resource *held = xnd::detail::resource();
+
+	/** test a resource refused while the SDK runs leaves the one in use */
+	if (xnd::sdk_init(std::pmr::new_delete_resource()) != -1 ||
+	    xnd::detail::resource() != held)
+		return 0;
+
+	return 1;
+}
+#endif
+
+int
+main(void)
+{
+	xnd_sdk_init();
+
+	if (! test_xnd_client_move())
+		std::exit(EXIT_FAILURE);
+	if (! test_xnd_balance_columns_move())
+		std::exit(EXIT_FAILURE);
+#ifdef XND_HAS_MEMORY_RESOURCE
+	if (! test_xnd_sdk_init_refused())
+		std::exit(EXIT_FAILURE);
+#endif
+
+	xnd_sdk_cleanup();
+
+	std::exit(EXIT_SUCCESS);
+}